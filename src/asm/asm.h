@@ -19,6 +19,8 @@
 #ifndef GRATE_ASM_H
 #define GRATE_ASM_H
 
+#include <stdio.h>
+
 #include "fragment_asm.h"
 #include "linker_asm.h"
 #include "vertex_asm.h"
@@ -61,6 +63,8 @@ extern asm_in_out asm_vs_exports[16];
 extern asm_in_out asm_vs_uniforms[256];
 extern int asm_vs_instructions_nb;
 
+extern int vertex_asm_disassemble(FILE *out);
+
 extern struct yy_buffer_state *fragment_asm_scan_string(const char *);
 extern int fragment_asmparse(void);
 extern int fragment_asmlex_destroy(void);
@@ -91,6 +95,24 @@ extern unsigned asm_pseq_to_dw_exec_nb;
 
 extern int asm_discards_fragment;
 
+extern int fragment_asm_alu_op_uses_immediate(
+		const union fragment_alu_instruction *op);
+extern unsigned fragment_asm_alu_ops_nb(const alu_instr *alu);
+
+struct fragment_asm_cost {
+	unsigned execs_nb;
+	unsigned alu_nb;
+	unsigned alu_ops_nb;
+	unsigned mfu_nb;
+	unsigned tex_nb;
+	unsigned regs_nb;
+	unsigned cycles;
+};
+
+extern void fragment_asm_cost(struct fragment_asm_cost *cost);
+
+extern int fragment_asm_disassemble(FILE *out);
+
 extern struct yy_buffer_state *linker_asm_scan_string(const char *);
 extern int linker_asmparse(void);
 extern int linker_asmlex_destroy(void);
@@ -100,4 +122,6 @@ extern link_instr	asm_linker_instructions[32];
 extern unsigned asm_linker_instructions_nb;
 extern unsigned asm_linker_used_tram_rows_nb;
 
+extern int linker_asm_disassemble(FILE *out);
+
 #endif
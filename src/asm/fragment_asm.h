@@ -269,6 +269,10 @@ typedef union fragment_alu_instruction_x4 {
 	};
 } alu_instr;
 
+/* NOP writes 0.0 to r31 */
+#define ALU_NOP_PART0		0x3e41f200
+#define ALU_NOP_PART1		0x000fe7e8
+
 typedef union fragment_pseq_instruction {
 	uint32_t data;
 } pseq_instr;
@@ -81,8 +81,8 @@ static void reset_fragment_asm_parser_state(void)
 	for (i = 0; i < ARRAY_SIZE(asm_alu_instructions); i++) {
 		for (k = 0; k < 4; k++) {
 			// a NOP is an instruction that writes 0.0 to r31
-			asm_alu_instructions[i].a[k].part0 = 0x3e41f200;
-			asm_alu_instructions[i].a[k].part1 = 0x000fe7e8;
+			asm_alu_instructions[i].a[k].part0 = ALU_NOP_PART0;
+			asm_alu_instructions[i].a[k].part1 = ALU_NOP_PART1;
 		}
 	}
 
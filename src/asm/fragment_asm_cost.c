@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) Dmitry Osipenko
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Static cost of the parsed fragment program.
+ *
+ * Every unit of the EXEC works in parallel with the others, ALU issues one
+ * scheduled instruction per clock and MFU one operation per clock. Hence
+ * EXEC takes as many clocks as the longest of its ALU and MFU schedules,
+ * but at least one. This is an estimate of the shader core throughput
+ * only, texture cache misses and memory bandwidth aren't accounted.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "asm.h"
+
+static int alu_op_is_nop(const union fragment_alu_instruction *op)
+{
+	return op->part0 == ALU_NOP_PART0 && op->part1 == ALU_NOP_PART1;
+}
+
+static unsigned row_reg_nb(unsigned index, unsigned regs_nb)
+{
+	if (index <= FRAGMENT_ROW_REG_15 && index + 1 > regs_nb)
+		return index + 1;
+
+	return regs_nb;
+}
+
+void fragment_asm_cost(struct fragment_asm_cost *cost)
+{
+	const union fragment_alu_instruction *op;
+	const alu_instr *alu;
+	unsigned clocks;
+	unsigned i, k, s;
+
+	memset(cost, 0, sizeof(*cost));
+
+	cost->execs_nb = asm_fs_instructions_nb;
+	cost->alu_nb = asm_alu_instructions_nb;
+	cost->mfu_nb = asm_mfu_instructions_nb;
+
+	for (i = 0; i < asm_fs_instructions_nb; i++) {
+		clocks = 1;
+
+		if (asm_alu_sched[i].instructions_nb > clocks)
+			clocks = asm_alu_sched[i].instructions_nb;
+
+		if (asm_mfu_sched[i].instructions_nb > clocks)
+			clocks = asm_mfu_sched[i].instructions_nb;
+
+		cost->cycles += clocks;
+
+		if (asm_tex_instructions[i].enable)
+			cost->tex_nb++;
+
+		/* units other than ALU address group of the batch slot */
+		if (asm_pseq_instructions[i].data ||
+		    asm_mfu_sched[i].instructions_nb ||
+		    asm_tex_instructions[i].data ||
+		    asm_dw_instructions[i].data) {
+			k = (i % asm_alu_buffer_size + 1) * 4;
+
+			if (k > cost->regs_nb)
+				cost->regs_nb = k;
+		}
+
+		for (k = 0; k < asm_alu_sched[i].instructions_nb; k++) {
+			alu = &asm_alu_instructions[asm_alu_sched[i].address + k];
+
+			for (s = 0; s < fragment_asm_alu_ops_nb(alu); s++) {
+				op = &alu->a[s];
+
+				if (alu_op_is_nop(op))
+					continue;
+
+				cost->alu_ops_nb++;
+
+				cost->regs_nb = row_reg_nb(op->dst_reg,
+							   cost->regs_nb);
+				cost->regs_nb = row_reg_nb(op->rA_reg_select,
+							   cost->regs_nb);
+				cost->regs_nb = row_reg_nb(op->rB_reg_select,
+							   cost->regs_nb);
+				cost->regs_nb = row_reg_nb(op->rC_reg_select,
+							   cost->regs_nb);
+			}
+		}
+	}
+}
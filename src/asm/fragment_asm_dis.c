@@ -0,0 +1,570 @@
+/*
+ * Copyright (c) Dmitry Osipenko
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Disassembler of the fragment program held by the asm_* globals. The
+ * output is accepted by the fragment assembler and produces the same
+ * binary, an encoding that has no textual form in the assembler syntax
+ * is printed as raw hex.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "asm.h"
+
+#define ARRAY_SIZE(a)		(sizeof(a) / sizeof((a)[0]))
+
+struct alu_src {
+	unsigned reg;
+	unsigned fixed10;
+	unsigned high;
+	unsigned negate;
+	unsigned absolute;
+	unsigned minus_one;
+	unsigned scale_x2;
+};
+
+static const char * const mfu_opcodes[] = {
+	[MFU_NOP]	= "NOP",
+	[MFU_RCP]	= "rcp",
+	[MFU_RSQ]	= "rsq",
+	[MFU_LG2]	= "lg2",
+	[MFU_EX2]	= "ex2",
+	[MFU_SQRT]	= "sqrt",
+	[MFU_SIN]	= "sin",
+	[MFU_COS]	= "cos",
+	[MFU_FRC]	= "frc",
+	[MFU_PREEX2]	= "preex2",
+	[MFU_PRESIN]	= "presin",
+	[MFU_PRECOS]	= "precos",
+};
+
+static const char * const alu_cc[] = {
+	[ALU_CC_ZERO]			= "eq",
+	[ALU_CC_GREATER_THAN_ZERO]	= "gt",
+	[ALU_CC_ZERO_OR_GREATER]	= "ge",
+};
+
+static const char * const alu_scale[] = {
+	[ALU_SCALE_X2]			= "x2",
+	[ALU_SCALE_X4]			= "x4",
+	[ALU_SCALE_DIV2]		= "/2",
+};
+
+static float fp20_to_float(uint32_t v)
+{
+	union {
+		uint32_t u;
+		float f;
+	} value;
+	uint32_t exponent = (v >> 13) & 0x3f;
+
+	if (!v)
+		return 0.0f;
+
+	if (exponent == 0x3f)
+		exponent = 0xff;
+	else
+		exponent = exponent - 31 + 127;
+
+	value.u = ((v >> 19) & 0x1) << 31 | exponent << 23 | (v & 0x1fff) << 10;
+
+	return value.f;
+}
+
+static int alu_src_name(char *buf, size_t size, const struct alu_src *src)
+{
+	const char *type = "";
+	unsigned reg = src->reg;
+
+	if (src->fixed10)
+		type = src->high ? ".h" : ".l";
+	else if (src->high)
+		return 0;
+
+	if (reg <= FRAGMENT_ROW_REG_15) {
+		snprintf(buf, size, "r%u%s", reg, type);
+	} else if (reg <= FRAGMENT_GENERAL_PURPOSE_REG_7) {
+		snprintf(buf, size, "g%u%s",
+			 reg - FRAGMENT_GENERAL_PURPOSE_REG_0, type);
+	} else if (reg <= FRAGMENT_ALU_RESULT_REG_3) {
+		snprintf(buf, size, "alu%u%s",
+			 reg - FRAGMENT_ALU_RESULT_REG_0, type);
+	} else if (reg <= FRAGMENT_EMBEDDED_CONSTANT_2) {
+		snprintf(buf, size, "imm%u%s",
+			 reg - FRAGMENT_EMBEDDED_CONSTANT_0, type);
+	} else if (reg == FRAGMENT_LOWP_VEC2_0_1) {
+		if (!src->fixed10)
+			return 0;
+
+		snprintf(buf, size, "#%u", src->high);
+	} else if (reg <= FRAGMENT_UNIFORM_REG_31) {
+		snprintf(buf, size, "u%u%s", reg - FRAGMENT_UNIFORM_REG_0, type);
+	} else if (reg <= FRAGMENT_CONDITION_REG_7) {
+		if (!src->fixed10)
+			return 0;
+
+		snprintf(buf, size, "cr%u",
+			 (reg - FRAGMENT_CONDITION_REG_0) * 2 + src->high);
+	} else if (reg == FRAGMENT_POS_X || reg == FRAGMENT_POS_Y ||
+		   reg == FRAGMENT_POLYGON_FACE) {
+		if (src->fixed10)
+			return 0;
+
+		snprintf(buf, size, "%s", reg == FRAGMENT_POS_X ? "posx" :
+					  reg == FRAGMENT_POS_Y ? "posy" :
+								  "pface");
+	} else {
+		return 0;
+	}
+
+	return 1;
+}
+
+static int alu_src(char *buf, size_t size, const struct alu_src *src)
+{
+	char name[16];
+
+	if (!alu_src_name(name, sizeof(name), src))
+		return 0;
+
+	snprintf(buf, size, "%s%s%s%s%s%s",
+		 src->negate ? "-" : "",
+		 src->absolute ? "abs(" : "", name,
+		 src->absolute ? ")" : "",
+		 src->scale_x2 ? "*2" : "",
+		 src->minus_one ? "-1" : "");
+
+	return 1;
+}
+
+static int alu_dst(char *buf, size_t size,
+		   const union fragment_alu_instruction *op)
+{
+	unsigned low = op->write_low_sub_reg;
+	unsigned high = op->write_high_sub_reg;
+	unsigned reg = op->dst_reg;
+	char mask[3] = "*";
+
+	if (low || high)
+		snprintf(mask, sizeof(mask), "%s%s", low ? "l" : "",
+			 high ? "h" : "");
+
+	if (reg == FRAGMENT_LOWP_VEC2_0_1 && !low && !high)
+		snprintf(buf, size, "lp");
+	else if (reg == FRAGMENT_KILL_REG && low && high)
+		snprintf(buf, size, "kill");
+	else if (reg >= FRAGMENT_CONDITION_REG_0 &&
+		 reg <= FRAGMENT_CONDITION_REG_7 && low == high)
+		snprintf(buf, size, "cr%u",
+			 (reg - FRAGMENT_CONDITION_REG_0) * 2 + low);
+	else if (reg <= FRAGMENT_ROW_REG_15)
+		snprintf(buf, size, "r%u.%s", reg, mask);
+	else if (reg <= FRAGMENT_GENERAL_PURPOSE_REG_7)
+		snprintf(buf, size, "g%u.%s",
+			 reg - FRAGMENT_GENERAL_PURPOSE_REG_0, mask);
+	else if (reg == FRAGMENT_LOWP_VEC2_0_1)
+		snprintf(buf, size, "lp.%s", mask);
+	else if (reg >= FRAGMENT_UNIFORM_REG(0) && reg <= FRAGMENT_UNIFORM_REG(7))
+		snprintf(buf, size, "u%u.%s", reg - FRAGMENT_UNIFORM_REG_0, mask);
+	else
+		return 0;
+
+	return 1;
+}
+
+/* optional 4th operand, parser leaves it disabled if omitted */
+static int alu_src_d(char *buf, size_t size,
+		     const union fragment_alu_instruction *op)
+{
+	const char *type = "";
+
+	buf[0] = '\0';
+
+	if (!op->rD_enable) {
+		if (!op->rD_absolute_value && !op->rD_minus_one &&
+		    !op->rD_fixed10 && !op->rD_sub_reg_select_high &&
+		    !op->rD_reg_select)
+			return 1;
+
+		if (!op->rD_absolute_value && !op->rD_minus_one &&
+		    op->rD_fixed10 && op->rD_sub_reg_select_high &&
+		    op->rD_reg_select) {
+			snprintf(buf, size, ", #1");
+			return 1;
+		}
+
+		return 0;
+	}
+
+	if (op->rD_fixed10)
+		type = op->rD_sub_reg_select_high ? ".h" : ".l";
+	else if (op->rD_sub_reg_select_high)
+		return 0;
+
+	snprintf(buf, size, ", %s%s%s%s%s",
+		 op->rD_absolute_value ? "abs(" : "",
+		 op->rD_reg_select ? "rC" : "rB", type,
+		 op->rD_absolute_value ? ")" : "",
+		 op->rD_minus_one ? "-1" : "");
+
+	return 1;
+}
+
+static int alu_op(char *buf, size_t size,
+		  const union fragment_alu_instruction *op)
+{
+	static const char * const opcodes[] = {
+		[ALU_OPCODE_MAD]	= "MAD ",
+		[ALU_OPCODE_MIN]	= "MIN ",
+		[ALU_OPCODE_MAX]	= "MAX ",
+		[ALU_OPCODE_CSEL]	= "CSEL",
+	};
+	struct alu_src a = {
+		op->rA_reg_select, op->rA_fixed10, op->rA_sub_reg_select_high,
+		op->rA_negate, op->rA_absolute_value, op->rA_minus_one,
+		op->rA_scale_by_two,
+	};
+	struct alu_src b = {
+		op->rB_reg_select, op->rB_fixed10, op->rB_sub_reg_select_high,
+		op->rB_negate, op->rB_absolute_value, op->rB_minus_one,
+		op->rB_scale_by_two,
+	};
+	struct alu_src c = {
+		op->rC_reg_select, op->rC_fixed10, op->rC_sub_reg_select_high,
+		op->rC_negate, op->rC_absolute_value, op->rC_minus_one,
+		op->rC_scale_by_two,
+	};
+	char dst[16], ra[32], rb[32], rc[32], rd[32];
+	const char *opcode = opcodes[op->opcode];
+	int len;
+
+	if (op->addition_disable) {
+		if (op->opcode != ALU_OPCODE_MAD)
+			return 0;
+
+		opcode = "MUL ";
+	}
+
+	if (!alu_dst(dst, sizeof(dst), op) ||
+	    !alu_src(ra, sizeof(ra), &a) ||
+	    !alu_src(rb, sizeof(rb), &b) ||
+	    !alu_src(rc, sizeof(rc), &c) ||
+	    !alu_src_d(rd, sizeof(rd), op))
+		return 0;
+
+	len = snprintf(buf, size, "%s  %s, %s, %s, %s%s",
+		       opcode, dst, ra, rb, rc, rd);
+
+	if (op->accumulate_result_this)
+		len += snprintf(buf + len, size - len, " (this)");
+
+	if (op->accumulate_result_other)
+		len += snprintf(buf + len, size - len, " (other)");
+
+	if (op->condition_code)
+		len += snprintf(buf + len, size - len, " (%s)",
+				alu_cc[op->condition_code]);
+
+	if (op->scale_result)
+		len += snprintf(buf + len, size - len, " (%s)",
+				alu_scale[op->scale_result]);
+
+	if (op->saturate_result)
+		snprintf(buf + len, size - len, " (sat)");
+
+	return 1;
+}
+
+static void disassemble_alu(FILE *out, const alu_instr *alu)
+{
+	unsigned ops_nb = 4;
+	char buf[256];
+	unsigned i;
+
+	fprintf(out, "\tALU:\n");
+
+	for (i = 0; i < 4; i++) {
+		if (fragment_asm_alu_op_uses_immediate(&alu->a[i]))
+			ops_nb = 3;
+	}
+
+	for (i = 0; i < ops_nb; i++) {
+		if (alu->a[i].part0 == ALU_NOP_PART0 &&
+		    alu->a[i].part1 == ALU_NOP_PART1)
+			continue;
+
+		if (alu_op(buf, sizeof(buf), &alu->a[i]))
+			fprintf(out, "\t\tALU%u:\t%s\n", i, buf);
+		else
+			fprintf(out, "\t\tALU%u:\t0x%08X, 0x%08X\n", i,
+				alu->a[i].part1, alu->a[i].part0);
+	}
+
+	/* ALU3 holds immediates */
+	if (ops_nb == 3)
+		fprintf(out, "\t\tALU3:\t0x%08X, 0x%08X\t"
+			"// imm0 = %f, imm1 = %f, imm2 = %f\n",
+			alu->a[3].part1, alu->a[3].part0,
+			fp20_to_float(alu->imm0.fp20),
+			fp20_to_float(alu->imm1.fp20),
+			fp20_to_float(alu->imm2.fp20));
+}
+
+static int mfu_var(char *buf, size_t size, unsigned saturate,
+		   unsigned opcode, unsigned source)
+{
+	char var[16];
+
+	switch (opcode) {
+	case MFU_VAR_NOP:
+		if (source)
+			return 0;
+
+		snprintf(var, sizeof(var), "NOP");
+		break;
+	case MFU_VAR_FP20:
+		snprintf(var, sizeof(var), "t%u.fp20", source);
+		break;
+	case MFU_VAR_FX10:
+		snprintf(var, sizeof(var), "t%u.fx10", source);
+		break;
+	default:
+		return 0;
+	}
+
+	if (saturate)
+		snprintf(buf, size, "sat(%s)", var);
+	else
+		snprintf(buf, size, "%s", var);
+
+	return 1;
+}
+
+static void mfu_mul_dst(char *buf, size_t size, unsigned dst)
+{
+	if (dst == MFU_MUL_DST_BARYCENTRIC_WEIGHT)
+		snprintf(buf, size, "bar");
+	else if (dst >= MFU_MUL_DST_ROW_REG_0)
+		snprintf(buf, size, "r%u", dst - MFU_MUL_DST_ROW_REG_0);
+	else
+		snprintf(buf, size, "dst%u", dst);
+}
+
+static void mfu_mul_src(char *buf, size_t size, unsigned src)
+{
+	switch (src) {
+	case MFU_MUL_SRC_ROW_REG_0:
+	case MFU_MUL_SRC_ROW_REG_1:
+	case MFU_MUL_SRC_ROW_REG_2:
+	case MFU_MUL_SRC_ROW_REG_3:
+		snprintf(buf, size, "r%u", src - MFU_MUL_SRC_ROW_REG_0);
+		break;
+	case MFU_MUL_SRC_SFU_RESULT:
+		snprintf(buf, size, "sfu");
+		break;
+	case MFU_MUL_SRC_BARYCENTRIC_COEF_0:
+		snprintf(buf, size, "bar0");
+		break;
+	case MFU_MUL_SRC_BARYCENTRIC_COEF_1:
+		snprintf(buf, size, "bar1");
+		break;
+	case MFU_MUL_SRC_CONST_1:
+		snprintf(buf, size, "#1");
+		break;
+	default:
+		snprintf(buf, size, "src%u", src);
+		break;
+	}
+}
+
+static void disassemble_mfu(FILE *out, const mfu_instr *mfu)
+{
+	char v[4][16], dst[8], src0[8], src1[8];
+	const char *sep = "";
+
+	if (!mfu->part0 && !mfu->part1) {
+		fprintf(out, "\tMFU:\tNOP\n");
+		return;
+	}
+
+	if (mfu->__pad || mfu->opcode >= ARRAY_SIZE(mfu_opcodes) ||
+	    !mfu_var(v[0], sizeof(v[0]), mfu->var0_saturate,
+		     mfu->var0_opcode, mfu->var0_source) ||
+	    !mfu_var(v[1], sizeof(v[1]), mfu->var1_saturate,
+		     mfu->var1_opcode, mfu->var1_source) ||
+	    !mfu_var(v[2], sizeof(v[2]), mfu->var2_saturate,
+		     mfu->var2_opcode, mfu->var2_source) ||
+	    !mfu_var(v[3], sizeof(v[3]), mfu->var3_saturate,
+		     mfu->var3_opcode, mfu->var3_source)) {
+		fprintf(out, "\tMFU:\t0x%08X, 0x%08X\n", mfu->part1, mfu->part0);
+		return;
+	}
+
+	fprintf(out, "\tMFU:");
+
+	if (mfu->opcode || mfu->reg) {
+		fprintf(out, "\tsfu:  %s r%u\n", mfu_opcodes[mfu->opcode],
+			mfu->reg);
+		sep = "\t";
+	}
+
+	if (mfu->mul0_dst || mfu->mul0_src0 || mfu->mul0_src1) {
+		mfu_mul_dst(dst, sizeof(dst), mfu->mul0_dst);
+		mfu_mul_src(src0, sizeof(src0), mfu->mul0_src0);
+		mfu_mul_src(src1, sizeof(src1), mfu->mul0_src1);
+		fprintf(out, "%s\tmul0: %s, %s, %s\n", sep, dst, src0, src1);
+		sep = "\t";
+	}
+
+	if (mfu->mul1_dst || mfu->mul1_src0 || mfu->mul1_src1) {
+		mfu_mul_dst(dst, sizeof(dst), mfu->mul1_dst);
+		mfu_mul_src(src0, sizeof(src0), mfu->mul1_src0);
+		mfu_mul_src(src1, sizeof(src1), mfu->mul1_src1);
+		fprintf(out, "%s\tmul1: %s, %s, %s\n", sep, dst, src0, src1);
+		sep = "\t";
+	}
+
+	if (mfu->part0 & 0x0fffffff)
+		fprintf(out, "%s\tipl:  %s, %s, %s, %s\n", sep,
+			v[0], v[1], v[2], v[3]);
+}
+
+static void disassemble_tex(FILE *out, const tex_instr *tex)
+{
+	static const char * const src_bias[] = {
+		[TEX_SRC_R0_R1_R2_R3] = "r0, r1, r2, r3",
+		[TEX_SRC_R2_R3_R0_R1] = "r2, r3, r0, r1",
+	};
+	static const char * const src[] = {
+		[TEX_SRC_R0_R1_R2_R3] = "r0, r1, r2",
+		[TEX_SRC_R2_R3_R0_R1] = "r2, r3, r0",
+	};
+	tex_instr sym = *tex;
+
+	sym.sampler_index = 0;
+	sym.src_regs_select = 0;
+	sym.sample_dst_regs_select = 0;
+	sym.enable_bias = 0;
+
+	if (!tex->enable || sym.data != 1 << 10) {
+		fprintf(out, "\tTEX:\t0x%08X\n", tex->data);
+		return;
+	}
+
+	fprintf(out, "\tTEX:\t%s %s, tex%u, %s\n",
+		tex->enable_bias ? "txb" : "tex",
+		tex->sample_dst_regs_select ? "r2, r3" : "r0, r1",
+		tex->sampler_index,
+		tex->enable_bias ? src_bias[tex->src_regs_select] :
+				   src[tex->src_regs_select]);
+}
+
+static void disassemble_dw(FILE *out, const dw_instr *dw)
+{
+	dw_instr sym = *dw;
+
+	sym.render_target_index = 0;
+	sym.src_regs_select = 0;
+
+	if (sym.data == (2 << 16 | 1)) {
+		fprintf(out, "\tDW:\tstore rt%u, %s\n", dw->render_target_index,
+			dw->src_regs_select ? "r2, r3" : "r0, r1");
+		return;
+	}
+
+	if (dw->data == (2 << 16 | 2 << 2 | 1 << 10 | 1)) {
+		fprintf(out, "\tDW:\tstore stencil\n");
+		return;
+	}
+
+	fprintf(out, "\tDW:\t0x%08X\n", dw->data);
+}
+
+static void disassemble_exec(FILE *out, unsigned i)
+{
+	unsigned k;
+
+	fprintf(out, "EXEC\n");
+
+	if (asm_pseq_instructions[i].data)
+		fprintf(out, "\tPSEQ:\t0x%08X\n", asm_pseq_instructions[i].data);
+
+	for (k = 0; k < asm_mfu_sched[i].instructions_nb; k++)
+		disassemble_mfu(out, &asm_mfu_instructions[
+					asm_mfu_sched[i].address + k]);
+
+	if (asm_tex_instructions[i].data)
+		disassemble_tex(out, &asm_tex_instructions[i]);
+
+	for (k = 0; k < asm_alu_sched[i].instructions_nb; k++)
+		disassemble_alu(out, &asm_alu_instructions[
+					asm_alu_sched[i].address + k]);
+
+	if (asm_alu_instructions[i].complement)
+		fprintf(out, "\tALU_COMPLEMENT:\t0x%08X\n",
+			asm_alu_instructions[i].complement);
+
+	if (asm_dw_instructions[i].data)
+		disassemble_dw(out, &asm_dw_instructions[i]);
+
+	fprintf(out, ";\n\n");
+}
+
+int fragment_asm_disassemble(FILE *out)
+{
+	unsigned i;
+
+	fprintf(out, "pseq_to_dw_exec_nb = %u\n", asm_pseq_to_dw_exec_nb);
+	fprintf(out, "alu_buffer_size = %u\n\n", asm_alu_buffer_size);
+
+	fprintf(out, ".uniforms\n");
+
+	for (i = 0; i < ARRAY_SIZE(asm_fs_uniforms); i++) {
+		switch (asm_fs_uniforms[i].type) {
+		case FS_UNIFORM_FP20:
+			if (!(i & 1))
+				fprintf(out, "\t[%u] = \"%s\";\n", i >> 1,
+					asm_fs_uniforms[i].name);
+			break;
+		case FS_UNIFORM_FX10_LOW:
+		case FS_UNIFORM_FX10_HIGH:
+			fprintf(out, "\t[%u].%c = \"%s\";\n", i >> 1,
+				(i & 1) ? 'h' : 'l', asm_fs_uniforms[i].name);
+			break;
+		default:
+			break;
+		}
+	}
+
+	fprintf(out, "\n.constants\n");
+
+	for (i = 0; i < ARRAY_SIZE(asm_fs_constants); i++) {
+		if (asm_fs_constants[i])
+			fprintf(out, "\t[%u] = 0x%08X;\n", i,
+				asm_fs_constants[i]);
+	}
+
+	fprintf(out, "\n.asm\n\n");
+
+	for (i = 0; i < asm_fs_instructions_nb; i++)
+		disassemble_exec(out, i);
+
+	return 1;
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) Dmitry Osipenko
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Disassembler of the shader linking program held by the asm_linker_*
+ * globals, the output is accepted by the linker assembler. The across_point
+ * fields have no textual form.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "asm.h"
+
+static const char *link_types[] = {
+	[TRAM_DST_NONE]		= "NOP",
+	[TRAM_DST_FX10_LOW]	= "fx10.l",
+	[TRAM_DST_FX10_HIGH]	= "fx10.h",
+	[TRAM_DST_FP20]		= "fp20",
+};
+
+static const char components[] = "xyzw";
+
+static void disassemble_column(FILE *out, unsigned type, unsigned width,
+			       unsigned length, unsigned disable)
+{
+	fprintf(out, "%s", link_types[type]);
+
+	if (width)
+		fprintf(out, "(cw)");
+
+	if (length)
+		fprintf(out, "(cl)");
+
+	if (disable)
+		fprintf(out, "(dis)");
+
+	fprintf(out, ", ");
+}
+
+int linker_asm_disassemble(FILE *out)
+{
+	const link_instr *instr;
+	unsigned i;
+
+	for (i = 0; i < asm_linker_instructions_nb; i++) {
+		instr = &asm_linker_instructions[i];
+
+		if (instr->x_across_point || instr->y_across_point ||
+		    instr->z_across_point || instr->w_across_point ||
+		    instr->__pad1 || instr->__pad2 || instr->__pad3) {
+			fprintf(stderr,
+				"linker: instruction %u has no textual form\n",
+				i);
+			return 0;
+		}
+
+		fprintf(out, "LINK ");
+
+		disassemble_column(out, instr->tram_dst_type_x,
+				   instr->const_x_across_width,
+				   instr->const_x_across_length,
+				   instr->interpolation_disable_x);
+		disassemble_column(out, instr->tram_dst_type_y,
+				   instr->const_y_across_width,
+				   instr->const_y_across_length,
+				   instr->interpolation_disable_y);
+		disassemble_column(out, instr->tram_dst_type_z,
+				   instr->const_z_across_width,
+				   instr->const_z_across_length,
+				   instr->interpolation_disable_z);
+		disassemble_column(out, instr->tram_dst_type_w,
+				   instr->const_w_across_width,
+				   instr->const_w_across_length,
+				   instr->interpolation_disable_w);
+
+		fprintf(out, "tram%u.%c%c%c%c, export%u%s\n",
+			instr->tram_row_index,
+			components[instr->tram_dst_swizzle_x],
+			components[instr->tram_dst_swizzle_y],
+			components[instr->tram_dst_swizzle_z],
+			components[instr->tram_dst_swizzle_w],
+			instr->vertex_export_index,
+			instr->vec4_select ? "(z)" : "");
+	}
+
+	return 1;
+}
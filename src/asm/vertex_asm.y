@@ -901,7 +901,7 @@ REGISTER_SRC_C: REGISTER_SRC
 	;
 
 REGISTER_SRC:
-	REGISTER_SRC_SWIZZLED
+	REGISTER_SRC_MODIFIED
 	{
 		if ((instr.constant_relative_addressing_enable ||
 			instr.attribute_relative_addressing_enable ||
@@ -924,7 +924,12 @@ REGISTER_SRC:
 		{
 			instr.address_register_select = pst.address_register_select;
 		}
+	}
+	;
 
+REGISTER_SRC_MODIFIED:
+	REGISTER_SRC_SWIZZLED
+	{
 		pst.negate = 0;
 		pst.absolute = 0;
 	}
@@ -932,17 +937,19 @@ REGISTER_SRC:
 	T_NEG REGISTER_SRC_SWIZZLED
 	{
 		pst.negate = 1;
+		pst.absolute = 0;
 	}
 	|
 	T_ABS '(' REGISTER_SRC_SWIZZLED ')'
 	{
+		pst.negate = 0;
 		pst.absolute = 1;
 	}
 	|
 	T_NEG T_ABS '(' REGISTER_SRC_SWIZZLED ')'
 	{
-		pst.absolute = 1;
 		pst.negate = 1;
+		pst.absolute = 1;
 	}
 	;
 
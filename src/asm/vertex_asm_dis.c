@@ -0,0 +1,391 @@
+/*
+ * Copyright (c) Dmitry Osipenko
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Disassembler of the vertex program held by the asm_vs_* globals, the
+ * output is accepted by the vertex assembler. Vertex assembler has no raw
+ * hex form, fields that the syntax doesn't cover are lost and the
+ * round-trip check of gen_shader_bin catches that.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "asm.h"
+
+#define ARRAY_SIZE(a)		(sizeof(a) / sizeof((a)[0]))
+
+enum vpe_operands {
+	VPE_DST		= 1 << 0,
+	VPE_ADDR_DST	= 1 << 1,
+	VPE_SRC_A	= 1 << 2,
+	VPE_SRC_B	= 1 << 3,
+	VPE_SRC_C	= 1 << 4,
+	VPE_IADDR	= 1 << 5,
+};
+
+struct vpe_opcode {
+	const char *name;
+	unsigned operands;
+};
+
+static const struct vpe_opcode vector_opcodes[] = {
+	[VECTOR_OPCODE_NOP]	= { "NOPv",	0 },
+	[VECTOR_OPCODE_MOV]	= { "MOVv",	VPE_DST | VPE_SRC_A },
+	[VECTOR_OPCODE_MUL]	= { "MULv",	VPE_DST | VPE_SRC_A | VPE_SRC_B },
+	[VECTOR_OPCODE_ADD]	= { "ADDv",	VPE_DST | VPE_SRC_A | VPE_SRC_C },
+	[VECTOR_OPCODE_MAD]	= { "MADv",	VPE_DST | VPE_SRC_A | VPE_SRC_B |
+						VPE_SRC_C },
+	[VECTOR_OPCODE_DP3]	= { "DP3v",	VPE_DST | VPE_SRC_A | VPE_SRC_B },
+	[VECTOR_OPCODE_DPH]	= { "DPHv",	VPE_DST | VPE_SRC_A | VPE_SRC_B },
+	[VECTOR_OPCODE_DP4]	= { "DP4v",	VPE_DST | VPE_SRC_A | VPE_SRC_B },
+	[VECTOR_OPCODE_DST]	= { "DSTv",	VPE_DST | VPE_SRC_A | VPE_SRC_B },
+	[VECTOR_OPCODE_MIN]	= { "MINv",	VPE_DST | VPE_SRC_A | VPE_SRC_B },
+	[VECTOR_OPCODE_MAX]	= { "MAXv",	VPE_DST | VPE_SRC_A | VPE_SRC_B },
+	[VECTOR_OPCODE_SLT]	= { "SLTv",	VPE_DST | VPE_SRC_A | VPE_SRC_B },
+	[VECTOR_OPCODE_SGE]	= { "SGEv",	VPE_DST | VPE_SRC_A | VPE_SRC_B },
+	[VECTOR_OPCODE_ARL]	= { "ARLv",	VPE_ADDR_DST | VPE_SRC_A },
+	[VECTOR_OPCODE_FRC]	= { "FRCv",	VPE_DST | VPE_SRC_A },
+	[VECTOR_OPCODE_FLR]	= { "FLRv",	VPE_DST | VPE_SRC_A },
+	[VECTOR_OPCODE_SEQ]	= { "SEQv",	VPE_DST | VPE_SRC_A | VPE_SRC_B },
+	[VECTOR_OPCODE_SFL]	= { "SFLv",	VPE_DST },
+	[VECTOR_OPCODE_SGT]	= { "SGTv",	VPE_DST | VPE_SRC_A | VPE_SRC_B },
+	[VECTOR_OPCODE_SLE]	= { "SLEv",	VPE_DST | VPE_SRC_A | VPE_SRC_B },
+	[VECTOR_OPCODE_SNE]	= { "SNEv",	VPE_DST | VPE_SRC_A | VPE_SRC_B },
+	[VECTOR_OPCODE_STR]	= { "STRv",	VPE_DST },
+	[VECTOR_OPCODE_SSG]	= { "SSGv",	VPE_DST },
+	[VECTOR_OPCODE_ARR]	= { "ARRv",	VPE_ADDR_DST | VPE_SRC_A },
+	[VECTOR_OPCODE_ARA]	= { "ARAv",	VPE_ADDR_DST },
+	[VECTOR_OPCODE_TXL]	= { "TXLv",	VPE_DST },
+	[VECTOR_OPCODE_PUSHA]	= { "PUSHAv",	0 },
+	[VECTOR_OPCODE_POPA]	= { "POPAv",	0 },
+};
+
+static const struct vpe_opcode scalar_opcodes[] = {
+	[SCALAR_OPCODE_NOP]	= { "NOPs",	0 },
+	[SCALAR_OPCODE_MOV]	= { "MOVs",	VPE_DST | VPE_SRC_C },
+	[SCALAR_OPCODE_RCP]	= { "RCPs",	VPE_DST | VPE_SRC_C },
+	[SCALAR_OPCODE_RCC]	= { "RCCs",	VPE_DST | VPE_SRC_C },
+	[SCALAR_OPCODE_RSQ]	= { "RSQs",	VPE_DST | VPE_SRC_C },
+	[SCALAR_OPCODE_EXP]	= { "EXPs",	VPE_DST | VPE_SRC_C },
+	[SCALAR_OPCODE_LOG]	= { "LOGs",	VPE_DST | VPE_SRC_C },
+	[SCALAR_OPCODE_LIT]	= { "LITs",	VPE_DST | VPE_SRC_C },
+	[SCALAR_OPCODE_BRA]	= { "BRAs",	VPE_IADDR },
+	[SCALAR_OPCODE_CAL]	= { "CALs",	VPE_IADDR },
+	[SCALAR_OPCODE_RET]	= { "RETs",	0 },
+	[SCALAR_OPCODE_LG2]	= { "LG2s",	VPE_DST | VPE_SRC_C },
+	[SCALAR_OPCODE_EX2]	= { "EX2s",	VPE_DST | VPE_SRC_C },
+	[SCALAR_OPCODE_SIN]	= { "SINs",	VPE_DST | VPE_SRC_C },
+	[SCALAR_OPCODE_COS]	= { "COSs",	VPE_DST | VPE_SRC_C },
+	[SCALAR_OPCODE_PUSHA]	= { "PUSHAs",	0 },
+	[SCALAR_OPCODE_POPA]	= { "POPAs",	0 },
+};
+
+static const char components[] = "xyzw";
+
+static void address(char *buf, size_t size, unsigned select, unsigned offset)
+{
+	if (offset)
+		snprintf(buf, size, "a0.%c + %u", components[select], offset);
+	else
+		snprintf(buf, size, "a0.%c", components[select]);
+}
+
+static int vpe_src(char *buf, size_t size, const vpe_instr128 *instr,
+		   unsigned type, unsigned index, unsigned negate,
+		   unsigned absolute, unsigned sx, unsigned sy, unsigned sz,
+		   unsigned sw)
+{
+	char reg[32], addr[16];
+	int len = 0;
+
+	switch (type) {
+	case REG_TYPE_TEMPORARY:
+		snprintf(reg, sizeof(reg), "r%u", index);
+		break;
+	case REG_TYPE_UNIFORM:
+		if (instr->constant_relative_addressing_enable) {
+			address(addr, sizeof(addr),
+				instr->address_register_select,
+				instr->uniform_fetch_index);
+			snprintf(reg, sizeof(reg), "c[%s]", addr);
+		} else {
+			snprintf(reg, sizeof(reg), "c[%u]",
+				 instr->uniform_fetch_index);
+		}
+		break;
+	case REG_TYPE_ATTRIBUTE:
+		if (instr->attribute_relative_addressing_enable) {
+			address(addr, sizeof(addr),
+				instr->address_register_select,
+				instr->attribute_fetch_index);
+			snprintf(reg, sizeof(reg), "a[%s]", addr);
+		} else {
+			snprintf(reg, sizeof(reg), "a[%u]",
+				 instr->attribute_fetch_index);
+		}
+		break;
+	default:
+		if (index)
+			return 0;
+
+		snprintf(reg, sizeof(reg), "u");
+		break;
+	}
+
+	if (negate)
+		len += snprintf(buf + len, size - len, "-");
+
+	snprintf(buf + len, size - len, "%s%s.%c%c%c%c%s",
+		 absolute ? "abs(" : "", reg,
+		 components[sx], components[sy], components[sz], components[sw],
+		 absolute ? ")" : "");
+
+	return 1;
+}
+
+static int vpe_op(char *buf, size_t size, const vpe_instr128 *instr,
+		  const struct vpe_opcode *op, unsigned rD,
+		  unsigned wr_x, unsigned wr_y, unsigned wr_z, unsigned wr_w)
+{
+	const char *sep = " ";
+	char src[64];
+	int len;
+
+	len = snprintf(buf, size, "%s", op->name);
+
+	if (op->operands & VPE_IADDR)
+		return snprintf(buf + len, size - len, " %u", instr->iaddr) > 0;
+
+	if (op->operands & (VPE_DST | VPE_ADDR_DST)) {
+		if (op->operands & VPE_ADDR_DST)
+			len += snprintf(buf + len, size - len, " a0.");
+		else
+			len += snprintf(buf + len, size - len, " r%u.", rD);
+
+		len += snprintf(buf + len, size - len, "%c%c%c%c",
+				wr_x ? 'x' : '*', wr_y ? 'y' : '*',
+				wr_z ? 'z' : '*', wr_w ? 'w' : '*');
+		sep = ", ";
+	}
+
+	if (op->operands & VPE_SRC_A) {
+		if (!vpe_src(src, sizeof(src), instr, instr->rA_type,
+			     instr->rA_index, instr->rA_negate,
+			     instr->rA_absolute_value, instr->rA_swizzle_x,
+			     instr->rA_swizzle_y, instr->rA_swizzle_z,
+			     instr->rA_swizzle_w))
+			return 0;
+
+		len += snprintf(buf + len, size - len, "%s%s", sep, src);
+		sep = ", ";
+	}
+
+	if (op->operands & VPE_SRC_B) {
+		if (!vpe_src(src, sizeof(src), instr, instr->rB_type,
+			     instr->rB_index, instr->rB_negate,
+			     instr->rB_absolute_value, instr->rB_swizzle_x,
+			     instr->rB_swizzle_y, instr->rB_swizzle_z,
+			     instr->rB_swizzle_w))
+			return 0;
+
+		len += snprintf(buf + len, size - len, "%s%s", sep, src);
+		sep = ", ";
+	}
+
+	if (op->operands & VPE_SRC_C) {
+		if (!vpe_src(src, sizeof(src), instr, instr->rC_type,
+			     instr->rC_index, instr->rC_negate,
+			     instr->rC_absolute_value, instr->rC_swizzle_x,
+			     instr->rC_swizzle_y, instr->rC_swizzle_z,
+			     instr->rC_swizzle_w))
+			return 0;
+
+		snprintf(buf + len, size - len, "%s%s", sep, src);
+	}
+
+	return 1;
+}
+
+static void disassemble_options(FILE *out, const vpe_instr128 *instr)
+{
+	char addr[16];
+
+	if (instr->export_relative_addressing_enable) {
+		address(addr, sizeof(addr), instr->address_register_select,
+			instr->export_write_index);
+		fprintf(out, "(export[%s]=%s)", addr,
+			instr->export_vector_write_enable ? "vector" : "scalar");
+	} else if (instr->export_write_index != 31) {
+		fprintf(out, "(export[%u]=%s)", instr->export_write_index,
+			instr->export_vector_write_enable ? "vector" : "scalar");
+	}
+
+	if (instr->predicate_swizzle_x != SWIZZLE_X ||
+	    instr->predicate_swizzle_y != SWIZZLE_Y ||
+	    instr->predicate_swizzle_z != SWIZZLE_Z ||
+	    instr->predicate_swizzle_w != SWIZZLE_W)
+		fprintf(out, "(p.%c%c%c%c)",
+			components[instr->predicate_swizzle_x],
+			components[instr->predicate_swizzle_y],
+			components[instr->predicate_swizzle_z],
+			components[instr->predicate_swizzle_w]);
+
+	if (instr->condition_set)
+		fprintf(out, "(cs)");
+
+	if (instr->predicate_eq)
+		fprintf(out, "(eq)");
+
+	if (instr->predicate_lt)
+		fprintf(out, "(lt)");
+
+	if (instr->predicate_gt)
+		fprintf(out, "(gt)");
+
+	if (instr->condition_check)
+		fprintf(out, "(cc)");
+
+	if (instr->condition_flags_write_enable)
+		fprintf(out, "(cwr)");
+
+	if (instr->condition_register_index)
+		fprintf(out, "(cr=1)");
+
+	if (instr->saturate_result)
+		fprintf(out, "(saturate)");
+
+	if (instr->bit120)
+		fprintf(out, "(bit120)");
+}
+
+static int disassemble_instruction(FILE *out, unsigned i)
+{
+	const vpe_instr128 *instr = &asm_vs_instructions[i];
+	char vector[128], scalar[128];
+	int omit_vector, omit_scalar;
+
+	if (instr->vector_opcode >= ARRAY_SIZE(vector_opcodes) ||
+	    instr->scalar_opcode >= ARRAY_SIZE(scalar_opcodes) ||
+	    !vector_opcodes[instr->vector_opcode].name ||
+	    !scalar_opcodes[instr->scalar_opcode].name)
+		return 0;
+
+	if (!vpe_op(vector, sizeof(vector), instr,
+		    &vector_opcodes[instr->vector_opcode],
+		    instr->vector_rD_index,
+		    instr->vector_op_write_x_enable,
+		    instr->vector_op_write_y_enable,
+		    instr->vector_op_write_z_enable,
+		    instr->vector_op_write_w_enable))
+		return 0;
+
+	if (!vpe_op(scalar, sizeof(scalar), instr,
+		    &scalar_opcodes[instr->scalar_opcode],
+		    instr->scalar_rD_index,
+		    instr->scalar_op_write_x_enable,
+		    instr->scalar_op_write_y_enable,
+		    instr->scalar_op_write_z_enable,
+		    instr->scalar_op_write_w_enable))
+		return 0;
+
+	/* parser leaves rD of the omitted NOP zeroed */
+	omit_vector = instr->vector_opcode == VECTOR_OPCODE_NOP &&
+		      !instr->vector_rD_index;
+	omit_scalar = instr->scalar_opcode == SCALAR_OPCODE_NOP &&
+		      !instr->scalar_rD_index;
+
+	fprintf(out, "%s", instr->end_of_program ? "EXEC_END" : "EXEC");
+	disassemble_options(out, instr);
+	fprintf(out, "\n");
+
+	if (!omit_vector || omit_scalar)
+		fprintf(out, "\t%s\n", vector);
+
+	if (!omit_scalar)
+		fprintf(out, "\t%s\n", scalar);
+
+	fprintf(out, ";\n\n");
+
+	return 1;
+}
+
+static void disassemble_names(FILE *out, const char *section,
+			      const asm_in_out *names, unsigned nb)
+{
+	unsigned i;
+
+	fprintf(out, "%s\n", section);
+
+	for (i = 0; i < nb; i++) {
+		if (names[i].used)
+			fprintf(out, "\t[%u] = \"%s\";\n", i, names[i].name);
+	}
+
+	fprintf(out, "\n");
+}
+
+static void disassemble_constant(FILE *out, unsigned i, char component,
+				 const struct asm_vec_component *c)
+{
+	union {
+		uint32_t u;
+		float f;
+	} value;
+
+	if (!c->dirty)
+		return;
+
+	value.u = c->value;
+
+	fprintf(out, "\t[%u].%c = 0x%08X;\t// %f\n", i, component, value.u,
+		value.f);
+}
+
+int vertex_asm_disassemble(FILE *out)
+{
+	unsigned i;
+
+	disassemble_names(out, ".exports", asm_vs_exports,
+			  ARRAY_SIZE(asm_vs_exports));
+	disassemble_names(out, ".attributes", asm_vs_attributes,
+			  ARRAY_SIZE(asm_vs_attributes));
+	disassemble_names(out, ".uniforms", asm_vs_uniforms,
+			  ARRAY_SIZE(asm_vs_uniforms));
+
+	fprintf(out, ".constants\n");
+
+	for (i = 0; i < ARRAY_SIZE(asm_vs_constants); i++) {
+		disassemble_constant(out, i, 'x', &asm_vs_constants[i].vector.x);
+		disassemble_constant(out, i, 'y', &asm_vs_constants[i].vector.y);
+		disassemble_constant(out, i, 'z', &asm_vs_constants[i].vector.z);
+		disassemble_constant(out, i, 'w', &asm_vs_constants[i].vector.w);
+	}
+
+	fprintf(out, "\n.asm\n\n");
+
+	for (i = 0; i < (unsigned)asm_vs_instructions_nb; i++) {
+		if (!disassemble_instruction(out, i)) {
+			fprintf(stderr, "vs: instruction %u has no textual form\n",
+				i);
+			return 0;
+		}
+	}
+
+	return 1;
+}
@@ -104,20 +104,24 @@
 #include <xf86drm.h>
 #include <xf86drmMode.h>
 
+#ifdef HAVE_SW_HOST1X
+#include "host1x_sw.h"
+#else
 #include <libdrm/tegra.h>
+#endif
 
 #include "common_helpers.h"
 #include "compat-api.h"
 #include "drmmode_display.h"
 #include "drm_plane.h"
 #include "tegra_stream.h"
+#include "tgr_3d.xml.h"
+#include "shaders/prog.h"
+#include "gr3d.h"
 #include "exa.h"
 #include "host1x.h"
 #include "vblank.h"
 #include "xv.h"
-#include "tgr_3d.xml.h"
-#include "shaders/prog.h"
-#include "gr3d.h"
 #include "memcpy_vfp.h"
 
 #ifdef LONG64
@@ -69,57 +69,150 @@ unsigned int TegraEXAPitch(unsigned int width, unsigned int height,
 
 void TegraEXAWaitFence(struct tegra_fence *fence)
 {
+    TegraEXAPtr tegra;
+
     if (tegra_stream_wait_fence(fence) && !fence->gr2d) {
+        tegra = TEGRA_CONTAINER_OF(fence->opaque, struct _TegraEXARec,
+                                   scratch);
+
+        /* buffers are referenced by the batch that isn't submitted yet */
+        if (tegra->gr3d.cmds.status != TEGRADRM_STREAM_FREE)
+            return;
+
         /*
-         * XXX: A bit more optimal would be to release buffers
-         *      right after submitting the job, but then BO reservation
-         *      support by kernel driver is required. For now we will
-         *      release buffers when it is known to be safe, i.e. after
-         *      fencing which should happen often enough.
+         * Overflow buffers are allocated only when attributes ring is
+         * exhausted by a single job, release them when it is known to be
+         * safe, i.e. after fencing which should happen often enough.
          */
-        TegraCompositeReleaseAttribBuffers(fence->opaque);
+        TegraCompositeReleaseAttribBuffers(&tegra->scratch);
+    }
+}
+
+/*
+ * Operations are accumulated into a single job per engine, the job is
+ * submitted when CPU or the other engine has to wait for its completion,
+ * by the BlockHandler or once the job grows too large.
+ */
+int TegraEXABeginBatch(TegraEXAEnginePtr engine)
+{
+    if (engine->cmds.status == TEGRADRM_STREAM_CONSTRUCT &&
+        engine->cmds.num_words < TEGRA_EXA_BATCH_MAX_WORDS) {
+        tegra_stream_checkpoint(&engine->cmds);
+        return 0;
     }
+
+    TegraEXAFlushBatch(engine);
+
+    if (tegra_stream_begin(&engine->cmds, engine->channel) < 0)
+        return -1;
+
+    engine->batch_ops = 0;
+    engine->batch_id++;
+
+    return 0;
+}
+
+struct tegra_fence * TegraEXABatchFence(TegraEXAEnginePtr engine,
+                                        unsigned ops)
+{
+    struct tegra_fence *fence;
+
+    engine->batch_ops += ops;
+
+    fence = tegra_stream_pending_fence(&engine->cmds, engine->gr2d);
+    if (!fence)
+        fence = TegraEXAFlushBatch(engine);
+
+    return fence;
+}
+
+/*
+ * Take back the operation under construction, keeping operations that were
+ * batched before it since their fences are handed out already. Returns FALSE
+ * if words of the operation have to stay in the job, they only set up state
+ * of the engine or render a part of the operation then.
+ */
+Bool TegraEXACancelBatchOp(TegraEXAEnginePtr engine)
+{
+    if (engine->cmds.status == TEGRADRM_STREAM_FREE)
+        return TRUE;
+
+    if (!engine->batch_ops) {
+        tegra_stream_cleanup(&engine->cmds);
+        return TRUE;
+    }
+
+    /* engine state doesn't match the shadowed state anymore */
+    engine->batch_id++;
+
+    if (tegra_stream_rollback(&engine->cmds) == 0)
+        return TRUE;
+
+    if (tegra_stream_recover(&engine->cmds) == 0)
+        return FALSE;
+
+    ErrorMsg("job is broken, %u batched operations are lost\n",
+             engine->batch_ops);
+    tegra_stream_cleanup(&engine->cmds);
+
+    return TRUE;
+}
+
+struct tegra_fence * TegraEXAFlushBatch(TegraEXAEnginePtr engine)
+{
+    if (engine->cmds.status == TEGRADRM_STREAM_FREE)
+        return NULL;
+
+    if (!engine->batch_ops) {
+        tegra_stream_cleanup(&engine->cmds);
+        return NULL;
+    }
+
+    if (tegra_stream_recover(&engine->cmds) < 0) {
+        ErrorMsg("job is broken, %u batched operations are lost\n",
+                 engine->batch_ops);
+        tegra_stream_cleanup(&engine->cmds);
+        return NULL;
+    }
+
+    tegra_stream_end(&engine->cmds);
+
+    return tegra_stream_submit(&engine->cmds, engine->gr2d);
 }
 
 static int TegraEXAMarkSync(ScreenPtr pScreen)
 {
     ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
     TegraEXAPtr tegra = TegraPTR(pScrn)->exa;
-    union {
-        struct tegra_fence *fence;
-        int marker;
-    } data;
-
-    /* on 32bit ARM size of integer is equal to size of pointer */
-    data.fence = tegra_stream_get_last_fence(&tegra->cmds);
+    struct tegra_exa_scratch *scratch = &tegra->scratch;
 
     /*
      * EXA may take marker multiple times, but it waits only for the
-     * lastly taken marker, so we release the previous marker-fence here.
+     * lastly taken marker, so we release the previous marker-fences here.
+     * Marker covers jobs of both engines.
      */
-    tegra_stream_put_fence(tegra->scratch.marker);
-    tegra->scratch.marker = data.fence;
+    tegra_stream_put_fence(scratch->marker[0]);
+    tegra_stream_put_fence(scratch->marker[1]);
 
-    return data.marker;
+    scratch->marker[0] = tegra_stream_get_last_fence(&tegra->gr3d.cmds);
+    scratch->marker[1] = tegra_stream_get_last_fence(&tegra->gr2d.cmds);
+
+    return 1;
 }
 
 static void TegraEXAWaitMarker(ScreenPtr pScreen, int marker)
 {
     ScrnInfoPtr pScrn = xf86ScreenToScrn(pScreen);
     TegraEXAPtr tegra = TegraPTR(pScrn)->exa;
-    union {
-        struct tegra_fence *fence;
-        int marker;
-    } data;
-
-    data.marker = marker;
-
-    TegraEXAWaitFence(data.fence);
-    tegra_stream_put_fence(data.fence);
-
-    /* if it was a lastly-taken marker, then we've just released it */
-    if (data.fence == tegra->scratch.marker)
-        tegra->scratch.marker = NULL;
+    struct tegra_exa_scratch *scratch = &tegra->scratch;
+    unsigned i;
+
+    /* waiting for the lastly taken marker covers the older ones */
+    for (i = 0; i < 2; i++) {
+        TegraEXAWaitFence(scratch->marker[i]);
+        tegra_stream_put_fence(scratch->marker[i]);
+        scratch->marker[i] = NULL;
+    }
 }
 
 static Bool __TegraEXAPrepareAccess(PixmapPtr pPix, int idx, void **ptr)
@@ -197,6 +290,21 @@ static void TegraEXAFinishAccess(PixmapPtr pPix, int idx)
     __TegraEXAFinishAccess(pPix, idx);
 }
 
+/* fill beginning of the driver-internal pixmap, e.g. gradient ramp */
+Bool TegraEXAWritePixmap(PixmapPtr pPix, const void *data, unsigned size)
+{
+    void *ptr;
+
+    if (!__TegraEXAPrepareAccess(pPix, EXA_PREPARE_DEST, &ptr))
+        return FALSE;
+
+    memcpy(ptr, data, size);
+
+    __TegraEXAFinishAccess(pPix, EXA_PREPARE_DEST);
+
+    return TRUE;
+}
+
 static Bool TegraEXAPixmapIsOffscreen(PixmapPtr pPix)
 {
     TegraPixmapPtr priv = exaGetPixmapDriverPrivate(pPix);
@@ -546,6 +654,18 @@ static void TegraEXABlockHandler(BLOCKHANDLER_ARGS_DECL)
     pScreen->BlockHandler(BLOCKHANDLER_ARGS);
     pScreen->BlockHandler = TegraEXABlockHandler;
 
+    /* nothing is left batched while server sleeps */
+    TegraEXAFlushBatch(&exa->gr2d);
+    TegraEXAFlushBatch(&exa->gr3d);
+
+    /*
+     * Jobs that wait for the other engine are handed to kernel before
+     * sleeping. There is no fd to poll for a fence of libdrm_tegra, so
+     * block till the other engine is done rather than wake up periodically.
+     */
+    tegra_stream_submit_deferred(&exa->gr2d.cmds, TRUE);
+    tegra_stream_submit_deferred(&exa->gr3d.cmds, TRUE);
+
     clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
     TegraEXAFreezePixmaps(tegra, time.tv_sec);
 }
@@ -562,6 +682,14 @@ static void TegraEXAWrapProc(ScreenPtr pScreen)
 
         ps->CreatePicture = TegraEXACreatePicture;
         ps->DestroyPicture = TegraEXADestroyPicture;
+
+        exa->Composite = ps->Composite;
+        exa->Glyphs = ps->Glyphs;
+        exa->UnrealizeGlyph = ps->UnrealizeGlyph;
+
+        ps->Composite = TegraEXACompositePicture;
+        ps->Glyphs = TegraEXAGlyphs;
+        ps->UnrealizeGlyph = TegraEXAUnrealizeGlyph;
     }
 
     exa->BlockHandler = pScreen->BlockHandler;
@@ -577,6 +705,9 @@ static void TegraEXAUnWrapProc(ScreenPtr pScreen)
     if (ps) {
         ps->CreatePicture = exa->CreatePicture;
         ps->DestroyPicture = exa->DestroyPicture;
+        ps->Composite = exa->Composite;
+        ps->Glyphs = exa->Glyphs;
+        ps->UnrealizeGlyph = exa->UnrealizeGlyph;
     }
 
     pScreen->BlockHandler = exa->BlockHandler;
@@ -605,28 +736,39 @@ Bool TegraEXAScreenInit(ScreenPtr pScreen)
         goto free_exa;
     }
 
-    err = drm_tegra_channel_open(&priv->gr2d, tegra->drm, DRM_TEGRA_GR2D);
+    err = drm_tegra_channel_open(&priv->gr2d.channel, tegra->drm,
+                                 DRM_TEGRA_GR2D);
     if (err < 0) {
         ErrorMsg("failed to open 2D channel: %d\n", err);
         goto free_priv;
     }
 
-    err = drm_tegra_channel_open(&priv->gr3d, tegra->drm, DRM_TEGRA_GR3D);
+    err = drm_tegra_channel_open(&priv->gr3d.channel, tegra->drm,
+                                 DRM_TEGRA_GR3D);
     if (err < 0) {
         ErrorMsg("failed to open 3D channel: %d\n", err);
         goto close_gr2d;
     }
 
-    err = tegra_stream_create(&priv->cmds);
+    err = tegra_stream_create(&priv->gr2d.cmds);
     if (err < 0) {
-        ErrorMsg("failed to create command stream: %d\n", err);
+        ErrorMsg("failed to create 2D command stream: %d\n", err);
         goto close_gr3d;
     }
 
+    err = tegra_stream_create(&priv->gr3d.cmds);
+    if (err < 0) {
+        ErrorMsg("failed to create 3D command stream: %d\n", err);
+        goto destroy_stream_2d;
+    }
+
+    priv->gr2d.gr2d = TRUE;
+    priv->gr3d.gr2d = FALSE;
+
     err = TegraEXAInitMM(tegra, priv);
     if (err) {
         ErrorMsg("TegraEXAInitMM failed\n");
-        goto destroy_stream;
+        goto destroy_stream_3d;
     }
 
     exa->exa_major = EXA_VERSION_MAJOR;
@@ -682,12 +824,14 @@ Bool TegraEXAScreenInit(ScreenPtr pScreen)
 
 release_mm:
     TegraEXAReleaseMM(tegra, priv);
-destroy_stream:
-    tegra_stream_destroy(&priv->cmds);
+destroy_stream_3d:
+    tegra_stream_destroy(&priv->gr3d.cmds);
+destroy_stream_2d:
+    tegra_stream_destroy(&priv->gr2d.cmds);
 close_gr3d:
-    drm_tegra_channel_close(priv->gr3d);
+    drm_tegra_channel_close(priv->gr3d.channel);
 close_gr2d:
-    drm_tegra_channel_close(priv->gr2d);
+    drm_tegra_channel_close(priv->gr2d.channel);
 free_priv:
     free(priv);
 free_exa:
@@ -703,15 +847,24 @@ void TegraEXAScreenExit(ScreenPtr pScreen)
     TegraEXAPtr priv = tegra->exa;
 
     if (priv) {
+        TegraEXAReleaseGlyphAtlas(priv);
+        TegraEXAReleaseGradientRamps(priv);
+        TegraEXAReleaseCompositeTiles(priv);
+        TegraEXAReleaseBlendPrograms(priv);
+        TegraEXAReleaseCompositePrograms();
         exaDriverFini(pScreen);
         TegraEXAUnWrapProc(pScreen);
         free(priv->driver);
 
+        TegraEXAFlushBatch(&priv->gr2d);
+        TegraEXAFlushBatch(&priv->gr3d);
         TegraEXAReleaseMM(tegra, priv);
-        tegra_stream_destroy(&priv->cmds);
-        drm_tegra_channel_close(priv->gr2d);
-        drm_tegra_channel_close(priv->gr3d);
+        tegra_stream_destroy(&priv->gr2d.cmds);
+        tegra_stream_destroy(&priv->gr3d.cmds);
+        drm_tegra_channel_close(priv->gr2d.channel);
+        drm_tegra_channel_close(priv->gr3d.channel);
         TegraCompositeReleaseAttribBuffers(&priv->scratch);
+        TegraCompositeReleaseAttribRing(&priv->scratch);
         free(priv);
 
         tegra->exa = NULL;
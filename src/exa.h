@@ -31,12 +31,46 @@
 
 #define TEGRA_EXA_OFFSET_ALIGN          256
 
+/* batched job is submitted once it grows over this size */
+#define TEGRA_EXA_BATCH_MAX_WORDS       (16 * 1024)
+
+/* GR3D texture dimension limit */
+#define TEGRA_TEXTURE_SIZE_MAX          2048
+
+/* oversized source is staged through that many scratch tiles in turn */
+#define TEGRA_COMPOSITE_TILE_SIZE       1024
+#define TEGRA_COMPOSITE_TILES_NB        2
+
+/* attribute buffers are slots of a ring, each slot is that large */
+#define TEGRA_ATTRIB_BUFFER_SIZE        0x1000
+#define TEGRA_ATTRIB_RING_SLOTS         64
+
+/*
+ * Rects are drawn as indexed quads, 4 vertices with at least one 2x int16
+ * attribute each. Attributes are pixel coordinates, vertex program maps
+ * them into normalized ones. Indices are shared by all slots and stored
+ * after them.
+ */
+#define TEGRA_ATTRIB_QUADS_MAX          (TEGRA_ATTRIB_BUFFER_SIZE / 16)
+#define TEGRA_ATTRIB_INDEX_OFFSET       (TEGRA_ATTRIB_BUFFER_SIZE *     \
+                                         TEGRA_ATTRIB_RING_SLOTS)
+#define TEGRA_ATTRIB_INDEX_SIZE         (TEGRA_ATTRIB_QUADS_MAX * 6 * 2)
+
 typedef struct tegra_attrib_bo {
     struct tegra_attrib_bo *next;
     struct drm_tegra_bo *bo;
-    __fp16 *map;
+    struct tegra_fence *fence;  /* last job that used the ring slot */
+    unsigned offset;
+    int16_t *map;
 } TegraEXAAttribBo;
 
+typedef struct tegra_attrib_ring {
+    struct drm_tegra_bo *bo;
+    TegraEXAAttribBo slots[TEGRA_ATTRIB_RING_SLOTS];
+    unsigned slot;              /* the lastly taken slot */
+    unsigned op_slots;          /* slots taken by the current operation */
+} TegraEXAAttribRing;
+
 enum Tegra2DOrientation {
     TEGRA2D_FLIP_X,
     TEGRA2D_FLIP_Y,
@@ -54,10 +88,20 @@ enum Tegra2DCompositeOp {
     TEGRA2D_COPY,
 };
 
+typedef struct tegra_exa_engine {
+    struct drm_tegra_channel *channel;
+    struct tegra_stream cmds;
+    unsigned batch_ops;
+    unsigned batch_id;      /* changes whenever engine state is lost */
+    Bool gr2d;
+} TegraEXAEngine, *TegraEXAEnginePtr;
+
 typedef struct tegra_exa_scratch {
     enum Tegra2DOrientation orientation;
     enum Tegra2DCompositeOp op2d;
-    struct tegra_fence *marker;
+    struct tegra_fence *marker[2]; /* indexed by tegra_fence.gr2d */
+    TegraEXAAttribRing attribs_ring;
+    TegraEXAAttribBo *attribs_overflow;
     TegraEXAAttribBo *attribs;
     PictTransform transform;
     Bool attribs_alloc_err;
@@ -67,12 +111,78 @@ typedef struct tegra_exa_scratch {
     PixmapPtr pMask;
     PixmapPtr pSrc;
     unsigned ops;
+    Bool rect_barrier;
     int srcX;
     int srcY;
     int dstX;
     int dstY;
+    Bool src_in_bounds;         /* source isn't sampled past its edges */
+    Bool mask_in_bounds;
 } TegraEXAScratch, *TegraEXAScratchPtr;
 
+/*
+ * Glyph atlas is an A8 pixmap split into equal cells, each holding one
+ * glyph. Cells are recycled in LRU order, lookup is hashed by GlyphPtr.
+ */
+#define TEGRA_GLYPH_ATLAS_SIZE          1024
+#define TEGRA_GLYPH_CELL_SIZE           32
+#define TEGRA_GLYPH_CELLS_NB            ((TEGRA_GLYPH_ATLAS_SIZE /       \
+                                          TEGRA_GLYPH_CELL_SIZE) *       \
+                                         (TEGRA_GLYPH_ATLAS_SIZE /       \
+                                          TEGRA_GLYPH_CELL_SIZE))
+#define TEGRA_GLYPH_HASH_SIZE           2048
+
+typedef struct tegra_glyph_cell {
+    GlyphPtr glyph;
+    struct tegra_glyph_cell *hash_next;
+    struct xorg_list lru_entry;
+    unsigned serial;            /* request that used the cell lastly */
+    unsigned x;
+    unsigned y;
+} TegraGlyphCell, *TegraGlyphCellPtr;
+
+typedef struct tegra_glyph_atlas {
+    PicturePtr pPicture;
+    TegraGlyphCellPtr hash[TEGRA_GLYPH_HASH_SIZE];
+    TegraGlyphCell cells[TEGRA_GLYPH_CELLS_NB];
+    struct xorg_list lru;       /* most recently used first */
+    unsigned serial;
+    TegraGlyphCellPtr pending[TEGRA_GLYPH_CELLS_NB]; /* not uploaded yet */
+    unsigned num_pending;
+} TegraGlyphAtlas, *TegraGlyphAtlasPtr;
+
+/*
+ * Gradient ramps are one texel high textures holding rasterized gradient
+ * stops, recently used ramps are kept to avoid re-uploading them.
+ */
+#define TEGRA_GRADIENT_RAMP_SIZE        256
+#define TEGRA_GRADIENT_CACHE_SIZE       8
+
+typedef struct tegra_gradient_ramp {
+    PixmapPtr pPixmap;
+    CARD32 texels[TEGRA_GRADIENT_RAMP_SIZE];
+    unsigned serial;            /* lookup that used the ramp lastly */
+} TegraGradientRamp, *TegraGradientRampPtr;
+
+/*
+ * Factors of the generated GR3D composite programs, where
+ *
+ *     dst = src * mask * src_factor + dst * dst_factor
+ *
+ * ALPHA of src_factor is dst.a and ALPHA of dst_factor is src.a * mask.
+ */
+enum Tegra3DBlendFactor {
+    TEGRA_BLEND_ZERO,
+    TEGRA_BLEND_ONE,
+    TEGRA_BLEND_ALPHA,
+    TEGRA_BLEND_INV_ALPHA,
+    TEGRA_BLEND_SATURATE,       /* min(1, (1 - dst.a) / (src.a * mask)) */
+};
+
+#define TEGRA_BLEND_FACTORS_NB          5
+#define TEGRA_BLEND_PROGS_NB            (TEGRA_BLEND_FACTORS_NB *   \
+                                         TEGRA_BLEND_FACTORS_NB * 16)
+
 typedef struct {
     struct drm_tegra_bo *bo;
     struct xorg_list entry;
@@ -83,9 +193,11 @@ typedef struct {
 } TegraPixmapPool, *TegraPixmapPoolPtr;
 
 typedef struct _TegraEXARec{
-    struct drm_tegra_channel *gr2d;
-    struct drm_tegra_channel *gr3d;
-    struct tegra_stream cmds;
+    TegraEXAEngine gr2d;
+    TegraEXAEngine gr3d;
+    struct tegra_gr3d_state gr3d_state;
+    unsigned gr3d_state_batch;  /* gr3d.batch_id the shadow belongs to */
+    uint64_t gr3d_caches_seqno; /* GR2D jobs visible to GR3D caches */
     TegraEXAScratch scratch;
     struct xorg_list mem_pools;
     time_t pool_slow_compact_time;
@@ -98,6 +210,14 @@ typedef struct _TegraEXARec{
     CreatePictureProcPtr CreatePicture;
     DestroyPictureProcPtr DestroyPicture;
     ScreenBlockHandlerProcPtr BlockHandler;
+    CompositeProcPtr Composite;
+    GlyphsProcPtr Glyphs;
+    UnrealizeGlyphProcPtr UnrealizeGlyph;
+    TegraGlyphAtlasPtr glyph_atlas;
+    TegraGradientRamp gradient_ramps[TEGRA_GRADIENT_CACHE_SIZE];
+    unsigned gradient_serial;
+    struct shader_program *blend_progs[TEGRA_BLEND_PROGS_NB];
+    PicturePtr composite_tiles[TEGRA_COMPOSITE_TILES_NB];
 #ifdef HAVE_JPEG
     tjhandle jpegCompressor;
     tjhandle jpegDecompressor;
@@ -167,6 +287,15 @@ unsigned int TegraEXAPitch(unsigned int width, unsigned int height,
 
 void TegraEXAWaitFence(struct tegra_fence *fence);
 
+int TegraEXABeginBatch(TegraEXAEnginePtr engine);
+
+struct tegra_fence * TegraEXABatchFence(TegraEXAEnginePtr engine,
+                                        unsigned ops);
+
+Bool TegraEXACancelBatchOp(TegraEXAEnginePtr engine);
+
+struct tegra_fence * TegraEXAFlushBatch(TegraEXAEnginePtr engine);
+
 unsigned TegraPixmapSize(TegraPixmapPtr pixmap);
 
 unsigned TegraEXAHeightHwAligned(unsigned int height, unsigned int bpp);
@@ -194,10 +323,14 @@ void TegraEXACopy(PixmapPtr pDstPixmap, int srcX, int srcY, int dstX,
 void TegraEXACopyExt(PixmapPtr pDstPixmap, int srcX, int srcY, int dstX,
                      int dstY, int width, int height);
 
+Bool TegraEXACopySource(PixmapPtr pSrcPixmap, PixmapPtr pDstPixmap);
+
 void TegraEXADoneCopy(PixmapPtr pDstPixmap);
 
 void TegraCompositeReleaseAttribBuffers(TegraEXAScratchPtr scratch);
 
+void TegraCompositeReleaseAttribRing(TegraEXAScratchPtr scratch);
+
 Bool TegraEXACheckComposite(int op, PicturePtr pSrcPicture,
                             PicturePtr pMaskPicture,
                             PicturePtr pDstPicture);
@@ -217,6 +350,46 @@ void TegraEXAComposite(PixmapPtr pDst,
 
 void TegraEXADoneComposite(PixmapPtr pDst);
 
+void TegraEXAReleaseCompositePrograms(void);
+
+void TegraEXAReleaseCompositeTiles(TegraEXAPtr exa);
+
+void TegraEXACompositePicture(CARD8 op,
+                              PicturePtr pSrcPicture,
+                              PicturePtr pMaskPicture,
+                              PicturePtr pDstPicture,
+                              INT16 xSrc, INT16 ySrc,
+                              INT16 xMask, INT16 yMask,
+                              INT16 xDst, INT16 yDst,
+                              CARD16 width, CARD16 height);
+
+void TegraEXAGlyphs(CARD8 op, PicturePtr pSrcPicture, PicturePtr pDstPicture,
+                    PictFormatPtr maskFormat, INT16 xSrc, INT16 ySrc,
+                    int nlist, GlyphListPtr list, GlyphPtr *glyphs);
+
+void TegraEXAUnrealizeGlyph(ScreenPtr pScreen, GlyphPtr glyph);
+
+void TegraEXAReleaseGlyphAtlas(TegraEXAPtr exa);
+
+Bool TegraEXAWritePixmap(PixmapPtr pPix, const void *data, unsigned size);
+
+Bool TegraEXAGradientSupported(PicturePtr pPicture);
+
+PixmapPtr TegraEXAGradientRamp(ScreenPtr pScreen, PicturePtr pPicture);
+
+void TegraEXAGradientMatrix(PicturePtr pPicture, float m[2][3]);
+
+void TegraEXAReleaseGradientRamps(TegraEXAPtr exa);
+
+struct shader_program *
+TegraEXABlendProgram(TegraEXAPtr exa,
+                     const struct shader_program *layout,
+                     enum Tegra3DBlendFactor src_factor,
+                     enum Tegra3DBlendFactor dst_factor,
+                     Bool src_tex, Bool mask_tex, unsigned flags);
+
+void TegraEXAReleaseBlendPrograms(TegraEXAPtr exa);
+
 #endif
 
 /* vim: set et sts=4 sw=4 ts=4: */
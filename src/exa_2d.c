@@ -87,33 +87,33 @@ Bool TegraEXAPrepareSolid(PixmapPtr pPixmap, int op, Pixel planemask,
     if (priv->type <= TEGRA_EXA_PIXMAP_TYPE_FALLBACK)
         return FALSE;
 
-    err = tegra_stream_begin(&tegra->cmds, tegra->gr2d);
+    err = TegraEXABeginBatch(&tegra->gr2d);
     if (err < 0)
             return FALSE;
 
-    tegra_stream_prep(&tegra->cmds, 15);
-    tegra_stream_push_setclass(&tegra->cmds, HOST1X_CLASS_GR2D);
-    tegra_stream_push(&tegra->cmds, HOST1X_OPCODE_MASK(0x9, 0x9));
-    tegra_stream_push(&tegra->cmds, 0x0000003a); /* trigger */
-    tegra_stream_push(&tegra->cmds, 0x00000000); /* cmdsel */
-    tegra_stream_push(&tegra->cmds, HOST1X_OPCODE_NONINCR(0x35, 1));
-    tegra_stream_push(&tegra->cmds, color);
-    tegra_stream_push(&tegra->cmds, HOST1X_OPCODE_MASK(0x1e, 0x7));
-    tegra_stream_push(&tegra->cmds, 0x00000000); /* controlsecond */
-    tegra_stream_push(&tegra->cmds, /* controlmain */
+    tegra_stream_prep(&tegra->gr2d.cmds, 15);
+    tegra_stream_push_setclass(&tegra->gr2d.cmds, HOST1X_CLASS_GR2D);
+    tegra_stream_push(&tegra->gr2d.cmds, HOST1X_OPCODE_MASK(0x9, 0x9));
+    tegra_stream_push(&tegra->gr2d.cmds, 0x0000003a); /* trigger */
+    tegra_stream_push(&tegra->gr2d.cmds, 0x00000000); /* cmdsel */
+    tegra_stream_push(&tegra->gr2d.cmds, HOST1X_OPCODE_NONINCR(0x35, 1));
+    tegra_stream_push(&tegra->gr2d.cmds, color);
+    tegra_stream_push(&tegra->gr2d.cmds, HOST1X_OPCODE_MASK(0x1e, 0x7));
+    tegra_stream_push(&tegra->gr2d.cmds, 0x00000000); /* controlsecond */
+    tegra_stream_push(&tegra->gr2d.cmds, /* controlmain */
                       ((bpp >> 4) << 16) | /* bytes per pixel */
                       (1 << 6) |           /* fill mode */
                       (1 << 2)             /* turbo-fill */);
-    tegra_stream_push(&tegra->cmds, rop3[op]); /* ropfade */
-    tegra_stream_push(&tegra->cmds, HOST1X_OPCODE_MASK(0x2b, 0x9));
-    tegra_stream_push_reloc(&tegra->cmds, TegraEXAPixmapBO(pPixmap),
+    tegra_stream_push(&tegra->gr2d.cmds, rop3[op]); /* ropfade */
+    tegra_stream_push(&tegra->gr2d.cmds, HOST1X_OPCODE_MASK(0x2b, 0x9));
+    tegra_stream_push_reloc(&tegra->gr2d.cmds, TegraEXAPixmapBO(pPixmap),
                             TegraEXAPixmapOffset(pPixmap));
-    tegra_stream_push(&tegra->cmds, exaGetPixmapPitch(pPixmap));
-    tegra_stream_push(&tegra->cmds, HOST1X_OPCODE_NONINCR(0x46, 1));
-    tegra_stream_push(&tegra->cmds, 0); /* non-tiled */
+    tegra_stream_push(&tegra->gr2d.cmds, exaGetPixmapPitch(pPixmap));
+    tegra_stream_push(&tegra->gr2d.cmds, HOST1X_OPCODE_NONINCR(0x46, 1));
+    tegra_stream_push(&tegra->gr2d.cmds, 0); /* non-tiled */
 
-    if (tegra->cmds.status != TEGRADRM_STREAM_CONSTRUCT) {
-        tegra_stream_cleanup(&tegra->cmds);
+    if (tegra->gr2d.cmds.status != TEGRADRM_STREAM_CONSTRUCT) {
+        TegraEXACancelBatchOp(&tegra->gr2d);
         return FALSE;
     }
 
@@ -126,12 +126,15 @@ void TegraEXASolid(PixmapPtr pPixmap, int px1, int py1, int px2, int py2)
 {
     ScrnInfoPtr pScrn = xf86ScreenToScrn(pPixmap->drawable.pScreen);
     TegraEXAPtr tegra = TegraPTR(pScrn)->exa;
-
-    tegra_stream_prep(&tegra->cmds, 3);
-    tegra_stream_push(&tegra->cmds, HOST1X_OPCODE_MASK(0x38, 0x5));
-    tegra_stream_push(&tegra->cmds, (py2 - py1) << 16 | (px2 - px1));
-    tegra_stream_push(&tegra->cmds, py1 << 16 | px1);
-    tegra_stream_sync(&tegra->cmds, DRM_TEGRA_SYNCPT_COND_OP_DONE);
+    uint32_t *cs;
+
+    cs = tegra_stream_reserve(&tegra->gr2d.cmds, 3);
+    if (cs) {
+        *cs++ = HOST1X_OPCODE_MASK(0x38, 0x5);
+        *cs++ = (py2 - py1) << 16 | (px2 - px1);
+        *cs++ = py1 << 16 | px1;
+        tegra_stream_commit(&tegra->gr2d.cmds, cs);
+    }
 
     tegra->scratch.ops++;
 }
@@ -143,22 +146,26 @@ void TegraEXADoneSolid(PixmapPtr pPixmap)
     TegraEXAPtr tegra = TegraPTR(pScrn)->exa;
     struct tegra_fence *fence;
 
-    if (tegra->scratch.ops && tegra->cmds.status == TEGRADRM_STREAM_CONSTRUCT) {
+    /* rects that made it into the job before a failure are kept */
+    if (tegra->gr2d.cmds.status != TEGRADRM_STREAM_CONSTRUCT &&
+        TegraEXACancelBatchOp(&tegra->gr2d))
+        tegra->scratch.ops = 0;
+
+    if (tegra->scratch.ops) {
         if (priv->fence_write && !priv->fence_write->gr2d)
-            TegraEXAWaitFence(priv->fence_write);
+            tegra_stream_add_prefence(&tegra->gr2d.cmds, priv->fence_write);
 
         if (priv->fence_read && !priv->fence_read->gr2d)
-            TegraEXAWaitFence(priv->fence_read);
+            tegra_stream_add_prefence(&tegra->gr2d.cmds, priv->fence_read);
 
-        tegra_stream_end(&tegra->cmds);
-        fence = tegra_stream_submit(&tegra->cmds, true);
+        fence = TegraEXABatchFence(&tegra->gr2d, tegra->scratch.ops);
 
         if (priv->fence_write != fence) {
             tegra_stream_put_fence(priv->fence_write);
             priv->fence_write = tegra_stream_ref_fence(fence, &tegra->scratch);
         }
     } else {
-        tegra_stream_cleanup(&tegra->cmds);
+        TegraEXACancelBatchOp(&tegra->gr2d);
     }
 
     TegraEXACoolPixmap(pPixmap, TRUE);
@@ -228,47 +235,60 @@ Bool TegraEXAPrepareCopyExt(PixmapPtr pSrcPixmap, PixmapPtr pDstPixmap,
     if (priv->type <= TEGRA_EXA_PIXMAP_TYPE_FALLBACK)
         return FALSE;
 
-    err = tegra_stream_begin(&tegra->cmds, tegra->gr2d);
+    err = TegraEXABeginBatch(&tegra->gr2d);
     if (err < 0)
         return FALSE;
 
-    tegra_stream_prep(&tegra->cmds, orientation == TEGRA2D_IDENTITY ? 14 : 12);
-    tegra_stream_push_setclass(&tegra->cmds, HOST1X_CLASS_GR2D);
-    tegra_stream_push(&tegra->cmds, HOST1X_OPCODE_MASK(0x9, 0x9));
-    tegra_stream_push(&tegra->cmds, orientation == TEGRA2D_IDENTITY ?
+    tegra_stream_prep(&tegra->gr2d.cmds,
+                      orientation == TEGRA2D_IDENTITY ? 14 : 12);
+    tegra_stream_push_setclass(&tegra->gr2d.cmds, HOST1X_CLASS_GR2D);
+    tegra_stream_push(&tegra->gr2d.cmds, HOST1X_OPCODE_MASK(0x9, 0x9));
+    tegra_stream_push(&tegra->gr2d.cmds, orientation == TEGRA2D_IDENTITY ?
                                     0x0000003a : 0x00000037 ); /* trigger */
-    tegra_stream_push(&tegra->cmds, 0x00000000); /* cmdsel */
-    tegra_stream_push(&tegra->cmds, HOST1X_OPCODE_MASK(0x01e, 0x5));
-    tegra_stream_push(&tegra->cmds, /* controlsecond */
+    tegra_stream_push(&tegra->gr2d.cmds, 0x00000000); /* cmdsel */
+    tegra_stream_push(&tegra->gr2d.cmds, HOST1X_OPCODE_MASK(0x01e, 0x5));
+    tegra_stream_push(&tegra->gr2d.cmds, /* controlsecond */
                       orientation << 26 | fr_mode << 24);
-    tegra_stream_push(&tegra->cmds, rop3[op]); /* ropfade */
-    tegra_stream_push(&tegra->cmds, HOST1X_OPCODE_NONINCR(0x046, 1));
+    tegra_stream_push(&tegra->gr2d.cmds, rop3[op]); /* ropfade */
+    tegra_stream_push(&tegra->gr2d.cmds, HOST1X_OPCODE_NONINCR(0x046, 1));
     /*
      * [20:20] destination write tile mode (0: linear, 1: tiled)
      * [ 0: 0] tile mode Y/RGB (0: linear, 1: tiled)
      */
-    tegra_stream_push(&tegra->cmds, 0x00000000); /* tilemode */
+    tegra_stream_push(&tegra->gr2d.cmds, 0x00000000); /* tilemode */
 
     if (orientation == TEGRA2D_IDENTITY) {
-        tegra_stream_push(&tegra->cmds, HOST1X_OPCODE_MASK(0x2b, 0x149));
+        tegra_stream_push(&tegra->gr2d.cmds, HOST1X_OPCODE_MASK(0x2b, 0x149));
 
-        tegra_stream_push_reloc(&tegra->cmds, TegraEXAPixmapBO(pDstPixmap),
+        tegra_stream_push_reloc(&tegra->gr2d.cmds, TegraEXAPixmapBO(pDstPixmap),
                                 TegraEXAPixmapOffset(pDstPixmap));
-        tegra_stream_push(&tegra->cmds,
+        tegra_stream_push(&tegra->gr2d.cmds,
                           exaGetPixmapPitch(pDstPixmap)); /* dstst */
 
-        tegra_stream_push_reloc(&tegra->cmds, TegraEXAPixmapBO(pSrcPixmap),
+        tegra_stream_push_reloc(&tegra->gr2d.cmds, TegraEXAPixmapBO(pSrcPixmap),
                                 TegraEXAPixmapOffset(pSrcPixmap));
-        tegra_stream_push(&tegra->cmds,
+        tegra_stream_push(&tegra->gr2d.cmds,
                           exaGetPixmapPitch(pSrcPixmap)); /* srcst */
     } else {
-        tegra_stream_push(&tegra->cmds, HOST1X_OPCODE_MASK(0x2b, 0x108));
-        tegra_stream_push(&tegra->cmds, exaGetPixmapPitch(pDstPixmap)); /* dstst */
-        tegra_stream_push(&tegra->cmds, exaGetPixmapPitch(pSrcPixmap)); /* srcst */
+        tegra_stream_push(&tegra->gr2d.cmds, HOST1X_OPCODE_MASK(0x2b, 0x108));
+        tegra_stream_push(&tegra->gr2d.cmds, exaGetPixmapPitch(pDstPixmap)); /* dstst */
+        tegra_stream_push(&tegra->gr2d.cmds, exaGetPixmapPitch(pSrcPixmap)); /* srcst */
     }
 
-    if (tegra->cmds.status != TEGRADRM_STREAM_CONSTRUCT) {
-        tegra_stream_cleanup(&tegra->cmds);
+    /*
+     * Blits of a job aren't separated by syncpoint increments, hence the
+     * preceding blits need to be completed before reading pixels written
+     * by them. This also applies to the rects of the same operation when
+     * copying within a single pixmap.
+     */
+    priv = exaGetPixmapDriverPrivate(pSrcPixmap);
+    if (priv->fence_write && priv->fence_write->stream == &tegra->gr2d.cmds)
+        tegra_stream_sync(&tegra->gr2d.cmds, DRM_TEGRA_SYNCPT_COND_OP_DONE);
+
+    tegra->scratch.rect_barrier = (pSrcPixmap == pDstPixmap);
+
+    if (tegra->gr2d.cmds.status != TEGRADRM_STREAM_CONSTRUCT) {
+        TegraEXACancelBatchOp(&tegra->gr2d);
         return FALSE;
     }
 
@@ -292,6 +312,7 @@ void TegraEXACopyExt(PixmapPtr pDstPixmap, int srcX, int srcY, int dstX,
     struct drm_tegra_bo * dst_bo;
     PixmapPtr pSrcPixmap;
     uint32_t controlmain;
+    uint32_t *cs;
     unsigned cell_size;
     unsigned bpp;
     PictVector v;
@@ -372,23 +393,23 @@ void TegraEXACopyExt(PixmapPtr pDstPixmap, int srcX, int srcY, int dstX,
     width  = twidth  - 1;
     height = theight - 1;
 
-    tegra_stream_prep(&tegra->cmds, 11);
+    cs = tegra_stream_reserve(&tegra->gr2d.cmds, 8);
+    if (!cs)
+        goto out;
 
     if (tegra->scratch.dstX != dstX || tegra->scratch.dstY != dstY) {
-        tegra_stream_push(&tegra->cmds, HOST1X_OPCODE_NONINCR(0x2b, 1));
-
-        tegra_stream_push_reloc(&tegra->cmds, dst_bo,
-                                sb_offset(pDstPixmap, dstX, dstY));
+        *cs++ = HOST1X_OPCODE_NONINCR(0x2b, 1);
+        cs = tegra_stream_write_reloc(&tegra->gr2d.cmds, cs, dst_bo,
+                                      sb_offset(pDstPixmap, dstX, dstY));
 
         tegra->scratch.dstX = dstX;
         tegra->scratch.dstY = dstY;
     }
 
     if (tegra->scratch.srcX != srcX || tegra->scratch.srcY != srcY) {
-        tegra_stream_push(&tegra->cmds, HOST1X_OPCODE_NONINCR(0x31, 1));
-
-        tegra_stream_push_reloc(&tegra->cmds, src_bo,
-                                sb_offset(pSrcPixmap, srcX, srcY));
+        *cs++ = HOST1X_OPCODE_NONINCR(0x31, 1);
+        cs = tegra_stream_write_reloc(&tegra->gr2d.cmds, cs, src_bo,
+                                      sb_offset(pSrcPixmap, srcX, srcY));
 
         tegra->scratch.srcX = srcX;
         tegra->scratch.srcY = srcY;
@@ -401,21 +422,84 @@ void TegraEXACopyExt(PixmapPtr pDstPixmap, int srcX, int srcY, int dstX,
      */
     controlmain = (1 << 29) | (1 << 20) | ((bpp >> 4) << 16);
 
-    tegra_stream_push(&tegra->cmds, HOST1X_OPCODE_NONINCR(0x01f, 1));
-    tegra_stream_push(&tegra->cmds, controlmain);
-    tegra_stream_push(&tegra->cmds, HOST1X_OPCODE_NONINCR(0x37, 0x1));
-    tegra_stream_push(&tegra->cmds, height << 16 | width); /* srcsize */
-    tegra_stream_sync(&tegra->cmds, DRM_TEGRA_SYNCPT_COND_OP_DONE);
+    *cs++ = HOST1X_OPCODE_NONINCR(0x01f, 1);
+    *cs++ = controlmain;
+    *cs++ = HOST1X_OPCODE_NONINCR(0x37, 0x1);
+    *cs++ = height << 16 | width; /* srcsize */
 
+    tegra_stream_commit(&tegra->gr2d.cmds, cs);
+
+    if (tegra->scratch.rect_barrier)
+        tegra_stream_sync(&tegra->gr2d.cmds, DRM_TEGRA_SYNCPT_COND_OP_DONE);
+out:
     tegra->scratch.ops++;
 }
 
+/*
+ * Switch source of the prepared copy, this allows to gather multiple pixmaps
+ * into the destination within a single operation. All operations of the job
+ * share the same fence, hence the outgoing source is fenced right away.
+ */
+Bool TegraEXACopySource(PixmapPtr pSrcPixmap, PixmapPtr pDstPixmap)
+{
+    ScrnInfoPtr pScrn = xf86ScreenToScrn(pDstPixmap->drawable.pScreen);
+    TegraEXAPtr tegra = TegraPTR(pScrn)->exa;
+    struct tegra_fence *fence;
+    TegraPixmapPtr priv;
+
+    if (pSrcPixmap == tegra->scratch.pSrc)
+        return TRUE;
+
+    if (pSrcPixmap->drawable.bitsPerPixel != pDstPixmap->drawable.bitsPerPixel)
+        return FALSE;
+
+    TegraEXAThawPixmap(pSrcPixmap, TRUE);
+
+    priv = exaGetPixmapDriverPrivate(pSrcPixmap);
+    if (priv->type <= TEGRA_EXA_PIXMAP_TYPE_FALLBACK)
+        return FALSE;
+
+    fence = tegra_stream_pending_fence(&tegra->gr2d.cmds, tegra->gr2d.gr2d);
+    if (!fence)
+        return FALSE;
+
+    if (priv->fence_write && !priv->fence_write->gr2d)
+        tegra_stream_add_prefence(&tegra->gr2d.cmds, priv->fence_write);
+
+    /* see TegraEXAPrepareCopyExt() */
+    if (priv->fence_write && priv->fence_write->stream == &tegra->gr2d.cmds)
+        tegra_stream_sync(&tegra->gr2d.cmds, DRM_TEGRA_SYNCPT_COND_OP_DONE);
+
+    tegra_stream_prep(&tegra->gr2d.cmds, 3);
+    tegra_stream_push(&tegra->gr2d.cmds, HOST1X_OPCODE_MASK(0x31, 0x5));
+    tegra_stream_push_reloc(&tegra->gr2d.cmds, TegraEXAPixmapBO(pSrcPixmap),
+                            TegraEXAPixmapOffset(pSrcPixmap));
+    tegra_stream_push(&tegra->gr2d.cmds,
+                      exaGetPixmapPitch(pSrcPixmap)); /* srcst */
+
+    priv = exaGetPixmapDriverPrivate(tegra->scratch.pSrc);
+    if (priv->fence_read != fence) {
+        tegra_stream_put_fence(priv->fence_read);
+        priv->fence_read = tegra_stream_ref_fence(fence, &tegra->scratch);
+    }
+
+    TegraEXACoolPixmap(tegra->scratch.pSrc, FALSE);
+
+    tegra->scratch.rect_barrier = (pSrcPixmap == pDstPixmap);
+    tegra->scratch.pSrc = pSrcPixmap;
+    tegra->scratch.srcX = -1;
+    tegra->scratch.srcY = -1;
+
+    return TRUE;
+}
+
 void TegraEXACopy(PixmapPtr pDstPixmap, int srcX, int srcY, int dstX,
                   int dstY, int width, int height)
 {
     ScrnInfoPtr pScrn = xf86ScreenToScrn(pDstPixmap->drawable.pScreen);
     TegraEXAPtr tegra = TegraPTR(pScrn)->exa;
     uint32_t controlmain;
+    uint32_t *cs;
 
     /*
      * [20:20] source color depth (0: mono, 1: same)
@@ -437,15 +521,20 @@ void TegraEXACopy(PixmapPtr pDstPixmap, int srcX, int srcY, int dstX,
         dstY += height - 1;
     }
 
-    tegra_stream_prep(&tegra->cmds, 7);
-    tegra_stream_push(&tegra->cmds, HOST1X_OPCODE_INCR(0x01f, 1));
-    tegra_stream_push(&tegra->cmds, controlmain);
-    tegra_stream_push(&tegra->cmds, HOST1X_OPCODE_INCR(0x37, 0x4));
-    tegra_stream_push(&tegra->cmds, height << 16 | width); /* srcsize */
-    tegra_stream_push(&tegra->cmds, height << 16 | width); /* dstsize */
-    tegra_stream_push(&tegra->cmds, srcY << 16 | srcX); /* srcps */
-    tegra_stream_push(&tegra->cmds, dstY << 16 | dstX); /* dstps */
-    tegra_stream_sync(&tegra->cmds, DRM_TEGRA_SYNCPT_COND_OP_DONE);
+    cs = tegra_stream_reserve(&tegra->gr2d.cmds, 7);
+    if (cs) {
+        *cs++ = HOST1X_OPCODE_INCR(0x01f, 1);
+        *cs++ = controlmain;
+        *cs++ = HOST1X_OPCODE_INCR(0x37, 0x4);
+        *cs++ = height << 16 | width; /* srcsize */
+        *cs++ = height << 16 | width; /* dstsize */
+        *cs++ = srcY << 16 | srcX; /* srcps */
+        *cs++ = dstY << 16 | dstX; /* dstps */
+        tegra_stream_commit(&tegra->gr2d.cmds, cs);
+    }
+
+    if (tegra->scratch.rect_barrier)
+        tegra_stream_sync(&tegra->gr2d.cmds, DRM_TEGRA_SYNCPT_COND_OP_DONE);
 
     tegra->scratch.ops++;
 }
@@ -457,27 +546,27 @@ void TegraEXADoneCopy(PixmapPtr pDstPixmap)
     struct tegra_fence *fence;
     TegraPixmapPtr priv;
 
-    if (tegra->scratch.ops && tegra->cmds.status == TEGRADRM_STREAM_CONSTRUCT) {
+    /* rects that made it into the job before a failure are kept */
+    if (tegra->gr2d.cmds.status != TEGRADRM_STREAM_CONSTRUCT &&
+        TegraEXACancelBatchOp(&tegra->gr2d))
+        tegra->scratch.ops = 0;
+
+    if (tegra->scratch.ops) {
         if (tegra->scratch.pSrc) {
             priv = exaGetPixmapDriverPrivate(tegra->scratch.pSrc);
 
-            if (priv->fence_write && !priv->fence_write->gr2d) {
-                TegraEXAWaitFence(priv->fence_write);
-
-                tegra_stream_put_fence(priv->fence_write);
-                priv->fence_write = NULL;
-            }
+            if (priv->fence_write && !priv->fence_write->gr2d)
+                tegra_stream_add_prefence(&tegra->gr2d.cmds, priv->fence_write);
         }
 
         priv = exaGetPixmapDriverPrivate(pDstPixmap);
         if (priv->fence_write && !priv->fence_write->gr2d)
-            TegraEXAWaitFence(priv->fence_write);
+            tegra_stream_add_prefence(&tegra->gr2d.cmds, priv->fence_write);
 
         if (priv->fence_read && !priv->fence_read->gr2d)
-            TegraEXAWaitFence(priv->fence_read);
+            tegra_stream_add_prefence(&tegra->gr2d.cmds, priv->fence_read);
 
-        tegra_stream_end(&tegra->cmds);
-        fence = tegra_stream_submit(&tegra->cmds, true);
+        fence = TegraEXABatchFence(&tegra->gr2d, tegra->scratch.ops);
 
         if (priv->fence_write != fence) {
             tegra_stream_put_fence(priv->fence_write);
@@ -493,7 +582,7 @@ void TegraEXADoneCopy(PixmapPtr pDstPixmap)
             }
         }
     } else {
-        tegra_stream_cleanup(&tegra->cmds);
+        TegraEXACancelBatchOp(&tegra->gr2d);
     }
 
     TegraEXACoolPixmap(tegra->scratch.pSrc, FALSE);
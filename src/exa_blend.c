@@ -0,0 +1,627 @@
+/*
+ * Copyright (c) Dmitry Osipenko
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "driver.h"
+#include "asm/asm.h"
+
+#define ErrorMsg(fmt, args...)                                              \
+    xf86DrvMsg(-1, X_ERROR, "%s:%d/%s(): " fmt, __FILE__,                   \
+               __LINE__, __func__, ##args)
+
+/*
+ * Composite programs of the Porter-Duff operations are generated on demand
+ * from the blend factors:
+ *
+ *     dst = src * mask * src_factor + dst * dst_factor
+ *
+ * Mask is always per-component here, the fetch of non-CA mask replicates
+ * its alpha. Generated assembly follows the hand-written programs: textures
+ * are fetched and converted first (mask to r4,r5 and src to r6,r7), then dst
+ * is fetched to r2,r3 and the blended result is written out from r0,r1,
+ * killing the pixels that stay unchanged.
+ */
+
+#define TEGRA_BLEND_ASM_SIZE    8192
+
+struct tegra_blend_asm {
+    char txt[TEGRA_BLEND_ASM_SIZE];
+    unsigned len;
+    unsigned exec_nb;       /* emitted EXEC blocks, including the padding */
+    unsigned alu_nb;        /* ALU instructions of the current EXEC */
+    unsigned buffer_size;
+    Bool overflow;
+};
+
+static const char * const blend_lp[4] = {
+    "lp.lh", "lp.lh", "lp.lh", "lp.lh",
+};
+
+static const char * const blend_alu[4] = {
+    "alu0", "alu1", "alu2", "alu3",
+};
+
+static const char * const blend_dst[4] = {
+    "r2.l", "r2.h", "r3.l", "r3.h",
+};
+
+static const char * const blend_out[4] = {
+    "r0.l", "r0.h", "r1.l", "r1.h",
+};
+
+static const char * const blend_zero[4] = {
+    "#0", "#0", "#0", "#0",
+};
+
+static const char * const blend_mask_tex[4] = {
+    "r4.l", "r4.h", "r5.l", "r5.h",
+};
+
+static const char * const blend_mask_solid[4] = {
+    "u2.l", "u2.h", "u3.l", "u3.h",
+};
+
+static const char * const blend_src_tex[4] = {
+    "r6.l", "r6.h", "r7.l", "r7.h",
+};
+
+static const char * const blend_src_solid[4] = {
+    "u0.l", "u0.h", "u1.l", "u1.h",
+};
+
+/* reciprocals of src.a * mask.bgra, used by saturate of solid colors */
+static const char * const blend_saturate_rcp[4] = {
+    "u9", "u10", "u11", "u12",
+};
+
+static const char blend_fetch_mask[] =
+    "EXEC\n"
+    "\tMFU:\tsfu:  rcp r4\n"
+    "\t\tmul0: bar, sfu, bar0\n"
+    "\t\tmul1: bar, sfu, bar1\n"
+    "\t\tipl:  t0.fp20, t0.fp20, NOP, NOP\n"
+    "\tTEX:\ttex r2, r3, tex1, r0, r1, r2\n"
+    "\tALU:\n"
+    "\t\tALU0:\tCSEL lp.lh, -u6.h, r3.h, #1\n"
+    "\t\tALU1:\tCSEL lp.lh, -u7.l, r3.l, r2.l\n"
+    "\t\tALU2:\tCSEL lp.lh, -u7.l, r2.l, r3.l\n"
+    "\tALU:\n"
+    "\t\tALU0:\tCSEL r4.l, -u6.l, alu1, alu0\n"
+    "\t\tALU1:\tCSEL r4.h, -u6.l, r2.h, alu0\n"
+    "\t\tALU2:\tCSEL r5.l, -u6.l, alu2, alu0\n"
+    "\t\tALU3:\tMAD  r5.h, alu0, #1, #0\n"
+    ";\n";
+
+/* mask coordinates are kept in r2,r3, the out of bounds flag goes to r6.l */
+static const char blend_fetch_coords[] =
+    "EXEC\n"
+    "\tMFU:\tsfu:  rcp r4\n"
+    "\t\tmul0: bar, sfu, bar0\n"
+    "\t\tmul1: bar, sfu, bar1\n"
+    "\t\tipl:  t0.fp20, t0.fp20, t0.fp20, t0.fp20\n";
+
+static const char blend_mask_bounds[] =
+    "\tALU:\n"
+    "\t\tALU0:\tMAD  lp.lh, r2, #1, -#1\n"
+    "\t\tALU1:\tMAD  lp.lh, r3, #1, -#1\n"
+    "\tALU:\n"
+    "\t\tALU0:\tCSEL lp.lh,   r2, u7.h, #0 (this)\n"
+    "\t\tALU1:\tCSEL lp.lh, alu0, #0, u7.h (other)\n"
+    "\t\tALU2:\tCSEL lp.lh,   r3, u7.h, #0 (other)\n"
+    "\t\tALU3:\tCSEL lp.lh, alu1, #0, u7.h\n"
+    "\tALU:\n"
+    "\t\tALU0:\tMAD  r6.l, alu0, #1, #0 (sat)\n";
+
+static const char blend_fetch_mask_tex1[] =
+    "EXEC\n"
+    "\tTEX:\ttex r2, r3, tex1, r2, r3, r0\n"
+    "\tALU:\n"
+    "\t\tALU0:\tCSEL lp.lh, -u6.h, r3.h, #1\n"
+    "\t\tALU1:\tCSEL lp.lh, -u7.l, r3.l, r2.l\n"
+    "\t\tALU2:\tCSEL lp.lh, -u7.l, r2.l, r3.l\n"
+    "\tALU:\n";
+
+static const char blend_expand_mask[] =
+    "\t\tALU0:\tCSEL r4.l, -u6.l, alu1, alu0\n"
+    "\t\tALU1:\tCSEL r4.h, -u6.l, r2.h, alu0\n"
+    "\t\tALU2:\tCSEL r5.l, -u6.l, alu2, alu0\n"
+    "\t\tALU3:\tMAD  r5.h, alu0, #1, #0\n"
+    ";\n";
+
+static const char blend_expand_mask_bounded[] =
+    "\t\tALU0:\tCSEL lp.lh, -u6.l, alu1, alu0\n"
+    "\t\tALU1:\tCSEL lp.lh, -u6.l, r2.h, alu0\n"
+    "\t\tALU2:\tCSEL lp.lh, -u6.l, alu2, alu0\n"
+    "\t\tALU3:\tMAD  lp.lh, alu0, #1, #0\n"
+    "\tALU:\n"
+    "\t\tALU0:\tMAD  r4.l, alu0, #1, -r6.l (sat)\n"
+    "\t\tALU1:\tMAD  r4.h, alu1, #1, -r6.l (sat)\n"
+    "\t\tALU2:\tMAD  r5.l, alu2, #1, -r6.l (sat)\n"
+    "\t\tALU3:\tMAD  r5.h, alu3, #1, -r6.l (sat)\n"
+    ";\n";
+
+static const char blend_fetch_src[] =
+    "EXEC\n"
+    "\tMFU:\tsfu:  rcp r4\n"
+    "\t\tmul0: bar, sfu, bar0\n"
+    "\t\tmul1: bar, sfu, bar1\n"
+    "\t\tipl:  t0.fp20, t0.fp20, NOP, NOP\n";
+
+static const char blend_fetch_src_tex0[] =
+    "EXEC\n";
+
+static const char blend_convert_src[] =
+    "\tTEX:\ttex r2, r3, tex0, r0, r1, r2\n"
+    "\tALU:\n"
+    "\t\tALU0:\tCSEL r7.h, -u5.l, r3.h, #1\n"
+    "\t\tALU1:\tMAD  r6.h, r2.h, #1, #0\n"
+    "\t\tALU2:\tCSEL r6.l, -u5.h, r3.l, r2.l\n"
+    "\t\tALU3:\tCSEL r7.l, -u5.h, r2.l, r3.l\n"
+    ";\n";
+
+/* %1$s,%2$s hold the texel to clear, %3$s is the clamp-to-border uniform */
+static const char blend_clamp_to_border[] =
+    "EXEC\n"
+    "\tALU:\n"
+    "\t\tALU0:\tMAD  lp.lh, r0, #1, -#1\n"
+    "\t\tALU1:\tMAD  lp.lh, r1, #1, -#1\n"
+    "\tALU:\n"
+    "\t\tALU0:\tCSEL lp.lh,   r0, %3$s, #0 (this)\n"
+    "\t\tALU1:\tCSEL lp.lh, alu0, #0, %3$s (other)\n"
+    "\t\tALU2:\tCSEL lp.lh,   r1, %3$s, #0 (other)\n"
+    "\t\tALU3:\tCSEL lp.lh, alu1, #0, %3$s\n"
+    "\tALU:\n"
+    "\t\tALU0:\tMAD  %1$s.l, %1$s.l, #1, -alu0 (sat)\n"
+    "\t\tALU1:\tMAD  %1$s.h, %1$s.h, #1, -alu0 (sat)\n"
+    "\t\tALU2:\tMAD  %2$s.l, %2$s.l, #1, -alu0 (sat)\n"
+    "\t\tALU3:\tMAD  %2$s.h, %2$s.h, #1, -alu0 (sat)\n"
+    ";\n";
+
+static const char blend_store[] =
+    "EXEC\n"
+    "\tALU:\n"
+    "\t\tALU0:\tMAD  lp.lh, r0.l, #1, -r2.l\n"
+    "\t\tALU1:\tMAD  lp.lh, r0.h, #1, -r2.h\n"
+    "\t\tALU2:\tMAD  lp.lh, r1.l, #1, -r3.l\n"
+    "\t\tALU3:\tMAD  lp.lh, r1.h, #1, -r3.h\n"
+    "\tALU:\n"
+    "\t\tALU0:\tMAD  lp.lh, abs(alu0), #1, #0 (this)\n"
+    "\t\tALU1:\tMAD  lp.lh, abs(alu1), #1, #0 (other)\n"
+    "\t\tALU2:\tMAD  lp.lh, abs(alu2), #1, #0 (other)\n"
+    "\t\tALU3:\tMAD  lp.lh, abs(alu3), u8.l, #0\n"
+    "\tALU:\n"
+    "\t\tALU0:\tCSEL kill, -alu0, #0, #1\n"
+    "\t\tALU1:\tCSEL r1.h, -u8.l, r1.h, #0\n"
+    "\tDW:\tstore rt1, r0, r1\n"
+    ";\n";
+
+static void TegraBlendVPrintf(struct tegra_blend_asm *a,
+                              const char *fmt, va_list args)
+{
+    int ret;
+
+    if (a->overflow)
+        return;
+
+    ret = vsnprintf(a->txt + a->len, sizeof(a->txt) - a->len, fmt, args);
+
+    if (ret < 0 || ret >= (int)(sizeof(a->txt) - a->len)) {
+        a->overflow = TRUE;
+        return;
+    }
+
+    a->len += ret;
+}
+
+static void TegraBlendPrintf(struct tegra_blend_asm *a, const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    TegraBlendVPrintf(a, fmt, args);
+    va_end(args);
+}
+
+/* complete EXEC block, rows of the ALU buffer are processed by the padding */
+static void TegraBlendExecEnd(struct tegra_blend_asm *a)
+{
+    unsigned i;
+
+    for (i = 1; i < a->buffer_size; i++)
+        TegraBlendPrintf(a, "EXEC\n;\n");
+
+    a->exec_nb += a->buffer_size;
+    a->alu_nb = 0;
+}
+
+/* print the rest of EXEC block and complete it */
+static void TegraBlendExec(struct tegra_blend_asm *a, const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    TegraBlendVPrintf(a, fmt, args);
+    va_end(args);
+
+    TegraBlendExecEnd(a);
+}
+
+/*
+ * ALU results are passed between instructions of the same EXEC only, hence
+ * a dependent chain of instructions is started in a new EXEC if it doesn't
+ * fit into the current one.
+ */
+static void TegraBlendChain(struct tegra_blend_asm *a, unsigned length)
+{
+    if (a->alu_nb + length <= 3)
+        return;
+
+    TegraBlendPrintf(a, ";\n");
+    TegraBlendExecEnd(a);
+    TegraBlendPrintf(a, "EXEC\n");
+}
+
+/* one ALU instruction, the format takes a channel of every operand */
+static void TegraBlendALU(struct tegra_blend_asm *a, const char *fmt,
+                          const char * const *v0, const char * const *v1,
+                          const char * const *v2, const char * const *v3)
+{
+    unsigned c;
+
+    TegraBlendPrintf(a, "\tALU:\n");
+
+    for (c = 0; c < 4; c++) {
+        TegraBlendPrintf(a, "\t\tALU%u:\t", c);
+        TegraBlendPrintf(a, fmt, v0[c], v1[c], v2[c], v3[c]);
+        TegraBlendPrintf(a, "\n");
+    }
+
+    a->alu_nb++;
+}
+
+static void TegraBlendFetch(struct tegra_blend_asm *a,
+                            Bool src_tex, Bool mask_tex, unsigned flags)
+{
+    if (src_tex && mask_tex) {
+        TegraBlendPrintf(a, "%s", blend_fetch_coords);
+
+        if (flags & SHADER_MASK_CLAMP)
+            TegraBlendPrintf(a, "%s", blend_mask_bounds);
+
+        TegraBlendExec(a, ";\n");
+
+        TegraBlendPrintf(a, "%s", blend_fetch_mask_tex1);
+
+        if (flags & SHADER_MASK_CLAMP)
+            TegraBlendExec(a, "%s", blend_expand_mask_bounded);
+        else
+            TegraBlendExec(a, "%s", blend_expand_mask);
+
+        TegraBlendPrintf(a, "%s", blend_fetch_src_tex0);
+        TegraBlendExec(a, "%s", blend_convert_src);
+
+        if (flags & SHADER_SRC_CLAMP)
+            TegraBlendExec(a, blend_clamp_to_border, "r6", "r7", "u8.h");
+    } else if (mask_tex) {
+        TegraBlendExec(a, "%s", blend_fetch_mask);
+
+        if (flags & SHADER_MASK_CLAMP)
+            TegraBlendExec(a, blend_clamp_to_border, "r4", "r5", "u7.h");
+    } else if (src_tex) {
+        TegraBlendPrintf(a, "%s", blend_fetch_src);
+        TegraBlendExec(a, "%s", blend_convert_src);
+
+        if (flags & SHADER_SRC_CLAMP)
+            TegraBlendExec(a, blend_clamp_to_border, "r6", "r7", "u8.h");
+    }
+}
+
+static void TegraBlendEquation(struct tegra_blend_asm *a,
+                               enum Tegra3DBlendFactor src_factor,
+                               enum Tegra3DBlendFactor dst_factor,
+                               const char * const *src,
+                               const char * const *mask)
+{
+    const char *src_alpha[4] = { src[3], src[3], src[3], src[3] };
+    const char * const *dst_term;
+
+    TegraBlendPrintf(a, "EXEC\n");
+
+    /* fetch dst pixel to r2,r3 */
+    TegraBlendPrintf(a, "\tPSEQ:\t0x0081000A\n");
+
+    /* dst.a = dst_fmt_alpha ? dst.a : 1.0 */
+    if (src_factor == TEGRA_BLEND_ALPHA ||
+        src_factor == TEGRA_BLEND_INV_ALPHA ||
+        src_factor == TEGRA_BLEND_SATURATE) {
+        TegraBlendPrintf(a, "\tALU:\n\t\tALU0:\tCSEL r3.h, -u8.l, r3.h, #1\n");
+        a->alu_nb++;
+    }
+
+    switch (dst_factor) {
+    case TEGRA_BLEND_ZERO:
+        dst_term = blend_zero;
+        break;
+
+    case TEGRA_BLEND_ONE:
+        dst_term = blend_dst;
+        break;
+
+    default:
+        TegraBlendChain(a, src_factor == TEGRA_BLEND_ONE ? 3 : 2);
+
+        /* tmp = src.aaaa * mask.bgra or 1 - src.aaaa * mask.bgra */
+        if (dst_factor == TEGRA_BLEND_ALPHA)
+            TegraBlendALU(a, "MAD  lp.lh, %s, %s, #0",
+                          src_alpha, mask, blend_zero, blend_zero);
+        else
+            TegraBlendALU(a, "MAD  lp.lh, -%s, %s, #1",
+                          src_alpha, mask, blend_zero, blend_zero);
+
+        /* the sum with the src term follows in the same EXEC if possible */
+        dst_term = (src_factor == TEGRA_BLEND_ONE) ? blend_alu : blend_out;
+
+        TegraBlendALU(a, "MAD  %s, %s, %s, #0",
+                      src_factor == TEGRA_BLEND_ONE ? blend_lp : blend_out,
+                      blend_alu, blend_dst, blend_zero);
+
+        if (src_factor == TEGRA_BLEND_ZERO)
+            goto done;
+
+        break;
+    }
+
+    switch (src_factor) {
+    case TEGRA_BLEND_ZERO:
+        TegraBlendChain(a, 1);
+        TegraBlendALU(a, "MAD  %s, %s, #1, #0",
+                      blend_out, dst_term, blend_zero, blend_zero);
+        break;
+
+    case TEGRA_BLEND_ONE:
+        TegraBlendChain(a, 1);
+        TegraBlendALU(a, "MAD  %s, %s, %s, %s (sat)",
+                      blend_out, src, mask, dst_term);
+        break;
+
+    case TEGRA_BLEND_ALPHA:
+        TegraBlendChain(a, 2);
+        TegraBlendALU(a, "MAD  lp.lh, %s, %s, #0",
+                      src, mask, blend_zero, blend_zero);
+        TegraBlendALU(a, "MAD  %s, %s, r3.h, %s (sat)",
+                      blend_out, blend_alu, dst_term, blend_zero);
+        break;
+
+    case TEGRA_BLEND_INV_ALPHA:
+        TegraBlendChain(a, 2);
+        TegraBlendALU(a, "MAD  lp.lh, %s, %s, #0",
+                      src, mask, blend_zero, blend_zero);
+        TegraBlendALU(a, "MAD  %s, -%s, r3.h-1, %s (sat)",
+                      blend_out, blend_alu, dst_term, blend_zero);
+        break;
+
+    case TEGRA_BLEND_SATURATE:
+        /* min(1, (1 - dst.a) / (src.a * mask.bgra)) */
+        TegraBlendChain(a, 3);
+        TegraBlendALU(a, "MAD  lp.lh, -r3.h, %s, %s (sat)",
+                      blend_saturate_rcp, blend_saturate_rcp,
+                      blend_zero, blend_zero);
+        TegraBlendALU(a, "MAD  lp.lh, %s, %s, #0",
+                      blend_alu, src, blend_zero, blend_zero);
+        TegraBlendALU(a, "MAD  %s, %s, %s, %s (sat)",
+                      blend_out, blend_alu, mask, dst_term);
+        break;
+    }
+
+done:
+    TegraBlendPrintf(a, ";\n");
+    TegraBlendExecEnd(a);
+}
+
+static struct shader_program *
+TegraBlendAssemble(struct tegra_blend_asm *a,
+                   const struct shader_program *layout)
+{
+    struct fragment_asm_cost cost;
+    struct shader_program *prog;
+    uint32_t *words;
+    unsigned i, n;
+    int err;
+
+    if (a->overflow) {
+        ErrorMsg("program is too long\n");
+        return NULL;
+    }
+
+    fragment_asm_scan_string(a->txt);
+    err = fragment_asmparse();
+    fragment_asmlex_destroy();
+
+    if (err) {
+        ErrorMsg("failed to assemble program:\n%s\n", a->txt);
+        return NULL;
+    }
+
+    fragment_asm_cost(&cost);
+
+    n = asm_fs_instructions_nb;
+
+    prog = calloc(1, sizeof(*prog));
+    words = malloc((n * 6 + asm_mfu_instructions_nb * 2 +
+                    asm_alu_instructions_nb * 8 + 9) * 4);
+
+    if (!prog || !words) {
+        ErrorMsg("failed to allocate program\n");
+        free(words);
+        free(prog);
+        return NULL;
+    }
+
+    /* same layout as produced by gen_shader_bin */
+    prog->fs_prog_words = words;
+
+    *words++ = HOST1X_OPCODE_NONINCR(0x541, n);
+    for (i = 0; i < n; i++)
+        *words++ = asm_pseq_instructions[i].data;
+
+    *words++ = HOST1X_OPCODE_IMM(0x500, 0x0);
+
+    *words++ = HOST1X_OPCODE_NONINCR(0x601, n);
+    for (i = 0; i < n; i++)
+        *words++ = asm_mfu_sched[i].data;
+
+    *words++ = HOST1X_OPCODE_NONINCR(0x604, asm_mfu_instructions_nb * 2);
+    for (i = 0; i < asm_mfu_instructions_nb; i++) {
+        *words++ = asm_mfu_instructions[i].part1;
+        *words++ = asm_mfu_instructions[i].part0;
+    }
+
+    *words++ = HOST1X_OPCODE_NONINCR(0x701, n);
+    for (i = 0; i < n; i++)
+        *words++ = asm_tex_instructions[i].data;
+
+    *words++ = HOST1X_OPCODE_NONINCR(0x801, n);
+    for (i = 0; i < n; i++)
+        *words++ = asm_alu_sched[i].data;
+
+    *words++ = HOST1X_OPCODE_NONINCR(0x804, asm_alu_instructions_nb * 8);
+    for (i = 0; i < asm_alu_instructions_nb; i++) {
+        *words++ = asm_alu_instructions[i].part1;
+        *words++ = asm_alu_instructions[i].part0;
+        *words++ = asm_alu_instructions[i].part3;
+        *words++ = asm_alu_instructions[i].part2;
+        *words++ = asm_alu_instructions[i].part5;
+        *words++ = asm_alu_instructions[i].part4;
+        *words++ = asm_alu_instructions[i].part7;
+        *words++ = asm_alu_instructions[i].part6;
+    }
+
+    *words++ = HOST1X_OPCODE_NONINCR(0x806, n);
+    for (i = 0; i < n; i++)
+        *words++ = asm_alu_instructions[i].complement;
+
+    *words++ = HOST1X_OPCODE_NONINCR(0x901, n);
+    for (i = 0; i < n; i++)
+        *words++ = asm_dw_instructions[i].data;
+
+    prog->fs_prog_words_nb = words - prog->fs_prog_words;
+    prog->fs_alu_buf_size = asm_alu_buffer_size;
+    prog->fs_pseq_to_dw = asm_pseq_to_dw_exec_nb;
+    prog->fs_pseq_inst_nb = n;
+
+    prog->fs_alu_inst_nb = cost.alu_nb;
+    prog->fs_mfu_inst_nb = cost.mfu_nb;
+    prog->fs_tex_inst_nb = cost.tex_nb;
+    prog->fs_regs_nb = cost.regs_nb;
+    prog->fs_cycles = cost.cycles;
+
+    /* vertex program and linker are shared with the programs of layout */
+    prog->vs_prog_words = layout->vs_prog_words;
+    prog->vs_prog_words_nb = layout->vs_prog_words_nb;
+    prog->vs_attrs_in_mask = layout->vs_attrs_in_mask;
+    prog->vs_attrs_out_mask = layout->vs_attrs_out_mask;
+
+    prog->linker_words = layout->linker_words;
+    prog->linker_words_nb = layout->linker_words_nb;
+    prog->linker_inst_nb = layout->linker_inst_nb;
+    prog->used_tram_rows_nb = layout->used_tram_rows_nb;
+
+    return prog;
+}
+
+struct shader_program *
+TegraEXABlendProgram(TegraEXAPtr exa,
+                     const struct shader_program *layout,
+                     enum Tegra3DBlendFactor src_factor,
+                     enum Tegra3DBlendFactor dst_factor,
+                     Bool src_tex, Bool mask_tex, unsigned flags)
+{
+    struct shader_program *prog;
+    struct tegra_blend_asm *a;
+    unsigned key;
+
+    /* saturate factor is precomputed for solid colors only */
+    if (src_factor == TEGRA_BLEND_SATURATE && (src_tex || mask_tex))
+        return NULL;
+
+    if (!src_tex)
+        flags &= ~SHADER_SRC_CLAMP;
+
+    if (!mask_tex)
+        flags &= ~SHADER_MASK_CLAMP;
+
+    key = src_factor;
+    key = key * TEGRA_BLEND_FACTORS_NB + dst_factor;
+    key = key * 2 + !!src_tex;
+    key = key * 2 + !!mask_tex;
+    key = key * 4 + flags;
+
+    if (exa->blend_progs[key])
+        return exa->blend_progs[key];
+
+    a = calloc(1, sizeof(*a));
+    if (!a)
+        return NULL;
+
+    a->buffer_size = (src_tex || mask_tex) ? 2 : 1;
+
+    TegraBlendPrintf(a, ".asm\n");
+
+    TegraBlendFetch(a, src_tex, mask_tex, flags);
+    TegraBlendEquation(a, src_factor, dst_factor,
+                       src_tex ? blend_src_tex : blend_src_solid,
+                       mask_tex ? blend_mask_tex : blend_mask_solid);
+
+    TegraBlendPrintf(a, "%s", blend_store);
+    TegraBlendExecEnd(a);
+
+    TegraBlendPrintf(a, "pseq_to_dw_exec_nb = %u\n",
+                     a->exec_nb - a->buffer_size + 1);
+    TegraBlendPrintf(a, "alu_buffer_size = %u\n", a->buffer_size);
+
+    prog = TegraBlendAssemble(a, layout);
+    free(a);
+
+    exa->blend_progs[key] = prog;
+
+    return prog;
+}
+
+void TegraEXAReleaseBlendPrograms(TegraEXAPtr exa)
+{
+    struct shader_program *prog;
+    unsigned i;
+
+    for (i = 0; i < TEGRA_BLEND_PROGS_NB; i++) {
+        prog = exa->blend_progs[i];
+        if (!prog)
+            continue;
+
+        TegraGR3D_ReleaseInitialization(prog);
+        free(prog->fs_prog_words);
+        free(prog);
+
+        exa->blend_progs[i] = NULL;
+    }
+}
+
+/* vim: set et sts=4 sw=4 ts=4: */
@@ -25,6 +25,8 @@
 #include "exa_mm.h"
 #include "shaders.h"
 
+#include <math.h>
+
 #define BLUE(c)     (((c) & 0xff)         / 255.0f)
 #define GREEN(c)    ((((c) >> 8)  & 0xff) / 255.0f)
 #define RED(c)      ((((c) >> 16) & 0xff) / 255.0f)
@@ -39,11 +41,44 @@
 #define TegraSwapRedBlue(v)                                                 \
     ((v & 0xff00ff00) | (v & 0x00ff0000) >> 16 | (v & 0x000000ff) << 16)
 
-#define TEGRA_ATTRIB_BUFFER_SIZE        0x1000
-
 struct tegra_composit_config {
     /* prog[MASK_TEX_USED][SRC_TEX_USED] */
     struct shader_program *prog[2][2];
+
+    /*
+     * prog_repeat[MASK_TEX_USED], variants that wrap texture coordinates
+     * of NPOT source in the fragment program since GR3D can't repeat it
+     */
+    struct shader_program *prog_repeat[2];
+
+    /*
+     * prog_radial, variant that takes distance to the centre of radial
+     * gradient as the texture coordinate, mask texture is unsupported
+     */
+    struct shader_program *prog_radial;
+
+    /*
+     * Operation that has no hand-written program for the combination of
+     * textures gets program generated by TegraEXABlendProgram()
+     */
+    Bool blend_gen;
+    enum Tegra3DBlendFactor src_factor;
+    enum Tegra3DBlendFactor dst_factor;
+};
+
+/*
+ * Convolution program fetches TEGRA_CONVOLUTION_TAPS texels, advancing
+ * texture coordinates by step from tap to tap and by row_step after every
+ * TEGRA_CONVOLUTION_ROW_TAPS taps. Offsets are in texels.
+ */
+#define TEGRA_CONVOLUTION_TAPS      9
+#define TEGRA_CONVOLUTION_ROW_TAPS  3
+
+struct tegra_convolution {
+    float weights[TEGRA_CONVOLUTION_TAPS];
+    int start_x, start_y;
+    int step_x, step_y;
+    int row_step_x, row_step_y;
 };
 
 static const struct tegra_composit_config composit_cfgs[] = {
@@ -52,20 +87,21 @@ static const struct tegra_composit_config composit_cfgs[] = {
         .prog[0][1] = &prog_blend_over_solid_src,
         .prog[1][0] = &prog_blend_over_solid_mask,
         .prog[0][0] = &prog_blend_over_solid_mask_src,
+        .prog_repeat[1] = &prog_blend_over_repeat,
+        .prog_repeat[0] = &prog_blend_over_solid_mask_repeat,
+        .prog_radial = &prog_blend_over_solid_mask_radial,
     },
 
     [PictOpOverReverse] = {
-        .prog[1][1] = &prog_blend_over_reverse,
-        .prog[0][1] = &prog_blend_over_reverse_solid_src,
-        .prog[1][0] = &prog_blend_over_reverse_solid_mask,
-        .prog[0][0] = &prog_blend_over_reverse_solid_mask_src,
+        .blend_gen = TRUE,
+        .src_factor = TEGRA_BLEND_INV_ALPHA,
+        .dst_factor = TEGRA_BLEND_ONE,
     },
 
     [PictOpAdd] = {
-        .prog[1][1] = &prog_blend_add,
-        .prog[0][1] = &prog_blend_add_solid_src,
-        .prog[1][0] = &prog_blend_add_solid_mask,
-        .prog[0][0] = &prog_blend_add_solid_mask_src,
+        .blend_gen = TRUE,
+        .src_factor = TEGRA_BLEND_ONE,
+        .dst_factor = TEGRA_BLEND_ONE,
     },
 
     [PictOpSrc] = {
@@ -73,6 +109,9 @@ static const struct tegra_composit_config composit_cfgs[] = {
         .prog[0][1] = &prog_blend_src_solid_src,
         .prog[1][0] = &prog_blend_src_solid_mask,
         .prog[0][0] = &prog_blend_src_solid_mask_src,
+        .prog_repeat[1] = &prog_blend_src_repeat,
+        .prog_repeat[0] = &prog_blend_src_solid_mask_repeat,
+        .prog_radial = &prog_blend_src_solid_mask_radial,
     },
 
     [PictOpClear] = {
@@ -83,74 +122,144 @@ static const struct tegra_composit_config composit_cfgs[] = {
     },
 
     [PictOpIn] = {
-        .prog[1][1] = &prog_blend_in,
-        .prog[0][1] = &prog_blend_in_solid_src,
-        .prog[1][0] = &prog_blend_in_solid_mask,
-        .prog[0][0] = &prog_blend_in_solid_mask_src,
+        .blend_gen = TRUE,
+        .src_factor = TEGRA_BLEND_ALPHA,
+        .dst_factor = TEGRA_BLEND_ZERO,
     },
 
     [PictOpInReverse] = {
-        .prog[1][1] = &prog_blend_in_reverse,
-        .prog[0][1] = &prog_blend_in_reverse_solid_src,
-        .prog[1][0] = &prog_blend_in_reverse_solid_mask,
-        .prog[0][0] = &prog_blend_in_reverse_solid_mask_src,
+        .blend_gen = TRUE,
+        .src_factor = TEGRA_BLEND_ZERO,
+        .dst_factor = TEGRA_BLEND_ALPHA,
     },
 
     [PictOpOut] = {
-        .prog[1][1] = &prog_blend_out,
-        .prog[0][1] = &prog_blend_out_solid_src,
-        .prog[1][0] = &prog_blend_out_solid_mask,
-        .prog[0][0] = &prog_blend_out_solid_mask_src,
+        .blend_gen = TRUE,
+        .src_factor = TEGRA_BLEND_INV_ALPHA,
+        .dst_factor = TEGRA_BLEND_ZERO,
     },
 
     [PictOpOutReverse] = {
-        .prog[1][1] = &prog_blend_out_reverse,
-        .prog[0][1] = &prog_blend_out_reverse_solid_src,
-        .prog[1][0] = &prog_blend_out_reverse_solid_mask,
-        .prog[0][0] = &prog_blend_out_reverse_solid_mask_src,
+        .blend_gen = TRUE,
+        .src_factor = TEGRA_BLEND_ZERO,
+        .dst_factor = TEGRA_BLEND_INV_ALPHA,
     },
 
     [PictOpDst] = {
-        .prog[1][0] = &prog_blend_dst,
-        .prog[0][0] = &prog_blend_dst_solid_mask,
+        .blend_gen = TRUE,
+        .src_factor = TEGRA_BLEND_ZERO,
+        .dst_factor = TEGRA_BLEND_ONE,
     },
 
     [PictOpAtop] = {
-        .prog[1][1] = &prog_blend_atop,
-        .prog[0][1] = &prog_blend_atop_solid_src,
-        .prog[1][0] = &prog_blend_atop_solid_mask,
-        .prog[0][0] = &prog_blend_atop_solid_mask_src,
+        .blend_gen = TRUE,
+        .src_factor = TEGRA_BLEND_ALPHA,
+        .dst_factor = TEGRA_BLEND_INV_ALPHA,
     },
 
     [PictOpAtopReverse] = {
-        .prog[1][1] = &prog_blend_atop_reverse,
-        .prog[0][1] = &prog_blend_atop_reverse_solid_src,
-        .prog[1][0] = &prog_blend_atop_reverse_solid_mask,
-        .prog[0][0] = &prog_blend_atop_reverse_solid_mask_src,
+        .blend_gen = TRUE,
+        .src_factor = TEGRA_BLEND_INV_ALPHA,
+        .dst_factor = TEGRA_BLEND_ALPHA,
     },
 
     [PictOpXor] = {
-        .prog[1][1] = &prog_blend_xor,
-        .prog[0][1] = &prog_blend_xor_solid_src,
-        .prog[1][0] = &prog_blend_xor_solid_mask,
-        .prog[0][0] = &prog_blend_xor_solid_mask_src,
+        .blend_gen = TRUE,
+        .src_factor = TEGRA_BLEND_INV_ALPHA,
+        .dst_factor = TEGRA_BLEND_INV_ALPHA,
     },
 
     [PictOpSaturate] = {
         .prog[1][1] = &prog_blend_saturate,
         .prog[0][1] = &prog_blend_saturate_solid_src,
         .prog[1][0] = &prog_blend_saturate_solid_mask,
+        .blend_gen = TRUE,
+        .src_factor = TEGRA_BLEND_SATURATE,
+        .dst_factor = TEGRA_BLEND_ONE,
     },
 };
 
-static int TegraCompositeAllocateAttribBuffer(struct drm_tegra *drm,
-                                              TegraEXAPtr tegra)
+static Bool TegraCompositeAttribBufferInRing(TegraEXAScratchPtr scratch)
 {
-    struct tegra_attrib_bo *old = tegra->scratch.attribs;
-    struct tegra_attrib_bo *new;
+    TegraEXAAttribRing *ring = &scratch->attribs_ring;
+
+    return (scratch->attribs >= ring->slots &&
+            scratch->attribs < ring->slots + TEGRA_ATTRIB_RING_SLOTS);
+}
+
+static int TegraCompositeAllocateAttribRing(struct drm_tegra *drm,
+                                            TegraEXAAttribRing *ring)
+{
+    TegraEXAAttribBo *slot;
+    uint16_t *indices;
+    uint8_t *map;
+    unsigned i;
     int err;
 
-    tegra->scratch.attribs_alloc_err = TRUE;
+    err = drm_tegra_bo_new(&ring->bo, drm, 0,
+                           TEGRA_ATTRIB_INDEX_OFFSET + TEGRA_ATTRIB_INDEX_SIZE);
+    if (err) {
+        ring->bo = NULL;
+        return err;
+    }
+
+    err = drm_tegra_bo_map(ring->bo, (void**)&map);
+    if (err) {
+        drm_tegra_bo_unref(ring->bo);
+        ring->bo = NULL;
+        return err;
+    }
+
+    for (i = 0; i < TEGRA_ATTRIB_RING_SLOTS; i++) {
+        slot = &ring->slots[i];
+        slot->bo = ring->bo;
+        slot->offset = i * TEGRA_ATTRIB_BUFFER_SIZE;
+        slot->map = (int16_t *)(map + slot->offset);
+    }
+
+    /* quad vertices are: left-bottom, left-top, right-top, right-bottom */
+    indices = (uint16_t *)(map + TEGRA_ATTRIB_INDEX_OFFSET);
+
+    for (i = 0; i < TEGRA_ATTRIB_QUADS_MAX; i++) {
+        *indices++ = i * 4 + 0;
+        *indices++ = i * 4 + 1;
+        *indices++ = i * 4 + 2;
+
+        *indices++ = i * 4 + 2;
+        *indices++ = i * 4 + 3;
+        *indices++ = i * 4 + 0;
+    }
+
+    ring->slot = TEGRA_ATTRIB_RING_SLOTS - 1;
+
+    return 0;
+}
+
+void TegraCompositeReleaseAttribRing(TegraEXAScratchPtr scratch)
+{
+    TegraEXAAttribRing *ring = &scratch->attribs_ring;
+    unsigned i;
+
+    if (TegraCompositeAttribBufferInRing(scratch)) {
+        scratch->attribs = NULL;
+        scratch->attrib_itr = 0;
+    }
+
+    for (i = 0; i < TEGRA_ATTRIB_RING_SLOTS; i++) {
+        tegra_stream_put_fence(ring->slots[i].fence);
+        ring->slots[i].fence = NULL;
+    }
+
+    drm_tegra_bo_unref(ring->bo);
+    ring->bo = NULL;
+}
+
+static int TegraCompositeAllocateAttribOverflow(struct drm_tegra *drm,
+                                                TegraEXAPtr tegra)
+{
+    struct tegra_attrib_bo *old = tegra->scratch.attribs_overflow;
+    struct tegra_attrib_bo *new;
+    int err;
 
     new = calloc(1, sizeof(*new));
     if (!new)
@@ -170,6 +279,7 @@ static int TegraCompositeAllocateAttribBuffer(struct drm_tegra *drm,
     }
 
     tegra->scratch.attribs_alloc_err = FALSE;
+    tegra->scratch.attribs_overflow = new;
     tegra->scratch.attrib_itr = 0;
     tegra->scratch.attribs = new;
     new->next = old;
@@ -177,12 +287,90 @@ static int TegraCompositeAllocateAttribBuffer(struct drm_tegra *drm,
     return 0;
 }
 
+/*
+ * Attributes are written to the slots of a persistently mapped ring, slot
+ * is recycled once the job that used it lastly is completed. If ring is
+ * exhausted by the job under construction and the job can't be flushed,
+ * i.e. in the middle of operation, a standalone buffer is allocated. These
+ * are released by TegraEXAWaitFence().
+ */
+static int TegraCompositeAllocateAttribBuffer(struct drm_tegra *drm,
+                                              TegraEXAPtr tegra,
+                                              Bool can_flush)
+{
+    TegraEXAAttribRing *ring = &tegra->scratch.attribs_ring;
+    TegraEXAAttribBo *slot;
+    unsigned next;
+    int err;
+
+    tegra->scratch.attribs_alloc_err = TRUE;
+
+    if (!ring->bo) {
+        err = TegraCompositeAllocateAttribRing(drm, ring);
+        if (err)
+            return err;
+    }
+
+    next = (ring->slot + 1) % TEGRA_ATTRIB_RING_SLOTS;
+    slot = &ring->slots[next];
+
+    /* fence of the slot isn't known yet if it is taken by this operation */
+    if (ring->op_slots == TEGRA_ATTRIB_RING_SLOTS)
+        return TegraCompositeAllocateAttribOverflow(drm, tegra);
+
+    if (slot->fence && slot->fence->stream == &tegra->gr3d.cmds) {
+        if (!can_flush)
+            return TegraCompositeAllocateAttribOverflow(drm, tegra);
+
+        TegraEXAFlushBatch(&tegra->gr3d);
+    }
+
+    if (slot->fence) {
+        tegra_stream_wait_fence(slot->fence);
+        tegra_stream_put_fence(slot->fence);
+        slot->fence = NULL;
+    }
+
+    ring->slot = next;
+    ring->op_slots++;
+
+    tegra->scratch.attribs_alloc_err = FALSE;
+    tegra->scratch.attrib_itr = 0;
+    tegra->scratch.attribs = slot;
+
+    return 0;
+}
+
+static void TegraCompositeFenceAttribRing(TegraEXAScratchPtr scratch,
+                                          struct tegra_fence *fence)
+{
+    TegraEXAAttribRing *ring = &scratch->attribs_ring;
+    TegraEXAAttribBo *slot;
+    unsigned idx = ring->slot;
+
+    for (; ring->op_slots; ring->op_slots--) {
+        slot = &ring->slots[idx];
+
+        if (slot->fence != fence) {
+            tegra_stream_put_fence(slot->fence);
+            slot->fence = tegra_stream_ref_fence(fence, scratch);
+        }
+
+        idx = (idx + TEGRA_ATTRIB_RING_SLOTS - 1) % TEGRA_ATTRIB_RING_SLOTS;
+    }
+}
+
 void TegraCompositeReleaseAttribBuffers(TegraEXAScratchPtr scratch)
 {
-    if (scratch->attribs) {
-        struct tegra_attrib_bo *attribs_bo = scratch->attribs;
+    if (scratch->attribs_overflow) {
+        struct tegra_attrib_bo *attribs_bo = scratch->attribs_overflow;
         struct tegra_attrib_bo *next;
 
+        if (!TegraCompositeAttribBufferInRing(scratch)) {
+            scratch->attribs = NULL;
+            scratch->attrib_itr = 0;
+        }
+
         while (attribs_bo) {
             next = attribs_bo->next;
             drm_tegra_bo_unref(attribs_bo->bo);
@@ -190,24 +378,220 @@ void TegraCompositeReleaseAttribBuffers(TegraEXAScratchPtr scratch)
             attribs_bo = next;
         }
 
-        scratch->attribs = NULL;
-        scratch->attrib_itr = 0;
+        scratch->attribs_overflow = NULL;
     }
 }
 
-static const struct shader_program * TegraCompositeProgram3D(
+static Bool TegraCompositeIsGradient(PicturePtr pic)
+{
+    return pic && !pic->pDrawable &&
+           pic->pSourcePict->type != SourcePictTypeSolidFill;
+}
+
+static Bool TegraCompositeRepeatEmulated(PicturePtr pic)
+{
+    if (!pic->repeat || pic->repeatType != RepeatNormal)
+        return FALSE;
+
+    /* gradient ramp is POT */
+    if (!pic->pDrawable)
+        return FALSE;
+
+    return !IS_POW2(pic->pDrawable->width) ||
+           !IS_POW2(pic->pDrawable->height);
+}
+
+/*
+ * Dimensions of the convolution kernel, params are checked to hold all of
+ * its elements. Kernel center is offset by half of the texel for even
+ * dimensions, these aren't supported.
+ */
+static Bool TegraCompositeKernelSize(PicturePtr pic, int *kw, int *kh)
+{
+    xFixed *params = pic->filter_params;
+
+    if (pic->filter != PictFilterConvolution || pic->filter_nparams < 2)
+        return FALSE;
+
+    *kw = pixman_fixed_to_int(params[0]);
+    *kh = pixman_fixed_to_int(params[1]);
+
+    if (*kw < 1 || *kh < 1 || !(*kw & 1) || !(*kh & 1))
+        return FALSE;
+
+    return pic->filter_nparams >= 2 + *kw * *kh;
+}
+
+/*
+ * Lays kernel of the convolution filter out into taps of the convolution
+ * program. Kernel up to 3x3 is fetched as a grid, kernel that is a single
+ * row or column of up to 9 elements as a line.
+ */
+static Bool TegraCompositeConvolution(PicturePtr pic,
+                                      struct tegra_convolution *conv)
+{
+    xFixed *params = pic->filter_params;
+    int kw, kh, ox, oy, stride;
+    int x, y;
+
+    if (!TegraCompositeKernelSize(pic, &kw, &kh))
+        return FALSE;
+
+    memset(conv, 0, sizeof(*conv));
+
+    if (kw <= TEGRA_CONVOLUTION_ROW_TAPS && kh <= TEGRA_CONVOLUTION_ROW_TAPS) {
+        conv->start_x = -1;
+        conv->start_y = -1;
+        conv->step_x = 1;
+        conv->row_step_x = 1 - TEGRA_CONVOLUTION_ROW_TAPS;
+        conv->row_step_y = 1;
+        stride = TEGRA_CONVOLUTION_ROW_TAPS;
+        ox = (TEGRA_CONVOLUTION_ROW_TAPS - kw) / 2;
+        oy = (TEGRA_CONVOLUTION_ROW_TAPS - kh) / 2;
+    } else if (kh == 1 && kw <= TEGRA_CONVOLUTION_TAPS) {
+        conv->start_x = -TEGRA_CONVOLUTION_TAPS / 2;
+        conv->step_x = 1;
+        conv->row_step_x = 1;
+        stride = 0;
+        ox = (TEGRA_CONVOLUTION_TAPS - kw) / 2;
+        oy = 0;
+    } else if (kw == 1 && kh <= TEGRA_CONVOLUTION_TAPS) {
+        conv->start_y = -TEGRA_CONVOLUTION_TAPS / 2;
+        conv->step_y = 1;
+        conv->row_step_y = 1;
+        stride = 1;
+        ox = 0;
+        oy = (TEGRA_CONVOLUTION_TAPS - kh) / 2;
+    } else {
+        return FALSE;
+    }
+
+    for (y = 0; y < kh; y++) {
+        for (x = 0; x < kw; x++)
+            conv->weights[(y + oy) * stride + x + ox] =
+                        pixman_fixed_to_double(params[2 + y * kw + x]);
+    }
+
+    return TRUE;
+}
+
+static struct shader_program * TegraCompositeProgram3D(
                 int op, PicturePtr pSrcPicture, PicturePtr pMaskPicture)
 {
     const struct tegra_composit_config *cfg = &composit_cfgs[op];
     Bool mask_tex = (pMaskPicture && pMaskPicture->pDrawable);
     Bool src_tex = (pSrcPicture && pSrcPicture->pDrawable);
 
+    /*
+     * Disjoint, conjoint and blend mode operations need factors that
+     * depend on both alphas or on the color components, they aren't
+     * supported and fall back to software.
+     */
     if (op > PictOpSaturate)
         return NULL;
 
+    /* linear gradient ramp is sampled like a regular texture */
+    if (TegraCompositeIsGradient(pSrcPicture)) {
+        if (pSrcPicture->pSourcePict->type != SourcePictTypeRadial)
+            return cfg->prog[1][mask_tex];
+
+        return mask_tex ? NULL : cfg->prog_radial;
+    }
+
+    /* convolution result is composited by a separate draw */
+    if (src_tex && pSrcPicture->filter == PictFilterConvolution) {
+        if (op != PictOpSrc || pMaskPicture)
+            return NULL;
+
+        return &prog_blend_src_convolve;
+    }
+
+    if (src_tex && TegraCompositeRepeatEmulated(pSrcPicture))
+        return cfg->prog_repeat[mask_tex];
+
     return cfg->prog[src_tex][mask_tex];
 }
 
+/*
+ * Whether program for the operation could be generated, generator knows
+ * only the plain texture fetch and saturate factor is precomputed on CPU
+ * for solid colors.
+ */
+static Bool TegraCompositeBlendGenerated(int op, PicturePtr pSrcPicture,
+                                         PicturePtr pMaskPicture)
+{
+    const struct tegra_composit_config *cfg = &composit_cfgs[op];
+    Bool mask_tex = (pMaskPicture && pMaskPicture->pDrawable);
+    Bool src_tex = (pSrcPicture && pSrcPicture->pDrawable);
+
+    if (op > PictOpSaturate || !cfg->blend_gen)
+        return FALSE;
+
+    if (TegraCompositeIsGradient(pSrcPicture)) {
+        if (pSrcPicture->pSourcePict->type == SourcePictTypeRadial)
+            return FALSE;
+
+        src_tex = TRUE;
+    }
+
+    if (pSrcPicture && pSrcPicture->pDrawable) {
+        if (pSrcPicture->filter == PictFilterConvolution)
+            return FALSE;
+
+        if (TegraCompositeRepeatEmulated(pSrcPicture))
+            return FALSE;
+    }
+
+    if (cfg->src_factor == TEGRA_BLEND_SATURATE && (src_tex || mask_tex))
+        return FALSE;
+
+    return TRUE;
+}
+
+static struct shader_program * TegraCompositeProgramVariant(
+                struct shader_program *prog, Bool clamp_src, Bool clamp_mask)
+{
+    struct shader_program *best = prog;
+    unsigned flags = 0;
+    unsigned i;
+
+    if (clamp_src)
+        flags |= SHADER_SRC_CLAMP;
+
+    if (clamp_mask)
+        flags |= SHADER_MASK_CLAMP;
+
+    /* pick the cheapest of the matching programs */
+    for (i = 0; i < prog->variants_nb; i++) {
+        if ((flags & prog->variants[i].flags_mask) != prog->variants[i].flags)
+            continue;
+
+        if (prog->variants[i].prog->fs_cycles < best->fs_cycles)
+            best = prog->variants[i].prog;
+    }
+
+    return best;
+}
+
+/*
+ * Generated saturate program takes reciprocals of the src.a * mask for
+ * the b, g, r, a channels, the src * mask contribution is zero where the
+ * reciprocal is undefined.
+ */
+static void TegraCompositeSetupSaturate(struct tegra_stream *cmds,
+                                        struct tegra_gr3d_state *state,
+                                        Pixel src, Pixel mask)
+{
+    float m[4] = { BLUE(mask), GREEN(mask), RED(mask), ALPHA(mask) };
+    float sa = ALPHA(src);
+    unsigned i;
+
+    for (i = 0; i < 4; i++)
+        TegraGR3D_UploadConstFP(cmds, state, 9 + i,
+                                FP20(sa * m[i] > 0.0f ? 1.0f / (sa * m[i])
+                                                      : 0.0f));
+}
+
 static unsigned TegraCompositeFormatToGR3D(unsigned format)
 {
     switch (format) {
@@ -268,7 +652,8 @@ static Bool TegraCompositeFormatSwapRedBlue2D(unsigned format)
     }
 }
 
-static Bool TegraCompositeCheckTexture(PicturePtr pic, PixmapPtr pix)
+static Bool TegraCompositeCheckTexture(PicturePtr pic, PixmapPtr pix,
+                                       Bool repeat_emulated)
 {
     unsigned width, height;
 
@@ -276,22 +661,25 @@ static Bool TegraCompositeCheckTexture(PicturePtr pic, PixmapPtr pix)
         width = pic->pDrawable->width;
         height = pic->pDrawable->height;
 
-        if (width > 2048 || height > 2048)
+        if (width > TEGRA_TEXTURE_SIZE_MAX || height > TEGRA_TEXTURE_SIZE_MAX)
             return FALSE;
 
         if (!IS_POW2(width) || !IS_POW2(height)) {
             if (pic->filter == PictFilterBilinear)
                 return FALSE;
 
-            if (pic->repeat && (pic->repeatType == RepeatReflect ||
-                                pic->repeatType == RepeatNormal))
+            if (pic->repeat && pic->repeatType == RepeatReflect)
+                return FALSE;
+
+            if (pic->repeat && pic->repeatType == RepeatNormal &&
+                !repeat_emulated)
                 return FALSE;
         }
     } else if (pix) {
         width = pix->drawable.width;
         height = pix->drawable.height;
 
-        if (width > 2048 || height > 2048)
+        if (width > TEGRA_TEXTURE_SIZE_MAX || height > TEGRA_TEXTURE_SIZE_MAX)
             return FALSE;
     }
 
@@ -299,6 +687,7 @@ static Bool TegraCompositeCheckTexture(PicturePtr pic, PixmapPtr pix)
 }
 
 static void TegraCompositeSetupTexture(struct tegra_stream *cmds,
+                                       struct tegra_gr3d_state *state,
                                        unsigned index,
                                        PicturePtr pic,
                                        PixmapPtr pix)
@@ -307,15 +696,17 @@ static void TegraCompositeSetupTexture(struct tegra_stream *cmds,
     Bool wrap_clamp_to_edge = TRUE;
     Bool bilinear = FALSE;
 
-    if (pic->repeat) {
+    /* emulated repeat wraps coordinates into the texture already */
+    if (pic->repeat && !TegraCompositeRepeatEmulated(pic)) {
         wrap_mirrored_repeat = (pic->repeatType == RepeatReflect);
         wrap_clamp_to_edge = (pic->repeatType == RepeatPad);
     }
 
-    if (pic->filter == PictFilterBilinear)
+    /* gradient ramp is always interpolated */
+    if (pic->filter == PictFilterBilinear || !pic->pDrawable)
         bilinear = TRUE;
 
-    TegraGR3D_SetupTextureDesc(cmds, index,
+    TegraGR3D_SetupTextureDesc(cmds, state, index,
                                TegraEXAPixmapBO(pix),
                                TegraEXAPixmapOffset(pix),
                                pix->drawable.width,
@@ -326,22 +717,100 @@ static void TegraCompositeSetupTexture(struct tegra_stream *cmds,
                                wrap_mirrored_repeat);
 }
 
+static Bool TegraCompositeTransformIsAffine(PictTransformPtr t)
+{
+    return t->matrix[2][0] == 0 &&
+           t->matrix[2][1] == 0 &&
+           t->matrix[2][2] == pixman_fixed_1;
+}
+
+static void TegraCompositeTextureMatrix(PictTransformPtr t, PixmapPtr pix,
+                                        float m[2][3])
+{
+    float sx = 1.0f / pix->drawable.width;
+    float sy = 1.0f / pix->drawable.height;
+    unsigned i;
+
+    if (!t) {
+        m[0][0] = sx;   m[0][1] = 0.0f; m[0][2] = 0.0f;
+        m[1][0] = 0.0f; m[1][1] = sy;   m[1][2] = 0.0f;
+        return;
+    }
+
+    for (i = 0; i < 3; i++) {
+        m[0][i] = pixman_fixed_to_double(t->matrix[0][i]) * sx;
+        m[1][i] = pixman_fixed_to_double(t->matrix[1][i]) * sy;
+    }
+}
+
+static void TegraCompositeSetupTransform(struct tegra_stream *cmds,
+                                         struct tegra_gr3d_state *state,
+                                         float m[2][3])
+{
+    /*
+     * Vertex program maps pixel coordinates of the source into normalized
+     * texture coordinates, picture transform is folded into that mapping.
+     */
+    TegraGR3D_UploadConstVP(cmds, state, 1, m[0][0], m[0][1], 0.0f, m[0][2]);
+    TegraGR3D_UploadConstVP(cmds, state, 2, m[1][0], m[1][1], 0.0f, m[1][2]);
+}
+
+static void TegraCompositeSetupScale(struct tegra_stream *cmds,
+                                     struct tegra_gr3d_state *state,
+                                     unsigned index, PixmapPtr pix,
+                                     float scale, float bias)
+{
+    /*
+     * Vertex program maps pixel coordinates of the destination and mask
+     * by the per-draw scale and bias.
+     */
+    TegraGR3D_UploadConstVP(cmds, state, index,
+                            scale / pix->drawable.width,
+                            scale / pix->drawable.height,
+                            bias, bias);
+}
+
+static void TegraCompositeSetupConvolution(struct tegra_stream *cmds,
+                                           struct tegra_gr3d_state *state,
+                                           struct tegra_convolution *conv,
+                                           PixmapPtr pix,
+                                           float m[2][3])
+{
+    float sx = 1.0f / pix->drawable.width;
+    float sy = 1.0f / pix->drawable.height;
+    unsigned i;
+
+    /* vertex program produces coordinates of the first tap */
+    m[0][2] += conv->start_x * sx;
+    m[1][2] += conv->start_y * sy;
+
+    TegraGR3D_UploadConstFP(cmds, state, 9, FP20(conv->step_x * sx));
+    TegraGR3D_UploadConstFP(cmds, state, 10, FP20(conv->step_y * sy));
+
+    for (i = 0; i < TEGRA_CONVOLUTION_TAPS; i++)
+        TegraGR3D_UploadConstFP(cmds, state, 11 + i, FP20(conv->weights[i]));
+
+    TegraGR3D_UploadConstFP(cmds, state, 20, FP20(conv->row_step_x * sx));
+    TegraGR3D_UploadConstFP(cmds, state, 21, FP20(conv->row_step_y * sy));
+}
+
 static void TegraCompositeSetupAttributes(TegraEXAPtr tegra)
 {
     struct tegra_exa_scratch *scratch = &tegra->scratch;
-    struct tegra_stream *cmds = &tegra->cmds;
+    struct tegra_stream *cmds = &tegra->gr3d.cmds;
     unsigned attrs_num = 1 + !!scratch->pSrc + !!scratch->pMask;
-    unsigned attribs_offset = scratch->attrib_itr * 2;
+    unsigned attribs_offset = scratch->attribs->offset +
+                              scratch->attrib_itr * 2;
 
     TegraGR3D_SetupAttribute(cmds, 0, scratch->attribs->bo,
-                             attribs_offset, TGR3D_ATTRIB_TYPE_FLOAT16,
+                             attribs_offset, TGR3D_ATTRIB_TYPE_SSHORT,
                              2, 4 * attrs_num);
 
     if (scratch->pSrc) {
         attribs_offset += 4;
 
         TegraGR3D_SetupAttribute(cmds, 1, scratch->attribs->bo,
-                                 attribs_offset, TGR3D_ATTRIB_TYPE_FLOAT16,
+                                 attribs_offset, TGR3D_ATTRIB_TYPE_SSHORT,
                                  2, 4 * attrs_num);
     }
 
@@ -349,27 +818,96 @@ static void TegraCompositeSetupAttributes(TegraEXAPtr tegra)
         attribs_offset += 4;
 
         TegraGR3D_SetupAttribute(cmds, 2, scratch->attribs->bo,
-                                 attribs_offset, TGR3D_ATTRIB_TYPE_FLOAT16,
+                                 attribs_offset, TGR3D_ATTRIB_TYPE_SSHORT,
                                  2, 4 * attrs_num);
     }
 }
 
+static Bool TegraCompositePixmapsOverlap(PixmapPtr pix1, PixmapPtr pix2)
+{
+    unsigned long start1, start2, end1, end2;
+
+    if (TegraEXAPixmapBO(pix1) != TegraEXAPixmapBO(pix2))
+        return FALSE;
+
+    start1 = TegraEXAPixmapOffset(pix1);
+    start2 = TegraEXAPixmapOffset(pix2);
+    end1 = start1 + exaGetPixmapPitch(pix1) * pix1->drawable.height;
+    end2 = start2 + exaGetPixmapPitch(pix2) * pix2->drawable.height;
+
+    return (start1 < end2 && start2 < end1);
+}
+
+/*
+ * GR3D state programmed by the previous composite of the current job can
+ * be reused. Caches are invalidated by the initialization sequence, so the
+ * state is programmed from scratch when render target changes or when it
+ * is sampled from. Hence whatever GR3D rendered earlier in the job is
+ * fetched anew, writes of GR2D are handled by TegraCompositeTextureWritten.
+ */
+static Bool TegraCompositeStateReusable(TegraEXAPtr tegra, PixmapPtr pDst)
+{
+    struct tegra_gr3d_state *state = &tegra->gr3d_state;
+    PixmapPtr pMask = tegra->scratch.pMask;
+    PixmapPtr pSrc = tegra->scratch.pSrc;
+
+    if (tegra->gr3d_state_batch != tegra->gr3d.batch_id)
+        return FALSE;
+
+    if (state->rt[1].bo != TegraEXAPixmapBO(pDst) ||
+        state->rt[1].offset != TegraEXAPixmapOffset(pDst))
+        return FALSE;
+
+    if (pSrc && TegraCompositePixmapsOverlap(pSrc, pDst))
+        return FALSE;
+
+    if (pMask && TegraCompositePixmapsOverlap(pMask, pDst))
+        return FALSE;
+
+    return TRUE;
+}
+
+/*
+ * Whether texture was written by GR2D after GR3D caches were invalidated
+ * the last time. Fence of the GR2D job under construction gets its seqno
+ * once the job is submitted.
+ */
+static Bool TegraCompositeTextureWritten(TegraEXAPtr tegra, PixmapPtr pix)
+{
+    struct tegra_fence *f;
+    TegraPixmapPtr priv;
+
+    if (!pix)
+        return FALSE;
+
+    priv = exaGetPixmapDriverPrivate(pix);
+    f = priv->fence_write;
+
+    if (!f || !f->gr2d)
+        return FALSE;
+
+    return (f->stream && !f->seqno) || f->seqno > tegra->gr3d_caches_seqno;
+}
+
 static Bool TegraCompositeAttribBufferIsFull(TegraEXAScratchPtr scratch)
 {
     unsigned attrs_num = 1 + !!scratch->pSrc + !!scratch->pMask;
 
-    return (scratch->attrib_itr * 2 + attrs_num * 24 > TEGRA_ATTRIB_BUFFER_SIZE);
+    return (scratch->attrib_itr * 2 + attrs_num * 16 > TEGRA_ATTRIB_BUFFER_SIZE);
 }
 
 static void TegraEXACompositeDraw(TegraEXAPtr tegra)
 {
     struct tegra_exa_scratch *scratch = &tegra->scratch;
-    struct tegra_stream *cmds = &tegra->cmds;
+    struct tegra_stream *cmds = &tegra->gr3d.cmds;
 
     if (scratch->vtx_cnt) {
+        TegraGR3D_SetupIndexBuffer(cmds, &tegra->gr3d_state,
+                                   scratch->attribs_ring.bo,
+                                   TEGRA_ATTRIB_INDEX_OFFSET);
         TegraGR3D_SetupDrawParams(cmds, TGR3D_PRIMITIVE_TYPE_TRIANGLES,
-                                  TGR3D_INDEX_MODE_NONE, 0);
-        TegraGR3D_DrawPrimitives(cmds, 0, scratch->vtx_cnt);
+                                  TGR3D_INDEX_MODE_UINT16, 0);
+        TegraGR3D_DrawPrimitives(cmds, 0, scratch->vtx_cnt / 4 * 6);
 
         scratch->vtx_cnt = 0;
         scratch->ops++;
@@ -379,7 +917,7 @@ static void TegraEXACompositeDraw(TegraEXAPtr tegra)
 static void TegraCompositeFlush(struct drm_tegra *drm, TegraEXAPtr tegra)
 {
     TegraEXACompositeDraw(tegra);
-    TegraCompositeAllocateAttribBuffer(drm, tegra);
+    TegraCompositeAllocateAttribBuffer(drm, tegra, FALSE);
     TegraCompositeSetupAttributes(tegra);
 }
 
@@ -470,6 +1008,9 @@ static Bool TegraEXACheckComposite2D(TegraEXAPtr tegra,
     if (pMaskPicture && pMaskPicture->pDrawable)
         return FALSE;
 
+    if (TegraCompositeIsGradient(pSrcPicture))
+        return FALSE;
+
     if (pSrcPicture && pSrcPicture->pDrawable) {
         if (op != PictOpSrc)
             return FALSE;
@@ -477,6 +1018,9 @@ static Bool TegraEXACheckComposite2D(TegraEXAPtr tegra,
         if (pMaskPicture)
             return FALSE;
 
+        if (pSrcPicture->filter >= PictFilterConvolution)
+            return FALSE;
+
         if (!pSrcPicture->transform)
                 return FALSE;
 
@@ -504,12 +1048,14 @@ Bool TegraEXACheckComposite(int op, PicturePtr pSrcPicture,
 {
     ScrnInfoPtr pScrn = xf86ScreenToScrn(pDstPicture->pDrawable->pScreen);
     TegraPtr tegra = TegraPTR(pScrn);
+    struct tegra_convolution conv;
 
     if (TegraEXACheckComposite2D(TegraPTR(pScrn)->exa,
                                  op, pSrcPicture, pMaskPicture, pDstPicture))
         return TRUE;
 
-    if (!TegraCompositeProgram3D(op, pSrcPicture, pMaskPicture))
+    if (!TegraCompositeProgram3D(op, pSrcPicture, pMaskPicture) &&
+        !TegraCompositeBlendGenerated(op, pSrcPicture, pMaskPicture))
         return FALSE;
 
     if (pDstPicture->format != PICT_x8r8g8b8 &&
@@ -532,13 +1078,28 @@ Bool TegraEXACheckComposite(int op, PicturePtr pSrcPicture,
             return FALSE;
 
         if (pSrcPicture->pDrawable) {
-            if (pSrcPicture->filter >= PictFilterConvolution)
+            if (pSrcPicture->filter == PictFilterConvolution) {
+                /* taps outside of the picture rely on the HW wrapping */
+                if (!pSrcPicture->repeat || pSrcPicture->transform)
+                    return FALSE;
+
+                if (!TegraCompositeConvolution(pSrcPicture, &conv))
+                    return FALSE;
+            } else if (pSrcPicture->filter > PictFilterConvolution) {
+                return FALSE;
+            }
+
+            /* projective transform needs per-fragment division */
+            if (pSrcPicture->transform &&
+                !TegraCompositeTransformIsAffine(pSrcPicture->transform))
                 return FALSE;
 
-            if (!TegraCompositeCheckTexture(pSrcPicture, NULL))
+            if (!TegraCompositeCheckTexture(pSrcPicture, NULL,
+                            pSrcPicture->filter != PictFilterConvolution))
                 return FALSE;
         } else {
-            if (pSrcPicture->pSourcePict->type != SourcePictTypeSolidFill)
+            if (pSrcPicture->pSourcePict->type != SourcePictTypeSolidFill &&
+                !TegraEXAGradientSupported(pSrcPicture))
                 return FALSE;
         }
     }
@@ -560,7 +1121,7 @@ Bool TegraEXACheckComposite(int op, PicturePtr pSrcPicture,
             if (pMaskPicture->filter >= PictFilterConvolution)
                 return FALSE;
 
-            if (!TegraCompositeCheckTexture(pMaskPicture, NULL))
+            if (!TegraCompositeCheckTexture(pMaskPicture, NULL, FALSE))
                 return FALSE;
         } else {
             if (pMaskPicture->pSourcePict->type != SourcePictTypeSolidFill)
@@ -571,10 +1132,6 @@ Bool TegraEXACheckComposite(int op, PicturePtr pSrcPicture,
     if (!tegra->exa_compositing)
         return FALSE;
 
-    /* TODO: support GR3D transforms */
-    if (pSrcPicture && pSrcPicture->pDrawable && pSrcPicture->transform)
-        return FALSE;
-
     return TRUE;
 }
 
@@ -620,6 +1177,9 @@ static Bool TegraEXAPrepareSolid2D(int op,
     if (pMaskPicture && pMaskPicture->pDrawable)
         return FALSE;
 
+    if (TegraCompositeIsGradient(pSrcPicture))
+        return FALSE;
+
     if (op == PictOpSrc) {
         solid = pSrcPicture ? pSrcPicture->pSourcePict->solidFill.color :
                               0x00000000;
@@ -754,33 +1314,69 @@ static Bool TegraEXAPrepareComposite3D(int op,
 {
     ScrnInfoPtr pScrn = xf86ScreenToScrn(pDst->drawable.pScreen);
     TegraEXAPtr tegra = TegraPTR(pScrn)->exa;
-    struct tegra_stream *cmds = &tegra->cmds;
-    const struct shader_program *prog;
+    struct tegra_gr3d_state *state = &tegra->gr3d_state;
+    struct tegra_stream *cmds = &tegra->gr3d.cmds;
+    const struct tegra_composit_config *cfg = NULL;
+    struct shader_program *prog;
     TegraPixmapPtr priv;
     Bool mask_tex = (pMaskPicture && pMaskPicture->pDrawable);
     Bool src_tex = (pSrcPicture && pSrcPicture->pDrawable);
+    Bool gradient = TegraCompositeIsGradient(pSrcPicture);
+    struct tegra_convolution conv;
+    Bool convolution = FALSE;
     Bool clamp_src = FALSE;
     Bool clamp_mask = FALSE;
     Bool swap_red_blue;
     Bool dst_alpha;
     Bool alpha;
     Pixel solid;
+    Pixel solid_src = 0x00000000;
+    Pixel solid_mask = 0xffffffff;
+    float m[2][3];
     int err;
 
-    if (src_tex && pSrcPicture->transform)
+    /* CheckComposite could pass the transform on behalf of GR2D */
+    if (src_tex && pSrcPicture->transform &&
+        (!TegraCompositeTransformIsAffine(pSrcPicture->transform) ||
+         !TegraCompositeCheckTexture(pSrcPicture, NULL, TRUE)))
         return FALSE;
 
     prog = TegraCompositeProgram3D(op, pSrcPicture, pMaskPicture);
-    if (!prog)
+    if (!prog && !TegraCompositeBlendGenerated(op, pSrcPicture, pMaskPicture))
         return FALSE;
 
+    if (src_tex && pSrcPicture->filter == PictFilterConvolution) {
+        if (!TegraCompositeConvolution(pSrcPicture, &conv))
+            return FALSE;
+
+        convolution = TRUE;
+    }
+
+    /* gradient is sampled from the ramp texture in place of the source */
+    if (gradient && op != PictOpClear) {
+        pSrc = TegraEXAGradientRamp(pDst->drawable.pScreen, pSrcPicture);
+        if (!pSrc)
+            return FALSE;
+
+        src_tex = TRUE;
+    }
+
     tegra->scratch.pMask = (op != PictOpClear && mask_tex) ? pMask : NULL;
     tegra->scratch.pSrc = (op != PictOpClear && src_tex) ? pSrc : NULL;
     tegra->scratch.ops = 0;
 
-    err = TegraCompositeAllocateAttribBuffer(TegraPTR(pScrn)->drm, tegra);
-    if (err)
-        return FALSE;
+    tegra->scratch.attribs_ring.op_slots = 0;
+
+    /* keep filling the ring slot used by the previous operation */
+    if (TegraCompositeAttribBufferInRing(&tegra->scratch) &&
+        !TegraCompositeAttribBufferIsFull(&tegra->scratch)) {
+        tegra->scratch.attribs_ring.op_slots = 1;
+    } else {
+        err = TegraCompositeAllocateAttribBuffer(TegraPTR(pScrn)->drm,
+                                                 tegra, TRUE);
+        if (err)
+            return FALSE;
+    }
 
     TegraEXAThawPixmap(pSrc, TRUE);
     TegraEXAThawPixmap(pMask, TRUE);
@@ -802,42 +1398,94 @@ static Bool TegraEXAPrepareComposite3D(int op,
     if (priv->type <= TEGRA_EXA_PIXMAP_TYPE_FALLBACK)
         return FALSE;
 
-    err = tegra_stream_begin(cmds, tegra->gr3d);
+    err = TegraEXABeginBatch(&tegra->gr3d);
     if (err)
         return FALSE;
 
-    tegra_stream_prep(&tegra->cmds, 1);
-    tegra_stream_push_setclass(cmds, HOST1X_CLASS_GR3D);
+    if (!TegraCompositeStateReusable(tegra, pDst)) {
+        TegraGR3D_ResetState(state);
+        tegra->gr3d_state_batch = tegra->gr3d.batch_id;
+
+        tegra_stream_prep(cmds, 1);
+        tegra_stream_push_setclass(cmds, HOST1X_CLASS_GR3D);
+    }
+
+    /*
+     * Render takes gradient as transparent outside of [0, 1] when it isn't
+     * repeated, while sampler clamps the ramp to its edge texels. Position
+     * of the ramp is the texture coordinate, hence clamp-to-border of the
+     * program clears it.
+     */
+    if (gradient && tegra->scratch.pSrc)
+        clamp_src = !pSrcPicture->repeat;
+    else if (tegra->scratch.pSrc)
+        clamp_src = !pSrcPicture->repeat && !tegra->scratch.src_in_bounds;
 
-    TegraGR3D_Initialize(cmds, prog);
+    if (tegra->scratch.pMask)
+        clamp_mask = !pMaskPicture->repeat && !tegra->scratch.mask_in_bounds;
 
-    TegraGR3D_SetupScissor(cmds, 0, 0,
+    if (prog) {
+        prog = TegraCompositeProgramVariant(prog, clamp_src, clamp_mask);
+    } else {
+        cfg = &composit_cfgs[op];
+        prog = TegraEXABlendProgram(
+                    tegra,
+                    composit_cfgs[PictOpOver].prog[src_tex][mask_tex],
+                    cfg->src_factor, cfg->dst_factor, src_tex, mask_tex,
+                    (clamp_src ? SHADER_SRC_CLAMP : 0) |
+                    (clamp_mask ? SHADER_MASK_CLAMP : 0));
+        if (!prog) {
+            TegraEXACancelBatchOp(&tegra->gr3d);
+            return FALSE;
+        }
+    }
+
+    /* program that is already set up leaves caches as they are */
+    if (state->prog != prog ||
+        TegraCompositeTextureWritten(tegra, tegra->scratch.pSrc) ||
+        TegraCompositeTextureWritten(tegra, tegra->scratch.pMask)) {
+        if (state->prog == prog)
+            TegraGR3D_InvalidateCaches(cmds);
+
+        tegra->gr3d_caches_seqno = tegra->gr2d.cmds.seqno;
+    }
+
+    TegraGR3D_Initialize(cmds, state, prog);
+
+    TegraGR3D_SetupScissor(cmds, state, 0, 0,
                            pDst->drawable.width,
                            pDst->drawable.height);
-    TegraGR3D_SetupViewportBiasScale(cmds, 0.0f, 0.0f, 0.5f,
+    TegraGR3D_SetupViewportBiasScale(cmds, state, 0.0f, 0.0f, 0.5f,
                                      pDst->drawable.width,
                                      pDst->drawable.height, 0.5f);
-    TegraGR3D_SetupRenderTarget(cmds, 1,
+    TegraGR3D_SetupRenderTarget(cmds, state, 1,
                                 TegraEXAPixmapBO(pDst),
                                 TegraEXAPixmapOffset(pDst),
                                 TegraCompositeFormatToGR3D(pDstPicture->format),
                                 exaGetPixmapPitch(pDst));
-    TegraGR3D_EnableRenderTargets(cmds, 1 << 1);
+    TegraGR3D_EnableRenderTargets(cmds, state, 1 << 1);
 
     TegraCompositeSetupAttributes(tegra);
 
     dst_alpha = TegraCompositeFormatHasAlpha(pDstPicture->format);
 
     if (tegra->scratch.pSrc) {
-        clamp_src = !pSrcPicture->repeat;
+        if (gradient)
+            TegraEXAGradientMatrix(pSrcPicture, m);
+        else
+            TegraCompositeTextureMatrix(pSrcPicture->transform, pSrc, m);
+
+        if (convolution)
+            TegraCompositeSetupConvolution(cmds, state, &conv, pSrc, m);
 
-        TegraCompositeSetupTexture(cmds, 0, pSrcPicture, pSrc);
+        TegraCompositeSetupTexture(cmds, state, 0, pSrcPicture, pSrc);
+        TegraCompositeSetupTransform(cmds, state, m);
 
         swap_red_blue = TegraCompositeFormatSwapRedBlue3D(pDstPicture->format) !=
                         TegraCompositeFormatSwapRedBlue3D(pSrcPicture->format);
 
         alpha = TegraCompositeFormatHasAlpha(pSrcPicture->format);
-        TegraGR3D_UploadConstFP(cmds, 5, FX10x2(alpha, swap_red_blue));
+        TegraGR3D_UploadConstFP(cmds, state, 5, FX10x2(alpha, swap_red_blue));
     } else {
         if (op != PictOpClear && pSrcPicture) {
             solid = pSrcPicture->pSourcePict->solidFill.color;
@@ -853,21 +1501,22 @@ static Bool TegraEXAPrepareComposite3D(int op,
             TegraCompositeFormatSwapRedBlue3D(pSrcPicture->format))
             solid = TegraSwapRedBlue(solid);
 
-        TegraGR3D_UploadConstFP(cmds, 0, FX10x2(BLUE(solid), GREEN(solid)));
-        TegraGR3D_UploadConstFP(cmds, 1, FX10x2(RED(solid), ALPHA(solid)));
+        solid_src = solid;
+
+        TegraGR3D_UploadConstFP(cmds, state, 0, FX10x2(BLUE(solid), GREEN(solid)));
+        TegraGR3D_UploadConstFP(cmds, state, 1, FX10x2(RED(solid), ALPHA(solid)));
     }
 
     if (tegra->scratch.pMask) {
-        clamp_mask = !pMaskPicture->repeat;
-
-        TegraCompositeSetupTexture(cmds, 1, pMaskPicture, pMask);
+        TegraCompositeSetupTexture(cmds, state, 1, pMaskPicture, pMask);
+        TegraCompositeSetupScale(cmds, state, 4, pMask, 1.0f, 0.0f);
 
         swap_red_blue = TegraCompositeFormatSwapRedBlue3D(pDstPicture->format) !=
                         TegraCompositeFormatSwapRedBlue3D(pMaskPicture->format);
 
         alpha = TegraCompositeFormatHasAlpha(pMaskPicture->format);
-        TegraGR3D_UploadConstFP(cmds, 6, FX10x2(pMaskPicture->componentAlpha, alpha));
-        TegraGR3D_UploadConstFP(cmds, 7, FX10x2(swap_red_blue, clamp_mask));
+        TegraGR3D_UploadConstFP(cmds, state, 6, FX10x2(pMaskPicture->componentAlpha, alpha));
+        TegraGR3D_UploadConstFP(cmds, state, 7, FX10x2(swap_red_blue, clamp_mask));
     } else {
         if (op != PictOpClear && pMaskPicture) {
             solid = pMaskPicture->pSourcePict->solidFill.color;
@@ -886,15 +1535,21 @@ static Bool TegraEXAPrepareComposite3D(int op,
             solid = 0xffffffff;
         }
 
-        TegraGR3D_UploadConstFP(cmds, 2, FX10x2(BLUE(solid), GREEN(solid)));
-        TegraGR3D_UploadConstFP(cmds, 3, FX10x2(RED(solid), ALPHA(solid)));
+        solid_mask = solid;
+
+        TegraGR3D_UploadConstFP(cmds, state, 2, FX10x2(BLUE(solid), GREEN(solid)));
+        TegraGR3D_UploadConstFP(cmds, state, 3, FX10x2(RED(solid), ALPHA(solid)));
     }
 
-    TegraGR3D_UploadConstFP(cmds, 8, FX10x2(dst_alpha, clamp_src));
-    TegraGR3D_UploadConstVP(cmds, 0, 0.0f, 0.0f, 0.0f, 1.0f);
+    if (cfg && cfg->src_factor == TEGRA_BLEND_SATURATE)
+        TegraCompositeSetupSaturate(cmds, state, solid_src, solid_mask);
+
+    TegraGR3D_UploadConstFP(cmds, state, 8, FX10x2(dst_alpha, clamp_src));
+    TegraGR3D_UploadConstVP(cmds, state, 0, 0.0f, 0.0f, 0.0f, 1.0f);
+    TegraCompositeSetupScale(cmds, state, 3, pDst, 2.0f, -1.0f);
 
     if (cmds->status != TEGRADRM_STREAM_CONSTRUCT) {
-        tegra_stream_cleanup(cmds);
+        TegraEXACancelBatchOp(&tegra->gr3d);
         return FALSE;
     }
 
@@ -909,9 +1564,9 @@ static void TegraEXAComposite3D(PixmapPtr pDst,
 {
     ScrnInfoPtr pScrn = xf86ScreenToScrn(pDst->drawable.pScreen);
     TegraEXAPtr tegra = TegraPTR(pScrn)->exa;
-    float dst_left, dst_right, dst_top, dst_bottom;
-    float src_left, src_right, src_top, src_bottom;
-    float mask_left, mask_right, mask_top, mask_bottom;
+    int dst_left, dst_right, dst_top, dst_bottom;
+    int src_left, src_right, src_top, src_bottom;
+    int mask_left, mask_right, mask_top, mask_bottom;
     bool push_mask = !!tegra->scratch.pMask;
     bool push_src = !!tegra->scratch.pSrc;
 
@@ -927,26 +1582,30 @@ static void TegraEXAComposite3D(PixmapPtr pDst,
     if (tegra->scratch.attribs_alloc_err)
         return;
 
+    /* normalized and transformed by vertex program */
     if (push_src) {
-        src_left   = (float) srcX   / tegra->scratch.pSrc->drawable.width;
-        src_right  = (float) width  / tegra->scratch.pSrc->drawable.width + src_left;
-        src_bottom = (float) srcY   / tegra->scratch.pSrc->drawable.height;
-        src_top    = (float) height / tegra->scratch.pSrc->drawable.height + src_bottom;
+        src_left   = srcX;
+        src_right  = srcX + width;
+        src_bottom = srcY;
+        src_top    = srcY + height;
     }
 
     if (push_mask) {
-        mask_left   = (float) maskX  / tegra->scratch.pMask->drawable.width;
-        mask_right  = (float) width  / tegra->scratch.pMask->drawable.width + mask_left;
-        mask_bottom = (float) maskY  / tegra->scratch.pMask->drawable.height;
-        mask_top    = (float) height / tegra->scratch.pMask->drawable.height + mask_bottom;
+        mask_left   = maskX;
+        mask_right  = maskX + width;
+        mask_bottom = maskY;
+        mask_top    = maskY + height;
     }
 
-    dst_left   = (float) (dstX   * 2) / pDst->drawable.width  - 1.0f;
-    dst_right  = (float) (width  * 2) / pDst->drawable.width  + dst_left;
-    dst_bottom = (float) (dstY   * 2) / pDst->drawable.height - 1.0f;
-    dst_top    = (float) (height * 2) / pDst->drawable.height + dst_bottom;
+    dst_left   = dstX;
+    dst_right  = dstX + width;
+    dst_bottom = dstY;
+    dst_top    = dstY + height;
 
-    /* push first triangle of the quad to attributes buffer */
+    /*
+     * Push quad vertices to attributes buffer, quad is drawn as two
+     * triangles using the static index buffer of the attributes ring.
+     */
     TegraPushVtxAttr(dst_left,  dst_bottom,  true);
     TegraPushVtxAttr(src_left,  src_bottom,  push_src);
     TegraPushVtxAttr(mask_left, mask_bottom, push_mask);
@@ -959,63 +1618,53 @@ static void TegraEXAComposite3D(PixmapPtr pDst,
     TegraPushVtxAttr(src_right,  src_top,  push_src);
     TegraPushVtxAttr(mask_right, mask_top, push_mask);
 
-    /* push second */
-    TegraPushVtxAttr(dst_right,  dst_top,  true);
-    TegraPushVtxAttr(src_right,  src_top,  push_src);
-    TegraPushVtxAttr(mask_right, mask_top, push_mask);
-
     TegraPushVtxAttr(dst_right,  dst_bottom,  true);
     TegraPushVtxAttr(src_right,  src_bottom,  push_src);
     TegraPushVtxAttr(mask_right, mask_bottom, push_mask);
 
-    TegraPushVtxAttr(dst_left,  dst_bottom,  true);
-    TegraPushVtxAttr(src_left,  src_bottom,  push_src);
-    TegraPushVtxAttr(mask_left, mask_bottom, push_mask);
-
-    tegra->scratch.vtx_cnt += 6;
+    tegra->scratch.vtx_cnt += 4;
 }
 
 static void TegraEXADoneComposite3D(PixmapPtr pDst)
 {
     ScrnInfoPtr pScrn = xf86ScreenToScrn(pDst->drawable.pScreen);
     TegraEXAPtr tegra = TegraPTR(pScrn)->exa;
+    struct tegra_stream *cmds = &tegra->gr3d.cmds;
     struct tegra_fence *fence = NULL;
     TegraPixmapPtr priv;
 
     TegraEXACompositeDraw(tegra);
 
-    if (tegra->scratch.ops && tegra->cmds.status == TEGRADRM_STREAM_CONSTRUCT) {
+    /* draws that made it into the job before a failure are kept */
+    if (cmds->status != TEGRADRM_STREAM_CONSTRUCT &&
+        TegraEXACancelBatchOp(&tegra->gr3d))
+        tegra->scratch.ops = 0;
+
+    if (tegra->scratch.ops) {
         if (tegra->scratch.pSrc) {
             priv = exaGetPixmapDriverPrivate(tegra->scratch.pSrc);
 
-            if (priv->fence_write && priv->fence_write->gr2d) {
-                TegraEXAWaitFence(priv->fence_write);
-
-                tegra_stream_put_fence(priv->fence_write);
-                priv->fence_write = NULL;
-            }
+            if (priv->fence_write && priv->fence_write->gr2d)
+                tegra_stream_add_prefence(cmds, priv->fence_write);
         }
 
         if (tegra->scratch.pMask) {
             priv = exaGetPixmapDriverPrivate(tegra->scratch.pMask);
 
-            if (priv->fence_write && priv->fence_write->gr2d) {
-                TegraEXAWaitFence(priv->fence_write);
-
-                tegra_stream_put_fence(priv->fence_write);
-                priv->fence_write = NULL;
-            }
+            if (priv->fence_write && priv->fence_write->gr2d)
+                tegra_stream_add_prefence(cmds, priv->fence_write);
         }
 
         priv = exaGetPixmapDriverPrivate(pDst);
         if (priv->fence_write && priv->fence_write->gr2d)
-            TegraEXAWaitFence(priv->fence_write);
+            tegra_stream_add_prefence(cmds, priv->fence_write);
 
         if (priv->fence_read && priv->fence_read->gr2d)
-            TegraEXAWaitFence(priv->fence_read);
+            tegra_stream_add_prefence(cmds, priv->fence_read);
+
+        fence = TegraEXABatchFence(&tegra->gr3d, tegra->scratch.ops);
 
-        tegra_stream_end(&tegra->cmds);
-        fence = tegra_stream_submit(&tegra->cmds, false);
+        TegraCompositeFenceAttribRing(&tegra->scratch, fence);
 
         /*
          * XXX: Glitches may occur due to lack of support for waitchecks
@@ -1051,11 +1700,12 @@ static void TegraEXADoneComposite3D(PixmapPtr pDst)
             }
         }
     } else {
-        tegra_stream_cleanup(&tegra->cmds);
+        TegraEXACancelBatchOp(&tegra->gr3d);
     }
 
     /* buffer reallocation could fail, cleanup it now */
     if (tegra->scratch.attribs_alloc_err) {
+        TegraEXAFlushBatch(&tegra->gr3d);
         tegra_stream_wait_fence(fence);
         TegraCompositeReleaseAttribBuffers(&tegra->scratch);
         tegra->scratch.attribs_alloc_err = FALSE;
@@ -1121,4 +1771,487 @@ void TegraEXADoneComposite(PixmapPtr pDst)
     return TegraEXADoneComposite3D(pDst);
 }
 
+static Bool TegraCompositeTextureOversized(PicturePtr pic)
+{
+    return pic && pic->pDrawable &&
+           (pic->pDrawable->width > TEGRA_TEXTURE_SIZE_MAX ||
+            pic->pDrawable->height > TEGRA_TEXTURE_SIZE_MAX);
+}
+
+/*
+ * Tile is sampled in place of the source, hence it takes over the sampling
+ * attributes of the source.
+ */
+static Bool TegraCompositeTileAttributes(PicturePtr pPicture,
+                                         PicturePtr pSrcPicture)
+{
+    char *filter = PictureGetFilterName(pSrcPicture->filter);
+    XID ca = pSrcPicture->componentAlpha;
+
+    if (ChangePicture(pPicture, CPComponentAlpha, &ca, NULL,
+                      serverClient) != Success)
+        return FALSE;
+
+    return SetPictureFilter(pPicture, filter, strlen(filter),
+                            pSrcPicture->filter_params,
+                            pSrcPicture->filter_nparams) == Success;
+}
+
+/*
+ * Scratch tiles are kept for the following operations, so that staging
+ * doesn't allocate and release memory every time. Filling a tile that is
+ * still sampled by GR3D is ordered by fences of the tile pixmap, using a
+ * few tiles in turn lets GR2D fill one of them while GR3D samples another.
+ */
+static PicturePtr TegraCompositeTile(ScreenPtr pScreen, TegraEXAPtr exa,
+                                     PicturePtr pSrcPicture, unsigned idx)
+{
+    PicturePtr pPicture = exa->composite_tiles[idx];
+    PixmapPtr pPixmap;
+    TegraPixmapPtr priv;
+    int error;
+
+    if (pPicture && pPicture->pFormat == pSrcPicture->pFormat)
+        goto attributes;
+
+    if (pPicture) {
+        FreePicture(pPicture, 0);
+        exa->composite_tiles[idx] = NULL;
+    }
+
+    pPixmap = pScreen->CreatePixmap(pScreen, TEGRA_COMPOSITE_TILE_SIZE,
+                                    TEGRA_COMPOSITE_TILE_SIZE,
+                                    pSrcPicture->pDrawable->depth, 0);
+    if (!pPixmap)
+        return NULL;
+
+    priv = exaGetPixmapDriverPrivate(pPixmap);
+    if (priv->type <= TEGRA_EXA_PIXMAP_TYPE_FALLBACK) {
+        pScreen->DestroyPixmap(pPixmap);
+        return NULL;
+    }
+
+    pPicture = CreatePicture(0, &pPixmap->drawable, pSrcPicture->pFormat,
+                             0, NULL, serverClient, &error);
+    pScreen->DestroyPixmap(pPixmap);
+
+    exa->composite_tiles[idx] = pPicture;
+    if (!pPicture)
+        return NULL;
+
+attributes:
+    if (!TegraCompositeTileAttributes(pPicture, pSrcPicture))
+        return NULL;
+
+    return pPicture;
+}
+
+void TegraEXAReleaseCompositeTiles(TegraEXAPtr exa)
+{
+    unsigned i;
+
+    for (i = 0; i < TEGRA_COMPOSITE_TILES_NB; i++) {
+        if (exa->composite_tiles[i]) {
+            FreePicture(exa->composite_tiles[i], 0);
+            exa->composite_tiles[i] = NULL;
+        }
+    }
+}
+
+/*
+ * GR3D can't sample textures larger than TEGRA_TEXTURE_SIZE_MAX and
+ * texture pitch is implied by its width, hence sub-rectangle of a large
+ * pixmap can't be sampled in-place. Source is copied tile-by-tile into
+ * scratch pixmaps (by GR2D) and every tile is composited by a separate
+ * draw.
+ */
+static Bool TegraCompositeTiled(CARD8 op,
+                                PicturePtr pSrcPicture,
+                                PicturePtr pMaskPicture,
+                                PicturePtr pDstPicture,
+                                INT16 xSrc, INT16 ySrc,
+                                INT16 xMask, INT16 yMask,
+                                INT16 xDst, INT16 yDst,
+                                CARD16 width, CARD16 height)
+{
+    ScreenPtr pScreen = pDstPicture->pDrawable->pScreen;
+    TegraPtr tegra = TegraPTR(xf86ScreenToScrn(pScreen));
+    DrawablePtr pSrcDrawable = pSrcPicture->pDrawable;
+    PicturePtr tiles[TEGRA_COMPOSITE_TILES_NB];
+    unsigned tiles_nb, i;
+    int x, y, w, h;
+
+    if (!tegra->exa_compositing || !width || !height)
+        return FALSE;
+
+    /* plain copy is done by GR2D through the copy path of EXA */
+    if (op == PictOpSrc && !pMaskPicture &&
+        pSrcPicture->format == pDstPicture->format)
+        return FALSE;
+
+    if (TegraCompositeTextureOversized(pMaskPicture))
+        return FALSE;
+
+    /*
+     * Tile has to reproduce source exactly, without clipping or wrapping.
+     * Untransformed source is sampled at texel centers, hence filtering
+     * doesn't reach texels of the neighbouring tile, unlike convolution.
+     */
+    if (pSrcDrawable->type != DRAWABLE_PIXMAP ||
+        pSrcPicture->transform ||
+        pSrcPicture->repeat ||
+        pSrcPicture->alphaMap ||
+        pSrcPicture->clientClip ||
+        pSrcPicture->filter >= PictFilterConvolution)
+        return FALSE;
+
+    if (xSrc < 0 || xSrc + width > pSrcDrawable->width ||
+        ySrc < 0 || ySrc + height > pSrcDrawable->height)
+        return FALSE;
+
+    tiles_nb = TEGRA_ROUND_UP(width, TEGRA_COMPOSITE_TILE_SIZE) /
+                                        TEGRA_COMPOSITE_TILE_SIZE *
+               TEGRA_ROUND_UP(height, TEGRA_COMPOSITE_TILE_SIZE) /
+                                        TEGRA_COMPOSITE_TILE_SIZE;
+    tiles_nb = min(tiles_nb, TEGRA_COMPOSITE_TILES_NB);
+
+    /* operation can't fall back once part of it is drawn */
+    for (i = 0; i < tiles_nb; i++) {
+        tiles[i] = TegraCompositeTile(pScreen, tegra->exa, pSrcPicture, i);
+        if (!tiles[i])
+            return FALSE;
+    }
+
+    /* tiles share format, checking one of them covers them all */
+    if (!TegraEXACheckComposite(op, tiles[0], pMaskPicture, pDstPicture))
+        return FALSE;
+
+    for (y = 0, i = 0; y < height; y += TEGRA_COMPOSITE_TILE_SIZE) {
+        for (x = 0; x < width; x += TEGRA_COMPOSITE_TILE_SIZE, i++) {
+            w = min(width - x, TEGRA_COMPOSITE_TILE_SIZE);
+            h = min(height - y, TEGRA_COMPOSITE_TILE_SIZE);
+
+            CompositePicture(PictOpSrc, pSrcPicture, NULL,
+                             tiles[i % tiles_nb],
+                             xSrc + x, ySrc + y, 0, 0, 0, 0, w, h);
+
+            CompositePicture(op, tiles[i % tiles_nb], pMaskPicture,
+                             pDstPicture, 0, 0, xMask + x, yMask + y,
+                             xDst + x, yDst + y, w, h);
+        }
+    }
+
+    return TRUE;
+}
+
+static PicturePtr TegraCompositeScratchPicture(ScreenPtr pScreen,
+                                               PicturePtr pSrcPicture,
+                                               int width, int height)
+{
+    PicturePtr pPicture;
+    PixmapPtr pPixmap;
+    TegraPixmapPtr priv;
+    XID repeat = RepeatPad;
+    int error;
+
+    pPixmap = pScreen->CreatePixmap(pScreen, width, height,
+                                    pSrcPicture->pDrawable->depth, 0);
+    if (!pPixmap)
+        return NULL;
+
+    priv = exaGetPixmapDriverPrivate(pPixmap);
+    if (priv->type <= TEGRA_EXA_PIXMAP_TYPE_FALLBACK) {
+        pScreen->DestroyPixmap(pPixmap);
+        return NULL;
+    }
+
+    pPicture = CreatePicture(0, &pPixmap->drawable, pSrcPicture->pFormat,
+                             CPRepeat, &repeat, serverClient, &error);
+    pScreen->DestroyPixmap(pPixmap);
+
+    return pPicture;
+}
+
+/*
+ * Splits kernel into a row and a column whose product gives the kernel,
+ * params are formatted for the convolution filter. Result of the row pass
+ * is stored in a scratch pixmap that clamps to [0, 1], hence only kernels
+ * with non-negative weights are split and the row is normalized, keeping
+ * the intermediate result in range.
+ */
+static Bool TegraCompositeKernelSeparate(PicturePtr pic,
+                                         xFixed row[2 + TEGRA_CONVOLUTION_TAPS],
+                                         xFixed col[2 + TEGRA_CONVOLUTION_TAPS])
+{
+    xFixed *params = pic->filter_params;
+    double kernel[TEGRA_CONVOLUTION_TAPS * TEGRA_CONVOLUTION_TAPS];
+    double pivot = 0.0;
+    double row_sum = 0.0;
+    int px = 0, py = 0;
+    int kw, kh;
+    int x, y;
+
+    if (!TegraCompositeKernelSize(pic, &kw, &kh))
+        return FALSE;
+
+    if (kw > TEGRA_CONVOLUTION_TAPS || kh > TEGRA_CONVOLUTION_TAPS)
+        return FALSE;
+
+    for (y = 0; y < kh; y++) {
+        for (x = 0; x < kw; x++) {
+            kernel[y * kw + x] = pixman_fixed_to_double(params[2 + y * kw + x]);
+
+            if (kernel[y * kw + x] < 0.0)
+                return FALSE;
+
+            if (kernel[y * kw + x] > pivot) {
+                pivot = kernel[y * kw + x];
+                px = x;
+                py = y;
+            }
+        }
+    }
+
+    if (pivot == 0.0)
+        return FALSE;
+
+    /* kernel is separable if it is an outer product of its row and column */
+    for (y = 0; y < kh; y++) {
+        for (x = 0; x < kw; x++) {
+            if (fabs(kernel[y * kw + px] * kernel[py * kw + x] / pivot -
+                     kernel[y * kw + x]) > 1.0 / 4096)
+                return FALSE;
+        }
+    }
+
+    row[0] = pixman_int_to_fixed(kw);
+    row[1] = pixman_int_to_fixed(1);
+    col[0] = pixman_int_to_fixed(1);
+    col[1] = pixman_int_to_fixed(kh);
+
+    for (x = 0; x < kw; x++)
+        row_sum += kernel[py * kw + x];
+
+    for (x = 0; x < kw; x++)
+        row[2 + x] = pixman_double_to_fixed(kernel[py * kw + x] / row_sum);
+
+    for (y = 0; y < kh; y++)
+        col[2 + y] = pixman_double_to_fixed(kernel[y * kw + px] * row_sum /
+                                            pivot);
+
+    return TRUE;
+}
+
+/*
+ * Convolution program handles a single pass of a small kernel with the
+ * Src operation. Otherwise the filtered source is resolved into a scratch
+ * pixmap first, a separable kernel with non-negative weights is applied by
+ * a row pass followed by a column pass, and the result is composited by a
+ * regular draw. Other kernels fall back.
+ */
+static Bool TegraCompositeConvolved(CARD8 op,
+                                    PicturePtr pSrcPicture,
+                                    PicturePtr pMaskPicture,
+                                    PicturePtr pDstPicture,
+                                    INT16 xSrc, INT16 ySrc,
+                                    INT16 xMask, INT16 yMask,
+                                    INT16 xDst, INT16 yDst,
+                                    CARD16 width, CARD16 height)
+{
+    ScreenPtr pScreen = pDstPicture->pDrawable->pScreen;
+    TegraPtr tegra = TegraPTR(xf86ScreenToScrn(pScreen));
+    DrawablePtr pSrcDrawable = pSrcPicture->pDrawable;
+    xFixed row[2 + TEGRA_CONVOLUTION_TAPS];
+    xFixed col[2 + TEGRA_CONVOLUTION_TAPS];
+    PicturePtr pRowPicture = NULL;
+    PicturePtr pColPicture = NULL;
+    PicturePtr pPicture = NULL;
+    struct tegra_convolution conv;
+    XID repeat;
+    int kw, kh, error;
+    Bool ret = FALSE;
+
+    if (!tegra->exa_compositing || !width || !height)
+        return FALSE;
+
+    /* scratch picture reproduces only the filter of the source */
+    if (pSrcDrawable->type != DRAWABLE_PIXMAP ||
+        pSrcPicture->transform ||
+        pSrcPicture->alphaMap ||
+        pSrcPicture->clientClip)
+        return FALSE;
+
+    if (TegraCompositeTextureOversized(pSrcPicture) ||
+        TegraCompositeTextureOversized(pMaskPicture))
+        return FALSE;
+
+    if (!TegraCompositeKernelSize(pSrcPicture, &kw, &kh))
+        return FALSE;
+
+    if (width > TEGRA_TEXTURE_SIZE_MAX ||
+        height + kh - 1 > TEGRA_TEXTURE_SIZE_MAX)
+        return FALSE;
+
+    pPicture = TegraCompositeScratchPicture(pScreen, pSrcPicture,
+                                            width, height);
+    if (!pPicture)
+        return FALSE;
+
+    if (TegraCompositeConvolution(pSrcPicture, &conv)) {
+        CompositePicture(PictOpSrc, pSrcPicture, NULL, pPicture,
+                         xSrc, ySrc, 0, 0, 0, 0, width, height);
+    } else {
+        if (!TegraCompositeKernelSeparate(pSrcPicture, row, col))
+            goto free_pictures;
+
+        repeat = pSrcPicture->repeat ? pSrcPicture->repeatType : RepeatNone;
+
+        pRowPicture = CreatePicture(0, pSrcDrawable, pSrcPicture->pFormat,
+                                    CPRepeat, &repeat, serverClient, &error);
+        if (!pRowPicture)
+            goto free_pictures;
+
+        /* rows above and below are needed by the column pass */
+        pColPicture = TegraCompositeScratchPicture(pScreen, pSrcPicture,
+                                                   width, height + kh - 1);
+        if (!pColPicture)
+            goto free_pictures;
+
+        if (SetPictureFilter(pRowPicture, FilterConvolution,
+                             strlen(FilterConvolution), row,
+                             2 + kw) != Success)
+            goto free_pictures;
+
+        if (SetPictureFilter(pColPicture, FilterConvolution,
+                             strlen(FilterConvolution), col,
+                             2 + kh) != Success)
+            goto free_pictures;
+
+        CompositePicture(PictOpSrc, pRowPicture, NULL, pColPicture,
+                         xSrc, ySrc - kh / 2, 0, 0, 0, 0,
+                         width, height + kh - 1);
+
+        CompositePicture(PictOpSrc, pColPicture, NULL, pPicture,
+                         0, kh / 2, 0, 0, 0, 0, width, height);
+    }
+
+    CompositePicture(op, pPicture, pMaskPicture, pDstPicture,
+                     0, 0, xMask, yMask, xDst, yDst, width, height);
+
+    ret = TRUE;
+
+free_pictures:
+    /* releasing scratch awaits the draws that sample it */
+    if (pColPicture)
+        FreePicture(pColPicture, 0);
+
+    if (pRowPicture)
+        FreePicture(pRowPicture, 0);
+
+    FreePicture(pPicture, 0);
+
+    return ret;
+}
+
+/*
+ * Untransformed texture that is sampled within its bounds doesn't need the
+ * clamp-to-border emulation, shorter fragment program is used for it.
+ */
+static Bool TegraCompositeInBounds(PicturePtr pPicture,
+                                   INT16 x, INT16 y,
+                                   CARD16 width, CARD16 height)
+{
+    if (!pPicture || !pPicture->pDrawable || pPicture->transform ||
+        pPicture->filter == PictFilterConvolution)
+        return FALSE;
+
+    return x >= 0 && y >= 0 &&
+           x + width <= pPicture->pDrawable->width &&
+           y + height <= pPicture->pDrawable->height;
+}
+
+void TegraEXACompositePicture(CARD8 op,
+                              PicturePtr pSrcPicture,
+                              PicturePtr pMaskPicture,
+                              PicturePtr pDstPicture,
+                              INT16 xSrc, INT16 ySrc,
+                              INT16 xMask, INT16 yMask,
+                              INT16 xDst, INT16 yDst,
+                              CARD16 width, CARD16 height)
+{
+    ScreenPtr pScreen = pDstPicture->pDrawable->pScreen;
+    TegraEXAPtr exa = TegraPTR(xf86ScreenToScrn(pScreen))->exa;
+    struct tegra_convolution conv;
+    Bool src_in_bounds;
+    Bool mask_in_bounds;
+
+    if (pSrcPicture->pDrawable &&
+        pSrcPicture->filter == PictFilterConvolution &&
+        !(op == PictOpSrc && !pMaskPicture &&
+          TegraCompositeConvolution(pSrcPicture, &conv)) &&
+        TegraCompositeConvolved(op, pSrcPicture, pMaskPicture, pDstPicture,
+                                xSrc, ySrc, xMask, yMask, xDst, yDst,
+                                width, height))
+        return;
+
+    if (TegraCompositeTextureOversized(pSrcPicture) &&
+        TegraCompositeTiled(op, pSrcPicture, pMaskPicture, pDstPicture,
+                            xSrc, ySrc, xMask, yMask, xDst, yDst,
+                            width, height))
+        return;
+
+    src_in_bounds = exa->scratch.src_in_bounds;
+    mask_in_bounds = exa->scratch.mask_in_bounds;
+
+    exa->scratch.src_in_bounds = TegraCompositeInBounds(pSrcPicture,
+                                                        xSrc, ySrc,
+                                                        width, height);
+    exa->scratch.mask_in_bounds = TegraCompositeInBounds(pMaskPicture,
+                                                         xMask, yMask,
+                                                         width, height);
+
+    exa->Composite(op, pSrcPicture, pMaskPicture, pDstPicture,
+                   xSrc, ySrc, xMask, yMask, xDst, yDst, width, height);
+
+    exa->scratch.src_in_bounds = src_in_bounds;
+    exa->scratch.mask_in_bounds = mask_in_bounds;
+}
+
+static void TegraCompositeReleaseProgram(struct shader_program *prog)
+{
+    unsigned i;
+
+    if (!prog)
+        return;
+
+    for (i = 0; i < prog->variants_nb; i++)
+        TegraGR3D_ReleaseInitialization(prog->variants[i].prog);
+
+    TegraGR3D_ReleaseInitialization(prog);
+}
+
+/*
+ * Initialization sequences of the prebuilt programs are allocated on first
+ * use, programs themselves are static.
+ */
+void TegraEXAReleaseCompositePrograms(void)
+{
+    const struct tegra_composit_config *cfg;
+    unsigned i;
+
+    for (i = 0; i < TEGRA_ARRAY_SIZE(composit_cfgs); i++) {
+        cfg = &composit_cfgs[i];
+
+        TegraCompositeReleaseProgram(cfg->prog[0][0]);
+        TegraCompositeReleaseProgram(cfg->prog[0][1]);
+        TegraCompositeReleaseProgram(cfg->prog[1][0]);
+        TegraCompositeReleaseProgram(cfg->prog[1][1]);
+        TegraCompositeReleaseProgram(cfg->prog_repeat[0]);
+        TegraCompositeReleaseProgram(cfg->prog_repeat[1]);
+        TegraCompositeReleaseProgram(cfg->prog_radial);
+    }
+
+    TegraCompositeReleaseProgram(&prog_blend_src_convolve);
+}
+
 /* vim: set et sts=4 sw=4 ts=4: */
@@ -0,0 +1,534 @@
+/*
+ * Copyright (c) Dmitry Osipenko
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "driver.h"
+
+#include <xorg/mipict.h>
+
+/*
+ * Text is drawn from the driver-managed glyph atlas: all glyphs of a
+ * CompositeGlyphs request are uploaded to the atlas first by a single copy
+ * operation and then drawn by a single composite operation that uses atlas
+ * as the mask, so the whole string ends up in one GR3D draw.
+ */
+
+static unsigned TegraGlyphHash(GlyphPtr glyph)
+{
+    return ((uintptr_t) glyph >> 4) & (TEGRA_GLYPH_HASH_SIZE - 1);
+}
+
+static TegraGlyphCellPtr TegraGlyphAtlasLookup(TegraGlyphAtlasPtr atlas,
+                                               GlyphPtr glyph)
+{
+    TegraGlyphCellPtr cell = atlas->hash[TegraGlyphHash(glyph)];
+
+    while (cell && cell->glyph != glyph)
+        cell = cell->hash_next;
+
+    return cell;
+}
+
+static void TegraGlyphAtlasUnlink(TegraGlyphAtlasPtr atlas,
+                                  TegraGlyphCellPtr cell)
+{
+    TegraGlyphCellPtr *link = &atlas->hash[TegraGlyphHash(cell->glyph)];
+
+    while (*link != cell)
+        link = &(*link)->hash_next;
+
+    *link = cell->hash_next;
+    cell->hash_next = NULL;
+    cell->glyph = NULL;
+}
+
+static TegraGlyphAtlasPtr TegraGlyphAtlasCreate(ScreenPtr pScreen)
+{
+    PictFormatPtr format = PictureMatchFormat(pScreen, 8, PICT_a8);
+    TegraGlyphAtlasPtr atlas;
+    TegraGlyphCellPtr cell;
+    PixmapPtr pPixmap;
+    TegraPixmapPtr priv;
+    unsigned i;
+    int error;
+
+    if (!format)
+        return NULL;
+
+    atlas = calloc(1, sizeof(*atlas));
+    if (!atlas)
+        return NULL;
+
+    pPixmap = pScreen->CreatePixmap(pScreen, TEGRA_GLYPH_ATLAS_SIZE,
+                                    TEGRA_GLYPH_ATLAS_SIZE, 8, 0);
+    if (!pPixmap)
+        goto free_atlas;
+
+    /* atlas is useless if GPU can't sample it */
+    priv = exaGetPixmapDriverPrivate(pPixmap);
+    if (priv->type <= TEGRA_EXA_PIXMAP_TYPE_FALLBACK)
+        goto destroy_pixmap;
+
+    atlas->pPicture = CreatePicture(0, &pPixmap->drawable, format, 0, NULL,
+                                    serverClient, &error);
+    if (!atlas->pPicture)
+        goto destroy_pixmap;
+
+    /* picture holds the reference */
+    pScreen->DestroyPixmap(pPixmap);
+
+    xorg_list_init(&atlas->lru);
+
+    for (i = 0; i < TEGRA_GLYPH_CELLS_NB; i++) {
+        cell = &atlas->cells[i];
+        cell->x = (i * TEGRA_GLYPH_CELL_SIZE) % TEGRA_GLYPH_ATLAS_SIZE;
+        cell->y = (i * TEGRA_GLYPH_CELL_SIZE) / TEGRA_GLYPH_ATLAS_SIZE *
+                  TEGRA_GLYPH_CELL_SIZE;
+
+        xorg_list_append(&cell->lru_entry, &atlas->lru);
+    }
+
+    return atlas;
+
+destroy_pixmap:
+    pScreen->DestroyPixmap(pPixmap);
+free_atlas:
+    free(atlas);
+
+    return NULL;
+}
+
+void TegraEXAReleaseGlyphAtlas(TegraEXAPtr exa)
+{
+    TegraGlyphAtlasPtr atlas = exa->glyph_atlas;
+
+    if (atlas) {
+        FreePicture(atlas->pPicture, 0);
+        free(atlas);
+
+        exa->glyph_atlas = NULL;
+    }
+}
+
+static TegraGlyphCellPtr TegraGlyphAtlasCache(ScreenPtr pScreen,
+                                              TegraGlyphAtlasPtr atlas,
+                                              GlyphPtr glyph)
+{
+    TegraGlyphCellPtr cell = TegraGlyphAtlasLookup(atlas, glyph);
+    PicturePtr pGlyphPicture;
+
+    if (!cell) {
+        cell = xorg_list_last_entry(&atlas->lru, TegraGlyphCell, lru_entry);
+
+        /* all cells are taken by the current request */
+        if (cell->serial == atlas->serial)
+            return NULL;
+
+        pGlyphPicture = GetGlyphPicture(glyph, pScreen);
+        if (!pGlyphPicture)
+            return NULL;
+
+        if (cell->glyph)
+            TegraGlyphAtlasUnlink(atlas, cell);
+
+        atlas->pending[atlas->num_pending++] = cell;
+
+        cell->glyph = glyph;
+        cell->hash_next = atlas->hash[TegraGlyphHash(glyph)];
+        atlas->hash[TegraGlyphHash(glyph)] = cell;
+    }
+
+    cell->serial = atlas->serial;
+
+    xorg_list_del(&cell->lru_entry);
+    xorg_list_add(&cell->lru_entry, &atlas->lru);
+
+    return cell;
+}
+
+/*
+ * Fences of the atlas pixmap take care of the draws that still sample
+ * the evicted glyphs.
+ */
+static void TegraGlyphAtlasUpload(ScreenPtr pScreen, TegraGlyphAtlasPtr atlas)
+{
+    PixmapPtr pAtlas = (PixmapPtr) atlas->pPicture->pDrawable;
+    PicturePtr pGlyphPicture;
+    TegraGlyphCellPtr cell;
+    Bool prepared = FALSE;
+    PixmapPtr pGlyph;
+    unsigned i;
+
+    for (i = 0; i < atlas->num_pending; i++) {
+        cell = atlas->pending[i];
+        pGlyphPicture = GetGlyphPicture(cell->glyph, pScreen);
+        pGlyph = (PixmapPtr) pGlyphPicture->pDrawable;
+
+        if (!prepared) {
+            if (!TegraEXAPrepareCopy(pGlyph, pAtlas, 0, 0, GXcopy,
+                                     FB_ALLONES))
+                continue;
+
+            prepared = TRUE;
+        } else if (!TegraEXACopySource(pGlyph, pAtlas)) {
+            continue;
+        }
+
+        TegraEXACopy(pAtlas, 0, 0, cell->x, cell->y,
+                     cell->glyph->info.width, cell->glyph->info.height);
+
+        atlas->pending[i] = NULL;
+    }
+
+    if (prepared) {
+        TegraEXADoneCopy(pAtlas);
+        exaMarkSync(pScreen);
+    }
+
+    /* glyphs that GR2D can't read */
+    for (i = 0; i < atlas->num_pending; i++) {
+        cell = atlas->pending[i];
+        if (!cell)
+            continue;
+
+        pGlyphPicture = GetGlyphPicture(cell->glyph, pScreen);
+
+        CompositePicture(PictOpSrc, pGlyphPicture, NULL, atlas->pPicture,
+                         0, 0, 0, 0, cell->x, cell->y,
+                         cell->glyph->info.width, cell->glyph->info.height);
+    }
+
+    atlas->num_pending = 0;
+}
+
+static PixmapPtr TegraGlyphsDrawablePixmap(DrawablePtr pDrawable,
+                                           int *xoff, int *yoff)
+{
+    PixmapPtr pPixmap;
+
+    *xoff = 0;
+    *yoff = 0;
+
+    if (pDrawable->type == DRAWABLE_PIXMAP)
+        return (PixmapPtr) pDrawable;
+
+    pPixmap = pDrawable->pScreen->GetWindowPixmap((WindowPtr) pDrawable);
+#ifdef COMPOSITE
+    *xoff = -pPixmap->screen_x;
+    *yoff = -pPixmap->screen_y;
+#endif
+    return pPixmap;
+}
+
+static Bool TegraGlyphsMaskOpSupported(CARD8 op)
+{
+    /*
+     * Drawing glyphs one by one touches only the pixels covered by glyphs,
+     * while the mask covers the whole extents. That is equal only if zero
+     * mask leaves destination unchanged.
+     */
+    switch (op) {
+    case PictOpDst:
+    case PictOpOver:
+    case PictOpOverReverse:
+    case PictOpAtop:
+    case PictOpOutReverse:
+    case PictOpXor:
+    case PictOpAdd:
+    case PictOpSaturate:
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+static Bool TegraGlyphsCheck(CARD8 op, PictFormatPtr maskFormat,
+                             int nlist, GlyphListPtr list, GlyphPtr *glyphs)
+{
+    BoxRec extents = { MAXSHORT, MAXSHORT, MINSHORT, MINSHORT };
+    GlyphPtr glyph;
+    BoxRec box;
+    int x = 0;
+    int y = 0;
+    int n;
+
+    /* mask could quantize coverage differently from A8 glyphs */
+    if (maskFormat && maskFormat->format != PICT_a8)
+        return FALSE;
+
+    if (maskFormat && !TegraGlyphsMaskOpSupported(op))
+        return FALSE;
+
+    while (nlist--) {
+        if (list->format->format != PICT_a8)
+            return FALSE;
+
+        x += list->xOff;
+        y += list->yOff;
+        n = list->len;
+
+        while (n--) {
+            glyph = *glyphs++;
+
+            if (glyph->info.width && glyph->info.height) {
+                if (glyph->info.width > TEGRA_GLYPH_CELL_SIZE ||
+                    glyph->info.height > TEGRA_GLYPH_CELL_SIZE)
+                    return FALSE;
+
+                box.x1 = x - glyph->info.x;
+                box.y1 = y - glyph->info.y;
+                box.x2 = box.x1 + glyph->info.width;
+                box.y2 = box.y1 + glyph->info.height;
+
+                /*
+                 * Drawing glyphs one by one is equal to accumulating
+                 * them in a mask only if glyphs don't overlap.
+                 */
+                if (maskFormat &&
+                    box.x1 < extents.x2 && box.x2 > extents.x1 &&
+                    box.y1 < extents.y2 && box.y2 > extents.y1)
+                    return FALSE;
+
+                extents.x1 = min(extents.x1, box.x1);
+                extents.y1 = min(extents.y1, box.y1);
+                extents.x2 = max(extents.x2, box.x2);
+                extents.y2 = max(extents.y2, box.y2);
+            }
+
+            x += glyph->info.xOff;
+            y += glyph->info.yOff;
+        }
+
+        list++;
+    }
+
+    return TRUE;
+}
+
+static Bool TegraGlyphsAccelerated(CARD8 op,
+                                   PicturePtr pSrcPicture,
+                                   PicturePtr pDstPicture,
+                                   PictFormatPtr maskFormat,
+                                   INT16 xSrc, INT16 ySrc,
+                                   int nlist, GlyphListPtr list,
+                                   GlyphPtr *glyphs)
+{
+    ScreenPtr pScreen = pDstPicture->pDrawable->pScreen;
+    TegraPtr tegra = TegraPTR(xf86ScreenToScrn(pScreen));
+    TegraEXAPtr exa = tegra->exa;
+    PixmapPtr pSrc = NULL, pDst, pAtlas;
+    int src_off_x = 0, src_off_y = 0;
+    int src_x = 0, src_y = 0;
+    int dst_off_x, dst_off_y;
+    int xDst, yDst, x, y, gx, gy, sx, sy;
+    TegraGlyphAtlasPtr atlas;
+    TegraGlyphCellPtr cell;
+    GlyphListPtr itr_list;
+    GlyphPtr *itr_glyphs;
+    GlyphPtr glyph;
+    Bool src_in_bounds;
+    Bool mask_in_bounds;
+    RegionRec region;
+    BoxPtr pbox;
+    int nbox, i, n;
+    Bool ret = TRUE;
+
+    if (!tegra->exa_compositing)
+        return FALSE;
+
+    if (pSrcPicture->alphaMap || pDstPicture->alphaMap)
+        return FALSE;
+
+    if (!TegraGlyphsCheck(op, maskFormat, nlist, list, glyphs))
+        return FALSE;
+
+    if (!exa->glyph_atlas)
+        exa->glyph_atlas = TegraGlyphAtlasCreate(pScreen);
+
+    atlas = exa->glyph_atlas;
+    if (!atlas)
+        return FALSE;
+
+    if (!TegraEXACheckComposite(op, pSrcPicture, atlas->pPicture,
+                                pDstPicture))
+        return FALSE;
+
+    /* cells of the current request are locked from eviction by serial */
+    if (++atlas->serial == 0)
+        atlas->serial = 1;
+
+    itr_list = list;
+    itr_glyphs = glyphs;
+
+    for (i = 0; i < nlist && ret; i++, itr_list++) {
+        for (n = 0; n < itr_list->len && ret; n++) {
+            glyph = *itr_glyphs++;
+
+            if (!glyph->info.width || !glyph->info.height)
+                continue;
+
+            ret = !!TegraGlyphAtlasCache(pScreen, atlas, glyph);
+        }
+    }
+
+    /* cells taken before a failure are in use by the hash already */
+    TegraGlyphAtlasUpload(pScreen, atlas);
+
+    if (!ret)
+        return FALSE;
+
+    ValidatePicture(atlas->pPicture);
+
+    pAtlas = (PixmapPtr) atlas->pPicture->pDrawable;
+    pDst = TegraGlyphsDrawablePixmap(pDstPicture->pDrawable,
+                                     &dst_off_x, &dst_off_y);
+
+    if (pSrcPicture->pDrawable) {
+        pSrc = TegraGlyphsDrawablePixmap(pSrcPicture->pDrawable,
+                                         &src_off_x, &src_off_y);
+        src_x = pSrcPicture->pDrawable->x;
+        src_y = pSrcPicture->pDrawable->y;
+    }
+
+    src_in_bounds = exa->scratch.src_in_bounds;
+    mask_in_bounds = exa->scratch.mask_in_bounds;
+
+    /* glyphs are sampled within their atlas cells */
+    exa->scratch.src_in_bounds = FALSE;
+    exa->scratch.mask_in_bounds = TRUE;
+
+    /*
+     * EXA_HANDLES_PIXMAPS without EXA_MIXED_PIXMAPS makes all pixmaps
+     * driver-allocated, EXA neither migrates nor tracks damage of them.
+     * Its own composite path then amounts to the same Prepare, Composite
+     * per box, Done and exaMarkSync sequence, which is issued directly here
+     * to draw all glyphs by one operation.
+     */
+    ret = TegraEXAPrepareComposite(op, pSrcPicture, atlas->pPicture,
+                                   pDstPicture, pSrc, pAtlas, pDst);
+
+    exa->scratch.src_in_bounds = src_in_bounds;
+    exa->scratch.mask_in_bounds = mask_in_bounds;
+
+    if (!ret)
+        return FALSE;
+
+    /* source origin corresponds to the origin of the first glyph */
+    xDst = list->xOff;
+    yDst = list->yOff;
+    x = 0;
+    y = 0;
+
+    while (nlist--) {
+        x += list->xOff;
+        y += list->yOff;
+        n = list->len;
+
+        while (n--) {
+            glyph = *glyphs++;
+
+            if (!glyph->info.width || !glyph->info.height)
+                goto next;
+
+            cell = TegraGlyphAtlasLookup(atlas, glyph);
+            gx = x - glyph->info.x;
+            gy = y - glyph->info.y;
+            sx = xSrc + gx - xDst + src_x;
+            sy = ySrc + gy - yDst + src_y;
+            gx += pDstPicture->pDrawable->x;
+            gy += pDstPicture->pDrawable->y;
+
+            if (!miComputeCompositeRegion(&region, pSrcPicture,
+                                          atlas->pPicture, pDstPicture,
+                                          sx, sy, cell->x, cell->y, gx, gy,
+                                          glyph->info.width,
+                                          glyph->info.height))
+                goto next;
+
+            nbox = RegionNumRects(&region);
+            pbox = RegionRects(&region);
+
+            while (nbox--) {
+                TegraEXAComposite(pDst,
+                                  pbox->x1 - gx + sx + src_off_x,
+                                  pbox->y1 - gy + sy + src_off_y,
+                                  pbox->x1 - gx + cell->x,
+                                  pbox->y1 - gy + cell->y,
+                                  pbox->x1 + dst_off_x,
+                                  pbox->y1 + dst_off_y,
+                                  pbox->x2 - pbox->x1,
+                                  pbox->y2 - pbox->y1);
+                pbox++;
+            }
+
+            RegionUninit(&region);
+next:
+            x += glyph->info.xOff;
+            y += glyph->info.yOff;
+        }
+
+        list++;
+    }
+
+    TegraEXADoneComposite(pDst);
+    exaMarkSync(pScreen);
+
+    return TRUE;
+}
+
+void TegraEXAGlyphs(CARD8 op, PicturePtr pSrcPicture, PicturePtr pDstPicture,
+                    PictFormatPtr maskFormat, INT16 xSrc, INT16 ySrc,
+                    int nlist, GlyphListPtr list, GlyphPtr *glyphs)
+{
+    ScreenPtr pScreen = pDstPicture->pDrawable->pScreen;
+    TegraEXAPtr exa = TegraPTR(xf86ScreenToScrn(pScreen))->exa;
+
+    if (TegraGlyphsAccelerated(op, pSrcPicture, pDstPicture, maskFormat,
+                               xSrc, ySrc, nlist, list, glyphs))
+        return;
+
+    exa->Glyphs(op, pSrcPicture, pDstPicture, maskFormat, xSrc, ySrc,
+                nlist, list, glyphs);
+}
+
+void TegraEXAUnrealizeGlyph(ScreenPtr pScreen, GlyphPtr glyph)
+{
+    TegraEXAPtr exa = TegraPTR(xf86ScreenToScrn(pScreen))->exa;
+    TegraGlyphAtlasPtr atlas = exa->glyph_atlas;
+    TegraGlyphCellPtr cell;
+
+    if (atlas) {
+        cell = TegraGlyphAtlasLookup(atlas, glyph);
+
+        /* freed cell is recycled first */
+        if (cell) {
+            TegraGlyphAtlasUnlink(atlas, cell);
+            xorg_list_del(&cell->lru_entry);
+            xorg_list_append(&cell->lru_entry, &atlas->lru);
+        }
+    }
+
+    if (exa->UnrealizeGlyph)
+        exa->UnrealizeGlyph(pScreen, glyph);
+}
+
+/* vim: set et sts=4 sw=4 ts=4: */
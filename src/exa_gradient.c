@@ -0,0 +1,296 @@
+/*
+ * Copyright (c) Dmitry Osipenko
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "driver.h"
+
+/*
+ * Gradient stops are rasterized by CPU into a one texel high ramp texture
+ * and GR3D samples the ramp at the gradient position of the fragment.
+ *
+ * Position of linear gradient is an affine function of the pixel, hence it
+ * is computed by the vertex program using the source transform constants
+ * and regular texturing programs are used. Radial gradients are limited to
+ * concentric circles, vertex program produces the centre-relative position
+ * scaled by the outer radius and fragment program takes its length. Inner
+ * circle is baked into the ramp.
+ *
+ * Gradient that isn't repeated is transparent outside of the ramp, it is
+ * drawn by the program variant that emulates clamp-to-border.
+ */
+
+static Bool TegraGradientTransformIsAffine(PictTransformPtr t)
+{
+    return !t || (t->matrix[2][0] == 0 &&
+                  t->matrix[2][1] == 0 &&
+                  t->matrix[2][2] == pixman_fixed_1);
+}
+
+Bool TegraEXAGradientSupported(PicturePtr pPicture)
+{
+    PictRadialGradient *radial;
+    PictLinearGradient *linear;
+
+    if (pPicture->pDrawable || !pPicture->pSourcePict)
+        return FALSE;
+
+    if (!TegraGradientTransformIsAffine(pPicture->transform))
+        return FALSE;
+
+    switch (pPicture->pSourcePict->type) {
+    case SourcePictTypeLinear:
+        linear = &pPicture->pSourcePict->linear;
+
+        if (linear->nstops < 1)
+            return FALSE;
+
+        if (linear->p1.x == linear->p2.x && linear->p1.y == linear->p2.y)
+            return FALSE;
+
+        return TRUE;
+
+    case SourcePictTypeRadial:
+        radial = &pPicture->pSourcePict->radial;
+
+        if (radial->nstops < 1)
+            return FALSE;
+
+        if (radial->c1.x != radial->c2.x || radial->c1.y != radial->c2.y)
+            return FALSE;
+
+        if (radial->c1.radius < 0 || radial->c2.radius <= radial->c1.radius)
+            return FALSE;
+
+        /* inner circle is baked into the ramp, ramp can't be wrapped then */
+        if (radial->c1.radius && pPicture->repeat &&
+            (pPicture->repeatType == RepeatNormal ||
+             pPicture->repeatType == RepeatReflect))
+            return FALSE;
+
+        return TRUE;
+
+    default:
+        return FALSE;
+    }
+}
+
+static CARD32 TegraGradientColor(PictGradient *gradient, double t)
+{
+    PictGradientStopPtr stops = gradient->stops;
+    xRenderColor *c0, *c1;
+    double a, r, g, b, f;
+    double x0, x1;
+    int i;
+
+    for (i = 0; i < gradient->nstops - 1; i++) {
+        if (pixman_fixed_to_double(stops[i + 1].x) > t)
+            break;
+    }
+
+    c0 = &stops[i].color;
+    c1 = &stops[i].color;
+    f = 0.0;
+
+    if (i < gradient->nstops - 1) {
+        x0 = pixman_fixed_to_double(stops[i].x);
+        x1 = pixman_fixed_to_double(stops[i + 1].x);
+
+        if (t > x0 && x1 > x0) {
+            c1 = &stops[i + 1].color;
+            f = (t - x0) / (x1 - x0);
+        }
+    }
+
+    /* stops are interpolated unpremultiplied, like pixman does */
+    a = (c0->alpha + (c1->alpha - c0->alpha) * f) / 65535.0;
+    r = (c0->red   + (c1->red   - c0->red)   * f) / 65535.0 * a;
+    g = (c0->green + (c1->green - c0->green) * f) / 65535.0 * a;
+    b = (c0->blue  + (c1->blue  - c0->blue)  * f) / 65535.0 * a;
+
+    return (CARD32) (a * 255.0 + 0.5) << 24 |
+           (CARD32) (r * 255.0 + 0.5) << 16 |
+           (CARD32) (g * 255.0 + 0.5) << 8  |
+           (CARD32) (b * 255.0 + 0.5);
+}
+
+static void TegraGradientRasterize(PicturePtr pPicture, CARD32 *texels)
+{
+    PictRadialGradient *radial = &pPicture->pSourcePict->radial;
+    Bool is_radial = pPicture->pSourcePict->type == SourcePictTypeRadial;
+    double r1 = 0.0, r2 = 1.0;
+    double s, t;
+    unsigned i;
+
+    if (is_radial) {
+        r1 = pixman_fixed_to_double(radial->c1.radius);
+        r2 = pixman_fixed_to_double(radial->c2.radius);
+    }
+
+    for (i = 0; i < TEGRA_GRADIENT_RAMP_SIZE; i++) {
+        s = (i + 0.5) / TEGRA_GRADIENT_RAMP_SIZE;
+        t = s;
+
+        /* ramp spans radius of the outer circle, map it to the stops */
+        if (is_radial) {
+            t = (s * r2 - r1) / (r2 - r1);
+
+            if (t < 0.0 && !pPicture->repeat) {
+                texels[i] = 0x00000000;
+                continue;
+            }
+        }
+
+        texels[i] = TegraGradientColor(&pPicture->pSourcePict->gradient, t);
+    }
+}
+
+PixmapPtr TegraEXAGradientRamp(ScreenPtr pScreen, PicturePtr pPicture)
+{
+    TegraEXAPtr exa = TegraPTR(xf86ScreenToScrn(pScreen))->exa;
+    CARD32 texels[TEGRA_GRADIENT_RAMP_SIZE];
+    TegraGradientRampPtr ramp, lru = NULL;
+    PixmapPtr pPixmap;
+    TegraPixmapPtr priv;
+    unsigned i;
+
+    TegraGradientRasterize(pPicture, texels);
+
+    exa->gradient_serial++;
+
+    /*
+     * Source pictures don't have a stable identity, a toolkit creates new
+     * picture for every paint, hence ramps are looked up by content.
+     */
+    for (i = 0; i < TEGRA_GRADIENT_CACHE_SIZE; i++) {
+        ramp = &exa->gradient_ramps[i];
+
+        if (ramp->pPixmap &&
+            !memcmp(ramp->texels, texels, sizeof(texels))) {
+            ramp->serial = exa->gradient_serial;
+            return ramp->pPixmap;
+        }
+
+        if (!lru || !ramp->pPixmap ||
+            (lru->pPixmap && ramp->serial < lru->serial))
+            lru = ramp;
+    }
+
+    pPixmap = lru->pPixmap;
+
+    if (!pPixmap) {
+        pPixmap = pScreen->CreatePixmap(pScreen, TEGRA_GRADIENT_RAMP_SIZE,
+                                        1, 32, 0);
+        if (!pPixmap)
+            return NULL;
+
+        /* ramp is useless if GPU can't sample it */
+        priv = exaGetPixmapDriverPrivate(pPixmap);
+        if (priv->type <= TEGRA_EXA_PIXMAP_TYPE_FALLBACK)
+            goto destroy_pixmap;
+
+        lru->pPixmap = pPixmap;
+    }
+
+    /* waits for the jobs that still sample the evicted ramp */
+    if (!TegraEXAWritePixmap(pPixmap, texels, sizeof(texels)))
+        goto release_ramp;
+
+    memcpy(lru->texels, texels, sizeof(texels));
+    lru->serial = exa->gradient_serial;
+
+    return pPixmap;
+
+release_ramp:
+    lru->pPixmap = NULL;
+destroy_pixmap:
+    pScreen->DestroyPixmap(pPixmap);
+
+    return NULL;
+}
+
+void TegraEXAGradientMatrix(PicturePtr pPicture, float m[2][3])
+{
+    PictTransformPtr t = pPicture->transform;
+    PictRadialGradient *radial;
+    PictLinearGradient *linear;
+    double a[3] = { 1.0, 0.0, 0.0 };
+    double b[3] = { 0.0, 1.0, 0.0 };
+    double dx, dy, l2, k;
+    unsigned i;
+
+    /* picture transform maps destination into the gradient space */
+    if (t) {
+        for (i = 0; i < 3; i++) {
+            a[i] = pixman_fixed_to_double(t->matrix[0][i]);
+            b[i] = pixman_fixed_to_double(t->matrix[1][i]);
+        }
+    }
+
+    if (pPicture->pSourcePict->type == SourcePictTypeLinear) {
+        linear = &pPicture->pSourcePict->linear;
+
+        dx = pixman_fixed_to_double(linear->p2.x - linear->p1.x);
+        dy = pixman_fixed_to_double(linear->p2.y - linear->p1.y);
+        l2 = dx * dx + dy * dy;
+
+        /* t = (p - p1) . (p2 - p1) / |p2 - p1|^2 */
+        for (i = 0; i < 3; i++)
+            m[0][i] = (dx * a[i] + dy * b[i]) / l2;
+
+        m[0][2] -= (dx * pixman_fixed_to_double(linear->p1.x) +
+                    dy * pixman_fixed_to_double(linear->p1.y)) / l2;
+
+        /* ramp is one texel high, sample the middle of it */
+        m[1][0] = 0.0f;
+        m[1][1] = 0.0f;
+        m[1][2] = 0.5f;
+    } else {
+        radial = &pPicture->pSourcePict->radial;
+
+        k = 1.0 / pixman_fixed_to_double(radial->c2.radius);
+
+        for (i = 0; i < 3; i++) {
+            m[0][i] = a[i] * k;
+            m[1][i] = b[i] * k;
+        }
+
+        m[0][2] -= pixman_fixed_to_double(radial->c2.x) * k;
+        m[1][2] -= pixman_fixed_to_double(radial->c2.y) * k;
+    }
+}
+
+void TegraEXAReleaseGradientRamps(TegraEXAPtr exa)
+{
+    TegraGradientRampPtr ramp;
+    unsigned i;
+
+    for (i = 0; i < TEGRA_GRADIENT_CACHE_SIZE; i++) {
+        ramp = &exa->gradient_ramps[i];
+
+        if (ramp->pPixmap) {
+            ramp->pPixmap->drawable.pScreen->DestroyPixmap(ramp->pPixmap);
+            ramp->pPixmap = NULL;
+        }
+    }
+}
+
+/* vim: set et sts=4 sw=4 ts=4: */
@@ -492,6 +492,10 @@ static TegraPixmapPoolPtr TegraEXACompactPools(TegraPtr tegra, size_t size)
     if (xorg_list_is_empty(&exa->mem_pools))
         return NULL;
 
+    /* batched job references pixmaps at their current location */
+    TegraEXAFlushBatch(&exa->gr2d);
+    TegraEXAFlushBatch(&exa->gr3d);
+
     limit = TEGRA_EXA_POOL_SIZE * 10;
 
     slow_compact = TegraEXACompactPoolsSlowAllowed(exa, limit * 3 / 2);
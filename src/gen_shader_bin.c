@@ -25,6 +25,7 @@
 #include <fcntl.h>
 #include <getopt.h>
 #include <locale.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -34,11 +35,44 @@
 
 #include "asm.h"
 
+#define VARIANTS_MAX    8
+#define DEFINES_MAX     8
+
+/*
+ * Variant is the fragment program specialized on a state flags. It is
+ * assembled with "FLAG" defined for a pinned flag that is set and with
+ * "NO_FLAG" defined for a pinned flag that is cleared, unpinned flags are
+ * handled at runtime by the generic program.
+ */
+struct variant {
+    char *suffix;
+    char *defines[DEFINES_MAX];
+    char *flags[DEFINES_MAX];
+    unsigned defines_nb;
+};
+
 static char *vs_path;
 static char *fs_path;
 static char *lnk_path;
 static char *fp_name;
 static char *out_name;
+static char *variants_path;
+static char *budget_path;
+static int report;
+static int disasm;
+static int verify;
+
+static struct variant variants[VARIANTS_MAX];
+static unsigned variants_nb;
+
+/*
+ * Budget caps the static cost of every fragment program of the shader,
+ * zero means unlimited.
+ */
+static unsigned budget_cycles;
+static unsigned budget_regs;
+
+static struct fragment_asm_cost fs_cost;
 
 static int parse_command_line(int argc, char *argv[])
 {
@@ -53,6 +87,11 @@ static int parse_command_line(int argc, char *argv[])
             {"lnk",     required_argument, NULL, 0},
             {"name",    required_argument, NULL, 0},
             {"out",     required_argument, NULL, 0},
+            {"variants", required_argument, NULL, 0},
+            {"budget",  required_argument, NULL, 0},
+            {"report",  no_argument,       NULL, 0},
+            {"disasm",  no_argument,       NULL, 0},
+            {"verify",  no_argument,       NULL, 0},
             { /* Sentinel */ }
         };
         int option_index = 0;
@@ -77,6 +116,21 @@ static int parse_command_line(int argc, char *argv[])
             case 4:
                 out_name = optarg;
                 break;
+            case 5:
+                variants_path = optarg;
+                break;
+            case 6:
+                budget_path = optarg;
+                break;
+            case 7:
+                report = 1;
+                break;
+            case 8:
+                disasm = 1;
+                break;
+            case 9:
+                verify = 1;
+                break;
             default:
                 return 0;
             }
@@ -127,51 +181,478 @@ static char *read_file(const char *path)
     return data;
 }
 
-int main(int argc, char *argv[])
+static int is_defined(const char *name, size_t len,
+                      char * const *defines, unsigned defines_nb)
 {
-    uint32_t in_mask = 0, out_mask = 0;
-    char *asm_txt;
-    unsigned int i;
-    FILE *out;
-    int err;
+    unsigned i;
 
-    /* float decimal point is locale-dependent */
-    setlocale(LC_ALL, "C");
+    for (i = 0; i < defines_nb; i++) {
+        if (strlen(defines[i]) == len && !strncmp(defines[i], name, len))
+            return 1;
+    }
 
-    if (!parse_command_line(argc, argv))
+    return 0;
+}
+
+/*
+ * Evaluates #ifdef / #ifndef / #else / #endif directives of the assembly,
+ * directive lines and lines of the false branches are blanked to preserve
+ * line numbers of the parser errors.
+ */
+static void preprocess(const char *path, char *txt,
+                       char * const *defines, unsigned defines_nb)
+{
+    unsigned skip_mask = 0, else_mask = 0, depth = 0;
+    char *line = txt, *end, *p, *name;
+    unsigned lineno = 1;
+    size_t len;
+    int cond;
+
+    while (*line) {
+        end = strchr(line, '\n');
+        if (!end)
+            end = line + strlen(line);
+
+        for (p = line; p < end && (*p == ' ' || *p == '\t'); p++);
+
+        if (!strncmp(p, "#ifdef", 6) || !strncmp(p, "#ifndef", 7)) {
+            cond = !strncmp(p, "#ifdef", 6);
+
+            for (name = p + (cond ? 6 : 7);
+                 name < end && (*name == ' ' || *name == '\t'); name++);
+
+            for (len = 0; name + len < end && name[len] != ' ' &&
+                          name[len] != '\t' && name[len] != '\r'; len++);
+
+            if (depth == 32) {
+                fprintf(stderr, "%s: line %u: nesting is too deep\n",
+                        path, lineno);
+                abort();
+            }
+
+            if (is_defined(name, len, defines, defines_nb) != cond)
+                skip_mask |= 1u << depth;
+
+            else_mask &= ~(1u << depth);
+            depth++;
+        } else if (!strncmp(p, "#else", 5)) {
+            if (!depth || (else_mask & (1u << (depth - 1)))) {
+                fprintf(stderr, "%s: line %u: unexpected #else\n",
+                        path, lineno);
+                abort();
+            }
+
+            skip_mask ^= 1u << (depth - 1);
+            else_mask |= 1u << (depth - 1);
+        } else if (!strncmp(p, "#endif", 6)) {
+            if (!depth) {
+                fprintf(stderr, "%s: line %u: unexpected #endif\n",
+                        path, lineno);
+                abort();
+            }
+
+            depth--;
+            skip_mask &= ~(1u << depth);
+        } else if (!skip_mask) {
+            goto next_line;
+        }
+
+        memset(line, ' ', end - line);
+next_line:
+        line = *end ? end + 1 : end;
+        lineno++;
+    }
+
+    if (depth) {
+        fprintf(stderr, "%s: unterminated #ifdef\n", path);
+        abort();
+    }
+}
+
+/*
+ * Each line of the variants file describes one variant:
+ *
+ *     <suffix> [!]FLAG...
+ *
+ * Runtime picks the variant of the lowest static cost among the ones that
+ * match the state.
+ */
+static void parse_variants(const char *path)
+{
+    struct variant *v;
+    char *txt, *line, *tok, *save_line, *save_tok;
+    size_t len;
+
+    txt = read_file(path);
+
+    for (line = strtok_r(txt, "\n", &save_line); line;
+         line = strtok_r(NULL, "\n", &save_line)) {
+        tok = strtok_r(line, " \t", &save_tok);
+        if (!tok || tok[0] == '#')
+            continue;
+
+        if (variants_nb == VARIANTS_MAX) {
+            fprintf(stderr, "%s: too many variants\n", path);
+            abort();
+        }
+
+        v = &variants[variants_nb++];
+        v->suffix = strdup(tok);
+
+        while ((tok = strtok_r(NULL, " \t", &save_tok))) {
+            if (v->defines_nb == DEFINES_MAX) {
+                fprintf(stderr, "%s: too many flags\n", path);
+                abort();
+            }
+
+            v->flags[v->defines_nb] = strdup(tok);
+
+            if (tok[0] == '!') {
+                len = strlen(tok) + 3;
+                v->defines[v->defines_nb] = malloc(len);
+                snprintf(v->defines[v->defines_nb], len, "NO_%s", tok + 1);
+            } else {
+                v->defines[v->defines_nb] = strdup(tok);
+            }
+
+            v->defines_nb++;
+        }
+    }
+
+    free(txt);
+}
+
+/*
+ * Each line of the budget file is a limit:
+ *
+ *     cycles <estimated clocks per fragment>
+ *     regs <row registers>
+ */
+static void parse_budget(const char *path)
+{
+    char *txt, *line, *tok, *save_line, *save_tok;
+    unsigned *limit;
+
+    txt = read_file(path);
+
+    for (line = strtok_r(txt, "\n", &save_line); line;
+         line = strtok_r(NULL, "\n", &save_line)) {
+        tok = strtok_r(line, " \t", &save_tok);
+        if (!tok || tok[0] == '#')
+            continue;
+
+        if (!strcmp(tok, "cycles")) {
+            limit = &budget_cycles;
+        } else if (!strcmp(tok, "regs")) {
+            limit = &budget_regs;
+        } else {
+            fprintf(stderr, "%s: unknown limit %s\n", path, tok);
+            abort();
+        }
+
+        tok = strtok_r(NULL, " \t", &save_tok);
+        if (!tok) {
+            fprintf(stderr, "%s: limit value is missing\n", path);
+            abort();
+        }
+
+        *limit = strtoul(tok, NULL, 0);
+    }
+
+    free(txt);
+}
+
+static void print_cost(FILE *out, const char *name)
+{
+    fprintf(out, "%s: %u EXEC, %u ALU (%u of %u ops), %u MFU, %u TEX, "
+            "%u regs, %u TRAM rows, %u clk/fragment (%.2f fragment/clk)\n",
+            name, fs_cost.execs_nb, fs_cost.alu_nb, fs_cost.alu_ops_nb,
+            fs_cost.alu_nb * 4, fs_cost.mfu_nb, fs_cost.tex_nb,
+            fs_cost.regs_nb, asm_linker_used_tram_rows_nb, fs_cost.cycles,
+            1.0 / fs_cost.cycles);
+}
+
+static int check_cost(const char *name)
+{
+    if (report)
+        print_cost(stdout, name);
+
+    if ((budget_cycles && fs_cost.cycles > budget_cycles) ||
+        (budget_regs && fs_cost.regs_nb > budget_regs)) {
+        fprintf(stderr, "%s: program exceeds the budget\n", budget_path);
+        print_cost(stderr, name);
         return 1;
+    }
 
-    /* parse vertex asm */
-    asm_txt = read_file(vs_path);
-    if (!asm_txt)
+    return 0;
+}
+
+static char *disassemble(const char *name, const char *unit,
+                         int (*disassemble_fn)(FILE *))
+{
+    char *txt = NULL;
+    size_t size = 0;
+    FILE *out;
+    int ok;
+
+    out = open_memstream(&txt, &size);
+    if (!out) {
+        fprintf(stderr, "Failed to open memstream: %s\n", strerror(errno));
+        abort();
+    }
+
+    ok = disassemble_fn(out);
+    fclose(out);
+
+    if (!ok) {
+        fprintf(stderr, "%s: %s disassembly failed\n", name, unit);
+        free(txt);
+        return NULL;
+    }
+
+    if (disasm)
+        printf("// %s %s program\n\n%s\n", name, unit, txt);
+
+    return txt;
+}
+
+static int mismatch(const char *name, const char *what, unsigned index)
+{
+    fprintf(stderr, "%s: disassembly doesn't reassemble, %s %u differs\n",
+            name, what, index);
+    return 1;
+}
+
+/*
+ * Disassembles the parsed program and assembles the listing back, binary
+ * of the reassembled program must be identical.
+ */
+static int verify_vertex(const char *name)
+{
+    static vpe_instr128 instructions[256];
+    static asm_const constants[256];
+    uint32_t in_mask = 0, out_mask = 0;
+    int instructions_nb;
+    unsigned i;
+    char *txt;
+    int err;
+
+    txt = disassemble(name, "vertex", vertex_asm_disassemble);
+    if (!txt)
         return 1;
 
-    vertex_asm_scan_string(asm_txt);
-    err = vertex_asmparse();
-    if (err)
-        return err;
+    if (!verify) {
+        free(txt);
+        return 0;
+    }
+
+    memcpy(instructions, asm_vs_instructions, sizeof(instructions));
+    memcpy(constants, asm_vs_constants, sizeof(constants));
+    instructions_nb = asm_vs_instructions_nb;
+
+    for (i = 0; i < 16; i++) {
+        in_mask |= !!asm_vs_attributes[i].used << i;
+        out_mask |= !!asm_vs_exports[i].used << i;
+    }
 
+    vertex_asm_scan_string(txt);
+    err = vertex_asmparse();
     vertex_asmlex_destroy();
-    free(asm_txt);
+    free(txt);
 
-    /* parse linker asm */
-    asm_txt = read_file(lnk_path);
-    if (!asm_txt)
+    if (err) {
+        fprintf(stderr, "%s: disassembly doesn't assemble\n", name);
         return 1;
+    }
 
-    linker_asm_scan_string(asm_txt);
-    err = linker_asmparse();
-    if (err)
-        return err;
+    if (asm_vs_instructions_nb != instructions_nb)
+        return mismatch(name, "instructions number", asm_vs_instructions_nb);
+
+    for (i = 0; i < instructions_nb; i++) {
+        if (memcmp(&asm_vs_instructions[i], &instructions[i],
+                   sizeof(instructions[i])))
+            return mismatch(name, "instruction", i);
+    }
+
+    for (i = 0; i < 256; i++) {
+        if (asm_vs_constants[i].used != constants[i].used ||
+            memcmp(&asm_vs_constants[i].vector, &constants[i].vector,
+                   sizeof(constants[i].vector)))
+            return mismatch(name, "constant", i);
+    }
+
+    for (i = 0; i < 16; i++) {
+        in_mask ^= !!asm_vs_attributes[i].used << i;
+        out_mask ^= !!asm_vs_exports[i].used << i;
+    }
+
+    if (in_mask || out_mask)
+        return mismatch(name, "attributes mask", in_mask | out_mask);
+
+    return 0;
+}
+
+static int verify_linker(const char *name)
+{
+    static link_instr instructions[32];
+    unsigned instructions_nb;
+    unsigned tram_rows_nb;
+    unsigned i;
+    char *txt;
+    int err;
+
+    txt = disassemble(name, "linker", linker_asm_disassemble);
+    if (!txt)
+        return 1;
 
+    if (!verify) {
+        free(txt);
+        return 0;
+    }
+
+    memcpy(instructions, asm_linker_instructions, sizeof(instructions));
+    instructions_nb = asm_linker_instructions_nb;
+    tram_rows_nb = asm_linker_used_tram_rows_nb;
+
+    linker_asm_scan_string(txt);
+    err = linker_asmparse();
     linker_asmlex_destroy();
-    free(asm_txt);
+    free(txt);
+
+    if (err) {
+        fprintf(stderr, "%s: disassembly doesn't assemble\n", name);
+        return 1;
+    }
+
+    if (asm_linker_instructions_nb != instructions_nb)
+        return mismatch(name, "instructions number",
+                        asm_linker_instructions_nb);
+
+    if (asm_linker_used_tram_rows_nb != tram_rows_nb)
+        return mismatch(name, "TRAM rows number",
+                        asm_linker_used_tram_rows_nb);
+
+    for (i = 0; i < instructions_nb; i++) {
+        if (asm_linker_instructions[i].data != instructions[i].data)
+            return mismatch(name, "instruction", i);
+    }
+
+    return 0;
+}
+
+static int verify_fragment(const char *name)
+{
+    static pseq_instr pseq[64];
+    static mfu_instr mfu[64];
+    static tex_instr tex[64];
+    static alu_instr alu[64];
+    static dw_instr dw[64];
+    static instr_sched mfu_sched[64];
+    static instr_sched alu_sched[64];
+    static uint32_t constants[32];
+    unsigned instructions_nb, mfu_nb, alu_nb;
+    unsigned alu_buffer_size, pseq_to_dw_exec_nb;
+    unsigned i;
+    char *txt;
+    int err;
+
+    txt = disassemble(name, "fragment", fragment_asm_disassemble);
+    if (!txt)
+        return 1;
+
+    if (!verify) {
+        free(txt);
+        return 0;
+    }
+
+    memcpy(pseq, asm_pseq_instructions, sizeof(pseq));
+    memcpy(mfu, asm_mfu_instructions, sizeof(mfu));
+    memcpy(tex, asm_tex_instructions, sizeof(tex));
+    memcpy(alu, asm_alu_instructions, sizeof(alu));
+    memcpy(dw, asm_dw_instructions, sizeof(dw));
+    memcpy(mfu_sched, asm_mfu_sched, sizeof(mfu_sched));
+    memcpy(alu_sched, asm_alu_sched, sizeof(alu_sched));
+    memcpy(constants, asm_fs_constants, sizeof(constants));
+
+    instructions_nb = asm_fs_instructions_nb;
+    mfu_nb = asm_mfu_instructions_nb;
+    alu_nb = asm_alu_instructions_nb;
+    alu_buffer_size = asm_alu_buffer_size;
+    pseq_to_dw_exec_nb = asm_pseq_to_dw_exec_nb;
+
+    fragment_asm_scan_string(txt);
+    err = fragment_asmparse();
+    fragment_asmlex_destroy();
+    free(txt);
+
+    if (err) {
+        fprintf(stderr, "%s: disassembly doesn't assemble\n", name);
+        return 1;
+    }
+
+    if (asm_fs_instructions_nb != instructions_nb ||
+        asm_mfu_instructions_nb != mfu_nb ||
+        asm_alu_instructions_nb != alu_nb)
+        return mismatch(name, "instructions number", asm_fs_instructions_nb);
+
+    if (asm_alu_buffer_size != alu_buffer_size)
+        return mismatch(name, "ALU buffer size", asm_alu_buffer_size);
+
+    if (asm_pseq_to_dw_exec_nb != pseq_to_dw_exec_nb)
+        return mismatch(name, "PSEQ to DW EXECs", asm_pseq_to_dw_exec_nb);
+
+    for (i = 0; i < instructions_nb; i++) {
+        if (asm_pseq_instructions[i].data != pseq[i].data)
+            return mismatch(name, "PSEQ of EXEC", i);
+
+        if (asm_mfu_sched[i].data != mfu_sched[i].data)
+            return mismatch(name, "MFU schedule of EXEC", i);
+
+        if (asm_tex_instructions[i].data != tex[i].data)
+            return mismatch(name, "TEX of EXEC", i);
+
+        if (asm_alu_sched[i].data != alu_sched[i].data)
+            return mismatch(name, "ALU schedule of EXEC", i);
+
+        if (asm_alu_instructions[i].complement != alu[i].complement)
+            return mismatch(name, "ALU complement of EXEC", i);
+
+        if (asm_dw_instructions[i].data != dw[i].data)
+            return mismatch(name, "DW of EXEC", i);
+    }
+
+    for (i = 0; i < mfu_nb; i++) {
+        if (asm_mfu_instructions[i].part0 != mfu[i].part0 ||
+            asm_mfu_instructions[i].part1 != mfu[i].part1)
+            return mismatch(name, "MFU instruction", i);
+    }
+
+    /* complement belongs to EXEC and is checked above */
+    for (i = 0; i < alu_nb; i++) {
+        if (memcmp(&asm_alu_instructions[i], &alu[i],
+                   offsetof(alu_instr, complement)))
+            return mismatch(name, "ALU instruction", i);
+    }
+
+    for (i = 0; i < 32; i++) {
+        if (asm_fs_constants[i] != constants[i])
+            return mismatch(name, "constant", i);
+    }
+
+    return 0;
+}
+
+static int assemble_fragment(char * const *defines, unsigned defines_nb)
+{
+    char *asm_txt;
+    int err;
 
-    /* parse fragment asm */
     asm_txt = read_file(fs_path);
     if (!asm_txt)
         return 1;
 
+    preprocess(fs_path, asm_txt, defines, defines_nb);
+
     fragment_asm_scan_string(asm_txt);
     err = fragment_asmparse();
     if (err)
@@ -180,16 +661,16 @@ int main(int argc, char *argv[])
     fragment_asmlex_destroy();
     free(asm_txt);
 
-    out = fopen(out_name, "w");
-    if (!out) {
-        fprintf(stderr, "Failed to open %s: %s\n", out_name, strerror(errno));
-        return 1;
-    }
+    fragment_asm_cost(&fs_cost);
 
-    fprintf(out, "/* Autogenerated file */\n\n");
-    fprintf(out, "#include \"shaders/prog.h\"\n\n");
+    return 0;
+}
+
+static void emit_fragment(FILE *out, const char *name)
+{
+    unsigned int i;
 
-    fprintf(out, "static uint32_t fs_%s_words[] = {\n", fp_name);
+    fprintf(out, "static uint32_t fs_%s_words[] = {\n", name);
 
     fprintf(out, "    HOST1X_OPCODE_NONINCR(0x541, %d),\n",
             asm_fs_instructions_nb);
@@ -244,6 +725,145 @@ int main(int argc, char *argv[])
         fprintf(out, "    0x%08X,\n", asm_dw_instructions[i].data);
 
     fprintf(out, "};\n\n");
+}
+
+static void emit_program(FILE *out, const char *name,
+                         uint32_t in_mask, uint32_t out_mask)
+{
+    fprintf(out, "static struct shader_program prog_%s = {\n", name);
+    fprintf(out, "    .vs_prog_words = vs_%s_words,\n", fp_name);
+    fprintf(out, "    .vs_prog_words_nb = TEGRA_ARRAY_SIZE(vs_%s_words),\n", fp_name);
+    fprintf(out, "    .vs_attrs_in_mask = %u,\n", in_mask);
+    fprintf(out, "    .vs_attrs_out_mask = %u,\n", out_mask);
+    fprintf(out, "\n");
+    fprintf(out, "    .fs_prog_words = fs_%s_words,\n", name);
+    fprintf(out, "    .fs_prog_words_nb = TEGRA_ARRAY_SIZE(fs_%s_words),\n", name);
+    fprintf(out, "    .fs_alu_buf_size = %u,\n", asm_alu_buffer_size);
+    fprintf(out, "    .fs_pseq_to_dw = %u,\n", asm_pseq_to_dw_exec_nb);
+    fprintf(out, "    .fs_pseq_inst_nb = %u,\n", asm_fs_instructions_nb);
+    fprintf(out, "\n");
+    fprintf(out, "    .fs_alu_inst_nb = %u,\n", fs_cost.alu_nb);
+    fprintf(out, "    .fs_mfu_inst_nb = %u,\n", fs_cost.mfu_nb);
+    fprintf(out, "    .fs_tex_inst_nb = %u,\n", fs_cost.tex_nb);
+    fprintf(out, "    .fs_regs_nb = %u,\n", fs_cost.regs_nb);
+    fprintf(out, "    .fs_cycles = %u,\n", fs_cost.cycles);
+    fprintf(out, "\n");
+    fprintf(out, "    .linker_words = lnk_%s_words,\n", fp_name);
+    fprintf(out, "    .linker_words_nb = TEGRA_ARRAY_SIZE(lnk_%s_words),\n", fp_name);
+    fprintf(out, "    .linker_inst_nb = %u,\n", asm_linker_instructions_nb);
+    fprintf(out, "    .used_tram_rows_nb = %u,\n", asm_linker_used_tram_rows_nb);
+
+    /* only the generic program refers to the variants */
+    if (strcmp(name, fp_name) || !variants_nb) {
+        fprintf(out, "};\n\n");
+        return;
+    }
+
+    fprintf(out, "\n");
+    fprintf(out, "    .variants = prog_%s_variants,\n", fp_name);
+    fprintf(out, "    .variants_nb = %u,\n", variants_nb);
+    fprintf(out, "};\n");
+}
+
+static void emit_variants(FILE *out)
+{
+    unsigned int i, k;
+    const char *flag;
+
+    fprintf(out, "static struct shader_variant prog_%s_variants[] = {\n",
+            fp_name);
+
+    for (i = 0; i < variants_nb; i++) {
+        fprintf(out, "    {\n");
+
+        fprintf(out, "        .flags_mask = 0");
+        for (k = 0; k < variants[i].defines_nb; k++) {
+            flag = variants[i].flags[k];
+            fprintf(out, " | SHADER_%s", flag[0] == '!' ? flag + 1 : flag);
+        }
+        fprintf(out, ",\n");
+
+        fprintf(out, "        .flags = 0");
+        for (k = 0; k < variants[i].defines_nb; k++) {
+            flag = variants[i].flags[k];
+            if (flag[0] != '!')
+                fprintf(out, " | SHADER_%s", flag);
+        }
+        fprintf(out, ",\n");
+
+        fprintf(out, "        .prog = &prog_%s_%s,\n",
+                fp_name, variants[i].suffix);
+        fprintf(out, "    },\n");
+    }
+
+    fprintf(out, "};\n\n");
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t in_mask = 0, out_mask = 0;
+    char name[256];
+    char *asm_txt;
+    unsigned int i;
+    FILE *out;
+    int err;
+
+    /* float decimal point is locale-dependent */
+    setlocale(LC_ALL, "C");
+
+    if (!parse_command_line(argc, argv))
+        return 1;
+
+    /* parse vertex asm */
+    asm_txt = read_file(vs_path);
+    if (!asm_txt)
+        return 1;
+
+    vertex_asm_scan_string(asm_txt);
+    err = vertex_asmparse();
+    if (err)
+        return err;
+
+    vertex_asmlex_destroy();
+    free(asm_txt);
+
+    /* parse linker asm */
+    asm_txt = read_file(lnk_path);
+    if (!asm_txt)
+        return 1;
+
+    linker_asm_scan_string(asm_txt);
+    err = linker_asmparse();
+    if (err)
+        return err;
+
+    linker_asmlex_destroy();
+    free(asm_txt);
+
+    if (disasm || verify) {
+        err = verify_vertex(fp_name);
+        if (err)
+            return err;
+
+        err = verify_linker(fp_name);
+        if (err)
+            return err;
+    }
+
+    if (variants_path)
+        parse_variants(variants_path);
+
+    if (budget_path)
+        parse_budget(budget_path);
+
+    out = fopen(out_name, "w");
+    if (!out) {
+        fprintf(stderr, "Failed to open %s: %s\n", out_name, strerror(errno));
+        return 1;
+    }
+
+    fprintf(out, "/* Autogenerated file */\n\n");
+    fprintf(out, "#include \"shaders/prog.h\"\n\n");
 
     fprintf(out, "static uint32_t vs_%s_words[] = {\n", fp_name);
 
@@ -279,23 +899,47 @@ int main(int argc, char *argv[])
 
     fprintf(out, "};\n\n");
 
-    fprintf(out, "static struct shader_program prog_%s = {\n", fp_name);
-    fprintf(out, "    .vs_prog_words = vs_%s_words,\n", fp_name);
-    fprintf(out, "    .vs_prog_words_nb = TEGRA_ARRAY_SIZE(vs_%s_words),\n", fp_name);
-    fprintf(out, "    .vs_attrs_in_mask = %u,\n", in_mask);
-    fprintf(out, "    .vs_attrs_out_mask = %u,\n", out_mask);
-    fprintf(out, "\n");
-    fprintf(out, "    .fs_prog_words = fs_%s_words,\n", fp_name);
-    fprintf(out, "    .fs_prog_words_nb = TEGRA_ARRAY_SIZE(fs_%s_words),\n", fp_name);
-    fprintf(out, "    .fs_alu_buf_size = %u,\n", asm_alu_buffer_size);
-    fprintf(out, "    .fs_pseq_to_dw = %u,\n", asm_pseq_to_dw_exec_nb);
-    fprintf(out, "    .fs_pseq_inst_nb = %u,\n", asm_fs_instructions_nb);
-    fprintf(out, "\n");
-    fprintf(out, "    .linker_words = lnk_%s_words,\n", fp_name);
-    fprintf(out, "    .linker_words_nb = TEGRA_ARRAY_SIZE(lnk_%s_words),\n", fp_name);
-    fprintf(out, "    .linker_inst_nb = %u,\n", asm_linker_instructions_nb);
-    fprintf(out, "    .used_tram_rows_nb = %u,\n", asm_linker_used_tram_rows_nb);
-    fprintf(out, "};\n");
+    /* specialized variants share vertex program and linker */
+    for (i = 0; i < variants_nb; i++) {
+        err = assemble_fragment(variants[i].defines, variants[i].defines_nb);
+        if (err)
+            return err;
+
+        snprintf(name, sizeof(name), "%s_%s", fp_name, variants[i].suffix);
+
+        err = check_cost(name);
+        if (err)
+            return err;
+
+        if (disasm || verify) {
+            err = verify_fragment(name);
+            if (err)
+                return err;
+        }
+
+        emit_fragment(out, name);
+        emit_program(out, name, in_mask, out_mask);
+    }
+
+    if (variants_nb)
+        emit_variants(out);
+
+    err = assemble_fragment(NULL, 0);
+    if (err)
+        return err;
+
+    err = check_cost(fp_name);
+    if (err)
+        return err;
+
+    if (disasm || verify) {
+        err = verify_fragment(fp_name);
+        if (err)
+            return err;
+    }
+
+    emit_fragment(out, fp_name);
+    emit_program(out, fp_name, in_mask, out_mask);
 
     return 0;
 }
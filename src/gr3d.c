@@ -23,135 +23,157 @@
 
 #include "driver.h"
 
-static void TegraGR3D_InitState(struct tegra_stream *cmds)
+/* upper bound of the fixed part of initialization, program excluded */
+#define TGR3D_INIT_STATE_WORDS_MAX  256
+
+static inline uint32_t TegraGR3D_Float(float f)
+{
+    union {
+        uint32_t u;
+        float f;
+    } value;
+
+    value.f = f;
+
+    return value.u;
+}
+
+static uint32_t * TegraGR3D_InitState(uint32_t *cs)
 {
     unsigned  i;
 
     /* Tegra30 specific stuff */
 
-    tegra_stream_prep(cmds, 17);
-    tegra_stream_push(cmds, HOST1X_OPCODE_INCR(0x750, 16));
+    *cs++ = HOST1X_OPCODE_INCR(0x750, 16);
     for (i = 0; i < 16; i++)
-        tegra_stream_push(cmds, 0x00000000);
+        *cs++ = 0x00000000;
 
-    tegra_stream_prep(cmds, 6);
-    tegra_stream_push(cmds, HOST1X_OPCODE_INCR(0x907, 5));
+    *cs++ = HOST1X_OPCODE_INCR(0x907, 5);
     for (i = 0; i < 5; i++)
-        tegra_stream_push(cmds, 0x00000000);
+        *cs++ = 0x00000000;
 
-    tegra_stream_prep(cmds, 3);
-    tegra_stream_push(cmds, HOST1X_OPCODE_INCR(0xb00, 2));
-    tegra_stream_push(cmds, 0x00000003);
-    tegra_stream_push(cmds, 0x00000000);
+    *cs++ = HOST1X_OPCODE_INCR(0xb00, 2);
+    *cs++ = 0x00000003;
+    *cs++ = 0x00000000;
 
-    tegra_stream_prep(cmds, 1);
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0xb04, 0x00000000));
+    *cs++ = HOST1X_OPCODE_IMM(0xb04, 0x00000000);
 
-    tegra_stream_prep(cmds, 14);
-    tegra_stream_push(cmds, HOST1X_OPCODE_INCR(0xb06, 13));
+    *cs++ = HOST1X_OPCODE_INCR(0xb06, 13);
     for (i = 0; i < 13; i++)
-        tegra_stream_push(cmds, 0x00000000);
+        *cs++ = 0x00000000;
 
-    tegra_stream_prep(cmds, 1);
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0xb14, 0x00000000));
+    *cs++ = HOST1X_OPCODE_IMM(0xb14, 0x00000000);
 
     /* End of Tegra30 specific stuff */
 
-    tegra_stream_prep(cmds, 10);
-    tegra_stream_push(cmds, HOST1X_OPCODE_INCR(0x00d, 9));
+    *cs++ = HOST1X_OPCODE_INCR(0x00d, 9);
     for (i = 0; i < 9; i++)
-        tegra_stream_push(cmds, 0x00000000);
+        *cs++ = 0x00000000;
 
-    tegra_stream_prep(cmds, 3);
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0x124, 0x00000007));
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0x125, 0x00000000));
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0x126, 0x00000000));
+    *cs++ = HOST1X_OPCODE_IMM(0x124, 0x00000007);
+    *cs++ = HOST1X_OPCODE_IMM(0x125, 0x00000000);
+    *cs++ = HOST1X_OPCODE_IMM(0x126, 0x00000000);
 
-    tegra_stream_prep(cmds, 6);
-    tegra_stream_push(cmds, HOST1X_OPCODE_INCR(0x200, 5));
-    tegra_stream_push(cmds, 0x00000011);
-    tegra_stream_push(cmds, 0x0000ffff);
-    tegra_stream_push(cmds, 0x00ff0000);
-    tegra_stream_push(cmds, 0x00000000);
-    tegra_stream_push(cmds, 0x00000000);
+    *cs++ = HOST1X_OPCODE_INCR(0x200, 5);
+    *cs++ = 0x00000011;
+    *cs++ = 0x0000ffff;
+    *cs++ = 0x00ff0000;
+    *cs++ = 0x00000000;
+    *cs++ = 0x00000000;
 
-    tegra_stream_prep(cmds, 3);
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0x209, 0x00000000));
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0x20a, 0x00000000));
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0x20b, 0x00000003));
+    *cs++ = HOST1X_OPCODE_IMM(0x209, 0x00000000);
+    *cs++ = HOST1X_OPCODE_IMM(0x20a, 0x00000000);
+    *cs++ = HOST1X_OPCODE_IMM(0x20b, 0x00000003);
 
-    tegra_stream_prep(cmds, 5);
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0x34e, 0x3f800000));
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0x34f, 0x00000000));
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0x35b, 0x00000205));
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0x363, 0x00000000));
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0x364, 0x00000000));
+    *cs++ = HOST1X_OPCODE_IMM(0x34e, 0x3f800000);
+    *cs++ = HOST1X_OPCODE_IMM(0x34f, 0x00000000);
+    *cs++ = HOST1X_OPCODE_IMM(0x35b, 0x00000205);
+    *cs++ = HOST1X_OPCODE_IMM(0x363, 0x00000000);
+    *cs++ = HOST1X_OPCODE_IMM(0x364, 0x00000000);
 
-    tegra_stream_prep(cmds, 2);
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0x412, 0x00000000));
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0x413, 0x00000000));
+    *cs++ = HOST1X_OPCODE_IMM(0x412, 0x00000000);
+    *cs++ = HOST1X_OPCODE_IMM(0x413, 0x00000000);
 
-    tegra_stream_prep(cmds, 32);
-    tegra_stream_push(cmds, HOST1X_OPCODE_INCR(0x521, 31));
+    *cs++ = HOST1X_OPCODE_INCR(0x521, 31);
     for (i = 1; i < 32; i++)
-        tegra_stream_push(cmds, 0x00000000);
+        *cs++ = 0x00000000;
+
+    *cs++ = HOST1X_OPCODE_IMM(0xe40, 0x00000000);
+    *cs++ = HOST1X_OPCODE_IMM(0xe41, 0x00000000);
+    *cs++ = HOST1X_OPCODE_IMM(0xe25, 0x00000000);
+    *cs++ = HOST1X_OPCODE_IMM(0xe26, 0x00000000);
+
+    *cs++ = HOST1X_OPCODE_INCR(0x406, 12);
+    *cs++ = 0x00000001;
+    *cs++ = 0x00000000;
+    *cs++ = 0x00000000;
+    *cs++ = 0x00000000;
+    *cs++ = 0x1fff1fff;
+    *cs++ = 0x00000000;
+    *cs++ = 0x00000006;
+    *cs++ = 0x00000000;
+    *cs++ = 0x00000008;
+    *cs++ = 0x00000048;
+    *cs++ = 0x00000000;
+    *cs++ = 0x00000000;
+
+    *cs++ = HOST1X_OPCODE_IMM(0x501, 0x00000007);
+    *cs++ = HOST1X_OPCODE_IMM(0x502, 0x00000000);
+    *cs++ = HOST1X_OPCODE_IMM(0x503, 0x00000000);
+    *cs++ = HOST1X_OPCODE_IMM(0x542, 0x00000000);
+    *cs++ = HOST1X_OPCODE_IMM(0x543, 0x00000000);
+    *cs++ = HOST1X_OPCODE_IMM(0x544, 0x00000000);
+    *cs++ = HOST1X_OPCODE_IMM(0x545, 0x00000000);
+    *cs++ = HOST1X_OPCODE_IMM(0x60e, 0x00000000);
+    *cs++ = HOST1X_OPCODE_IMM(0x702, 0x00000000);
+    *cs++ = HOST1X_OPCODE_IMM(0x740, 0x00000035);
+    *cs++ = HOST1X_OPCODE_IMM(0x741, 0x00000000);
+    *cs++ = HOST1X_OPCODE_IMM(0x742, 0x00000000);
+    *cs++ = HOST1X_OPCODE_IMM(0x902, 0x00000000);
+
+    *cs++ = HOST1X_OPCODE_INCR(TGR3D_FDC_CONTROL, 13);
+    *cs++ = 0x00000e00 | TGR3D_FDC_CONTROL_INVALIDATE;
+    *cs++ = 0x00000000;
+    *cs++ = 0x000001ff;
+    *cs++ = 0x000001ff;
+    *cs++ = 0x000001ff;
+    *cs++ = 0x00000030;
+    *cs++ = 0x00000020;
+    *cs++ = 0x000001ff;
+    *cs++ = 0x00000100;
+    *cs++ = 0x0f0f0f0f;
+    *cs++ = 0x00000000;
+    *cs++ = 0x00000000;
+    *cs++ = 0x00000000;
+
+    return cs;
+}
 
-    tegra_stream_prep(cmds, 4);
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0xe40, 0x00000000));
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0xe41, 0x00000000));
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0xe25, 0x00000000));
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0xe26, 0x00000000));
-
-    tegra_stream_prep(cmds, 13);
-    tegra_stream_push(cmds, HOST1X_OPCODE_INCR(0x406, 12));
-    tegra_stream_push(cmds, 0x00000001);
-    tegra_stream_push(cmds, 0x00000000);
-    tegra_stream_push(cmds, 0x00000000);
-    tegra_stream_push(cmds, 0x00000000);
-    tegra_stream_push(cmds, 0x1fff1fff);
-    tegra_stream_push(cmds, 0x00000000);
-    tegra_stream_push(cmds, 0x00000006);
-    tegra_stream_push(cmds, 0x00000000);
-    tegra_stream_push(cmds, 0x00000008);
-    tegra_stream_push(cmds, 0x00000048);
-    tegra_stream_push(cmds, 0x00000000);
-    tegra_stream_push(cmds, 0x00000000);
-
-    tegra_stream_prep(cmds, 13);
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0x501, 0x00000007));
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0x502, 0x00000000));
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0x503, 0x00000000));
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0x542, 0x00000000));
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0x543, 0x00000000));
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0x544, 0x00000000));
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0x545, 0x00000000));
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0x60e, 0x00000000));
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0x702, 0x00000000));
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0x740, 0x00000035));
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0x741, 0x00000000));
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0x742, 0x00000000));
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0x902, 0x00000000));
-
-    tegra_stream_prep(cmds, 14);
-    tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_FDC_CONTROL, 13));
-    tegra_stream_push(cmds, 0x00000e00 | TGR3D_FDC_CONTROL_INVALIDATE);
-    tegra_stream_push(cmds, 0x00000000);
-    tegra_stream_push(cmds, 0x000001ff);
-    tegra_stream_push(cmds, 0x000001ff);
-    tegra_stream_push(cmds, 0x000001ff);
-    tegra_stream_push(cmds, 0x00000030);
-    tegra_stream_push(cmds, 0x00000020);
-    tegra_stream_push(cmds, 0x000001ff);
-    tegra_stream_push(cmds, 0x00000100);
-    tegra_stream_push(cmds, 0x0f0f0f0f);
-    tegra_stream_push(cmds, 0x00000000);
-    tegra_stream_push(cmds, 0x00000000);
-    tegra_stream_push(cmds, 0x00000000);
-}
-
-void TegraGR3D_UploadConstVP(struct tegra_stream *cmds, unsigned index,
+void TegraGR3D_ResetState(struct tegra_gr3d_state *state)
+{
+    memset(state, 0, sizeof(*state));
+}
+
+void TegraGR3D_UploadConstVP(struct tegra_stream *cmds,
+                             struct tegra_gr3d_state *state, unsigned index,
                              float x, float y, float z, float w)
 {
+    uint32_t value[4];
+
+    value[0] = TegraGR3D_Float(x);
+    value[1] = TegraGR3D_Float(y);
+    value[2] = TegraGR3D_Float(z);
+    value[3] = TegraGR3D_Float(w);
+
+    if (index < TGR3D_STATE_VP_CONSTS_NB) {
+        if ((state->vp_consts_valid & (1 << index)) &&
+            !memcmp(state->vp_consts[index], value, sizeof(value)))
+            return;
+
+        memcpy(state->vp_consts[index], value, sizeof(value));
+        state->vp_consts_valid |= 1 << index;
+    }
+
     tegra_stream_prep(cmds, 6);
 
     tegra_stream_push(cmds,
@@ -159,182 +181,202 @@ void TegraGR3D_UploadConstVP(struct tegra_stream *cmds, unsigned index,
     tegra_stream_push(cmds,
                       HOST1X_OPCODE_NONINCR(TGR3D_VP_UPLOAD_CONST, 4));
 
-    tegra_stream_pushf(cmds, x);
-    tegra_stream_pushf(cmds, y);
-    tegra_stream_pushf(cmds, z);
-    tegra_stream_pushf(cmds, w);
+    tegra_stream_push(cmds, value[0]);
+    tegra_stream_push(cmds, value[1]);
+    tegra_stream_push(cmds, value[2]);
+    tegra_stream_push(cmds, value[3]);
 }
 
-void TegraGR3D_UploadConstFP(struct tegra_stream *cmds, unsigned index,
+void TegraGR3D_UploadConstFP(struct tegra_stream *cmds,
+                             struct tegra_gr3d_state *state, unsigned index,
                              uint32_t constant)
 {
+    if ((state->fp_consts_valid & (1u << index)) &&
+        state->fp_consts[index] == constant)
+        return;
+
+    state->fp_consts[index] = constant;
+    state->fp_consts_valid |= 1u << index;
+
     tegra_stream_prep(cmds, 2);
     tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_FP_CONST(index), 1));
     tegra_stream_push(cmds, constant);
 }
 
 void TegraGR3D_SetupScissor(struct tegra_stream *cmds,
+                            struct tegra_gr3d_state *state,
                             unsigned scissor_x,
                             unsigned scissor_y,
                             unsigned scissor_width,
                             unsigned scissor_heigth)
 {
-    uint32_t value;
+    uint32_t horiz, vert;
 
-    tegra_stream_prep(cmds, 3);
+    horiz  = TGR3D_VAL(SCISSOR_HORIZ, MIN, scissor_x);
+    horiz |= TGR3D_VAL(SCISSOR_HORIZ, MAX, scissor_x + scissor_width);
 
-    tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_SCISSOR_HORIZ, 2));
+    vert  = TGR3D_VAL(SCISSOR_VERT, MIN, scissor_y);
+    vert |= TGR3D_VAL(SCISSOR_VERT, MAX, scissor_y + scissor_heigth);
 
-    value  = TGR3D_VAL(SCISSOR_HORIZ, MIN, scissor_x);
-    value |= TGR3D_VAL(SCISSOR_HORIZ, MAX, scissor_x + scissor_width);
+    if ((state->valid & TGR3D_STATE_SCISSOR) &&
+        state->scissor[0] == horiz && state->scissor[1] == vert)
+        return;
 
-    tegra_stream_push(cmds, value);
+    state->scissor[0] = horiz;
+    state->scissor[1] = vert;
+    state->valid |= TGR3D_STATE_SCISSOR;
 
-    value  = TGR3D_VAL(SCISSOR_VERT, MIN, scissor_y);
-    value |= TGR3D_VAL(SCISSOR_VERT, MAX, scissor_y + scissor_heigth);
+    tegra_stream_prep(cmds, 3);
 
-    tegra_stream_push(cmds, value);
+    tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_SCISSOR_HORIZ, 2));
+    tegra_stream_push(cmds, horiz);
+    tegra_stream_push(cmds, vert);
 }
 
-static void TegraGR3D_SetupGuardband(struct tegra_stream *cmds)
+static uint32_t * TegraGR3D_SetupGuardband(uint32_t *cs)
 {
-    tegra_stream_prep(cmds, 4);
+    *cs++ = HOST1X_OPCODE_INCR(TGR3D_GUARDBAND_WIDTH, 3);
+    *cs++ = TegraGR3D_Float(1.0f);
+    *cs++ = TegraGR3D_Float(1.0f);
+    *cs++ = TegraGR3D_Float(1.0f);
 
-    tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_GUARDBAND_WIDTH, 3));
-    tegra_stream_pushf(cmds, 1.0f);
-    tegra_stream_pushf(cmds, 1.0f);
-    tegra_stream_pushf(cmds, 1.0f);
+    return cs;
 }
 
-static void TegraGR3D_SetupLateTest(struct tegra_stream *cmds)
+static uint32_t * TegraGR3D_SetupLateTest(uint32_t *cs)
 {
     uint32_t value = 0x48;
 
-    tegra_stream_prep(cmds, 1);
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(0x40f, value));
+    *cs++ = HOST1X_OPCODE_IMM(0x40f, value);
+
+    return cs;
 }
 
-static void TegraGR3D_SetupDepthRange(struct tegra_stream *cmds)
+static uint32_t * TegraGR3D_SetupDepthRange(uint32_t *cs)
 {
-    tegra_stream_prep(cmds, 3);
+    *cs++ = HOST1X_OPCODE_INCR(TGR3D_DEPTH_RANGE_NEAR, 2);
+    *cs++ = (uint32_t)(0xFFFFF * 0.0f);
+    *cs++ = (uint32_t)(0xFFFFF * 1.0f);
 
-    tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_DEPTH_RANGE_NEAR, 2));
-    tegra_stream_push(cmds, (uint32_t)(0xFFFFF * 0.0f));
-    tegra_stream_push(cmds, (uint32_t)(0xFFFFF * 1.0f));
+    return cs;
 }
 
-static void TegraGR3D_SetupDepthBuffer(struct tegra_stream *cmds)
+static uint32_t * TegraGR3D_SetupDepthBuffer(uint32_t *cs)
 {
     uint32_t value = 0;
 
-    tegra_stream_prep(cmds, 2);
-
     value |= TGR3D_VAL(DEPTH_TEST_PARAMS, FUNC, TGR3D_COMPARE_FUNC_ALWAYS);
     value |= 0x200;
 
-    tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_DEPTH_TEST_PARAMS, 1));
-    tegra_stream_pushf(cmds, value);
+    *cs++ = HOST1X_OPCODE_INCR(TGR3D_DEPTH_TEST_PARAMS, 1);
+    *cs++ = TegraGR3D_Float(value);
+
+    return cs;
 }
 
-static void TegraGR3D_SetupPolygonOffset(struct tegra_stream *cmds)
+static uint32_t * TegraGR3D_SetupPolygonOffset(uint32_t *cs)
 {
-    tegra_stream_prep(cmds, 3);
-    tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_POLYGON_OFFSET_UNITS, 2));
-    tegra_stream_pushf(cmds, 0.0f);
-    tegra_stream_pushf(cmds, 0.0f);
+    *cs++ = HOST1X_OPCODE_INCR(TGR3D_POLYGON_OFFSET_UNITS, 2);
+    *cs++ = TegraGR3D_Float(0.0f);
+    *cs++ = TegraGR3D_Float(0.0f);
+
+    return cs;
 }
 
-static void TegraGR3D_SetupPSEQ_DW_cfg(struct tegra_stream *cmds,
-                                       unsigned pseq_to_dw_nb)
+static uint32_t * TegraGR3D_SetupPSEQ_DW_cfg(uint32_t *cs,
+                                             unsigned pseq_to_dw_nb)
 {
     uint32_t value = TGR3D_VAL(FP_PSEQ_DW_CFG, PSEQ_TO_DW_EXEC_NB,
                                pseq_to_dw_nb);
 
-    tegra_stream_prep(cmds, 2);
-    tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_FP_PSEQ_DW_CFG, 1));
-    tegra_stream_push(cmds, value);
+    *cs++ = HOST1X_OPCODE_INCR(TGR3D_FP_PSEQ_DW_CFG, 1);
+    *cs++ = value;
+
+    return cs;
 }
 
-static void TegraGR3D_SetupALUBufferSize(struct tegra_stream *cmds,
-                                         unsigned alu_buf_size)
+static uint32_t * TegraGR3D_SetupALUBufferSize(uint32_t *cs,
+                                               unsigned alu_buf_size)
 {
     unsigned unk_pseq_cfg = 0x12C;
     uint32_t value = 0;
 
-    tegra_stream_prep(cmds, 4);
-
     value |= TGR3D_VAL(ALU_BUFFER_SIZE, SIZE, alu_buf_size - 1);
     value |= TGR3D_VAL(ALU_BUFFER_SIZE, SIZEx4,
                        (unk_pseq_cfg - 1) / (alu_buf_size * 4));
 
-    tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_ALU_BUFFER_SIZE, 1));
-    tegra_stream_push(cmds, value);
+    *cs++ = HOST1X_OPCODE_INCR(TGR3D_ALU_BUFFER_SIZE, 1);
+    *cs++ = value;
+
+    *cs++ = HOST1X_OPCODE_INCR(0x501, 1);
+    *cs++ = (0x0032 << 16) | (unk_pseq_cfg << 4) | 0xF;
 
-    tegra_stream_push(cmds, HOST1X_OPCODE_INCR(0x501, 1));
-    tegra_stream_push(cmds, (0x0032 << 16) | (unk_pseq_cfg << 4) | 0xF);
+    return cs;
 }
 
-static void TegraGR3D_SetupStencilTest(struct tegra_stream *cmds)
+static uint32_t * TegraGR3D_SetupStencilTest(uint32_t *cs)
 {
     uint32_t value;
 
-    tegra_stream_prep(cmds, 7);
-
-    tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_STENCIL_FRONT1, 3));
+    *cs++ = HOST1X_OPCODE_INCR(TGR3D_STENCIL_FRONT1, 3);
 
     value  = TGR3D_VAL(STENCIL_FRONT1, MASK, 0);
     value |= TGR3D_VAL(STENCIL_FRONT1, FUNC, TGR3D_COMPARE_FUNC_NEVER);
-    tegra_stream_push(cmds, value);
+    *cs++ = value;
 
     value  = TGR3D_VAL(STENCIL_BACK1, MASK, 0);
     value |= TGR3D_VAL(STENCIL_BACK1, FUNC, TGR3D_COMPARE_FUNC_NEVER);
-    tegra_stream_push(cmds, value);
+    *cs++ = value;
 
     value  = TGR3D_BOOL(STENCIL_PARAMS, STENCIL_TEST, 0);
     value |= TGR3D_BOOL(STENCIL_PARAMS, STENCIL_WRITE_EARLY, 0);
     value |= 0x8;
-    tegra_stream_push(cmds, value);
+    *cs++ = value;
 
-    tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_STENCIL_FRONT2, 2));
+    *cs++ = HOST1X_OPCODE_INCR(TGR3D_STENCIL_FRONT2, 2);
 
     value  = TGR3D_VAL(STENCIL_FRONT2, REF, 0);
     value |= TGR3D_VAL(STENCIL_FRONT2, OP_FAIL, TGR3D_STENCIL_OP_ZERO);
     value |= TGR3D_VAL(STENCIL_FRONT2, OP_ZFAIL, TGR3D_STENCIL_OP_ZERO);
     value |= TGR3D_VAL(STENCIL_FRONT2, OP_ZPASS, TGR3D_STENCIL_OP_ZERO);
     value |= 0x1fe00;
-    tegra_stream_push(cmds, value);
+    *cs++ = value;
 
     value  = TGR3D_VAL(STENCIL_BACK2, REF, 0);
     value |= TGR3D_VAL(STENCIL_BACK2, OP_FAIL, TGR3D_STENCIL_OP_ZERO);
     value |= TGR3D_VAL(STENCIL_BACK2, OP_ZFAIL, TGR3D_STENCIL_OP_ZERO);
     value |= TGR3D_VAL(STENCIL_BACK2, OP_ZPASS, TGR3D_STENCIL_OP_ZERO);
     value |= 0x1fe00;
-    tegra_stream_push(cmds, value);
+    *cs++ = value;
+
+    return cs;
 }
 
-static void TegraGR3D_Startup_PSEQ_Engine(struct tegra_stream *cmds,
-                                          unsigned pseq_inst_nb)
+static uint32_t * TegraGR3D_Startup_PSEQ_Engine(uint32_t *cs,
+                                                unsigned pseq_inst_nb)
 {
-    tegra_stream_prep(cmds, 2);
-    tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_FP_PSEQ_ENGINE_INST, 1));
-    tegra_stream_push(cmds, 0x20006000 | pseq_inst_nb);
+    *cs++ = HOST1X_OPCODE_INCR(TGR3D_FP_PSEQ_ENGINE_INST, 1);
+    *cs++ = 0x20006000 | pseq_inst_nb;
+
+    return cs;
 }
 
-static void TegraGR3D_SetUsed_TRAM_RowsNum(struct tegra_stream *cmds,
-                                           unsigned used_tram_rows_nb)
+static uint32_t * TegraGR3D_SetUsed_TRAM_RowsNum(uint32_t *cs,
+                                                 unsigned used_tram_rows_nb)
 {
     uint32_t value = 0;
 
-    tegra_stream_prep(cmds, 2);
-
     value |= TGR3D_VAL(TRAM_SETUP, USED_TRAM_ROWS_NB, used_tram_rows_nb);
     value |= TGR3D_VAL(TRAM_SETUP, DIV64, 64 / used_tram_rows_nb);
 
-    tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_TRAM_SETUP, 1));
-    tegra_stream_push(cmds, value);
+    *cs++ = HOST1X_OPCODE_INCR(TGR3D_TRAM_SETUP, 1);
+    *cs++ = value;
+
+    return cs;
 }
 
 void TegraGR3D_SetupViewportBiasScale(struct tegra_stream *cmds,
+                                      struct tegra_gr3d_state *state,
                                       float viewport_x_bias,
                                       float viewport_y_bias,
                                       float viewport_z_bias,
@@ -342,33 +384,45 @@ void TegraGR3D_SetupViewportBiasScale(struct tegra_stream *cmds,
                                       float viewport_y_scale,
                                       float viewport_z_scale)
 {
+    uint32_t value[6];
+    unsigned i;
+
+    value[0] = TegraGR3D_Float(viewport_x_bias * 16.0f + viewport_x_scale * 8.0f);
+    value[1] = TegraGR3D_Float(viewport_y_bias * 16.0f + viewport_y_scale * 8.0f);
+    value[2] = TegraGR3D_Float(viewport_z_bias - 4.76837158203125e-07);
+    value[3] = TegraGR3D_Float(viewport_x_scale * 8.0f);
+    value[4] = TegraGR3D_Float(viewport_y_scale * 8.0f);
+    value[5] = TegraGR3D_Float(viewport_z_scale - 4.76837158203125e-07);
+
+    if ((state->valid & TGR3D_STATE_VIEWPORT) &&
+        !memcmp(state->viewport, value, sizeof(value)))
+        return;
+
+    memcpy(state->viewport, value, sizeof(value));
+    state->valid |= TGR3D_STATE_VIEWPORT;
+
     tegra_stream_prep(cmds, 7);
     tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_VIEWPORT_X_BIAS, 6));
-    tegra_stream_pushf(cmds, viewport_x_bias * 16.0f + viewport_x_scale * 8.0f);
-    tegra_stream_pushf(cmds, viewport_y_bias * 16.0f + viewport_y_scale * 8.0f);
-    tegra_stream_pushf(cmds, viewport_z_bias - 4.76837158203125e-07);
-    tegra_stream_pushf(cmds, viewport_x_scale * 8.0f);
-    tegra_stream_pushf(cmds, viewport_y_scale * 8.0f);
-    tegra_stream_pushf(cmds, viewport_z_scale - 4.76837158203125e-07);
+    for (i = 0; i < 6; i++)
+        tegra_stream_push(cmds, value[i]);
 }
 
-static void TegraGR3D_SetupCullFaceAndLinkerInstNum(struct tegra_stream *cmds,
-                                                  unsigned linker_inst_nb)
+static uint32_t * TegraGR3D_SetupCullFaceAndLinkerInstNum(uint32_t *cs,
+                                                          unsigned linker_inst_nb)
 {
     uint32_t unk = 0x2E38;
     uint32_t value = 0;
 
-    tegra_stream_prep(cmds, 2);
-
     value |= TGR3D_VAL(CULL_FACE_LINKER_SETUP, CULL_FACE, TGR3D_CULL_FACE_NONE);
 
     value |= TGR3D_VAL(CULL_FACE_LINKER_SETUP, LINKER_INST_COUNT,
                        linker_inst_nb - 1);
     value |= TGR3D_VAL(CULL_FACE_LINKER_SETUP, UNK_18_31, unk);
 
-    tegra_stream_push(cmds,
-                      HOST1X_OPCODE_INCR(TGR3D_CULL_FACE_LINKER_SETUP, 1));
-    tegra_stream_push(cmds, value);
+    *cs++ = HOST1X_OPCODE_INCR(TGR3D_CULL_FACE_LINKER_SETUP, 1);
+    *cs++ = value;
+
+    return cs;
 }
 
 void TegraGR3D_SetupAttribute(struct tegra_stream *cmds,
@@ -390,16 +444,34 @@ void TegraGR3D_SetupAttribute(struct tegra_stream *cmds,
     tegra_stream_push(cmds, value);
 }
 
-static void TegraGR3D_SetupVpAttributesInOutMask(struct tegra_stream *cmds,
-                                               uint32_t in_mask,
-                                               uint32_t out_mask)
+static uint32_t * TegraGR3D_SetupVpAttributesInOutMask(uint32_t *cs,
+                                                       uint32_t in_mask,
+                                                       uint32_t out_mask)
 {
+    *cs++ = HOST1X_OPCODE_INCR(TGR3D_VP_ATTRIB_IN_OUT_SELECT, 1);
+    *cs++ = in_mask << 16 | out_mask;
+
+    return cs;
+}
+
+void TegraGR3D_SetupIndexBuffer(struct tegra_stream *cmds,
+                                struct tegra_gr3d_state *state,
+                                struct drm_tegra_bo *bo,
+                                unsigned offset)
+{
+    if (state->index_bo == bo && state->index_offset == offset)
+        return;
+
+    state->index_bo = bo;
+    state->index_offset = offset;
+
     tegra_stream_prep(cmds, 2);
-    tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_VP_ATTRIB_IN_OUT_SELECT, 1));
-    tegra_stream_push(cmds, in_mask << 16 | out_mask);
+    tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_INDEX_PTR, 1));
+    tegra_stream_push_reloc(cmds, bo, offset);
 }
 
 void TegraGR3D_SetupRenderTarget(struct tegra_stream *cmds,
+                                 struct tegra_gr3d_state *state,
                                  unsigned index,
                                  struct drm_tegra_bo *bo,
                                  unsigned offset,
@@ -408,12 +480,21 @@ void TegraGR3D_SetupRenderTarget(struct tegra_stream *cmds,
 {
     uint32_t value = 0;
 
-    tegra_stream_prep(cmds, 4);
-
     value |= TGR3D_VAL(RT_PARAMS, FORMAT, pixel_format);
     value |= TGR3D_VAL(RT_PARAMS, PITCH, pitch);
     value |= TGR3D_BOOL(RT_PARAMS, TILED, 0);
 
+    if (state->rt[index].bo == bo &&
+        state->rt[index].offset == offset &&
+        state->rt[index].params == value)
+        return;
+
+    state->rt[index].bo = bo;
+    state->rt[index].offset = offset;
+    state->rt[index].params = value;
+
+    tegra_stream_prep(cmds, 4);
+
     tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_RT_PARAMS(index), 1));
     tegra_stream_push(cmds, value);
 
@@ -421,14 +502,23 @@ void TegraGR3D_SetupRenderTarget(struct tegra_stream *cmds,
     tegra_stream_push_reloc(cmds, bo, offset);
 }
 
-void TegraGR3D_EnableRenderTargets(struct tegra_stream *cmds, uint32_t mask)
+void TegraGR3D_EnableRenderTargets(struct tegra_stream *cmds,
+                                   struct tegra_gr3d_state *state,
+                                   uint32_t mask)
 {
+    if ((state->valid & TGR3D_STATE_RT_ENABLE) && state->rt_enable == mask)
+        return;
+
+    state->rt_enable = mask;
+    state->valid |= TGR3D_STATE_RT_ENABLE;
+
     tegra_stream_prep(cmds, 2);
     tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_RT_ENABLE, 1));
     tegra_stream_push(cmds, mask);
 }
 
 void TegraGR3D_SetupTextureDesc(struct tegra_stream *cmds,
+                                struct tegra_gr3d_state *state,
                                 unsigned index,
                                 struct drm_tegra_bo *bo,
                                 unsigned offset,
@@ -441,33 +531,43 @@ void TegraGR3D_SetupTextureDesc(struct tegra_stream *cmds,
                                 bool clamp_to_edge,
                                 bool mirrored_repeat)
 {
-    uint32_t value = 0;
+    uint32_t desc1, desc2;
 
-    tegra_stream_prep(cmds, 5);
-    tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_TEXTURE_DESC1(index), 2));
+    desc1  = TGR3D_VAL(TEXTURE_DESC1, FORMAT, pixel_format);
+    desc1 |= TGR3D_BOOL(TEXTURE_DESC1, MINFILTER_LINEAR_WITHIN, min_filter_linear);
+    desc1 |= TGR3D_BOOL(TEXTURE_DESC1, MINFILTER_LINEAR_BETWEEN, mip_filter_linear);
+    desc1 |= TGR3D_BOOL(TEXTURE_DESC1, MAGFILTER_LINEAR, mag_filter_linear);
+    desc1 |= TGR3D_BOOL(TEXTURE_DESC1, WRAP_T_CLAMP_TO_EDGE, clamp_to_edge);
+    desc1 |= TGR3D_BOOL(TEXTURE_DESC1, WRAP_S_CLAMP_TO_EDGE, clamp_to_edge);
+    desc1 |= TGR3D_BOOL(TEXTURE_DESC1, WRAP_T_MIRRORED_REPEAT, mirrored_repeat);
+    desc1 |= TGR3D_BOOL(TEXTURE_DESC1, WRAP_S_MIRRORED_REPEAT, mirrored_repeat);
 
-    value  = TGR3D_VAL(TEXTURE_DESC1, FORMAT, pixel_format);
-    value |= TGR3D_BOOL(TEXTURE_DESC1, MINFILTER_LINEAR_WITHIN, min_filter_linear);
-    value |= TGR3D_BOOL(TEXTURE_DESC1, MINFILTER_LINEAR_BETWEEN, mip_filter_linear);
-    value |= TGR3D_BOOL(TEXTURE_DESC1, MAGFILTER_LINEAR, mag_filter_linear);
-    value |= TGR3D_BOOL(TEXTURE_DESC1, WRAP_T_CLAMP_TO_EDGE, clamp_to_edge);
-    value |= TGR3D_BOOL(TEXTURE_DESC1, WRAP_S_CLAMP_TO_EDGE, clamp_to_edge);
-    value |= TGR3D_BOOL(TEXTURE_DESC1, WRAP_T_MIRRORED_REPEAT, mirrored_repeat);
-    value |= TGR3D_BOOL(TEXTURE_DESC1, WRAP_S_MIRRORED_REPEAT, mirrored_repeat);
-
-    tegra_stream_push(cmds, value);
-
-    value = TGR3D_BOOL(TEXTURE_DESC2, MIPMAP_DISABLE, 1);
+    desc2 = TGR3D_BOOL(TEXTURE_DESC2, MIPMAP_DISABLE, 1);
 
     if (IS_POW2(width) && IS_POW2(height)) {
-        value |= TGR3D_VAL(TEXTURE_DESC2, WIDTH_LOG2, LOG2_SIZE(width));
-        value |= TGR3D_VAL(TEXTURE_DESC2, HEIGHT_LOG2, LOG2_SIZE(height));
+        desc2 |= TGR3D_VAL(TEXTURE_DESC2, WIDTH_LOG2, LOG2_SIZE(width));
+        desc2 |= TGR3D_VAL(TEXTURE_DESC2, HEIGHT_LOG2, LOG2_SIZE(height));
     } else {
-        value |= TGR3D_BOOL(TEXTURE_DESC2, NOT_POW2_DIMENSIONS, 1);
-        value |= TGR3D_VAL(TEXTURE_DESC2, WIDTH, width);
-        value |= TGR3D_VAL(TEXTURE_DESC2, HEIGHT, height);
+        desc2 |= TGR3D_BOOL(TEXTURE_DESC2, NOT_POW2_DIMENSIONS, 1);
+        desc2 |= TGR3D_VAL(TEXTURE_DESC2, WIDTH, width);
+        desc2 |= TGR3D_VAL(TEXTURE_DESC2, HEIGHT, height);
     }
-    tegra_stream_push(cmds, value);
+
+    if (state->textures[index].bo == bo &&
+        state->textures[index].offset == offset &&
+        state->textures[index].desc[0] == desc1 &&
+        state->textures[index].desc[1] == desc2)
+        return;
+
+    state->textures[index].bo = bo;
+    state->textures[index].offset = offset;
+    state->textures[index].desc[0] = desc1;
+    state->textures[index].desc[1] = desc2;
+
+    tegra_stream_prep(cmds, 5);
+    tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_TEXTURE_DESC1(index), 2));
+    tegra_stream_push(cmds, desc1);
+    tegra_stream_push(cmds, desc2);
 
     tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_TEXTURE_POINTER(index), 1));
     tegra_stream_push_reloc(cmds, bo, offset);
@@ -514,46 +614,125 @@ void TegraGR3D_DrawPrimitives(struct tegra_stream *cmds,
     tegra_stream_sync(cmds, DRM_TEGRA_SYNCPT_COND_OP_DONE);
 }
 
-static void TegraGR3D_UploadProgram(struct tegra_stream *cmds,
-                                    const struct shader_program *prog)
+static uint32_t * TegraGR3D_UploadProgram(uint32_t *cs,
+                                          const struct shader_program *prog)
 {
-    unsigned i;
+    *cs++ = HOST1X_OPCODE_IMM(TGR3D_VP_UPLOAD_INST_ID, 0);
+    *cs++ = HOST1X_OPCODE_IMM(TGR3D_FP_UPLOAD_INST_ID_COMMON, 0);
+    *cs++ = HOST1X_OPCODE_IMM(TGR3D_FP_UPLOAD_MFU_INST_ID, 0);
+    *cs++ = HOST1X_OPCODE_IMM(TGR3D_FP_UPLOAD_ALU_INST_ID, 0);
 
-    tegra_stream_prep(cmds, 4);
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(TGR3D_VP_UPLOAD_INST_ID, 0));
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(TGR3D_FP_UPLOAD_INST_ID_COMMON, 0));
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(TGR3D_FP_UPLOAD_MFU_INST_ID, 0));
-    tegra_stream_push(cmds, HOST1X_OPCODE_IMM(TGR3D_FP_UPLOAD_ALU_INST_ID, 0));
+    memcpy(cs, prog->vs_prog_words, prog->vs_prog_words_nb * 4);
+    cs += prog->vs_prog_words_nb;
 
-    tegra_stream_prep(cmds, prog->vs_prog_words_nb);
-    for (i = 0; i < prog->vs_prog_words_nb; i++)
-        tegra_stream_push(cmds, prog->vs_prog_words[i]);
+    memcpy(cs, prog->fs_prog_words, prog->fs_prog_words_nb * 4);
+    cs += prog->fs_prog_words_nb;
 
-    tegra_stream_prep(cmds, prog->fs_prog_words_nb);
-    for (i = 0; i < prog->fs_prog_words_nb; i++)
-        tegra_stream_push(cmds, prog->fs_prog_words[i]);
+    memcpy(cs, prog->linker_words, prog->linker_words_nb * 4);
+    cs += prog->linker_words_nb;
 
-    tegra_stream_prep(cmds, prog->linker_words_nb);
-    for (i = 0; i < prog->linker_words_nb; i++)
-        tegra_stream_push(cmds, prog->linker_words[i]);
+    return cs;
 }
 
-void TegraGR3D_Initialize(struct tegra_stream *cmds,
-                          const struct shader_program *prog)
-{
-    TegraGR3D_InitState(cmds);
-    TegraGR3D_SetupGuardband(cmds);
-    TegraGR3D_SetupLateTest(cmds);
-    TegraGR3D_SetupDepthRange(cmds);
-    TegraGR3D_SetupDepthBuffer(cmds);
-    TegraGR3D_SetupStencilTest(cmds);
-    TegraGR3D_SetupPolygonOffset(cmds);
-    TegraGR3D_SetupVpAttributesInOutMask(cmds,
+static uint32_t * TegraGR3D_EmitInitialization(uint32_t *cs,
+                                               const struct shader_program *prog)
+{
+    cs = TegraGR3D_InitState(cs);
+    cs = TegraGR3D_SetupGuardband(cs);
+    cs = TegraGR3D_SetupLateTest(cs);
+    cs = TegraGR3D_SetupDepthRange(cs);
+    cs = TegraGR3D_SetupDepthBuffer(cs);
+    cs = TegraGR3D_SetupStencilTest(cs);
+    cs = TegraGR3D_SetupPolygonOffset(cs);
+    cs = TegraGR3D_SetupVpAttributesInOutMask(cs,
         prog->vs_attrs_in_mask, prog->vs_attrs_out_mask);
-    TegraGR3D_SetupPSEQ_DW_cfg(cmds, prog->fs_pseq_to_dw);
-    TegraGR3D_SetupALUBufferSize(cmds, prog->fs_alu_buf_size);
-    TegraGR3D_Startup_PSEQ_Engine(cmds, prog->fs_pseq_inst_nb);
-    TegraGR3D_SetUsed_TRAM_RowsNum(cmds, prog->used_tram_rows_nb);
-    TegraGR3D_SetupCullFaceAndLinkerInstNum(cmds, prog->linker_inst_nb);
-    TegraGR3D_UploadProgram(cmds, prog);
+    cs = TegraGR3D_SetupPSEQ_DW_cfg(cs, prog->fs_pseq_to_dw);
+    cs = TegraGR3D_SetupALUBufferSize(cs, prog->fs_alu_buf_size);
+    cs = TegraGR3D_Startup_PSEQ_Engine(cs, prog->fs_pseq_inst_nb);
+    cs = TegraGR3D_SetUsed_TRAM_RowsNum(cs, prog->used_tram_rows_nb);
+    cs = TegraGR3D_SetupCullFaceAndLinkerInstNum(cs, prog->linker_inst_nb);
+    cs = TegraGR3D_UploadProgram(cs, prog);
+
+    return cs;
+}
+
+static unsigned TegraGR3D_InitializationWordsMax(const struct shader_program *prog)
+{
+    return TGR3D_INIT_STATE_WORDS_MAX +
+           prog->vs_prog_words_nb +
+           prog->fs_prog_words_nb +
+           prog->linker_words_nb;
+}
+
+/*
+ * Initialization sequence depends only on the shader program, hence it is
+ * built once per program and then copied into every job as a whole.
+ */
+static int TegraGR3D_BuildInitialization(struct shader_program *prog)
+{
+    uint32_t *words, *cs;
+    void *tmp;
+
+    words = malloc(TegraGR3D_InitializationWordsMax(prog) * 4);
+    if (!words)
+        return -1;
+
+    cs = TegraGR3D_EmitInitialization(words, prog);
+
+    prog->init_words_nb = cs - words;
+
+    tmp = realloc(words, prog->init_words_nb * 4);
+    if (tmp)
+        words = tmp;
+
+    prog->init_words = words;
+
+    return 0;
+}
+
+void TegraGR3D_Initialize(struct tegra_stream *cmds,
+                          struct tegra_gr3d_state *state,
+                          struct shader_program *prog)
+{
+    uint32_t *cs;
+
+    if (state->prog == prog)
+        return;
+
+    state->prog = prog;
+
+    if (!prog->init_words && TegraGR3D_BuildInitialization(prog) < 0) {
+        /* out of memory, emit directly into the stream */
+        cs = tegra_stream_reserve(cmds, TegraGR3D_InitializationWordsMax(prog));
+        if (!cs)
+            return;
+
+        cs = TegraGR3D_EmitInitialization(cs, prog);
+        tegra_stream_commit(cmds, cs);
+        return;
+    }
+
+    cs = tegra_stream_reserve(cmds, prog->init_words_nb);
+    if (!cs)
+        return;
+
+    memcpy(cs, prog->init_words, prog->init_words_nb * 4);
+    cs += prog->init_words_nb;
+
+    tegra_stream_commit(cmds, cs);
+}
+
+void TegraGR3D_ReleaseInitialization(struct shader_program *prog)
+{
+    free(prog->init_words);
+    prog->init_words = NULL;
+    prog->init_words_nb = 0;
+}
+
+/* same invalidation as done by the initialization sequence */
+void TegraGR3D_InvalidateCaches(struct tegra_stream *cmds)
+{
+    tegra_stream_prep(cmds, 2);
+    tegra_stream_push(cmds, HOST1X_OPCODE_INCR(TGR3D_FDC_CONTROL, 1));
+    tegra_stream_push(cmds, 0x00000e00 | TGR3D_FDC_CONTROL_INVALIDATE);
 }
@@ -29,6 +29,22 @@
 #define FX10_H(f)           (FX10(f) << 10)
 #define FX10x2(low, high)   (FX10_H(high) | FX10_L(low))
 
+/* 20bit float of fragment ALU: 1 sign, 6 exponent, 13 mantissa bits */
+static inline uint32_t FP20(float f)
+{
+    union { float f; uint32_t u; } v = { .f = f };
+    uint32_t sign = v.u >> 31;
+    int exponent = ((v.u >> 23) & 0xff) - 127 + 31;
+
+    if (exponent <= 0)
+        return sign << 19;
+
+    if (exponent >= 0x3f)
+        return (sign << 19) | (0x3f << 13);
+
+    return (sign << 19) | (exponent << 13) | ((v.u & 0x7fffff) >> 10);
+}
+
 #define TGR3D_VAL(reg_name, field_name, value)                              \
     (((value) << TGR3D_ ## reg_name ## _ ## field_name ## __SHIFT) &        \
                  TGR3D_ ## reg_name ## _ ## field_name ## __MASK)
@@ -39,19 +55,69 @@
 #define LOG2_SIZE(v)    (31 - __builtin_clz(v))
 #define IS_POW2(v)      (((v) & ((v) - 1)) == 0)
 
-void TegraGR3D_UploadConstVP(struct tegra_stream *cmds, unsigned index,
+#define TGR3D_STATE_RT_NB           TGR3D_RT_PTR__LEN
+#define TGR3D_STATE_TEXTURES_NB     TGR3D_TEXTURE_POINTER__LEN
+#define TGR3D_STATE_VP_CONSTS_NB    8
+
+#define TGR3D_STATE_SCISSOR         (1 << 0)
+#define TGR3D_STATE_VIEWPORT        (1 << 1)
+#define TGR3D_STATE_RT_ENABLE       (1 << 2)
+
+/*
+ * Shadow of the registers programmed by the job under construction, it is
+ * used to elide redundant writes. Hardware context is preserved only within
+ * a job, so shadow must be reset whenever a new job begins.
+ */
+struct tegra_gr3d_state {
+    struct shader_program *prog;
+
+    struct {
+        struct drm_tegra_bo *bo;
+        unsigned offset;
+        uint32_t params;
+    } rt[TGR3D_STATE_RT_NB];
+
+    struct {
+        struct drm_tegra_bo *bo;
+        unsigned offset;
+        uint32_t desc[2];
+    } textures[TGR3D_STATE_TEXTURES_NB];
+
+    uint32_t scissor[2];
+    uint32_t viewport[6];
+    uint32_t rt_enable;
+
+    uint32_t fp_consts[TGR3D_FP_CONST__LEN];
+    uint32_t fp_consts_valid;
+
+    uint32_t vp_consts[TGR3D_STATE_VP_CONSTS_NB][4];
+    uint32_t vp_consts_valid;
+
+    struct drm_tegra_bo *index_bo;
+    unsigned index_offset;
+
+    unsigned valid;
+};
+
+void TegraGR3D_ResetState(struct tegra_gr3d_state *state);
+
+void TegraGR3D_UploadConstVP(struct tegra_stream *cmds,
+                             struct tegra_gr3d_state *state, unsigned index,
                              float x, float y, float z, float w);
 
-void TegraGR3D_UploadConstFP(struct tegra_stream *cmds, unsigned index,
+void TegraGR3D_UploadConstFP(struct tegra_stream *cmds,
+                             struct tegra_gr3d_state *state, unsigned index,
                              uint32_t constant);
 
 void TegraGR3D_SetupScissor(struct tegra_stream *cmds,
+                            struct tegra_gr3d_state *state,
                             unsigned scissor_x,
                             unsigned scissor_y,
                             unsigned scissor_width,
                             unsigned scissor_heigth);
 
 void TegraGR3D_SetupViewportBiasScale(struct tegra_stream *cmds,
+                                      struct tegra_gr3d_state *state,
                                       float viewport_x_bias,
                                       float viewport_y_bias,
                                       float viewport_z_bias,
@@ -65,16 +131,25 @@ void TegraGR3D_SetupAttribute(struct tegra_stream *cmds,
                               unsigned offset, unsigned type,
                               unsigned size, unsigned stride);
 
+void TegraGR3D_SetupIndexBuffer(struct tegra_stream *cmds,
+                                struct tegra_gr3d_state *state,
+                                struct drm_tegra_bo *bo,
+                                unsigned offset);
+
 void TegraGR3D_SetupRenderTarget(struct tegra_stream *cmds,
+                                 struct tegra_gr3d_state *state,
                                  unsigned index,
                                  struct drm_tegra_bo *bo,
                                  unsigned offset,
                                  unsigned pixel_format,
                                  unsigned pitch);
 
-void TegraGR3D_EnableRenderTargets(struct tegra_stream *cmds, uint32_t mask);
+void TegraGR3D_EnableRenderTargets(struct tegra_stream *cmds,
+                                   struct tegra_gr3d_state *state,
+                                   uint32_t mask);
 
 void TegraGR3D_SetupTextureDesc(struct tegra_stream *cmds,
+                                struct tegra_gr3d_state *state,
                                 unsigned index,
                                 struct drm_tegra_bo *bo,
                                 unsigned offset,
@@ -96,6 +171,11 @@ void TegraGR3D_DrawPrimitives(struct tegra_stream *cmds,
                               unsigned first_index, unsigned count);
 
 void TegraGR3D_Initialize(struct tegra_stream *cmds,
-                          const struct shader_program *prog);
+                          struct tegra_gr3d_state *state,
+                          struct shader_program *prog);
+
+void TegraGR3D_ReleaseInitialization(struct shader_program *prog);
+
+void TegraGR3D_InvalidateCaches(struct tegra_stream *cmds);
 
 #endif
@@ -0,0 +1,1000 @@
+/*
+ * Copyright (c) Dmitry Osipenko
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * Software replacement of libdrm_tegra. Buffer objects are backed by KMS
+ * "dumb" buffers (so that they are still scanout-able) or by plain memory,
+ * jobs are executed by CPU at the submission time and fences are signalled
+ * immediately. This allows to run the driver and verify output of the 2D
+ * acceleration pixel-for-pixel on a machine without Tegra GPU, 3D jobs are
+ * run by the shader interpreter from host1x_sw_gr3d.c.
+ */
+
+#include "driver.h"
+#include "host1x_sw.h"
+
+#define ErrorMsg(fmt, args...)                                              \
+    xf86DrvMsg(-1, X_ERROR, "%s:%d/%s(): " fmt, __FILE__,                   \
+               __LINE__, __func__, ##args)
+
+#define HOST1X_SW_IOVA_BASE     0x10000000
+#define HOST1X_SW_IOVA_ALIGN    0x1000
+
+#define GR2D_TRIGGER            0x09
+#define GR2D_CONTROLSECOND      0x1e
+#define GR2D_CONTROLMAIN        0x1f
+#define GR2D_ROPFADE            0x20
+#define GR2D_DSTBA              0x2b
+#define GR2D_DSTST              0x2e
+#define GR2D_SRCBA              0x31
+#define GR2D_SRCST              0x33
+#define GR2D_SRCFGC             0x35
+#define GR2D_SRCSIZE            0x37
+#define GR2D_DSTSIZE            0x38
+#define GR2D_SRCPS              0x39
+#define GR2D_DSTPS              0x3a
+#define GR2D_TILEMODE           0x46
+
+struct drm_tegra {
+    struct drm_tegra_bo *bos; /* sorted by IOVA */
+    int fd;
+};
+
+struct drm_tegra_bo {
+    struct drm_tegra_bo *next;
+    struct drm_tegra *drm;
+    uint32_t map_size;
+    uint32_t handle;
+    uint32_t size;
+    uint32_t iova;
+    void *map;
+    int refcnt;
+    bool dumb;
+};
+
+struct drm_tegra_channel {
+    struct drm_tegra *drm;
+    enum drm_tegra_class client;
+    struct host1x_sw_gr2d gr2d;
+    struct host1x_sw_gr3d gr3d;
+    uint32_t syncpt_value;
+};
+
+struct host1x_sw_reloc {
+    struct drm_tegra_bo *bo;
+    unsigned long offset;
+    unsigned long shift;
+    unsigned word;
+};
+
+struct host1x_sw_pushbuf {
+    struct drm_tegra_pushbuf base;
+    struct drm_tegra_job *job;
+    uint32_t *start;
+    uint32_t *end;
+};
+
+struct drm_tegra_job {
+    struct drm_tegra_channel *channel;
+    struct host1x_sw_pushbuf *pushbuf;
+    struct host1x_sw_reloc *relocs;
+    unsigned num_relocs;
+    unsigned max_relocs;
+    unsigned increments;
+};
+
+struct drm_tegra_fence {
+    uint32_t value;
+};
+
+int drm_tegra_new(struct drm_tegra **drmp, int fd)
+{
+    struct drm_tegra *drm;
+
+    drm = calloc(1, sizeof(*drm));
+    if (!drm)
+        return -ENOMEM;
+
+    drm->fd = fd;
+    *drmp = drm;
+
+    xf86DrvMsg(-1, X_WARNING, "Using software host1x, GPU isn't used\n");
+
+    return 0;
+}
+
+void drm_tegra_close(struct drm_tegra *drm)
+{
+    free(drm);
+}
+
+static int host1x_sw_bo_assign_iova(struct drm_tegra_bo *bo)
+{
+    struct drm_tegra_bo **itr = &bo->drm->bos;
+    uint32_t size = TEGRA_ALIGN(bo->size ?: 1, HOST1X_SW_IOVA_ALIGN);
+    uint32_t iova = HOST1X_SW_IOVA_BASE;
+
+    /* first-fit search for a hole in the sorted list */
+    while (*itr) {
+        if ((*itr)->iova - iova >= size)
+            break;
+
+        iova = (*itr)->iova + TEGRA_ALIGN((*itr)->size ?: 1,
+                                          HOST1X_SW_IOVA_ALIGN);
+        itr = &(*itr)->next;
+    }
+
+    if (!*itr && UINT32_MAX - iova < size)
+        return -ENOMEM;
+
+    bo->iova = iova;
+    bo->next = *itr;
+    *itr = bo;
+
+    return 0;
+}
+
+static void host1x_sw_bo_release_iova(struct drm_tegra_bo *bo)
+{
+    struct drm_tegra_bo **itr = &bo->drm->bos;
+
+    while (*itr) {
+        if (*itr == bo) {
+            *itr = bo->next;
+            break;
+        }
+
+        itr = &(*itr)->next;
+    }
+}
+
+static int host1x_sw_bo_mmap_dumb(struct drm_tegra_bo *bo, uint32_t size)
+{
+    struct drm_mode_map_dumb map;
+    void *ptr;
+
+    memset(&map, 0, sizeof(map));
+    map.handle = bo->handle;
+
+    if (drmIoctl(bo->drm->fd, DRM_IOCTL_MODE_MAP_DUMB, &map))
+        return -errno;
+
+    ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+               bo->drm->fd, map.offset);
+    if (ptr == MAP_FAILED)
+        return -errno;
+
+    bo->map = ptr;
+    bo->map_size = size;
+    bo->dumb = true;
+
+    return 0;
+}
+
+static int host1x_sw_bo_create_dumb(struct drm_tegra_bo *bo)
+{
+    struct drm_mode_create_dumb create;
+    struct drm_gem_close gem_close;
+    int err;
+
+    memset(&create, 0, sizeof(create));
+    create.bpp = 32;
+    create.width = 1024;
+    create.height = (bo->size + 4095) / 4096 ?: 1;
+
+    if (drmIoctl(bo->drm->fd, DRM_IOCTL_MODE_CREATE_DUMB, &create))
+        return -errno;
+
+    bo->handle = create.handle;
+
+    err = host1x_sw_bo_mmap_dumb(bo, create.size);
+    if (err) {
+        memset(&gem_close, 0, sizeof(gem_close));
+        gem_close.handle = bo->handle;
+        drmIoctl(bo->drm->fd, DRM_IOCTL_GEM_CLOSE, &gem_close);
+        bo->handle = 0;
+    }
+
+    return err;
+}
+
+int drm_tegra_bo_new(struct drm_tegra_bo **bop, struct drm_tegra *drm,
+                     uint32_t flags, uint32_t size)
+{
+    struct drm_tegra_bo *bo;
+    int err;
+
+    bo = calloc(1, sizeof(*bo));
+    if (!bo)
+        return -ENOMEM;
+
+    bo->drm = drm;
+    bo->size = size;
+    bo->refcnt = 1;
+
+    /* fall back to plain memory if dumb buffers aren't supported */
+    if (host1x_sw_bo_create_dumb(bo) != 0) {
+        bo->map = calloc(1, size ?: 1);
+        if (!bo->map) {
+            free(bo);
+            return -ENOMEM;
+        }
+    }
+
+    err = host1x_sw_bo_assign_iova(bo);
+    if (err) {
+        bo->refcnt = 0;
+        drm_tegra_bo_unref(bo);
+        return err;
+    }
+
+    *bop = bo;
+
+    return 0;
+}
+
+int drm_tegra_bo_wrap(struct drm_tegra_bo **bop, struct drm_tegra *drm,
+                      uint32_t handle, uint32_t flags, uint32_t size)
+{
+    struct drm_tegra_bo *bo;
+    int err;
+
+    for (bo = drm->bos; bo; bo = bo->next) {
+        if (bo->dumb && bo->handle == handle) {
+            *bop = drm_tegra_bo_ref(bo);
+            return 0;
+        }
+    }
+
+    bo = calloc(1, sizeof(*bo));
+    if (!bo)
+        return -ENOMEM;
+
+    bo->drm = drm;
+    bo->size = size;
+    bo->handle = handle;
+    bo->refcnt = 1;
+
+    err = host1x_sw_bo_mmap_dumb(bo, size);
+    if (err) {
+        free(bo);
+        return err;
+    }
+
+    err = host1x_sw_bo_assign_iova(bo);
+    if (err) {
+        bo->refcnt = 0;
+        drm_tegra_bo_unref(bo);
+        return err;
+    }
+
+    *bop = bo;
+
+    return 0;
+}
+
+struct drm_tegra_bo *drm_tegra_bo_ref(struct drm_tegra_bo *bo)
+{
+    if (bo)
+        bo->refcnt++;
+
+    return bo;
+}
+
+void drm_tegra_bo_unref(struct drm_tegra_bo *bo)
+{
+    struct drm_gem_close gem_close;
+
+    if (!bo || --bo->refcnt > 0)
+        return;
+
+    host1x_sw_bo_release_iova(bo);
+
+    if (bo->dumb) {
+        munmap(bo->map, bo->map_size);
+
+        memset(&gem_close, 0, sizeof(gem_close));
+        gem_close.handle = bo->handle;
+        drmIoctl(bo->drm->fd, DRM_IOCTL_GEM_CLOSE, &gem_close);
+    } else {
+        free(bo->map);
+    }
+
+    free(bo);
+}
+
+int drm_tegra_bo_get_handle(struct drm_tegra_bo *bo, uint32_t *handle)
+{
+    if (!bo || !handle)
+        return -EINVAL;
+
+    *handle = bo->handle;
+
+    return 0;
+}
+
+int drm_tegra_bo_get_name(struct drm_tegra_bo *bo, uint32_t *name)
+{
+    struct drm_gem_flink flink;
+
+    if (!bo || !name)
+        return -EINVAL;
+
+    if (!bo->dumb) {
+        *name = -1;
+        return -EINVAL;
+    }
+
+    memset(&flink, 0, sizeof(flink));
+    flink.handle = bo->handle;
+
+    if (drmIoctl(bo->drm->fd, DRM_IOCTL_GEM_FLINK, &flink)) {
+        *name = -1;
+        return -errno;
+    }
+
+    *name = flink.name;
+
+    return 0;
+}
+
+int drm_tegra_bo_map(struct drm_tegra_bo *bo, void **ptr)
+{
+    if (!bo)
+        return -EINVAL;
+
+    if (ptr)
+        *ptr = bo->map;
+
+    return 0;
+}
+
+int drm_tegra_bo_unmap(struct drm_tegra_bo *bo)
+{
+    return bo ? 0 : -EINVAL;
+}
+
+int drm_tegra_bo_forbid_caching(struct drm_tegra_bo *bo)
+{
+    return bo ? 0 : -EINVAL;
+}
+
+void *host1x_sw_resolve(struct drm_tegra *drm, uint32_t iova, uint32_t size)
+{
+    struct drm_tegra_bo *bo;
+
+    for (bo = drm->bos; bo && bo->iova <= iova; bo = bo->next) {
+        if (iova - bo->iova < bo->size &&
+            bo->size - (iova - bo->iova) >= size)
+            return (uint8_t *)bo->map + (iova - bo->iova);
+    }
+
+    ErrorMsg("invalid memory access: 0x%08x size %u\n", iova, size);
+
+    return NULL;
+}
+
+int drm_tegra_channel_open(struct drm_tegra_channel **channelp,
+                           struct drm_tegra *drm,
+                           enum drm_tegra_class client)
+{
+    struct drm_tegra_channel *channel;
+
+    switch (client) {
+    case DRM_TEGRA_GR2D:
+    case DRM_TEGRA_GR3D:
+        break;
+
+    default:
+        return -EINVAL;
+    }
+
+    channel = calloc(1, sizeof(*channel));
+    if (!channel)
+        return -ENOMEM;
+
+    channel->drm = drm;
+    channel->client = client;
+    *channelp = channel;
+
+    return 0;
+}
+
+int drm_tegra_channel_close(struct drm_tegra_channel *channel)
+{
+    struct host1x_sw_gr3d *gr3d;
+
+    if (!channel)
+        return -EINVAL;
+
+    gr3d = &channel->gr3d;
+
+    if (gr3d->draws)
+        xf86DrvMsg(-1, X_INFO,
+                   "GR3D: %llu draws, %llu fragments (%llu killed), "
+                   "~%llu cycles/fragment on average\n",
+                   (unsigned long long)gr3d->draws,
+                   (unsigned long long)gr3d->fragments,
+                   (unsigned long long)gr3d->fragments_killed,
+                   (unsigned long long)(gr3d->fragments ?
+                        gr3d->cycles / gr3d->fragments : 0));
+
+    free(channel);
+
+    return 0;
+}
+
+int drm_tegra_job_new(struct drm_tegra_job **jobp,
+                      struct drm_tegra_channel *channel)
+{
+    struct drm_tegra_job *job;
+
+    job = calloc(1, sizeof(*job));
+    if (!job)
+        return -ENOMEM;
+
+    job->channel = channel;
+    *jobp = job;
+
+    return 0;
+}
+
+int drm_tegra_job_free(struct drm_tegra_job *job)
+{
+    if (!job)
+        return -EINVAL;
+
+    if (job->pushbuf) {
+        free(job->pushbuf->start);
+        free(job->pushbuf);
+    }
+
+    free(job->relocs);
+    free(job);
+
+    return 0;
+}
+
+int drm_tegra_pushbuf_new(struct drm_tegra_pushbuf **pushbufp,
+                          struct drm_tegra_job *job)
+{
+    struct host1x_sw_pushbuf *pushbuf;
+
+    /* driver uses a single pushbuf per job */
+    if (job->pushbuf)
+        return -EBUSY;
+
+    pushbuf = calloc(1, sizeof(*pushbuf));
+    if (!pushbuf)
+        return -ENOMEM;
+
+    pushbuf->job = job;
+    job->pushbuf = pushbuf;
+    *pushbufp = &pushbuf->base;
+
+    return 0;
+}
+
+int drm_tegra_pushbuf_free(struct drm_tegra_pushbuf *pushbuf)
+{
+    return pushbuf ? 0 : -EINVAL;
+}
+
+int drm_tegra_pushbuf_prepare(struct drm_tegra_pushbuf *base,
+                              unsigned int words)
+{
+    struct host1x_sw_pushbuf *pushbuf;
+    size_t used, size;
+    uint32_t *start;
+
+    pushbuf = TEGRA_CONTAINER_OF(base, struct host1x_sw_pushbuf, base);
+
+    if (pushbuf->end - base->ptr >= words)
+        return 0;
+
+    used = base->ptr - pushbuf->start;
+    size = (pushbuf->end - pushbuf->start) * 2;
+
+    if (size < used + words)
+        size = used + words;
+
+    if (size < 1024)
+        size = 1024;
+
+    start = realloc(pushbuf->start, size * sizeof(uint32_t));
+    if (!start)
+        return -ENOMEM;
+
+    pushbuf->start = start;
+    pushbuf->end = start + size;
+    base->ptr = start + used;
+
+    return 0;
+}
+
+int drm_tegra_pushbuf_relocate(struct drm_tegra_pushbuf *base,
+                               struct drm_tegra_bo *target,
+                               unsigned long offset,
+                               unsigned long shift)
+{
+    struct host1x_sw_pushbuf *pushbuf;
+    struct host1x_sw_reloc *relocs;
+    struct drm_tegra_job *job;
+    unsigned max_relocs;
+    int err;
+
+    pushbuf = TEGRA_CONTAINER_OF(base, struct host1x_sw_pushbuf, base);
+    job = pushbuf->job;
+
+    err = drm_tegra_pushbuf_prepare(base, 1);
+    if (err)
+        return err;
+
+    if (job->num_relocs == job->max_relocs) {
+        max_relocs = job->max_relocs ? job->max_relocs * 2 : 64;
+
+        relocs = realloc(job->relocs, max_relocs * sizeof(*relocs));
+        if (!relocs)
+            return -ENOMEM;
+
+        job->relocs = relocs;
+        job->max_relocs = max_relocs;
+    }
+
+    relocs = &job->relocs[job->num_relocs++];
+    relocs->bo = target;
+    relocs->offset = offset;
+    relocs->shift = shift;
+    relocs->word = base->ptr - pushbuf->start;
+
+    *base->ptr++ = 0xdeadbeef;
+
+    return 0;
+}
+
+int drm_tegra_pushbuf_sync(struct drm_tegra_pushbuf *base,
+                           enum drm_tegra_syncpt_cond cond)
+{
+    struct host1x_sw_pushbuf *pushbuf;
+    int err;
+
+    pushbuf = TEGRA_CONTAINER_OF(base, struct host1x_sw_pushbuf, base);
+
+    if (cond >= DRM_TEGRA_SYNCPT_COND_MAX)
+        return -EINVAL;
+
+    err = drm_tegra_pushbuf_prepare(base, 2);
+    if (err)
+        return err;
+
+    *base->ptr++ = HOST1X_OPCODE_NONINCR(0x0, 0x1);
+    *base->ptr++ = cond << 8;
+
+    pushbuf->job->increments++;
+
+    return 0;
+}
+
+static uint32_t host1x_sw_rop3(uint8_t rop, uint32_t pat, uint32_t src,
+                               uint32_t dst)
+{
+    uint32_t result = 0;
+    unsigned i;
+
+    if (rop == 0xcc)
+        return src;
+
+    /* bit index of ROP3 is (pattern << 2) | (source << 1) | destination */
+    for (i = 0; i < 8; i++) {
+        if (rop & (1 << i))
+            result |= ((i & 4) ? pat : ~pat) &
+                      ((i & 2) ? src : ~src) &
+                      ((i & 1) ? dst : ~dst);
+    }
+
+    return result;
+}
+
+static uint32_t host1x_sw_read_pixel(const uint8_t *ptr, unsigned cpp)
+{
+    uint32_t pixel = 0;
+
+    memcpy(&pixel, ptr, cpp);
+
+    return pixel;
+}
+
+static void host1x_sw_write_pixel(uint8_t *ptr, unsigned cpp, uint32_t pixel)
+{
+    memcpy(ptr, &pixel, cpp);
+}
+
+static void host1x_sw_gr2d_fill(struct drm_tegra *drm,
+                                struct host1x_sw_gr2d *gr2d,
+                                unsigned cpp)
+{
+    uint32_t *regs = gr2d->regs;
+    unsigned width  = regs[GR2D_DSTSIZE] & 0xffff;
+    unsigned height = regs[GR2D_DSTSIZE] >> 16;
+    unsigned xpos   = regs[GR2D_DSTPS] & 0xffff;
+    unsigned ypos   = regs[GR2D_DSTPS] >> 16;
+    unsigned pitch  = regs[GR2D_DSTST];
+    uint32_t color  = regs[GR2D_SRCFGC];
+    uint8_t rop     = regs[GR2D_ROPFADE] & 0xff;
+    uint8_t *dst, *pix;
+    unsigned x, y;
+
+    if (!width || !height)
+        return;
+
+    dst = host1x_sw_resolve(drm,
+                            regs[GR2D_DSTBA] + ypos * pitch + xpos * cpp,
+                            (height - 1) * pitch + width * cpp);
+    if (!dst)
+        return;
+
+    for (y = 0; y < height; y++, dst += pitch) {
+        for (x = 0, pix = dst; x < width; x++, pix += cpp)
+            host1x_sw_write_pixel(pix, cpp,
+                host1x_sw_rop3(rop, color, color,
+                               host1x_sw_read_pixel(pix, cpp)));
+    }
+}
+
+static void host1x_sw_gr2d_blit(struct drm_tegra *drm,
+                                struct host1x_sw_gr2d *gr2d,
+                                unsigned cpp)
+{
+    uint32_t *regs   = gr2d->regs;
+    bool xdec        = !!(regs[GR2D_CONTROLMAIN] & (1 << 9));
+    bool ydec        = !!(regs[GR2D_CONTROLMAIN] & (1 << 10));
+    unsigned width   = regs[GR2D_SRCSIZE] & 0xffff;
+    unsigned height  = regs[GR2D_SRCSIZE] >> 16;
+    unsigned src_x   = regs[GR2D_SRCPS] & 0xffff;
+    unsigned src_y   = regs[GR2D_SRCPS] >> 16;
+    unsigned dst_x   = regs[GR2D_DSTPS] & 0xffff;
+    unsigned dst_y   = regs[GR2D_DSTPS] >> 16;
+    unsigned src_pitch = regs[GR2D_SRCST];
+    unsigned dst_pitch = regs[GR2D_DSTST];
+    uint8_t rop      = regs[GR2D_ROPFADE] & 0xff;
+    uint8_t *src, *dst, *s, *d;
+    unsigned x, y, row, col;
+
+    if (!width || !height)
+        return;
+
+    /* in the decrement mode positions point to the last pixel */
+    if (xdec) {
+        src_x -= width - 1;
+        dst_x -= width - 1;
+    }
+
+    if (ydec) {
+        src_y -= height - 1;
+        dst_y -= height - 1;
+    }
+
+    src = host1x_sw_resolve(drm,
+                            regs[GR2D_SRCBA] + src_y * src_pitch + src_x * cpp,
+                            (height - 1) * src_pitch + width * cpp);
+
+    dst = host1x_sw_resolve(drm,
+                            regs[GR2D_DSTBA] + dst_y * dst_pitch + dst_x * cpp,
+                            (height - 1) * dst_pitch + width * cpp);
+    if (!src || !dst)
+        return;
+
+    for (y = 0; y < height; y++) {
+        row = ydec ? height - 1 - y : y;
+        s = src + row * src_pitch;
+        d = dst + row * dst_pitch;
+
+        if (rop == 0xcc) {
+            memmove(d, s, width * cpp);
+            continue;
+        }
+
+        for (x = 0; x < width; x++) {
+            col = xdec ? width - 1 - x : x;
+
+            host1x_sw_write_pixel(d + col * cpp, cpp,
+                host1x_sw_rop3(rop, 0,
+                               host1x_sw_read_pixel(s + col * cpp, cpp),
+                               host1x_sw_read_pixel(d + col * cpp, cpp)));
+        }
+    }
+}
+
+static void host1x_sw_gr2d_fast_rotate(struct drm_tegra *drm,
+                                       struct host1x_sw_gr2d *gr2d,
+                                       unsigned cpp)
+{
+    uint32_t *regs   = gr2d->regs;
+    unsigned orientation = (regs[GR2D_CONTROLSECOND] >> 26) & 0x7;
+    unsigned width   = (regs[GR2D_SRCSIZE] & 0xffff) + 1;
+    unsigned height  = (regs[GR2D_SRCSIZE] >> 16) + 1;
+    unsigned src_pitch = regs[GR2D_SRCST];
+    unsigned dst_pitch = regs[GR2D_DSTST];
+    unsigned dst_width, dst_height;
+    unsigned x, y, dx, dy;
+    uint8_t *src, *dst, *tmp;
+
+    switch (orientation) {
+    case TEGRA2D_TRANS_LR:
+    case TEGRA2D_TRANS_RL:
+    case TEGRA2D_ROT_90:
+    case TEGRA2D_ROT_270:
+        dst_width  = height;
+        dst_height = width;
+        break;
+
+    default:
+        dst_width  = width;
+        dst_height = height;
+        break;
+    }
+
+    src = host1x_sw_resolve(drm, regs[GR2D_SRCBA],
+                            (height - 1) * src_pitch + width * cpp);
+
+    dst = host1x_sw_resolve(drm, regs[GR2D_DSTBA],
+                            (dst_height - 1) * dst_pitch + dst_width * cpp);
+    if (!src || !dst)
+        return;
+
+    /* source and destination overlap in the SQUARE mode */
+    tmp = malloc(width * height * cpp);
+    if (!tmp) {
+        ErrorMsg("failed to allocate fast-rotate buffer\n");
+        return;
+    }
+
+    for (y = 0; y < height; y++)
+        memcpy(tmp + y * width * cpp, src + y * src_pitch, width * cpp);
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            switch (orientation) {
+            case TEGRA2D_FLIP_X:
+                dx = width - 1 - x;
+                dy = y;
+                break;
+            case TEGRA2D_FLIP_Y:
+                dx = x;
+                dy = height - 1 - y;
+                break;
+            case TEGRA2D_TRANS_LR:
+                dx = y;
+                dy = x;
+                break;
+            case TEGRA2D_TRANS_RL:
+                dx = height - 1 - y;
+                dy = width - 1 - x;
+                break;
+            case TEGRA2D_ROT_90:
+                dx = y;
+                dy = width - 1 - x;
+                break;
+            case TEGRA2D_ROT_180:
+                dx = width - 1 - x;
+                dy = height - 1 - y;
+                break;
+            case TEGRA2D_ROT_270:
+                dx = height - 1 - y;
+                dy = x;
+                break;
+            default:
+                dx = x;
+                dy = y;
+                break;
+            }
+
+            memcpy(dst + dy * dst_pitch + dx * cpp,
+                   tmp + (y * width + x) * cpp, cpp);
+        }
+    }
+
+    free(tmp);
+}
+
+static void host1x_sw_gr2d_trigger(struct drm_tegra *drm,
+                                   struct host1x_sw_gr2d *gr2d)
+{
+    uint32_t controlmain = gr2d->regs[GR2D_CONTROLMAIN];
+    uint32_t controlsecond = gr2d->regs[GR2D_CONTROLSECOND];
+    unsigned depth = (controlmain >> 16) & 0x3;
+
+    if (depth > 2) {
+        ErrorMsg("invalid color depth %u\n", depth);
+        return;
+    }
+
+    if (gr2d->regs[GR2D_TILEMODE]) {
+        ErrorMsg("tiled surfaces aren't supported\n");
+        return;
+    }
+
+    if ((controlsecond >> 24) & 0x3)
+        host1x_sw_gr2d_fast_rotate(drm, gr2d, 1 << depth);
+    else if (controlmain & (1 << 6))
+        host1x_sw_gr2d_fill(drm, gr2d, 1 << depth);
+    else
+        host1x_sw_gr2d_blit(drm, gr2d, 1 << depth);
+}
+
+void host1x_sw_gr2d_write(struct drm_tegra *drm, struct host1x_sw_gr2d *gr2d,
+                          unsigned offset, uint32_t value)
+{
+    if (offset >= HOST1X_SW_GR2D_REGS_NB)
+        return;
+
+    gr2d->regs[offset] = value;
+
+    /* operation is started by writing to the register set by trigger */
+    if (offset != GR2D_TRIGGER && offset == (gr2d->regs[GR2D_TRIGGER] & 0xfff))
+        host1x_sw_gr2d_trigger(drm, gr2d);
+}
+
+static void host1x_sw_write(struct drm_tegra_channel *channel,
+                            unsigned class_id, unsigned offset,
+                            uint32_t value)
+{
+    /* offset 0 is the INCR_SYNCPT register of every client */
+    if (offset == 0)
+        return;
+
+    switch (class_id) {
+    case HOST1X_CLASS_GR2D:
+        host1x_sw_gr2d_write(channel->drm, &channel->gr2d, offset, value);
+        break;
+
+    case HOST1X_CLASS_GR3D:
+        host1x_sw_gr3d_write(channel->drm, &channel->gr3d, offset, value);
+        break;
+    }
+}
+
+static int host1x_sw_execute(struct drm_tegra_job *job)
+{
+    struct drm_tegra_channel *channel = job->channel;
+    uint32_t *ptr = job->pushbuf->start;
+    uint32_t *end = job->pushbuf->base.ptr;
+    unsigned offset, count, mask, i;
+    unsigned class_id;
+    uint32_t word;
+
+    if (channel->client == DRM_TEGRA_GR2D)
+        class_id = HOST1X_CLASS_GR2D;
+    else
+        class_id = HOST1X_CLASS_GR3D;
+
+    while (ptr < end) {
+        word = *ptr++;
+        offset = (word >> 16) & 0xfff;
+
+        switch (word >> 28) {
+        case 0x0: /* SETCL */
+            class_id = (word >> 6) & 0x3ff;
+            mask = word & 0x3f;
+            goto write_mask;
+
+        case 0x1: /* INCR */
+        case 0x2: /* NONINCR */
+            count = word & 0xffff;
+
+            if (end - ptr < count)
+                goto overrun;
+
+            for (i = 0; i < count; i++)
+                host1x_sw_write(channel, class_id,
+                                (word >> 28) == 0x1 ? offset + i : offset,
+                                *ptr++);
+            break;
+
+        case 0x3: /* MASK */
+            mask = word & 0xffff;
+write_mask:
+            for (i = 0; mask; i++, mask >>= 1) {
+                if (!(mask & 1))
+                    continue;
+
+                if (ptr == end)
+                    goto overrun;
+
+                host1x_sw_write(channel, class_id, offset + i, *ptr++);
+            }
+            break;
+
+        case 0x4: /* IMM */
+            host1x_sw_write(channel, class_id, offset, word & 0xffff);
+            break;
+
+        case 0xe: /* EXTEND */
+            break;
+
+        default:
+            ErrorMsg("invalid opcode 0x%08x\n", word);
+            return -EINVAL;
+        }
+    }
+
+    return 0;
+
+overrun:
+    ErrorMsg("pushbuf overrun\n");
+
+    return -EINVAL;
+}
+
+int drm_tegra_job_submit(struct drm_tegra_job *job,
+                         struct drm_tegra_fence **fencep)
+{
+    struct drm_tegra_fence *fence = NULL;
+    struct host1x_sw_reloc *reloc;
+    unsigned i;
+    int err;
+
+    if (!job || !job->pushbuf)
+        return -EINVAL;
+
+    if (fencep) {
+        fence = calloc(1, sizeof(*fence));
+        if (!fence)
+            return -ENOMEM;
+    }
+
+    for (i = 0; i < job->num_relocs; i++) {
+        reloc = &job->relocs[i];
+        job->pushbuf->start[reloc->word] =
+                (reloc->bo->iova + reloc->offset) >> reloc->shift;
+    }
+
+    err = host1x_sw_execute(job);
+    if (err) {
+        free(fence);
+        return err;
+    }
+
+    job->channel->syncpt_value += job->increments;
+
+    if (fencep) {
+        fence->value = job->channel->syncpt_value;
+        *fencep = fence;
+    }
+
+    return 0;
+}
+
+int drm_tegra_fence_wait_timeout(struct drm_tegra_fence *fence,
+                                 unsigned long timeout)
+{
+    /* jobs are executed synchronously, fence is always signalled */
+    return fence ? 0 : -EINVAL;
+}
+
+void drm_tegra_fence_free(struct drm_tegra_fence *fence)
+{
+    free(fence);
+}
+
+/* vim: set et sts=4 sw=4 ts=4: */
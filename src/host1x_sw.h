@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) Dmitry Osipenko
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef __TEGRA_HOST1X_SW_H
+#define __TEGRA_HOST1X_SW_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Software host1x backend. Implements the subset of libdrm_tegra API used
+ * by the driver, jobs are decoded and executed by CPU at submission time.
+ * The declarations below mirror libdrm/tegra.h, which isn't available when
+ * building without libdrm_tegra.
+ */
+
+struct drm_tegra;
+struct drm_tegra_bo;
+struct drm_tegra_channel;
+struct drm_tegra_job;
+struct drm_tegra_fence;
+
+struct drm_tegra_pushbuf {
+    uint32_t *ptr;
+};
+
+enum drm_tegra_class {
+    DRM_TEGRA_GR2D,
+    DRM_TEGRA_GR3D,
+};
+
+enum drm_tegra_syncpt_cond {
+    DRM_TEGRA_SYNCPT_COND_IMMEDIATE,
+    DRM_TEGRA_SYNCPT_COND_OP_DONE,
+    DRM_TEGRA_SYNCPT_COND_RD_DONE,
+    DRM_TEGRA_SYNCPT_COND_WR_SAFE,
+    DRM_TEGRA_SYNCPT_COND_MAX,
+};
+
+int drm_tegra_new(struct drm_tegra **drmp, int fd);
+void drm_tegra_close(struct drm_tegra *drm);
+
+int drm_tegra_bo_new(struct drm_tegra_bo **bop, struct drm_tegra *drm,
+                     uint32_t flags, uint32_t size);
+int drm_tegra_bo_wrap(struct drm_tegra_bo **bop, struct drm_tegra *drm,
+                      uint32_t handle, uint32_t flags, uint32_t size);
+struct drm_tegra_bo *drm_tegra_bo_ref(struct drm_tegra_bo *bo);
+void drm_tegra_bo_unref(struct drm_tegra_bo *bo);
+int drm_tegra_bo_get_handle(struct drm_tegra_bo *bo, uint32_t *handle);
+int drm_tegra_bo_get_name(struct drm_tegra_bo *bo, uint32_t *name);
+int drm_tegra_bo_map(struct drm_tegra_bo *bo, void **ptr);
+int drm_tegra_bo_unmap(struct drm_tegra_bo *bo);
+int drm_tegra_bo_forbid_caching(struct drm_tegra_bo *bo);
+
+int drm_tegra_channel_open(struct drm_tegra_channel **channelp,
+                           struct drm_tegra *drm,
+                           enum drm_tegra_class client);
+int drm_tegra_channel_close(struct drm_tegra_channel *channel);
+
+int drm_tegra_job_new(struct drm_tegra_job **jobp,
+                      struct drm_tegra_channel *channel);
+int drm_tegra_job_free(struct drm_tegra_job *job);
+int drm_tegra_job_submit(struct drm_tegra_job *job,
+                         struct drm_tegra_fence **fencep);
+
+int drm_tegra_pushbuf_new(struct drm_tegra_pushbuf **pushbufp,
+                          struct drm_tegra_job *job);
+int drm_tegra_pushbuf_free(struct drm_tegra_pushbuf *pushbuf);
+int drm_tegra_pushbuf_prepare(struct drm_tegra_pushbuf *pushbuf,
+                              unsigned int words);
+int drm_tegra_pushbuf_relocate(struct drm_tegra_pushbuf *pushbuf,
+                               struct drm_tegra_bo *target,
+                               unsigned long offset,
+                               unsigned long shift);
+int drm_tegra_pushbuf_sync(struct drm_tegra_pushbuf *pushbuf,
+                           enum drm_tegra_syncpt_cond cond);
+
+int drm_tegra_fence_wait_timeout(struct drm_tegra_fence *fence,
+                                 unsigned long timeout);
+void drm_tegra_fence_free(struct drm_tegra_fence *fence);
+
+#define HOST1X_SW_GR2D_REGS_NB  0x50
+
+struct host1x_sw_gr2d {
+    uint32_t regs[HOST1X_SW_GR2D_REGS_NB];
+};
+
+#define HOST1X_SW_GR3D_REGS_NB  0x1000
+
+struct host1x_sw_gr3d {
+    uint32_t regs[HOST1X_SW_GR3D_REGS_NB];
+
+    /* shader programs, as written to the upload registers */
+    uint32_t vp_insts[256][4];
+    uint32_t vp_consts[256][4];
+    uint32_t pseq_insts[64];
+    uint32_t mfu_sched[64];
+    uint32_t mfu_insts[64][2];
+    uint32_t tex_insts[64];
+    uint32_t alu_sched[64];
+    uint32_t alu_insts[64][8];
+    uint32_t alu_complement[64];
+    uint32_t dw_insts[64];
+
+    /* upload pointers, in words */
+    unsigned vp_inst_id;
+    unsigned vp_const_id;
+    unsigned pseq_inst_id;
+    unsigned mfu_sched_id;
+    unsigned mfu_inst_id;
+    unsigned tex_inst_id;
+    unsigned alu_sched_id;
+    unsigned alu_inst_id;
+    unsigned alu_complement_id;
+    unsigned dw_inst_id;
+
+    /* profiling statistics */
+    uint64_t draws;
+    uint64_t fragments;
+    uint64_t fragments_killed;
+    uint64_t cycles;
+};
+
+void *host1x_sw_resolve(struct drm_tegra *drm, uint32_t iova, uint32_t size);
+
+void host1x_sw_gr2d_write(struct drm_tegra *drm, struct host1x_sw_gr2d *gr2d,
+                          unsigned offset, uint32_t value);
+
+void host1x_sw_gr3d_write(struct drm_tegra *drm, struct host1x_sw_gr3d *gr3d,
+                          unsigned offset, uint32_t value);
+
+#endif
+
+/* vim: set et sts=4 sw=4 ts=4: */
@@ -0,0 +1,1736 @@
+/*
+ * Copyright (c) Dmitry Osipenko
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * CPU interpreter of the GR3D. Shader programs are captured from the upload
+ * registers and executed once DRAW_PRIMITIVES is written: vertex program runs
+ * per vertex, linker fills TRAM from the vertex exports, triangles are
+ * rasterized and fragment program runs per pixel, going through PSEQ, MFU,
+ * TEX, ALU and DW stages of every EXEC block.
+ *
+ * Semantics of the instructions follow the shader assembler and are known
+ * only approximately, the goal is to check output of the shaders against a
+ * reference and to estimate their cost, not to be bit-exact with hardware.
+ * Perspective correction, predication, flow control and depth / stencil
+ * aren't emulated.
+ */
+
+#include <math.h>
+
+#include "driver.h"
+#include "host1x_sw.h"
+
+#include "asm/fragment_asm.h"
+#include "asm/linker_asm.h"
+#include "asm/vertex_asm.h"
+
+#define ErrorMsg(fmt, args...)                                              \
+    xf86DrvMsg(-1, X_ERROR, "%s:%d/%s(): " fmt, __FILE__,                   \
+               __LINE__, __func__, ##args)
+
+#define TGR3D_GET(reg_name, field_name, value)                              \
+    (((value) & TGR3D_ ## reg_name ## _ ## field_name ## __MASK) >>         \
+                TGR3D_ ## reg_name ## _ ## field_name ## __SHIFT)
+
+#define GR3D_VP_INSTS_NB        256
+#define GR3D_VP_CONSTS_NB       256
+#define GR3D_FP_INSTS_NB        64
+#define GR3D_FP_CONSTS_NB       32
+#define GR3D_LINKER_INSTS_NB    32
+#define GR3D_TRAM_ROWS_NB       16
+
+struct gr3d_surface {
+    uint8_t *map;
+    unsigned width;
+    unsigned height;
+    unsigned pitch;
+    unsigned format;
+    unsigned cpp;
+    bool linear;
+    bool clamp_s, clamp_t;
+    bool mirror_s, mirror_t;
+};
+
+struct gr3d_vertex {
+    float exports[16][4];
+    float x, y;
+};
+
+struct gr3d_tram {
+    float value[GR3D_TRAM_ROWS_NB][4][2];
+    bool flat[GR3D_TRAM_ROWS_NB][4][2];
+};
+
+struct gr3d_fragment {
+    uint32_t regs[FRAGMENT_KILL_REG + 1];
+    struct gr3d_tram tram;
+    float bar[2];
+    float alu[4];
+    float sfu;
+    float posx, posy;
+    bool kill;
+};
+
+struct gr3d_draw_ctx {
+    struct drm_tegra *drm;
+    struct host1x_sw_gr3d *gr3d;
+
+    vpe_instr128 vp[GR3D_VP_INSTS_NB];
+    link_instr linker[GR3D_LINKER_INSTS_NB];
+    unsigned linker_nb;
+
+    mfu_instr mfu[GR3D_FP_INSTS_NB];
+    alu_instr alu[GR3D_FP_INSTS_NB];
+    unsigned fp_nb;
+
+    struct gr3d_surface tex[16];
+    struct gr3d_surface rt[16];
+    unsigned dst_rt;
+
+    unsigned scissor_x0, scissor_x1;
+    unsigned scissor_y0, scissor_y1;
+
+    struct gr3d_fragment frag_init;
+
+    unsigned fragments;
+    unsigned fragments_killed;
+    unsigned frag_cycles;
+};
+
+static inline float gr3d_u2f(uint32_t u)
+{
+    union { uint32_t u; float f; } v = { .u = u };
+
+    return v.f;
+}
+
+static inline uint32_t gr3d_f2u(float f)
+{
+    union { uint32_t u; float f; } v = { .f = f };
+
+    return v.u;
+}
+
+static inline float gr3d_clampf(float v, float min, float max)
+{
+    return v < min ? min : (v > max ? max : v);
+}
+
+static float gr3d_fp20_to_float(uint32_t v)
+{
+    uint32_t sign = (v >> 19) & 0x1;
+    uint32_t exponent = (v >> 13) & 0x3f;
+    uint32_t mantissa = v & 0x1fff;
+
+    if (exponent == 0)
+        return sign ? -0.0f : 0.0f;
+
+    if (exponent == 0x3f)
+        return sign ? -INFINITY : INFINITY;
+
+    return gr3d_u2f((sign << 31) | ((exponent - 31 + 127) << 23) |
+                    (mantissa << 10));
+}
+
+static uint32_t gr3d_float_to_fp20(float f)
+{
+    uint32_t u = gr3d_f2u(f);
+    uint32_t sign = (u >> 31) & 0x1;
+    int exponent = (u >> 23) & 0xff;
+
+    if (exponent == 0xff)
+        return (sign << 19) | (0x3f << 13);
+
+    exponent = exponent - 127 + 31;
+
+    /* denormals are flushed to zero, overflow saturates to infinity */
+    if (exponent <= 0)
+        return sign << 19;
+
+    if (exponent >= 0x3f)
+        return (sign << 19) | (0x3f << 13);
+
+    return (sign << 19) | (exponent << 13) | ((u & 0x7fffff) >> 10);
+}
+
+static inline float gr3d_fx10_to_float(uint32_t v)
+{
+    return (((int32_t)(v & 0x3ff) ^ 0x200) - 0x200) / 256.0f;
+}
+
+static inline uint32_t gr3d_float_to_fx10(float f)
+{
+    return FX10(gr3d_clampf(f, -2.0f, 511.0f / 256.0f));
+}
+
+static inline float gr3d_fp20_round(float f)
+{
+    return gr3d_fp20_to_float(gr3d_float_to_fp20(f));
+}
+
+static float gr3d_half_to_float(uint16_t h)
+{
+    uint32_t sign = (h >> 15) & 0x1;
+    uint32_t exponent = (h >> 10) & 0x1f;
+    uint32_t mantissa = h & 0x3ff;
+
+    if (exponent == 0)
+        return (sign ? -1.0f : 1.0f) * ldexpf(mantissa, -24);
+
+    if (exponent == 0x1f)
+        return gr3d_u2f((sign << 31) | 0x7f800000 | (mantissa << 13));
+
+    return gr3d_u2f((sign << 31) | ((exponent - 15 + 127) << 23) |
+                    (mantissa << 13));
+}
+
+static unsigned gr3d_format_cpp(unsigned format)
+{
+    switch (format) {
+    case TGR3D_PIXEL_FORMAT_A8:
+    case TGR3D_PIXEL_FORMAT_L8:
+        return 1;
+
+    case TGR3D_PIXEL_FORMAT_LA88:
+    case TGR3D_PIXEL_FORMAT_RGB565:
+    case TGR3D_PIXEL_FORMAT_RGBA5551:
+    case TGR3D_PIXEL_FORMAT_RGBA4444:
+        return 2;
+
+    case TGR3D_PIXEL_FORMAT_RGBA8888:
+        return 4;
+
+    default:
+        return 0;
+    }
+}
+
+/*
+ * Color components are kept in the order of hardware registers, i.e. the
+ * first byte of RGBA8888 pixel goes to the low half of the first register.
+ */
+static void gr3d_surface_load(const struct gr3d_surface *surf,
+                              unsigned x, unsigned y, float c[4])
+{
+    const uint8_t *p = surf->map + y * surf->pitch + x * surf->cpp;
+    uint16_t v;
+
+    switch (surf->format) {
+    case TGR3D_PIXEL_FORMAT_A8:
+        c[0] = c[1] = c[2] = 0.0f;
+        c[3] = p[0] / 255.0f;
+        break;
+
+    case TGR3D_PIXEL_FORMAT_L8:
+        c[0] = c[1] = c[2] = p[0] / 255.0f;
+        c[3] = 1.0f;
+        break;
+
+    case TGR3D_PIXEL_FORMAT_LA88:
+        c[0] = c[1] = c[2] = p[0] / 255.0f;
+        c[3] = p[1] / 255.0f;
+        break;
+
+    case TGR3D_PIXEL_FORMAT_RGB565:
+        v = p[0] | p[1] << 8;
+        c[0] = ((v >> 11) & 0x1f) / 31.0f;
+        c[1] = ((v >>  5) & 0x3f) / 63.0f;
+        c[2] = ((v >>  0) & 0x1f) / 31.0f;
+        c[3] = 1.0f;
+        break;
+
+    case TGR3D_PIXEL_FORMAT_RGBA5551:
+        v = p[0] | p[1] << 8;
+        c[0] = ((v >> 11) & 0x1f) / 31.0f;
+        c[1] = ((v >>  6) & 0x1f) / 31.0f;
+        c[2] = ((v >>  1) & 0x1f) / 31.0f;
+        c[3] = v & 0x1;
+        break;
+
+    case TGR3D_PIXEL_FORMAT_RGBA4444:
+        v = p[0] | p[1] << 8;
+        c[0] = ((v >> 12) & 0xf) / 15.0f;
+        c[1] = ((v >>  8) & 0xf) / 15.0f;
+        c[2] = ((v >>  4) & 0xf) / 15.0f;
+        c[3] = ((v >>  0) & 0xf) / 15.0f;
+        break;
+
+    case TGR3D_PIXEL_FORMAT_RGBA8888:
+        c[0] = p[0] / 255.0f;
+        c[1] = p[1] / 255.0f;
+        c[2] = p[2] / 255.0f;
+        c[3] = p[3] / 255.0f;
+        break;
+
+    default:
+        c[0] = c[1] = c[2] = c[3] = 0.0f;
+        break;
+    }
+}
+
+static inline unsigned gr3d_unorm(float v, unsigned max)
+{
+    return gr3d_clampf(v, 0.0f, 1.0f) * max + 0.5f;
+}
+
+static void gr3d_surface_store(const struct gr3d_surface *surf,
+                               unsigned x, unsigned y, const float c[4])
+{
+    uint8_t *p = surf->map + y * surf->pitch + x * surf->cpp;
+    uint16_t v;
+
+    switch (surf->format) {
+    case TGR3D_PIXEL_FORMAT_A8:
+        p[0] = gr3d_unorm(c[3], 0xff);
+        break;
+
+    case TGR3D_PIXEL_FORMAT_L8:
+        p[0] = gr3d_unorm(c[0], 0xff);
+        break;
+
+    case TGR3D_PIXEL_FORMAT_LA88:
+        p[0] = gr3d_unorm(c[0], 0xff);
+        p[1] = gr3d_unorm(c[3], 0xff);
+        break;
+
+    case TGR3D_PIXEL_FORMAT_RGB565:
+        v  = gr3d_unorm(c[0], 0x1f) << 11;
+        v |= gr3d_unorm(c[1], 0x3f) << 5;
+        v |= gr3d_unorm(c[2], 0x1f) << 0;
+        p[0] = v;
+        p[1] = v >> 8;
+        break;
+
+    case TGR3D_PIXEL_FORMAT_RGBA5551:
+        v  = gr3d_unorm(c[0], 0x1f) << 11;
+        v |= gr3d_unorm(c[1], 0x1f) << 6;
+        v |= gr3d_unorm(c[2], 0x1f) << 1;
+        v |= gr3d_unorm(c[3], 0x01) << 0;
+        p[0] = v;
+        p[1] = v >> 8;
+        break;
+
+    case TGR3D_PIXEL_FORMAT_RGBA4444:
+        v  = gr3d_unorm(c[0], 0xf) << 12;
+        v |= gr3d_unorm(c[1], 0xf) << 8;
+        v |= gr3d_unorm(c[2], 0xf) << 4;
+        v |= gr3d_unorm(c[3], 0xf) << 0;
+        p[0] = v;
+        p[1] = v >> 8;
+        break;
+
+    case TGR3D_PIXEL_FORMAT_RGBA8888:
+        p[0] = gr3d_unorm(c[0], 0xff);
+        p[1] = gr3d_unorm(c[1], 0xff);
+        p[2] = gr3d_unorm(c[2], 0xff);
+        p[3] = gr3d_unorm(c[3], 0xff);
+        break;
+    }
+}
+
+static int gr3d_wrap(int c, unsigned size, bool clamp, bool mirror)
+{
+    int period = size * 2;
+
+    if (clamp)
+        return c < 0 ? 0 : (c >= (int)size ? (int)size - 1 : c);
+
+    if (mirror) {
+        c %= period;
+        if (c < 0)
+            c += period;
+
+        return c < (int)size ? c : period - 1 - c;
+    }
+
+    c %= (int)size;
+
+    return c < 0 ? c + (int)size : c;
+}
+
+static void gr3d_sample(const struct gr3d_surface *tex, float s, float t,
+                        float c[4])
+{
+    float u, v, fu, fv, t00[4], t01[4], t10[4], t11[4];
+    int x0, y0, x1, y1;
+    unsigned i;
+
+    if (!tex->map) {
+        c[0] = c[1] = c[2] = c[3] = 0.0f;
+        return;
+    }
+
+    if (!isfinite(s))
+        s = 0.0f;
+
+    if (!isfinite(t))
+        t = 0.0f;
+
+    u = s * tex->width;
+    v = t * tex->height;
+
+    if (!tex->linear) {
+        x0 = gr3d_wrap(floorf(u), tex->width, tex->clamp_s, tex->mirror_s);
+        y0 = gr3d_wrap(floorf(v), tex->height, tex->clamp_t, tex->mirror_t);
+
+        gr3d_surface_load(tex, x0, y0, c);
+        return;
+    }
+
+    u -= 0.5f;
+    v -= 0.5f;
+    fu = u - floorf(u);
+    fv = v - floorf(v);
+
+    x0 = gr3d_wrap(floorf(u),     tex->width,  tex->clamp_s, tex->mirror_s);
+    x1 = gr3d_wrap(floorf(u) + 1, tex->width,  tex->clamp_s, tex->mirror_s);
+    y0 = gr3d_wrap(floorf(v),     tex->height, tex->clamp_t, tex->mirror_t);
+    y1 = gr3d_wrap(floorf(v) + 1, tex->height, tex->clamp_t, tex->mirror_t);
+
+    gr3d_surface_load(tex, x0, y0, t00);
+    gr3d_surface_load(tex, x1, y0, t01);
+    gr3d_surface_load(tex, x0, y1, t10);
+    gr3d_surface_load(tex, x1, y1, t11);
+
+    for (i = 0; i < 4; i++)
+        c[i] = (t00[i] * (1.0f - fu) + t01[i] * fu) * (1.0f - fv) +
+               (t10[i] * (1.0f - fu) + t11[i] * fu) * fv;
+}
+
+static void gr3d_setup_texture(struct gr3d_draw_ctx *ctx, unsigned index)
+{
+    struct host1x_sw_gr3d *gr3d = ctx->gr3d;
+    struct gr3d_surface *tex = &ctx->tex[index];
+    uint32_t desc1 = gr3d->regs[TGR3D_TEXTURE_DESC1(index)];
+    uint32_t desc2 = gr3d->regs[TGR3D_TEXTURE_DESC2(index)];
+    unsigned alignment = 16;
+
+    if (tex->map)
+        return;
+
+    tex->format = TGR3D_GET(TEXTURE_DESC1, FORMAT, desc1);
+    tex->cpp = gr3d_format_cpp(tex->format);
+    tex->linear = !!(desc1 & TGR3D_TEXTURE_DESC1_MAGFILTER_LINEAR);
+    tex->clamp_s = !!(desc1 & TGR3D_TEXTURE_DESC1_WRAP_S_CLAMP_TO_EDGE);
+    tex->clamp_t = !!(desc1 & TGR3D_TEXTURE_DESC1_WRAP_T_CLAMP_TO_EDGE);
+    tex->mirror_s = !!(desc1 & TGR3D_TEXTURE_DESC1_WRAP_S_MIRRORED_REPEAT);
+    tex->mirror_t = !!(desc1 & TGR3D_TEXTURE_DESC1_WRAP_T_MIRRORED_REPEAT);
+
+    if (desc2 & TGR3D_TEXTURE_DESC2_NOT_POW2_DIMENSIONS) {
+        tex->width = TGR3D_GET(TEXTURE_DESC2, WIDTH, desc2);
+        tex->height = TGR3D_GET(TEXTURE_DESC2, HEIGHT, desc2);
+        alignment = 64;
+    } else {
+        tex->width = 1 << TGR3D_GET(TEXTURE_DESC2, WIDTH_LOG2, desc2);
+        tex->height = 1 << TGR3D_GET(TEXTURE_DESC2, HEIGHT_LOG2, desc2);
+    }
+
+    if (!tex->cpp || !tex->width || !tex->height) {
+        ErrorMsg("unsupported texture %u: format %u size %ux%u\n",
+                 index, tex->format, tex->width, tex->height);
+        return;
+    }
+
+    /* sampler expects pitch aligned the same way as TegraEXAPitch() does */
+    tex->pitch = TEGRA_ALIGN(tex->width * tex->cpp, alignment);
+    tex->map = host1x_sw_resolve(ctx->drm,
+                                 gr3d->regs[TGR3D_TEXTURE_POINTER(index)],
+                                 tex->pitch * (tex->height - 1) +
+                                 tex->width * tex->cpp);
+}
+
+static void gr3d_setup_render_target(struct gr3d_draw_ctx *ctx,
+                                     unsigned index)
+{
+    struct host1x_sw_gr3d *gr3d = ctx->gr3d;
+    struct gr3d_surface *rt = &ctx->rt[index];
+    uint32_t params = gr3d->regs[TGR3D_RT_PARAMS(index)];
+
+    if (rt->map || !(gr3d->regs[TGR3D_RT_ENABLE] & (1 << index)))
+        return;
+
+    if (params & TGR3D_RT_PARAMS_TILED) {
+        ErrorMsg("tiled render target %u isn't supported\n", index);
+        return;
+    }
+
+    rt->format = TGR3D_GET(RT_PARAMS, FORMAT, params);
+    rt->pitch = TGR3D_GET(RT_PARAMS, PITCH, params);
+    rt->cpp = gr3d_format_cpp(rt->format);
+
+    if (!rt->cpp) {
+        ErrorMsg("unsupported render target %u format %u\n",
+                 index, rt->format);
+        return;
+    }
+
+    /* render target has no size, scissor is the best approximation */
+    rt->map = host1x_sw_resolve(ctx->drm, gr3d->regs[TGR3D_RT_PTR(index)],
+                                rt->pitch * (ctx->scissor_y1 - 1) +
+                                ctx->scissor_x1 * rt->cpp);
+}
+
+static void gr3d_fetch_attribute(struct gr3d_draw_ctx *ctx, unsigned index,
+                                 unsigned vtx, float attr[4])
+{
+    struct host1x_sw_gr3d *gr3d = ctx->gr3d;
+    uint32_t mode = gr3d->regs[TGR3D_ATTRIB_MODE(index)];
+    unsigned type = TGR3D_GET(ATTRIB_MODE, TYPE, mode);
+    unsigned size = TGR3D_GET(ATTRIB_MODE, SIZE, mode);
+    unsigned stride = TGR3D_GET(ATTRIB_MODE, STRIDE, mode);
+    unsigned elem_size, i;
+    const uint8_t *p;
+
+    attr[0] = attr[1] = attr[2] = 0.0f;
+    attr[3] = 1.0f;
+
+    switch (type) {
+    case TGR3D_ATTRIB_TYPE_UBYTE:
+    case TGR3D_ATTRIB_TYPE_UBYTE_NORM:
+    case TGR3D_ATTRIB_TYPE_SBYTE:
+    case TGR3D_ATTRIB_TYPE_SBYTE_NORM:
+        elem_size = 1;
+        break;
+
+    case TGR3D_ATTRIB_TYPE_USHORT:
+    case TGR3D_ATTRIB_TYPE_USHORT_NORM:
+    case TGR3D_ATTRIB_TYPE_SSHORT:
+    case TGR3D_ATTRIB_TYPE_SSHORT_NORM:
+    case TGR3D_ATTRIB_TYPE_FLOAT16:
+        elem_size = 2;
+        break;
+
+    default:
+        elem_size = 4;
+        break;
+    }
+
+    size = size > 4 ? 4 : size;
+
+    p = host1x_sw_resolve(ctx->drm,
+                          gr3d->regs[TGR3D_ATTRIB_PTR(index)] + stride * vtx,
+                          elem_size * size);
+    if (!p)
+        return;
+
+    for (i = 0; i < size; i++, p += elem_size) {
+        uint32_t u32 = 0;
+        uint16_t u16;
+
+        memcpy(&u32, p, elem_size);
+        u16 = u32;
+
+        switch (type) {
+        case TGR3D_ATTRIB_TYPE_UBYTE:       attr[i] = (uint8_t)u32; break;
+        case TGR3D_ATTRIB_TYPE_UBYTE_NORM:  attr[i] = (uint8_t)u32 / 255.0f; break;
+        case TGR3D_ATTRIB_TYPE_SBYTE:       attr[i] = (int8_t)u32; break;
+        case TGR3D_ATTRIB_TYPE_SBYTE_NORM:  attr[i] = (int8_t)u32 / 127.0f; break;
+        case TGR3D_ATTRIB_TYPE_USHORT:      attr[i] = u16; break;
+        case TGR3D_ATTRIB_TYPE_USHORT_NORM: attr[i] = u16 / 65535.0f; break;
+        case TGR3D_ATTRIB_TYPE_SSHORT:      attr[i] = (int16_t)u16; break;
+        case TGR3D_ATTRIB_TYPE_SSHORT_NORM: attr[i] = (int16_t)u16 / 32767.0f; break;
+        case TGR3D_ATTRIB_TYPE_UINT:        attr[i] = u32; break;
+        case TGR3D_ATTRIB_TYPE_UINT_NORM:   attr[i] = u32 / 4294967295.0f; break;
+        case TGR3D_ATTRIB_TYPE_SINT:        attr[i] = (int32_t)u32; break;
+        case TGR3D_ATTRIB_TYPE_SINT_NORM:   attr[i] = (int32_t)u32 / 2147483647.0f; break;
+        case TGR3D_ATTRIB_TYPE_FIXED16:     attr[i] = (int32_t)u32 / 65536.0f; break;
+        case TGR3D_ATTRIB_TYPE_FLOAT32:     attr[i] = gr3d_u2f(u32); break;
+        case TGR3D_ATTRIB_TYPE_FLOAT16:     attr[i] = gr3d_half_to_float(u16); break;
+        }
+    }
+}
+
+struct gr3d_vp_src {
+    unsigned type;
+    unsigned index;
+    unsigned swizzle[4];
+    bool negate;
+    bool absolute;
+};
+
+struct gr3d_vp_state {
+    float attrs[16][4];
+    float temps[32][4];
+    int address[4];
+};
+
+static void gr3d_vp_read(struct gr3d_draw_ctx *ctx,
+                         const struct gr3d_vp_state *vps,
+                         const vpe_instr128 *instr,
+                         const struct gr3d_vp_src *src, float out[4])
+{
+    static const float zero[4];
+    const float *vec = zero;
+    int index;
+    unsigned i;
+
+    switch (src->type) {
+    case REG_TYPE_TEMPORARY:
+        vec = vps->temps[src->index & 31];
+        break;
+
+    case REG_TYPE_ATTRIBUTE:
+        index = instr->attribute_fetch_index;
+        if (instr->attribute_relative_addressing_enable)
+            index += vps->address[instr->address_register_select];
+
+        if (index >= 0 && index < 16)
+            vec = vps->attrs[index];
+        break;
+
+    case REG_TYPE_UNIFORM:
+        index = instr->uniform_fetch_index;
+        if (instr->constant_relative_addressing_enable)
+            index += vps->address[instr->address_register_select];
+
+        if (index >= 0 && index < GR3D_VP_CONSTS_NB) {
+            for (i = 0; i < 4; i++)
+                out[i] = gr3d_u2f(ctx->gr3d->vp_consts[index][i]);
+
+            vec = out;
+        }
+        break;
+    }
+
+    {
+        float tmp[4] = { vec[0], vec[1], vec[2], vec[3] };
+
+        for (i = 0; i < 4; i++) {
+            out[i] = tmp[src->swizzle[i]];
+
+            if (src->absolute)
+                out[i] = fabsf(out[i]);
+
+            if (src->negate)
+                out[i] = -out[i];
+        }
+    }
+}
+
+#define GR3D_VP_SRC(instr, r)                                               \
+    {                                                                       \
+        .type       = (instr)->r##_type,                                    \
+        .index      = (instr)->r##_index,                                   \
+        .swizzle    = { (instr)->r##_swizzle_x, (instr)->r##_swizzle_y,     \
+                        (instr)->r##_swizzle_z, (instr)->r##_swizzle_w },   \
+        .negate     = (instr)->r##_negate,                                  \
+        .absolute   = (instr)->r##_absolute_value,                          \
+    }
+
+static bool gr3d_vp_vector_op(unsigned opcode, const float a[4],
+                              const float b[4], const float c[4],
+                              float d[4], int address[4])
+{
+    unsigned i;
+    float dp;
+
+    switch (opcode) {
+    case VECTOR_OPCODE_MOV:
+        memcpy(d, a, sizeof(float) * 4);
+        return true;
+
+    case VECTOR_OPCODE_MUL:
+        for (i = 0; i < 4; i++)
+            d[i] = a[i] * b[i];
+        return true;
+
+    case VECTOR_OPCODE_ADD:
+        for (i = 0; i < 4; i++)
+            d[i] = a[i] + c[i];
+        return true;
+
+    case VECTOR_OPCODE_MAD:
+        for (i = 0; i < 4; i++)
+            d[i] = a[i] * b[i] + c[i];
+        return true;
+
+    case VECTOR_OPCODE_DP3:
+    case VECTOR_OPCODE_DPH:
+    case VECTOR_OPCODE_DP4:
+        dp = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+
+        if (opcode == VECTOR_OPCODE_DPH)
+            dp += b[3];
+        else if (opcode == VECTOR_OPCODE_DP4)
+            dp += a[3] * b[3];
+
+        d[0] = d[1] = d[2] = d[3] = dp;
+        return true;
+
+    case VECTOR_OPCODE_DST:
+        d[0] = 1.0f;
+        d[1] = a[1] * b[1];
+        d[2] = a[2];
+        d[3] = b[3];
+        return true;
+
+    case VECTOR_OPCODE_MIN:
+        for (i = 0; i < 4; i++)
+            d[i] = fminf(a[i], b[i]);
+        return true;
+
+    case VECTOR_OPCODE_MAX:
+        for (i = 0; i < 4; i++)
+            d[i] = fmaxf(a[i], b[i]);
+        return true;
+
+    case VECTOR_OPCODE_SLT: for (i = 0; i < 4; i++) d[i] = a[i] <  b[i]; return true;
+    case VECTOR_OPCODE_SGE: for (i = 0; i < 4; i++) d[i] = a[i] >= b[i]; return true;
+    case VECTOR_OPCODE_SEQ: for (i = 0; i < 4; i++) d[i] = a[i] == b[i]; return true;
+    case VECTOR_OPCODE_SGT: for (i = 0; i < 4; i++) d[i] = a[i] >  b[i]; return true;
+    case VECTOR_OPCODE_SLE: for (i = 0; i < 4; i++) d[i] = a[i] <= b[i]; return true;
+    case VECTOR_OPCODE_SNE: for (i = 0; i < 4; i++) d[i] = a[i] != b[i]; return true;
+    case VECTOR_OPCODE_SFL: for (i = 0; i < 4; i++) d[i] = 0.0f; return true;
+    case VECTOR_OPCODE_STR: for (i = 0; i < 4; i++) d[i] = 1.0f; return true;
+
+    case VECTOR_OPCODE_FRC:
+        for (i = 0; i < 4; i++)
+            d[i] = a[i] - floorf(a[i]);
+        return true;
+
+    case VECTOR_OPCODE_FLR:
+        for (i = 0; i < 4; i++)
+            d[i] = floorf(a[i]);
+        return true;
+
+    case VECTOR_OPCODE_SSG:
+        for (i = 0; i < 4; i++)
+            d[i] = a[i] > 0.0f ? 1.0f : (a[i] < 0.0f ? -1.0f : 0.0f);
+        return true;
+
+    case VECTOR_OPCODE_ARL:
+    case VECTOR_OPCODE_ARR:
+        for (i = 0; i < 4; i++) {
+            address[i] = opcode == VECTOR_OPCODE_ARL ? floorf(a[i]) :
+                                                       roundf(a[i]);
+            d[i] = address[i];
+        }
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+static bool gr3d_vp_scalar_op(unsigned opcode, float x, float *d)
+{
+    switch (opcode) {
+    case SCALAR_OPCODE_MOV: *d = x;                             return true;
+    case SCALAR_OPCODE_RCP: *d = 1.0f / x;                      return true;
+    case SCALAR_OPCODE_RSQ: *d = 1.0f / sqrtf(fabsf(x));        return true;
+    case SCALAR_OPCODE_EXP:
+    case SCALAR_OPCODE_EX2: *d = exp2f(x);                      return true;
+    case SCALAR_OPCODE_LOG:
+    case SCALAR_OPCODE_LG2: *d = log2f(fabsf(x));               return true;
+    case SCALAR_OPCODE_SIN: *d = sinf(x);                       return true;
+    case SCALAR_OPCODE_COS: *d = cosf(x);                       return true;
+
+    case SCALAR_OPCODE_RCC:
+        *d = 1.0f / x;
+        if (fabsf(*d) > 1.884467e+19f)
+            *d = copysignf(1.884467e+19f, *d);
+        else if (fabsf(*d) < 5.42101e-20f)
+            *d = copysignf(5.42101e-20f, *d);
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+static void gr3d_vp_write(float dst[4], const float src[4],
+                          bool x, bool y, bool z, bool w)
+{
+    if (x) dst[0] = src[0];
+    if (y) dst[1] = src[1];
+    if (z) dst[2] = src[2];
+    if (w) dst[3] = src[3];
+}
+
+static void gr3d_vp_run(struct gr3d_draw_ctx *ctx, struct gr3d_vp_state *vps,
+                        struct gr3d_vertex *v)
+{
+    unsigned pc, i;
+
+    for (pc = 0; pc < GR3D_VP_INSTS_NB; pc++) {
+        const vpe_instr128 *instr = &ctx->vp[pc];
+        struct gr3d_vp_src src_a = GR3D_VP_SRC(instr, rA);
+        struct gr3d_vp_src src_b = GR3D_VP_SRC(instr, rB);
+        struct gr3d_vp_src src_c = GR3D_VP_SRC(instr, rC);
+        float a[4], b[4], c[4], vec[4], scalar[4] = { 0.0f };
+        bool vec_valid, scalar_valid;
+        int export;
+
+        gr3d_vp_read(ctx, vps, instr, &src_a, a);
+        gr3d_vp_read(ctx, vps, instr, &src_b, b);
+        gr3d_vp_read(ctx, vps, instr, &src_c, c);
+
+        vec_valid = gr3d_vp_vector_op(instr->vector_opcode, a, b, c, vec,
+                                      vps->address);
+        scalar_valid = gr3d_vp_scalar_op(instr->scalar_opcode, c[0],
+                                         &scalar[0]);
+        scalar[1] = scalar[2] = scalar[3] = scalar[0];
+
+        if (instr->saturate_result) {
+            for (i = 0; i < 4; i++) {
+                vec[i] = gr3d_clampf(vec[i], 0.0f, 1.0f);
+                scalar[i] = gr3d_clampf(scalar[i], 0.0f, 1.0f);
+            }
+        }
+
+        if (vec_valid && instr->vector_rD_index < 32)
+            gr3d_vp_write(vps->temps[instr->vector_rD_index], vec,
+                          instr->vector_op_write_x_enable,
+                          instr->vector_op_write_y_enable,
+                          instr->vector_op_write_z_enable,
+                          instr->vector_op_write_w_enable);
+
+        if (scalar_valid && instr->scalar_rD_index < 32)
+            gr3d_vp_write(vps->temps[instr->scalar_rD_index], scalar,
+                          instr->scalar_op_write_x_enable,
+                          instr->scalar_op_write_y_enable,
+                          instr->scalar_op_write_z_enable,
+                          instr->scalar_op_write_w_enable);
+
+        export = instr->export_write_index;
+        if (instr->export_relative_addressing_enable)
+            export += vps->address[instr->address_register_select];
+
+        if (instr->export_write_index != 31 && export >= 0 && export < 16) {
+            if (instr->export_vector_write_enable && vec_valid)
+                gr3d_vp_write(v->exports[export], vec,
+                              instr->vector_op_write_x_enable,
+                              instr->vector_op_write_y_enable,
+                              instr->vector_op_write_z_enable,
+                              instr->vector_op_write_w_enable);
+
+            if (!instr->export_vector_write_enable && scalar_valid)
+                gr3d_vp_write(v->exports[export], scalar,
+                              instr->scalar_op_write_x_enable,
+                              instr->scalar_op_write_y_enable,
+                              instr->scalar_op_write_z_enable,
+                              instr->scalar_op_write_w_enable);
+        }
+
+        if (instr->end_of_program)
+            break;
+    }
+}
+
+static void gr3d_shade_vertex(struct gr3d_draw_ctx *ctx, unsigned vtx,
+                              struct gr3d_vertex *v)
+{
+    struct host1x_sw_gr3d *gr3d = ctx->gr3d;
+    uint32_t in_mask = gr3d->regs[TGR3D_VP_ATTRIB_IN_OUT_SELECT] >> 16;
+    struct gr3d_vp_state vps;
+    float *pos = v->exports[0];
+    float w;
+    unsigned i;
+
+    memset(&vps, 0, sizeof(vps));
+    memset(v, 0, sizeof(*v));
+
+    for (i = 0; i < 16; i++) {
+        if (in_mask & (1 << i))
+            gr3d_fetch_attribute(ctx, i, vtx, vps.attrs[i]);
+        else
+            vps.attrs[i][3] = 1.0f;
+    }
+
+    gr3d_vp_run(ctx, &vps, v);
+
+    /* export 0 is the position, viewport values are in 1/16 of pixel */
+    w = pos[3] ? pos[3] : 1.0f;
+
+    v->x = (pos[0] / w * gr3d_u2f(gr3d->regs[TGR3D_VIEWPORT_X_SCALE]) +
+                         gr3d_u2f(gr3d->regs[TGR3D_VIEWPORT_X_BIAS])) / 16.0f;
+    v->y = (pos[1] / w * gr3d_u2f(gr3d->regs[TGR3D_VIEWPORT_Y_SCALE]) +
+                         gr3d_u2f(gr3d->regs[TGR3D_VIEWPORT_Y_BIAS])) / 16.0f;
+}
+
+static void gr3d_link_vertex(struct gr3d_draw_ctx *ctx,
+                             const struct gr3d_vertex *v,
+                             struct gr3d_tram *tram)
+{
+    unsigned i, c;
+
+    memset(tram, 0, sizeof(*tram));
+
+    for (i = 0; i < ctx->linker_nb; i++) {
+        const link_instr *link = &ctx->linker[i];
+        const float *exp = v->exports[link->vertex_export_index];
+        unsigned row = link->tram_row_index % GR3D_TRAM_ROWS_NB;
+        unsigned type[4] = {
+            link->tram_dst_type_x, link->tram_dst_type_y,
+            link->tram_dst_type_z, link->tram_dst_type_w,
+        };
+        unsigned swizzle[4] = {
+            link->tram_dst_swizzle_x, link->tram_dst_swizzle_y,
+            link->tram_dst_swizzle_z, link->tram_dst_swizzle_w,
+        };
+        bool flat[4] = {
+            link->interpolation_disable_x, link->interpolation_disable_y,
+            link->interpolation_disable_z, link->interpolation_disable_w,
+        };
+
+        /* export component goes to the TRAM column selected by swizzle */
+        for (c = 0; c < 4; c++) {
+            unsigned half = (type[c] == TRAM_DST_FX10_HIGH);
+
+            if (type[c] == TRAM_DST_NONE)
+                continue;
+
+            tram->value[row][swizzle[c]][half] = exp[c];
+            tram->flat[row][swizzle[c]][half] = flat[c];
+        }
+    }
+}
+
+static float gr3d_alu_src(const struct gr3d_fragment *frag,
+                          const uint32_t imm[3], unsigned index,
+                          bool fx10, bool high, bool absolute,
+                          bool minus_one, bool scale_x2, bool negate)
+{
+    uint32_t raw;
+    float v;
+
+    switch (index) {
+    case FRAGMENT_ROW_REG_0 ... FRAGMENT_GENERAL_PURPOSE_REG_7:
+    case FRAGMENT_UNIFORM_REG_0 ... FRAGMENT_CONDITION_REG_7:
+        raw = frag->regs[index];
+        goto convert;
+
+    case FRAGMENT_EMBEDDED_CONSTANT_0 ... FRAGMENT_EMBEDDED_CONSTANT_2:
+        raw = imm[index - FRAGMENT_EMBEDDED_CONSTANT_0];
+        goto convert;
+
+    case FRAGMENT_ALU_RESULT_REG_0 ... FRAGMENT_ALU_RESULT_REG_3:
+        v = frag->alu[index - FRAGMENT_ALU_RESULT_REG_0];
+        break;
+
+    case FRAGMENT_LOWP_VEC2_0_1:
+        v = high ? 1.0f : 0.0f;
+        break;
+
+    case FRAGMENT_POS_X:
+        v = frag->posx;
+        break;
+
+    case FRAGMENT_POS_Y:
+        v = frag->posy;
+        break;
+
+    default:
+        v = 0.0f;
+        break;
+    }
+
+    goto modify;
+
+convert:
+    if (fx10)
+        v = gr3d_fx10_to_float(high ? raw >> 10 : raw);
+    else
+        v = gr3d_fp20_to_float(raw);
+
+modify:
+    if (absolute)
+        v = fabsf(v);
+
+    if (minus_one)
+        v -= 1.0f;
+
+    if (scale_x2)
+        v *= 2.0f;
+
+    if (negate)
+        v = -v;
+
+    return v;
+}
+
+#define GR3D_ALU_SRC(frag, imm, a, r)                                       \
+    gr3d_alu_src(frag, imm, (a)->r##_reg_select, (a)->r##_fixed10,          \
+                 (a)->r##_sub_reg_select_high, (a)->r##_absolute_value,     \
+                 (a)->r##_minus_one, (a)->r##_scale_by_two, (a)->r##_negate)
+
+static void gr3d_alu_dst(struct gr3d_fragment *frag,
+                         const union fragment_alu_instruction *a, float v)
+{
+    uint32_t *reg;
+
+    switch (a->dst_reg) {
+    case FRAGMENT_KILL_REG:
+        if (v != 0.0f)
+            frag->kill = true;
+        return;
+
+    case FRAGMENT_ROW_REG_0 ... FRAGMENT_GENERAL_PURPOSE_REG_7:
+    case FRAGMENT_UNIFORM_REG_0 ... FRAGMENT_CONDITION_REG_7:
+        reg = &frag->regs[a->dst_reg];
+        break;
+
+    default:
+        return;
+    }
+
+    if (a->write_low_sub_reg && a->write_high_sub_reg)
+        *reg = gr3d_float_to_fp20(v);
+    else if (a->write_low_sub_reg)
+        *reg = (*reg & ~0x3ff) | gr3d_float_to_fx10(v);
+    else if (a->write_high_sub_reg)
+        *reg = (*reg & 0x3ff) | gr3d_float_to_fx10(v) << 10;
+}
+
+static inline bool gr3d_alu_uses_imm(const union fragment_alu_instruction *a)
+{
+    return (a->rA_reg_select >= FRAGMENT_EMBEDDED_CONSTANT_0 &&
+            a->rA_reg_select <= FRAGMENT_EMBEDDED_CONSTANT_2) ||
+           (a->rB_reg_select >= FRAGMENT_EMBEDDED_CONSTANT_0 &&
+            a->rB_reg_select <= FRAGMENT_EMBEDDED_CONSTANT_2) ||
+           (a->rC_reg_select >= FRAGMENT_EMBEDDED_CONSTANT_0 &&
+            a->rC_reg_select <= FRAGMENT_EMBEDDED_CONSTANT_2);
+}
+
+static void gr3d_alu_exec(struct gr3d_fragment *frag, const alu_instr *instr)
+{
+    bool imm_used = false;
+    alu_instr imm_words;
+    uint32_t imm[3];
+    float res[4];
+    unsigned i;
+
+    /*
+     * Immediates override ALU3, assembler places them into the upper
+     * word of the ALU3 pair.
+     */
+    imm_words = *instr;
+    imm_words.part6 = instr->part7;
+    imm_words.part7 = instr->part6;
+
+    imm[0] = imm_words.imm0.fp20;
+    imm[1] = imm_words.imm1.fp20;
+    imm[2] = imm_words.imm2.fp20;
+
+    for (i = 0; i < 3; i++)
+        imm_used |= gr3d_alu_uses_imm(&instr->a[i]);
+
+    for (i = 0; i < 4; i++) {
+        const union fragment_alu_instruction *a = &instr->a[i];
+        float ra, rb, rc;
+
+        res[i] = 0.0f;
+
+        if (i == 3 && imm_used)
+            continue;
+
+        ra = GR3D_ALU_SRC(frag, imm, a, rA);
+        rb = GR3D_ALU_SRC(frag, imm, a, rB);
+        rc = GR3D_ALU_SRC(frag, imm, a, rC);
+
+        switch (a->opcode) {
+        case ALU_OPCODE_MAD:
+            res[i] = ra * rb + (a->addition_disable ? 0.0f : rc);
+            break;
+
+        case ALU_OPCODE_MIN:
+            res[i] = fminf(ra, rb);
+            break;
+
+        case ALU_OPCODE_MAX:
+            res[i] = fmaxf(ra, rb);
+            break;
+
+        case ALU_OPCODE_CSEL:
+            res[i] = ra < 0.0f ? rb : rc;
+            break;
+        }
+
+        switch (a->scale_result) {
+        case ALU_SCALE_X2:   res[i] *= 2.0f; break;
+        case ALU_SCALE_X4:   res[i] *= 4.0f; break;
+        case ALU_SCALE_DIV2: res[i] *= 0.5f; break;
+        }
+
+        if (a->saturate_result)
+            res[i] = gr3d_clampf(res[i], 0.0f, 1.0f);
+    }
+
+    /* "this" / "other" chain results of the following ALUs into ALU0 */
+    for (i = 3; i-- > 0;) {
+        if (instr->a[i].accumulate_result_this ||
+            instr->a[i].accumulate_result_other)
+            res[i] += res[i + 1];
+    }
+
+    for (i = 0; i < 4; i++) {
+        res[i] = gr3d_fp20_round(res[i]);
+
+        if (i == 3 && imm_used)
+            continue;
+
+        gr3d_alu_dst(frag, &instr->a[i], res[i]);
+    }
+
+    memcpy(frag->alu, res, sizeof(res));
+}
+
+static float gr3d_mfu_mul_src(const struct gr3d_fragment *frag, unsigned src)
+{
+    switch (src) {
+    case MFU_MUL_SRC_ROW_REG_0 ... MFU_MUL_SRC_ROW_REG_3:
+        return gr3d_fp20_to_float(frag->regs[FRAGMENT_ROW_REG(src)]);
+
+    case MFU_MUL_SRC_SFU_RESULT:
+        return frag->sfu;
+
+    case MFU_MUL_SRC_BARYCENTRIC_COEF_0:
+        return frag->bar[0];
+
+    case MFU_MUL_SRC_BARYCENTRIC_COEF_1:
+        return frag->bar[1];
+
+    case MFU_MUL_SRC_CONST_1:
+        return 1.0f;
+
+    default:
+        return 0.0f;
+    }
+}
+
+static void gr3d_mfu_mul(struct gr3d_fragment *frag, unsigned dst,
+                         unsigned src0, unsigned src1)
+{
+    float v = gr3d_mfu_mul_src(frag, src0) * gr3d_mfu_mul_src(frag, src1);
+
+    /* barycentric weight only matters for perspective correction */
+    if (dst >= MFU_MUL_DST_ROW_REG_0 && dst <= MFU_MUL_DST_ROW_REG_3)
+        frag->regs[FRAGMENT_ROW_REG(dst - MFU_MUL_DST_ROW_REG_0)] =
+                                                    gr3d_float_to_fp20(v);
+}
+
+static void gr3d_mfu_exec(struct gr3d_fragment *frag, const mfu_instr *instr)
+{
+    unsigned opcode[4] = {
+        instr->var0_opcode, instr->var1_opcode,
+        instr->var2_opcode, instr->var3_opcode,
+    };
+    unsigned source[4] = {
+        instr->var0_source, instr->var1_source,
+        instr->var2_source, instr->var3_source,
+    };
+    bool saturate[4] = {
+        instr->var0_saturate, instr->var1_saturate,
+        instr->var2_saturate, instr->var3_saturate,
+    };
+    float x, lo, hi;
+    unsigned i;
+
+    if (instr->opcode != MFU_NOP) {
+        x = gr3d_fp20_to_float(frag->regs[instr->reg % 16]);
+
+        switch (instr->opcode) {
+        case MFU_RCP:  x = 1.0f / x;                break;
+        case MFU_RSQ:  x = 1.0f / sqrtf(fabsf(x));  break;
+        case MFU_LG2:  x = log2f(fabsf(x));         break;
+        case MFU_EX2:  x = exp2f(x);                break;
+        case MFU_SQRT: x = sqrtf(fabsf(x));         break;
+        case MFU_SIN:  x = sinf(x);                 break;
+        case MFU_COS:  x = cosf(x);                 break;
+        case MFU_FRC:  x = x - floorf(x);           break;
+        /* range reduction steps, result is passed through as is */
+        default:                                    break;
+        }
+
+        frag->sfu = gr3d_fp20_round(x);
+    }
+
+    gr3d_mfu_mul(frag, instr->mul0_dst, instr->mul0_src0, instr->mul0_src1);
+    gr3d_mfu_mul(frag, instr->mul1_dst, instr->mul1_src0, instr->mul1_src1);
+
+    for (i = 0; i < 4; i++) {
+        lo = frag->tram.value[source[i]][i][0];
+        hi = frag->tram.value[source[i]][i][1];
+
+        if (saturate[i]) {
+            lo = gr3d_clampf(lo, 0.0f, 1.0f);
+            hi = gr3d_clampf(hi, 0.0f, 1.0f);
+        }
+
+        switch (opcode[i]) {
+        case MFU_VAR_FP20:
+            frag->regs[FRAGMENT_ROW_REG(i)] = gr3d_float_to_fp20(lo);
+            break;
+
+        case MFU_VAR_FX10:
+            frag->regs[FRAGMENT_ROW_REG(i)] = gr3d_float_to_fx10(lo) |
+                                              gr3d_float_to_fx10(hi) << 10;
+            break;
+        }
+    }
+}
+
+static void gr3d_regs_load_color(struct gr3d_fragment *frag, unsigned reg,
+                                 const float c[4])
+{
+    frag->regs[reg + 0] = gr3d_float_to_fx10(c[0]) |
+                          gr3d_float_to_fx10(c[1]) << 10;
+    frag->regs[reg + 1] = gr3d_float_to_fx10(c[2]) |
+                          gr3d_float_to_fx10(c[3]) << 10;
+}
+
+static void gr3d_tex_exec(struct gr3d_draw_ctx *ctx,
+                          struct gr3d_fragment *frag, tex_instr instr)
+{
+    unsigned src = instr.src_regs_select == TEX_SRC_R2_R3_R0_R1 ? 2 : 0;
+    unsigned dst = instr.sample_dst_regs_select == TEX_SAMPLE_DST_R2_R3 ? 2 : 0;
+    float c[4];
+
+    gr3d_sample(&ctx->tex[instr.sampler_index],
+                gr3d_fp20_to_float(frag->regs[FRAGMENT_ROW_REG(src + 0)]),
+                gr3d_fp20_to_float(frag->regs[FRAGMENT_ROW_REG(src + 1)]),
+                c);
+
+    gr3d_regs_load_color(frag, FRAGMENT_ROW_REG(dst), c);
+}
+
+static void gr3d_dw_exec(struct gr3d_draw_ctx *ctx,
+                         const struct gr3d_fragment *frag,
+                         unsigned x, unsigned y, dw_instr instr)
+{
+    const struct gr3d_surface *rt = &ctx->rt[instr.render_target_index];
+    unsigned src = instr.src_regs_select ? 2 : 0;
+    uint32_t lo = frag->regs[FRAGMENT_ROW_REG(src + 0)];
+    uint32_t hi = frag->regs[FRAGMENT_ROW_REG(src + 1)];
+    float c[4];
+
+    if (!rt->map)
+        return;
+
+    c[0] = gr3d_fx10_to_float(lo);
+    c[1] = gr3d_fx10_to_float(lo >> 10);
+    c[2] = gr3d_fx10_to_float(hi);
+    c[3] = gr3d_fx10_to_float(hi >> 10);
+
+    gr3d_surface_store(rt, x, y, c);
+}
+
+static void gr3d_shade_fragment(struct gr3d_draw_ctx *ctx,
+                                struct gr3d_fragment *frag,
+                                unsigned x, unsigned y)
+{
+    struct host1x_sw_gr3d *gr3d = ctx->gr3d;
+    unsigned i, k;
+    float c[4];
+
+    for (i = 0; i < ctx->fp_nb && !frag->kill; i++) {
+        instr_sched mfu_sched = { .data = gr3d->mfu_sched[i] };
+        instr_sched alu_sched = { .data = gr3d->alu_sched[i] };
+        tex_instr tex = { .data = gr3d->tex_insts[i] };
+        dw_instr dw = { .data = gr3d->dw_insts[i] };
+
+        /*
+         * PSEQ words aren't decoded, the only one used by the driver
+         * fetches destination pixel into r2,r3.
+         */
+        if (gr3d->pseq_insts[i] && ctx->rt[ctx->dst_rt].map) {
+            gr3d_surface_load(&ctx->rt[ctx->dst_rt], x, y, c);
+            gr3d_regs_load_color(frag, FRAGMENT_ROW_REG(2), c);
+        }
+
+        for (k = 0; k < mfu_sched.instructions_nb; k++)
+            gr3d_mfu_exec(frag, &ctx->mfu[(mfu_sched.address + k) %
+                                          GR3D_FP_INSTS_NB]);
+
+        if (tex.enable)
+            gr3d_tex_exec(ctx, frag, tex);
+
+        for (k = 0; k < alu_sched.instructions_nb && !frag->kill; k++)
+            gr3d_alu_exec(frag, &ctx->alu[(alu_sched.address + k) %
+                                          GR3D_FP_INSTS_NB]);
+
+        if (dw.enable && !frag->kill)
+            gr3d_dw_exec(ctx, frag, x, y, dw);
+    }
+
+    ctx->fragments++;
+
+    if (frag->kill)
+        ctx->fragments_killed++;
+}
+
+static inline float gr3d_edge(const struct gr3d_vertex *a,
+                              const struct gr3d_vertex *b,
+                              float x, float y)
+{
+    return (b->x - a->x) * (y - a->y) - (b->y - a->y) * (x - a->x);
+}
+
+/*
+ * Pixel lying exactly on an edge belongs to one triangle only. Triangles
+ * are brought to the same winding, hence edge shared by two triangles has
+ * opposite direction in each of them.
+ */
+static inline bool gr3d_edge_owns(const struct gr3d_vertex *a,
+                                  const struct gr3d_vertex *b, float w)
+{
+    float dx = b->x - a->x;
+    float dy = b->y - a->y;
+
+    return w > 0.0f || (w == 0.0f && (dy > 0.0f || (dy == 0.0f && dx < 0.0f)));
+}
+
+static void gr3d_draw_triangle(struct gr3d_draw_ctx *ctx,
+                               const struct gr3d_vertex *v0,
+                               const struct gr3d_vertex *v1,
+                               const struct gr3d_vertex *v2)
+{
+    const struct gr3d_vertex *tmp;
+    struct gr3d_tram tram[3];
+    struct gr3d_fragment *frag;
+    float area, w0, w1, w2, px, py;
+    int x, y, x0, x1, y0, y1;
+    unsigned r, c, h;
+
+    area = gr3d_edge(v0, v1, v2->x, v2->y);
+    if (area == 0.0f || !isfinite(area))
+        return;
+
+    if (area < 0.0f) {
+        tmp = v1;
+        v1 = v2;
+        v2 = tmp;
+        area = -area;
+    }
+
+    x0 = floorf(fminf(v0->x, fminf(v1->x, v2->x)));
+    x1 = ceilf(fmaxf(v0->x, fmaxf(v1->x, v2->x)));
+    y0 = floorf(fminf(v0->y, fminf(v1->y, v2->y)));
+    y1 = ceilf(fmaxf(v0->y, fmaxf(v1->y, v2->y)));
+
+    x0 = x0 < (int)ctx->scissor_x0 ? (int)ctx->scissor_x0 : x0;
+    y0 = y0 < (int)ctx->scissor_y0 ? (int)ctx->scissor_y0 : y0;
+    x1 = x1 > (int)ctx->scissor_x1 ? (int)ctx->scissor_x1 : x1;
+    y1 = y1 > (int)ctx->scissor_y1 ? (int)ctx->scissor_y1 : y1;
+
+    if (x0 >= x1 || y0 >= y1)
+        return;
+
+    gr3d_link_vertex(ctx, v0, &tram[0]);
+    gr3d_link_vertex(ctx, v1, &tram[1]);
+    gr3d_link_vertex(ctx, v2, &tram[2]);
+
+    frag = malloc(sizeof(*frag));
+    if (!frag)
+        return;
+
+    for (y = y0; y < y1; y++) {
+        for (x = x0; x < x1; x++) {
+            px = x + 0.5f;
+            py = y + 0.5f;
+
+            w0 = gr3d_edge(v1, v2, px, py);
+            w1 = gr3d_edge(v2, v0, px, py);
+            w2 = gr3d_edge(v0, v1, px, py);
+
+            if (!gr3d_edge_owns(v1, v2, w0) ||
+                !gr3d_edge_owns(v2, v0, w1) ||
+                !gr3d_edge_owns(v0, v1, w2))
+                continue;
+
+            w0 /= area;
+            w1 /= area;
+            w2 /= area;
+
+            memcpy(frag, &ctx->frag_init, sizeof(*frag));
+
+            frag->posx = px;
+            frag->posy = py;
+            frag->bar[0] = w1;
+            frag->bar[1] = w2;
+
+            for (r = 0; r < GR3D_TRAM_ROWS_NB; r++) {
+                for (c = 0; c < 4; c++) {
+                    for (h = 0; h < 2; h++) {
+                        if (tram[0].flat[r][c][h])
+                            frag->tram.value[r][c][h] = tram[0].value[r][c][h];
+                        else
+                            frag->tram.value[r][c][h] =
+                                tram[0].value[r][c][h] * w0 +
+                                tram[1].value[r][c][h] * w1 +
+                                tram[2].value[r][c][h] * w2;
+                    }
+                }
+            }
+
+            gr3d_shade_fragment(ctx, frag, x, y);
+        }
+    }
+
+    free(frag);
+}
+
+static void gr3d_setup_program(struct gr3d_draw_ctx *ctx)
+{
+    struct host1x_sw_gr3d *gr3d = ctx->gr3d;
+    uint32_t setup = gr3d->regs[TGR3D_CULL_FACE_LINKER_SETUP];
+    unsigned i;
+    bool dst_rt_found = false;
+
+    for (i = 0; i < GR3D_VP_INSTS_NB; i++)
+        memcpy(&ctx->vp[i], gr3d->vp_insts[i], sizeof(ctx->vp[i]));
+
+    ctx->linker_nb = TGR3D_GET(CULL_FACE_LINKER_SETUP, LINKER_INST_COUNT,
+                               setup) + 1;
+
+    for (i = 0; i < ctx->linker_nb; i++) {
+        ctx->linker[i].first = gr3d->regs[TGR3D_LINKER_INSTRUCTION(i)];
+        ctx->linker[i].latter = gr3d->regs[TGR3D_LINKER_INSTRUCTION(i) + 1];
+    }
+
+    for (i = 0; i < GR3D_FP_INSTS_NB; i++) {
+        ctx->mfu[i].part0 = gr3d->mfu_insts[i][0];
+        ctx->mfu[i].part1 = gr3d->mfu_insts[i][1];
+
+        memcpy(&ctx->alu[i].part0, gr3d->alu_insts[i],
+               sizeof(gr3d->alu_insts[i]));
+        ctx->alu[i].complement = gr3d->alu_complement[i];
+    }
+
+    ctx->fp_nb = gr3d->regs[TGR3D_FP_PSEQ_ENGINE_INST] & 0x7f;
+    if (ctx->fp_nb > GR3D_FP_INSTS_NB)
+        ctx->fp_nb = GR3D_FP_INSTS_NB;
+
+    /*
+     * Rough cost model: EXEC block takes a clock per issued MFU or ALU
+     * instruction (whichever is more) and at least one clock, texture
+     * fetch and PSEQ read of the destination pixel take a clock each.
+     */
+    ctx->frag_cycles = 0;
+
+    for (i = 0; i < ctx->fp_nb; i++) {
+        instr_sched mfu_sched = { .data = gr3d->mfu_sched[i] };
+        instr_sched alu_sched = { .data = gr3d->alu_sched[i] };
+        tex_instr tex = { .data = gr3d->tex_insts[i] };
+        dw_instr dw = { .data = gr3d->dw_insts[i] };
+        unsigned cycles = 1;
+
+        if (mfu_sched.instructions_nb > cycles)
+            cycles = mfu_sched.instructions_nb;
+
+        if (alu_sched.instructions_nb > cycles)
+            cycles = alu_sched.instructions_nb;
+
+        if (tex.enable) {
+            gr3d_setup_texture(ctx, tex.sampler_index);
+            cycles++;
+        }
+
+        if (gr3d->pseq_insts[i])
+            cycles++;
+
+        if (dw.enable) {
+            gr3d_setup_render_target(ctx, dw.render_target_index);
+
+            if (!dst_rt_found) {
+                ctx->dst_rt = dw.render_target_index;
+                dst_rt_found = true;
+            }
+        }
+
+        ctx->frag_cycles += cycles;
+    }
+
+    memset(&ctx->frag_init, 0, sizeof(ctx->frag_init));
+
+    for (i = 0; i < GR3D_FP_CONSTS_NB; i++)
+        ctx->frag_init.regs[FRAGMENT_UNIFORM_REG(i)] =
+                        gr3d->regs[TGR3D_FP_CONST(i)] & 0xfffff;
+}
+
+static int gr3d_fetch_index(struct gr3d_draw_ctx *ctx, unsigned index_mode,
+                            unsigned first, unsigned offset, unsigned count,
+                            unsigned *indices)
+{
+    uint32_t ptr = ctx->gr3d->regs[TGR3D_INDEX_PTR];
+    unsigned i, size;
+    uint8_t *map;
+
+    switch (index_mode) {
+    case TGR3D_INDEX_MODE_NONE:
+        for (i = 0; i < count; i++)
+            indices[i] = first + offset + i;
+        return 0;
+
+    case TGR3D_INDEX_MODE_UINT8:
+        size = 1;
+        break;
+
+    case TGR3D_INDEX_MODE_UINT16:
+        size = 2;
+        break;
+
+    default:
+        ErrorMsg("invalid index mode %u\n", index_mode);
+        return -EINVAL;
+    }
+
+    map = host1x_sw_resolve(ctx->drm, ptr + offset * size, count * size);
+    if (!map)
+        return -EFAULT;
+
+    for (i = 0; i < count; i++) {
+        if (size == 1)
+            indices[i] = first + map[i];
+        else
+            indices[i] = first + (map[i * 2] | map[i * 2 + 1] << 8);
+    }
+
+    return 0;
+}
+
+static void host1x_sw_gr3d_draw(struct drm_tegra *drm,
+                                struct host1x_sw_gr3d *gr3d,
+                                uint32_t value)
+{
+    uint32_t params = gr3d->regs[TGR3D_DRAW_PARAMS];
+    uint32_t horiz = gr3d->regs[TGR3D_SCISSOR_HORIZ];
+    uint32_t vert = gr3d->regs[TGR3D_SCISSOR_VERT];
+    unsigned count = TGR3D_GET(DRAW_PRIMITIVES, INDEX_COUNT, value) + 1;
+    unsigned offset = TGR3D_GET(DRAW_PRIMITIVES, OFFSET, value);
+    unsigned primitive = TGR3D_GET(DRAW_PARAMS, PRIMITIVE_TYPE, params);
+    unsigned first = TGR3D_GET(DRAW_PARAMS, FIRST, params);
+    unsigned index_mode = TGR3D_GET(DRAW_PARAMS, INDEX_MODE, params);
+    struct gr3d_vertex *vertices = NULL;
+    struct gr3d_draw_ctx *ctx;
+    unsigned *indices = NULL;
+    unsigned i;
+
+    switch (primitive) {
+    case TGR3D_PRIMITIVE_TYPE_TRIANGLES:
+    case TGR3D_PRIMITIVE_TYPE_TRIANGLE_STRIP:
+    case TGR3D_PRIMITIVE_TYPE_TRIANGLE_FAN:
+        break;
+
+    default:
+        ErrorMsg("primitive type %u isn't supported\n", primitive);
+        return;
+    }
+
+    ctx = calloc(1, sizeof(*ctx));
+    vertices = calloc(count, sizeof(*vertices));
+    indices = calloc(count, sizeof(*indices));
+
+    if (!ctx || !vertices || !indices) {
+        ErrorMsg("failed to allocate draw state\n");
+        goto cleanup;
+    }
+
+    ctx->drm = drm;
+    ctx->gr3d = gr3d;
+    ctx->scissor_x0 = TGR3D_GET(SCISSOR_HORIZ, MIN, horiz);
+    ctx->scissor_x1 = TGR3D_GET(SCISSOR_HORIZ, MAX, horiz);
+    ctx->scissor_y0 = TGR3D_GET(SCISSOR_VERT, MIN, vert);
+    ctx->scissor_y1 = TGR3D_GET(SCISSOR_VERT, MAX, vert);
+
+    if (ctx->scissor_x0 >= ctx->scissor_x1 ||
+        ctx->scissor_y0 >= ctx->scissor_y1)
+        goto cleanup;
+
+    gr3d_setup_program(ctx);
+
+    if (gr3d_fetch_index(ctx, index_mode, first, offset, count, indices))
+        goto cleanup;
+
+    for (i = 0; i < count; i++)
+        gr3d_shade_vertex(ctx, indices[i], &vertices[i]);
+
+    for (i = 0; i + 2 < count; ) {
+        switch (primitive) {
+        case TGR3D_PRIMITIVE_TYPE_TRIANGLES:
+            gr3d_draw_triangle(ctx, &vertices[i], &vertices[i + 1],
+                               &vertices[i + 2]);
+            i += 3;
+            break;
+
+        case TGR3D_PRIMITIVE_TYPE_TRIANGLE_STRIP:
+            if (i & 1)
+                gr3d_draw_triangle(ctx, &vertices[i + 1], &vertices[i],
+                                   &vertices[i + 2]);
+            else
+                gr3d_draw_triangle(ctx, &vertices[i], &vertices[i + 1],
+                                   &vertices[i + 2]);
+            i++;
+            break;
+
+        case TGR3D_PRIMITIVE_TYPE_TRIANGLE_FAN:
+            gr3d_draw_triangle(ctx, &vertices[0], &vertices[i + 1],
+                               &vertices[i + 2]);
+            i++;
+            break;
+        }
+    }
+
+    gr3d->draws++;
+    gr3d->fragments += ctx->fragments;
+    gr3d->fragments_killed += ctx->fragments_killed;
+    gr3d->cycles += (uint64_t)ctx->fragments * ctx->frag_cycles;
+
+    xf86DrvMsgVerb(-1, X_INFO, 4,
+                   "GR3D draw %llu: %u vertices, %u fragments (%u killed), "
+                   "%u EXEC, ~%u cycles/fragment, %llu cycles in total\n",
+                   (unsigned long long)gr3d->draws, count, ctx->fragments,
+                   ctx->fragments_killed, ctx->fp_nb, ctx->frag_cycles,
+                   (unsigned long long)gr3d->cycles);
+
+cleanup:
+    free(indices);
+    free(vertices);
+    free(ctx);
+}
+
+void host1x_sw_gr3d_write(struct drm_tegra *drm, struct host1x_sw_gr3d *gr3d,
+                          unsigned offset, uint32_t value)
+{
+    unsigned id;
+
+    if (offset >= HOST1X_SW_GR3D_REGS_NB)
+        return;
+
+    gr3d->regs[offset] = value;
+
+    switch (offset) {
+    case TGR3D_VP_UPLOAD_INST_ID:
+        gr3d->vp_inst_id = value * 4;
+        break;
+
+    case TGR3D_VP_UPLOAD_INST:
+        /* instruction words are uploaded starting from the upper one */
+        id = gr3d->vp_inst_id++;
+        if (id < GR3D_VP_INSTS_NB * 4)
+            gr3d->vp_insts[id / 4][3 - id % 4] = value;
+        break;
+
+    case TGR3D_VP_UPLOAD_CONST_ID:
+        gr3d->vp_const_id = value;
+        break;
+
+    case TGR3D_VP_UPLOAD_CONST:
+        id = gr3d->vp_const_id++;
+        if (id < GR3D_VP_CONSTS_NB * 4)
+            gr3d->vp_consts[id / 4][id % 4] = value;
+        break;
+
+    case TGR3D_FP_UPLOAD_INST_ID_COMMON:
+        gr3d->pseq_inst_id = value;
+        gr3d->mfu_sched_id = value;
+        gr3d->tex_inst_id = value;
+        gr3d->alu_sched_id = value;
+        gr3d->alu_complement_id = value;
+        gr3d->dw_inst_id = value;
+        break;
+
+    case TGR3D_FP_PSEQ_UPLOAD_INST_ID:
+        gr3d->pseq_inst_id = value;
+        break;
+
+    case TGR3D_FP_PSEQ_UPLOAD_INST:
+        id = gr3d->pseq_inst_id++;
+        if (id < GR3D_FP_INSTS_NB)
+            gr3d->pseq_insts[id] = value;
+        break;
+
+    case TGR3D_FP_UPLOAD_MFU_SCHED_ID:
+        gr3d->mfu_sched_id = value;
+        break;
+
+    case TGR3D_FP_UPLOAD_MFU_SCHED:
+        id = gr3d->mfu_sched_id++;
+        if (id < GR3D_FP_INSTS_NB)
+            gr3d->mfu_sched[id] = value;
+        break;
+
+    case TGR3D_FP_UPLOAD_MFU_INST_ID:
+        gr3d->mfu_inst_id = value * 2;
+        break;
+
+    case TGR3D_FP_UPLOAD_MFU_INST:
+        id = gr3d->mfu_inst_id++;
+        if (id < GR3D_FP_INSTS_NB * 2)
+            gr3d->mfu_insts[id / 2][1 - id % 2] = value;
+        break;
+
+    case TGR3D_FP_UPLOAD_TEX_INST_ID:
+        gr3d->tex_inst_id = value;
+        break;
+
+    case TGR3D_FP_UPLOAD_TEX_INST:
+        id = gr3d->tex_inst_id++;
+        if (id < GR3D_FP_INSTS_NB)
+            gr3d->tex_insts[id] = value;
+        break;
+
+    case TGR3D_FP_UPLOAD_ALU_SCHED_ID:
+        gr3d->alu_sched_id = value;
+        break;
+
+    case TGR3D_FP_UPLOAD_ALU_SCHED:
+        id = gr3d->alu_sched_id++;
+        if (id < GR3D_FP_INSTS_NB)
+            gr3d->alu_sched[id] = value;
+        break;
+
+    case TGR3D_FP_UPLOAD_ALU_INST_ID:
+        gr3d->alu_inst_id = value * 8;
+        break;
+
+    case TGR3D_FP_UPLOAD_ALU_INST:
+        /* upper word of every scalar ALU pair goes first */
+        id = gr3d->alu_inst_id++;
+        if (id < GR3D_FP_INSTS_NB * 8)
+            gr3d->alu_insts[id / 8][(id % 8) ^ 1] = value;
+        break;
+
+    case TGR3D_FP_UPLOAD_ALU_INST_COMPLEMENT:
+        id = gr3d->alu_complement_id++;
+        if (id < GR3D_FP_INSTS_NB)
+            gr3d->alu_complement[id] = value;
+        break;
+
+    case TGR3D_FP_UPLOAD_DW_INST_ID:
+        gr3d->dw_inst_id = value;
+        break;
+
+    case TGR3D_FP_UPLOAD_DW_INST:
+        id = gr3d->dw_inst_id++;
+        if (id < GR3D_FP_INSTS_NB)
+            gr3d->dw_insts[id] = value;
+        break;
+
+    case TGR3D_DRAW_PRIMITIVES:
+        host1x_sw_gr3d_draw(drm, gr3d, value);
+        break;
+    }
+}
+
+/* vim: set et sts=4 sw=4 ts=4: */
@@ -45,18 +45,19 @@ static struct {
  * 1) Each allocation is an "entry".
  * 2) The maximum number of entries is limited by the size of bitmap.
  * 3) Bitmap represents the used/unused entries.
- * 4) On allocation, the allocator walks up the bitmap until it finds
- *    an unused entry that has enough space for allocation.
- * 5) The unused entry is selected this way:
- *      1. Find the first unused entry.
- *      2. Find first used entry after the unused of step 1.
- *      3. If unused entry position isn't 0, then the memory-end of used
- *         position that is behind the unused (used_index = unused_index - 1)
- *         is the beginning for the new allocation.
- *         Otherwise the base address of pool is the beginning for the
- *         new allocation.
- *      4. If space between the behind-used entry and the front-used entry
- *         is enough for allocation, allocation succeed.
+ * 4) Free space between two used entries is a "hole", it can be taken only
+ *    by an unused entry that is placed between them in the bitmap. Hole is
+ *    owned by the first unused entry that follows the used one (or by the
+ *    entry 0 if it is unused), its memory starts at the end of the used
+ *    entry behind it (or at the base address of pool).
+ * 5) Holes are indexed by size, there is a list of holes per power of two
+ *    of the hole size. On allocation, the list of the allocation size class
+ *    is searched for the first fitting hole, otherwise the smallest hole of
+ *    the larger classes is taken. Hence allocation doesn't walk the bitmap.
+ *    The rest of the hole is passed to the next unused entry, if any.
+ *    On release, the freed space is merged with the adjacent holes.
+ *    Operations that move entries in bulk drop the index, it is rebuilt
+ *    by the next allocation.
  * 6) If pool has enough space for allocation, but allocation fails due to
  *    fragmentation, then perform defragmentation and retry the allocation.
  * 7) Defragmentation is performed this way:
@@ -85,10 +86,14 @@ int mem_pool_init(struct mem_pool *pool, void *addr, unsigned long size,
     pool->remain = size;
     pool->base = addr;
 
+    pool->holes_valid = 0;
+
     pool->bitmap = calloc(bitmap_size, sizeof(*pool->bitmap));
     pool->entries = malloc(bitmap_size * 32 * sizeof(*pool->entries));
+    pool->holes = malloc(bitmap_size * 32 * sizeof(*pool->holes));
 
-    if (!pool->bitmap || !pool->entries) {
+    if (!pool->bitmap || !pool->entries || !pool->holes) {
+        free(pool->holes);
         free(pool->entries);
         free(pool->bitmap);
         return -ENOMEM;
@@ -174,6 +179,44 @@ out:
     return -1;
 }
 
+static int get_prev_used_entry(struct mem_pool * restrict pool,
+                               unsigned int start)
+{
+    unsigned int bits_array = start / 32;
+    unsigned long bitmap;
+    unsigned long mask;
+
+    if (bits_array >= pool->bitmap_size)
+        goto out;
+
+    bitmap = pool->bitmap[bits_array];
+    mask = (2ul << (start % 32)) - 1;
+    bitmap &= mask & 0xffffffff;
+
+    while (1) {
+        if (bitmap)
+            return bits_array * 32 + 31 - __builtin_clz(bitmap);
+
+        if (bits_array-- == 0)
+            break;
+
+        bitmap = pool->bitmap[bits_array] & 0xffffffff;
+    }
+out:
+#ifdef POOL_DEBUG
+    PRINTF("%s: start=%u ret=-1\n", __func__, start);
+#endif
+    return -1;
+}
+
+static int test_bit(struct mem_pool * restrict pool, unsigned int bit)
+{
+    unsigned int bits_array = bit / 32;
+    unsigned long mask = 1ul << (bit % 32);
+
+    return !!(pool->bitmap[bits_array] & mask);
+}
+
 static void set_bit(struct mem_pool * restrict pool, unsigned int bit)
 {
     unsigned int bits_array = bit / 32;
@@ -226,6 +269,129 @@ static void mem_pool_clear_canary(struct __mem_pool_entry *entry)
 #endif
 }
 
+static unsigned int hole_class(unsigned long size)
+{
+    return sizeof(size) * 8 - 1 - __builtin_clzl(size);
+}
+
+/* memory of the hole owned by unused entry starts after the used behind it */
+static char *hole_start(struct mem_pool * restrict pool, unsigned int e)
+{
+    struct __mem_pool_entry *busy;
+
+    if (e == 0)
+        return pool->base;
+
+    busy = &pool->entries[e - 1];
+
+    return busy->base + busy->size;
+}
+
+/* and ends at the used entry that follows it */
+static char *hole_end(struct mem_pool * restrict pool, unsigned int e)
+{
+    int b = get_next_used_entry(pool, e + 1);
+
+    if (b < 0)
+        return pool->base + pool->pool_size;
+
+    return pool->entries[b].base;
+}
+
+static void hole_insert(struct mem_pool * restrict pool, unsigned int e,
+                        unsigned long size)
+{
+    struct __mem_pool_hole *hole = &pool->holes[e];
+    unsigned int c;
+
+    if (!size)
+        return;
+
+    c = hole_class(size);
+
+    hole->size = size;
+    hole->prev = -1;
+    hole->next = pool->hole_classes[c];
+
+    if (hole->next >= 0)
+        pool->holes[hole->next].prev = e;
+
+    pool->hole_classes[c] = e;
+    pool->holes_mask |= 1ul << c;
+}
+
+static void hole_remove(struct mem_pool * restrict pool, unsigned int e)
+{
+    struct __mem_pool_hole *hole = &pool->holes[e];
+    unsigned int c;
+
+    if (!hole->size)
+        return;
+
+    c = hole_class(hole->size);
+
+    if (hole->prev >= 0)
+        pool->holes[hole->prev].next = hole->next;
+    else
+        pool->hole_classes[c] = hole->next;
+
+    if (hole->next >= 0)
+        pool->holes[hole->next].prev = hole->prev;
+
+    if (pool->hole_classes[c] < 0)
+        pool->holes_mask &= ~(1ul << c);
+
+    hole->size = 0;
+}
+
+static int hole_find(struct mem_pool * restrict pool, unsigned long size)
+{
+    unsigned int c = hole_class(size);
+    unsigned long mask;
+    int e;
+
+    for (e = pool->hole_classes[c]; e >= 0; e = pool->holes[e].next) {
+        if (pool->holes[e].size >= size)
+            return e;
+    }
+
+    /* any hole of the larger classes fits */
+    mask = pool->holes_mask & ~((2ul << c) - 1);
+    if (!mask)
+        return -1;
+
+    return pool->hole_classes[__builtin_ctzl(mask)];
+}
+
+static void index_holes(struct mem_pool * restrict pool)
+{
+    int e, b = -1;
+    unsigned int c;
+
+#ifdef POOL_DEBUG
+    PRINTF("%s: pool %p\n", __func__, pool);
+#endif
+    memset(pool->holes, 0, pool->bitmap_size * 32 * sizeof(*pool->holes));
+
+    for (c = 0; c < MEM_POOL_HOLE_CLASSES; c++)
+        pool->hole_classes[c] = -1;
+
+    pool->holes_mask = 0;
+
+    do {
+        e = get_next_unused_entry(pool, b + 1);
+
+        if (e < 0)
+            break;
+
+        b = get_next_used_entry(pool, e + 1);
+
+        hole_insert(pool, e, hole_end(pool, e) - hole_start(pool, e));
+    } while (b >= 0);
+
+    pool->holes_valid = 1;
+}
+
 static void validate_pool(struct mem_pool * restrict pool)
 {
 #ifdef POOL_DEBUG
@@ -270,6 +436,25 @@ static void validate_pool(struct mem_pool * restrict pool)
 
         b_prev = b;
     } while (b >= 0);
+
+    if (pool->holes_valid) {
+        int e = -1;
+
+        while (1) {
+            e = get_next_unused_entry(pool, e + 1);
+
+            if (e < 0)
+                break;
+
+            if (e > 0 && !test_bit(pool, e - 1)) {
+                assert(pool->holes[e].size == 0);
+                continue;
+            }
+
+            assert(pool->holes[e].size ==
+                   (unsigned long)(hole_end(pool, e) - hole_start(pool, e)));
+        }
+    }
 #endif
 }
 
@@ -325,6 +510,7 @@ static int mem_pool_resize_bitmap(struct mem_pool * restrict pool,
                                   unsigned long new_size)
 {
     struct __mem_pool_entry *new_entries;
+    struct __mem_pool_hole *new_holes;
     unsigned long *new_bitmap;
     unsigned long old_size;
     int shrink;
@@ -355,15 +541,28 @@ static int mem_pool_resize_bitmap(struct mem_pool * restrict pool,
 
     new_bitmap = realloc(pool->bitmap, new_size * sizeof(*new_bitmap));
     new_entries = realloc(pool->entries, new_size * 32 * sizeof(*new_entries));
+    new_holes = realloc(pool->holes, new_size * 32 * sizeof(*new_holes));
 
-    if (new_bitmap && new_entries) {
+    if (new_bitmap && new_entries && new_holes) {
         pool->entries = new_entries;
         pool->bitmap_size = new_size;
         pool->bitmap = new_bitmap;
+        pool->holes = new_holes;
 
         if (!shrink) {
             for (i = old_size; i < new_size; i++)
                 pool->bitmap[i] = 0;
+
+            memset(&pool->holes[old_size * 32], 0,
+                   (new_size - old_size) * 32 * sizeof(*new_holes));
+
+            /* space at the end of pool gets the first added entry */
+            if (pool->holes_valid && test_bit(pool, old_size * 32 - 1))
+                hole_insert(pool, old_size * 32,
+                            hole_end(pool, old_size * 32) -
+                            hole_start(pool, old_size * 32));
+        } else {
+            pool->holes_valid = 0;
         }
 
         return 1;
@@ -375,6 +574,9 @@ static int mem_pool_resize_bitmap(struct mem_pool * restrict pool,
     if (new_bitmap)
         pool->bitmap = new_bitmap;
 
+    if (new_holes)
+        pool->holes = new_holes;
+
     return 0;
 }
 
@@ -402,6 +604,8 @@ static int defrag_pool(struct mem_pool * restrict pool,
         goto out;
     }
 
+    pool->holes_valid = 0;
+
     if (!(pool->bitmap[0] & 1)) {
         b = get_next_used_entry(pool, 1);
         migrate_entry(pool, pool, b, 0, pool->base);
@@ -451,9 +655,9 @@ void *mem_pool_alloc(struct mem_pool * restrict pool, unsigned long size,
                      struct mem_pool_entry *ret_entry, int defrag)
 {
     struct __mem_pool_entry *empty;
-    struct __mem_pool_entry *busy;
-    char *start = NULL, *end;
-    int e, b = -1; // b for "busy/used entry", e for "unused/empty"
+    unsigned long hole_size;
+    char *start = NULL;
+    int e; // e for "unused/empty"
 
 #ifdef POOL_DEBUG
     int defragged = 0;
@@ -478,67 +682,43 @@ void *mem_pool_alloc(struct mem_pool * restrict pool, unsigned long size,
         return NULL;
 
 retry:
-    do {
-        e = get_next_unused_entry(pool, b + 1);
+    if (!pool->holes_valid)
+        index_holes(pool);
 
-        if (e < 0) {
-            if (mem_pool_grow_bitmap(pool))
-                continue;
-
-            pool->bitmap_full = 1;
-            break;
-        }
+    e = hole_find(pool, size);
 
-        if (e == 0) {
-            empty = &pool->entries[0];
-            start = pool->base;
-        } else {
-            busy = &pool->entries[e - 1];
-            empty = &pool->entries[e];
-            start = busy->base + busy->size;
-        }
-
-        b = get_next_used_entry(pool, e + 1);
+    if (e >= 0) {
+        hole_size = pool->holes[e].size;
+        hole_remove(pool, e);
 
-        if (b < 0) {
-            end = pool->base + pool->pool_size;
-        } else {
-            busy = &pool->entries[b];
-            end = busy->base;
-        }
+        empty = &pool->entries[e];
+        start = hole_start(pool, e);
 
-        if (end - start >= size) {
-            empty->owner = ret_entry;
-            empty->base = start;
-            empty->size = size;
-            set_bit(pool, e);
-            break;
-        }
+        empty->owner = ret_entry;
+        empty->base = start;
+        empty->size = size;
+        set_bit(pool, e);
 
-        start = NULL;
-    } while (b > 0);
+        /* rest of the hole goes to the next entry if it is unused */
+        if (e + 1 == pool->bitmap_size * 32)
+            pool->bitmap_full = !mem_pool_grow_bitmap(pool);
+        else if (!test_bit(pool, e + 1))
+            hole_insert(pool, e + 1, hole_size - size);
 
-    if (start) {
         pool->remain -= size;
         ret_entry->pool = pool;
         ret_entry->id = e;
 
-        if (!pool->bitmap_full)
-            pool->bitmap_full = (get_next_unused_entry(pool, b + 1) < 0);
-
-        if (pool->bitmap_full)
-            pool->bitmap_full = !mem_pool_grow_bitmap(pool);
-
         mem_pool_set_canary(&pool->entries[e]);
 
 #ifdef POOL_DEBUG
         stats.total_remain -= size;
 #endif
-    } else if (defrag && !pool->bitmap_full) {
+    } else if (defrag) {
 #ifdef POOL_DEBUG
         assert(!defragged);
 #endif
-        b = defrag_pool(pool, size, 1);
+        defrag_pool(pool, size, 1);
 #ifdef POOL_DEBUG
         defragged = 1;
 #else
@@ -562,7 +742,7 @@ void mem_pool_free(struct mem_pool_entry *entry)
 {
     struct mem_pool *pool = entry->pool;
     unsigned int entry_id = entry->id;
-    int b;
+    int p;
 
 #ifdef POOL_DEBUG_VERBOSE
     char *base = mem_pool_entry_addr(entry);
@@ -571,10 +751,10 @@ void mem_pool_free(struct mem_pool_entry *entry)
 #endif
     validate_pool(pool);
 
+    /* used entries are packed, only release of the last one keeps them so */
     if (!pool->fragmented) {
-        b = get_next_unused_entry(pool, 0) - 1;
-
-        if (b != entry_id)
+        if (entry_id + 1 < pool->bitmap_size * 32 &&
+            test_bit(pool, entry_id + 1))
             pool->fragmented = 1;
     }
 
@@ -582,6 +762,19 @@ void mem_pool_free(struct mem_pool_entry *entry)
     pool->remain += pool->entries[entry_id].size;
     clear_bit(pool, entry_id);
 
+    /* merge released space with the holes around it */
+    if (pool->holes_valid) {
+        p = entry_id ? get_prev_used_entry(pool, entry_id - 1) : -1;
+
+        hole_remove(pool, p + 1);
+
+        if (entry_id + 1 < pool->bitmap_size * 32)
+            hole_remove(pool, entry_id + 1);
+
+        hole_insert(pool, p + 1,
+                    hole_end(pool, p + 1) - hole_start(pool, p + 1));
+    }
+
     mem_pool_check_canary(&pool->entries[entry_id]);
 #ifdef POOL_DEBUG_CANARY
     memset(pool->entries[entry_id].base, 0x88, pool->entries[entry_id].size);
@@ -609,6 +802,9 @@ void mem_pool_destroy(struct mem_pool *pool)
     pool->base = (void *) 0xfff00000;
     pool->pool_size = 0;
 #endif
+    free(pool->holes);
+    free(pool->entries);
+    free(pool->bitmap);
 }
 
 int mem_pool_transfer_entries(struct mem_pool * restrict pool_to,
@@ -645,6 +841,8 @@ int mem_pool_transfer_entries(struct mem_pool * restrict pool_to,
         new_base = busy_to->base + busy_to->size;
     }
 
+    pool_to->holes_valid = 0;
+
     while (1) {
         e_to = get_next_unused_entry(pool_to, b_to + 1);
 
@@ -684,6 +882,7 @@ next_from:
     if (transferred_entries) {
         pool_from->bitmap_full = 0;
         pool_from->fragmented = !mem_pool_empty(pool_from);
+        pool_from->holes_valid = 0;
     }
 
 #ifdef POOL_DEBUG
@@ -760,9 +959,11 @@ int mem_pool_transfer_entries_fast(struct mem_pool * restrict pool_to,
         }
     }
 
+    /* entries of pool_to were taken by mem_pool_alloc() */
     if (transferred_entries) {
         pool_from->bitmap_full = 0;
         pool_from->fragmented = !mem_pool_empty(pool_from);
+        pool_from->holes_valid = 0;
     }
 
 #ifdef POOL_DEBUG
@@ -41,15 +41,32 @@ struct mem_pool_entry {
     unsigned int id : 16;
 };
 
+/*
+ * Free space that follows used entry and that could be taken by the
+ * unused entry next to it, "size" is zero if entry doesn't start a hole.
+ */
+struct __mem_pool_hole {
+    unsigned long size;
+    int prev;
+    int next;
+};
+
+/* holes are kept in lists per power of two of the hole size */
+#define MEM_POOL_HOLE_CLASSES   (sizeof(unsigned long) * 8)
+
 struct mem_pool {
     char *base;
     int fragmented:1;
     int bitmap_full:1;
+    int holes_valid:1;
     unsigned long remain;
     unsigned long pool_size;
     unsigned long bitmap_size;
     unsigned long *bitmap;
     struct __mem_pool_entry *entries;
+    struct __mem_pool_hole *holes;
+    unsigned long holes_mask;
+    int hole_classes[MEM_POOL_HOLE_CLASSES];
 };
 
 int mem_pool_init(struct mem_pool *pool, void *addr, unsigned long size,
@@ -28,59 +28,18 @@
 #include "shaders/blend_over_solid_src.bin.h"
 #include "shaders/blend_over_solid_mask.bin.h"
 #include "shaders/blend_over_solid_mask_src.bin.h"
-
-#include "shaders/blend_over_reverse.bin.h"
-#include "shaders/blend_over_reverse_solid_src.bin.h"
-#include "shaders/blend_over_reverse_solid_mask.bin.h"
-#include "shaders/blend_over_reverse_solid_mask_src.bin.h"
-
-#include "shaders/blend_add.bin.h"
-#include "shaders/blend_add_solid_src.bin.h"
-#include "shaders/blend_add_solid_mask.bin.h"
-#include "shaders/blend_add_solid_mask_src.bin.h"
+#include "shaders/blend_over_repeat.bin.h"
+#include "shaders/blend_over_solid_mask_radial.bin.h"
+#include "shaders/blend_over_solid_mask_repeat.bin.h"
 
 #include "shaders/blend_src.bin.h"
 #include "shaders/blend_src_solid_src.bin.h"
 #include "shaders/blend_src_solid_mask.bin.h"
 #include "shaders/blend_src_solid_mask_src.bin.h"
-
-#include "shaders/blend_in.bin.h"
-#include "shaders/blend_in_solid_src.bin.h"
-#include "shaders/blend_in_solid_mask.bin.h"
-#include "shaders/blend_in_solid_mask_src.bin.h"
-
-#include "shaders/blend_in_reverse.bin.h"
-#include "shaders/blend_in_reverse_solid_src.bin.h"
-#include "shaders/blend_in_reverse_solid_mask.bin.h"
-#include "shaders/blend_in_reverse_solid_mask_src.bin.h"
-
-#include "shaders/blend_out.bin.h"
-#include "shaders/blend_out_solid_src.bin.h"
-#include "shaders/blend_out_solid_mask.bin.h"
-#include "shaders/blend_out_solid_mask_src.bin.h"
-
-#include "shaders/blend_out_reverse.bin.h"
-#include "shaders/blend_out_reverse_solid_src.bin.h"
-#include "shaders/blend_out_reverse_solid_mask.bin.h"
-#include "shaders/blend_out_reverse_solid_mask_src.bin.h"
-
-#include "shaders/blend_atop.bin.h"
-#include "shaders/blend_atop_solid_src.bin.h"
-#include "shaders/blend_atop_solid_mask.bin.h"
-#include "shaders/blend_atop_solid_mask_src.bin.h"
-
-#include "shaders/blend_atop_reverse.bin.h"
-#include "shaders/blend_atop_reverse_solid_src.bin.h"
-#include "shaders/blend_atop_reverse_solid_mask.bin.h"
-#include "shaders/blend_atop_reverse_solid_mask_src.bin.h"
-
-#include "shaders/blend_xor.bin.h"
-#include "shaders/blend_xor_solid_src.bin.h"
-#include "shaders/blend_xor_solid_mask.bin.h"
-#include "shaders/blend_xor_solid_mask_src.bin.h"
-
-#include "shaders/blend_dst.bin.h"
-#include "shaders/blend_dst_solid_mask.bin.h"
+#include "shaders/blend_src_repeat.bin.h"
+#include "shaders/blend_src_solid_mask_radial.bin.h"
+#include "shaders/blend_src_solid_mask_repeat.bin.h"
+#include "shaders/blend_src_convolve.bin.h"
 
 #include "shaders/blend_saturate.bin.h"
 #include "shaders/blend_saturate_solid_src.bin.h"
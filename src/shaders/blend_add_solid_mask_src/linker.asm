@@ -1 +0,0 @@
-LINK NOP, NOP, NOP, NOP, tram0.xyzw, export1
@@ -20,7 +20,11 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#ifdef NO_SRC_CLAMP
+pseq_to_dw_exec_nb = 13	// the number of 'EXEC' block where DW happens
+#else
 pseq_to_dw_exec_nb = 15	// the number of 'EXEC' block where DW happens
+#endif
 alu_buffer_size = 2	// number of .rgba regs carried through pipeline
 
 .uniforms
@@ -44,6 +48,7 @@ EXEC
 		mul1: bar, sfu, bar1
 		ipl: t0.fp20, t0.fp20, t0.fp20, t0.fp20
 
+#ifndef NO_MASK_CLAMP
 	// Emulate clamp-to-border for mask
 	ALU:
 		ALU0:	MAD  lp.lh, r2, #1, -#1
@@ -57,6 +62,7 @@ EXEC
 
 	ALU:
 		ALU0:	CSEL kill, alu0, #1, #0
+#endif
 ;
 
 EXEC
@@ -128,6 +134,7 @@ EXEC
 EXEC
 ;
 
+#ifndef NO_SRC_CLAMP
 // Fifth batch
 EXEC
 	// Emulate clamp-to-border for src
@@ -150,6 +157,7 @@ EXEC
 
 EXEC
 ;
+#endif
 
 // Sixth batch
 EXEC
@@ -42,7 +42,14 @@ EXEC
 	MFU:	sfu:  rcp r4
 		mul0: bar, sfu, bar0
 		mul1: bar, sfu, bar1
-		ipl:  t0.fp20, t0.fp20, t0.fp20, t0.fp20
+		ipl: t0.fp20, t0.fp20, t0.fp20, t0.fp20
+
+	// wrap src texcoords to emulate repeat of NPOT texture
+	MFU:	sfu:  frc r0
+		mul0: r0, sfu, #1
+
+	MFU:	sfu:  frc r1
+		mul0: r1, sfu, #1
 
 	// Emulate clamp-to-border for mask
 	ALU:
@@ -154,12 +161,18 @@ EXEC
 // Sixth batch
 EXEC
 	ALU:
-		ALU0:	MAD  lp.lh, r6.l, #1, #0 (this)
-		ALU1:	MAD  lp.lh, r6.h, #1, #0 (other)
-		ALU2:	MAD  lp.lh, r7.l, #1, #0 (other)
-		ALU3:	MAD  lp.lh, r7.h, #1, #0
+		ALU0:	MAD  lp.lh, r6.l, r4.l, #0
+		ALU1:	MAD  lp.lh, r6.h, r4.h, #0
+		ALU2:	MAD  lp.lh, r7.l, r5.l, #0
+		ALU3:	MAD  lp.lh, r7.h, r5.h, r7.h
+
+	ALU:
+		ALU0:	MAD  lp.lh, alu0, #1, #0 (this)
+		ALU1:	MAD  lp.lh, alu1, #1, #0 (other)
+		ALU2:	MAD  lp.lh, alu2, #1, #0 (other)
+		ALU3:	MAD  lp.lh, alu3, #1, #0
 
-	// kill the pixel if src.bgra == 0
+	// kill the pixel if src.bgra * mask.bgra == 0 && src.a == 0
 	ALU:
 		ALU0:	CSEL kill, -alu0, #0, #1
 ;
@@ -172,22 +185,26 @@ EXEC
 	// fetch dst pixel to r2,r3
 	PSEQ:	0x0081000A
 
+	// tmp = -src.aaaa * mask.bgra + 1
 	ALU:
-		ALU0:	CSEL lp.lh, -u8.l, r3.h-1, -#0
+		ALU0:	MAD  lp.lh, -r7.h, r4.l, #1
+		ALU1:	MAD  lp.lh, -r7.h, r4.h, #1
+		ALU2:	MAD  lp.lh, -r7.h, r5.l, #1
+		ALU3:	MAD  lp.lh, -r7.h, r5.h, #1
 
-	// tmp = (dst.aaaa  - 1) * -mask.bgra
+	// tmp = tmp * dst.bgra
 	ALU:
-		ALU0:	MAD  lp.lh, -alu0, r4.l, #0
-		ALU1:	MAD  lp.lh, -alu0, r4.h, #0
-		ALU2:	MAD  lp.lh, -alu0, r5.l, #0
-		ALU3:	MAD  lp.lh, -alu0, r5.h, #0
+		ALU0:	MAD  lp.lh, alu0, r2.l, #0
+		ALU1:	MAD  lp.lh, alu1, r2.h, #0
+		ALU2:	MAD  lp.lh, alu2, r3.l, #0
+		ALU3:	MAD  lp.lh, alu3, r3.h, #0
 
-	// r0,r1 = dst.bgra + (1 - dst.aaaa) * src.bgra * mask.bgra
+	// r0,r1 = (1 - src.aaaa * mask.bgra) * dst.bgra + src.bgra * mask.bgra
 	ALU:
-		ALU0:	MAD  r0.l, alu0, r6.l, r2.l (sat)
-		ALU1:	MAD  r0.h, alu1, r6.h, r2.h (sat)
-		ALU2:	MAD  r1.l, alu2, r7.l, r3.l (sat)
-		ALU3:	MAD  r1.h, alu3, r7.h, r3.h (sat)
+		ALU0:	MAD  r0.l, r6.l, r4.l, alu0 (sat)
+		ALU1:	MAD  r0.h, r6.h, r4.h, alu1 (sat)
+		ALU2:	MAD  r1.l, r7.l, r5.l, alu2 (sat)
+		ALU3:	MAD  r1.h, r7.h, r5.h, alu3 (sat)
 ;
 
 EXEC
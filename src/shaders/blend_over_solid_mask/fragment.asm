@@ -20,7 +20,11 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#ifdef NO_SRC_CLAMP
+pseq_to_dw_exec_nb = 4	// the number of 'EXEC' block where DW happens
+#else
 pseq_to_dw_exec_nb = 5	// the number of 'EXEC' block where DW happens
+#endif
 alu_buffer_size = 1	// number of .rgba regs carried through pipeline
 
 .uniforms
@@ -46,6 +50,22 @@ EXEC
 	// sample tex0 (src)
 	TEX:	tex r2, r3, tex0, r0, r1, r2
 
+#ifdef NO_SRC_CLAMP
+	ALU:
+		// src = src_fmt_alpha ? src.a : 1.0
+		ALU0:	CSEL lp.lh, -u5.l, r3.h, #1
+
+		// swap src ABGR to ARGB if needed
+		ALU1:	CSEL lp.lh, -u5.h, r3.l, r2.l
+		ALU2:	CSEL lp.lh, -u5.h, r2.l, r3.l
+
+	ALU:
+		ALU0:	MAD  r0.l, alu1, #1, #0
+		ALU1:	MAD  r0.h, r2.h, #1, #0
+		ALU2:	MAD  r1.l, alu2, #1, #0
+		ALU3:	MAD  r1.h, alu0, #1, #0
+;
+#else
 	ALU:
 		// src = src_fmt_alpha ? src.a : 1.0
 		ALU0:	CSEL r3.h, -u5.l, r3.h, #1
@@ -73,6 +93,7 @@ EXEC
 		ALU2:	MAD  r1.l, r3.l, #1, -alu0 (sat)
 		ALU3:	MAD  r1.h, r3.h, #1, -alu0 (sat)
 ;
+#endif
 
 EXEC
 	ALU:
@@ -20,7 +20,7 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
-pseq_to_dw_exec_nb = 5	// the number of 'EXEC' block where DW happens
+pseq_to_dw_exec_nb = 6	// the number of 'EXEC' block where DW happens
 alu_buffer_size = 1	// number of .rgba regs carried through pipeline
 
 .uniforms
@@ -38,27 +38,34 @@ alu_buffer_size = 1	// number of .rgba regs carried through pipeline
 .asm
 
 EXEC
-	// fetch dst pixel to r2,r3
-	PSEQ:	0x0081000A
+	MFU:	sfu:  rcp r4
+		mul0: bar, sfu, bar0
+		mul1: bar, sfu, bar1
+		ipl:  t0.fp20, t0.fp20, NOP, NOP
 
+	// r0 = u * u + v * v, where u,v are centre-relative src coords
 	ALU:
-		ALU0:	CSEL kill, -r3.h, #0, u8.l
+		ALU0:	MAD  r0.lh, r0, r0, #0 (this)
+		ALU1:	MAD  lp.lh, r1, r1, #0
+
+	// the gradient ramp is one texel high, sample its first row
+	ALU:
+		ALU0:	MAD  r1.lh, #0, #0, #0
 ;
 
 EXEC
-	MFU:	sfu:  rcp r4
-		mul0: bar, sfu, bar0
-		mul1: bar, sfu, bar1
-		ipl:  t0.fp20, t0.fp20, NOP, NOP
+	// r0 = distance from the centre, i.e. the ramp position
+	MFU:	sfu:  sqrt r0
+		mul0: r0, sfu, #1
 
-	// sample tex0 (src)
+	// sample tex0 (gradient ramp)
 	TEX:	tex r2, r3, tex0, r0, r1, r2
 
 	ALU:
 		// src = src_fmt_alpha ? src.a : 1.0
 		ALU0:	CSEL r3.h, -u5.l, r3.h, #1
 
-		// swap mask ABGR to ARGB if needed
+		// swap src ABGR to ARGB if needed
 		ALU1:	CSEL r2.l, -u5.h, r3.l, r2.l
 		ALU2:	CSEL r3.l, -u5.h, r2.l, r3.l
 ;
@@ -82,23 +89,48 @@ EXEC
 		ALU3:	MAD  r1.h, r3.h, #1, -alu0 (sat)
 ;
 
+EXEC
+	ALU:
+		ALU0:	MAD  lp.lh, r0.l, u2.l, #0
+		ALU1:	MAD  lp.lh, r0.h, u2.h, #0
+		ALU2:	MAD  lp.lh, r1.l, u3.l, #0
+		ALU3:	MAD  lp.lh, r1.h, u3.h, r1.h
+
+	ALU:
+		ALU0:	MAD  lp.lh, alu0, #1, #0 (this)
+		ALU1:	MAD  lp.lh, alu1, #1, #0 (other)
+		ALU2:	MAD  lp.lh, alu2, #1, #0 (other)
+		ALU3:	MAD  lp.lh, alu3, #1, #0
+
+	// kill the pixel if src.bgra * mask.bgra == 0 && src.a == 0
+	ALU:
+		ALU0:	CSEL kill, -alu0, #0, #1
+;
+
 EXEC
 	// fetch dst pixel to r2,r3
 	PSEQ:	0x0081000A
 
-	// tmp = (dst.aaaa  - 1) * -mask.bgra
+	// tmp = -src.aaaa * mask.bgra + 1
+	ALU:
+		ALU0:	MAD  lp.lh, -u2.l, r1.h, #1
+		ALU1:	MAD  lp.lh, -u2.h, r1.h, #1
+		ALU2:	MAD  lp.lh, -u3.l, r1.h, #1
+		ALU3:	MAD  lp.lh, -u3.h, r1.h, #1
+
+	// tmp = tmp * dst.bgra
 	ALU:
-		ALU0:	MAD  lp.lh, r3.h-1, -u2.l, u8.l-1
-		ALU1:	MAD  lp.lh, r3.h-1, -u2.h, u8.l-1
-		ALU2:	MAD  lp.lh, r3.h-1, -u3.l, u8.l-1
-		ALU3:	MAD  lp.lh, r3.h-1, -u3.h, u8.l-1
+		ALU0:	MAD  lp.lh, alu0, r2.l, #0
+		ALU1:	MAD  lp.lh, alu1, r2.h, #0
+		ALU2:	MAD  lp.lh, alu2, r3.l, #0
+		ALU3:	MAD  lp.lh, alu3, r3.h, #0
 
-	// r2,r3 = (1 - dst.aaaa) * src.bgra * mask.bgra
+	// r0,r1 = src.bgra * mask.bgra + tmp
 	ALU:
-		ALU0:	MAD  r0.l, alu0, r0.l, #0 (sat)
-		ALU1:	MAD  r0.h, alu1, r0.h, #0 (sat)
-		ALU2:	MAD  r1.l, alu2, r1.l, #0 (sat)
-		ALU3:	MAD  r1.h, alu3, r1.h, #0 (sat)
+		ALU0:	MAD  r0.l, u2.l, r0.l, alu0 (sat)
+		ALU1:	MAD  r0.h, u2.h, r0.h, alu1 (sat)
+		ALU2:	MAD  r1.l, u3.l, r1.l, alu2 (sat)
+		ALU3:	MAD  r1.h, u3.h, r1.h, alu3 (sat)
 ;
 
 EXEC
@@ -43,6 +43,13 @@ EXEC
 		mul1: bar, sfu, bar1
 		ipl:  t0.fp20, t0.fp20, NOP, NOP
 
+	// wrap src texcoords to emulate repeat of NPOT texture
+	MFU:	sfu:  frc r0
+		mul0: r0, sfu, #1
+
+	MFU:	sfu:  frc r1
+		mul0: r1, sfu, #1
+
 	// sample tex0 (src)
 	TEX:	tex r2, r3, tex0, r0, r1, r2
 
@@ -50,7 +57,7 @@ EXEC
 		// src = src_fmt_alpha ? src.a : 1.0
 		ALU0:	CSEL r3.h, -u5.l, r3.h, #1
 
-		// swap mask ABGR to ARGB if needed
+		// swap src ABGR to ARGB if needed
 		ALU1:	CSEL r2.l, -u5.h, r3.l, r2.l
 		ALU2:	CSEL r3.l, -u5.h, r2.l, r3.l
 ;
@@ -76,12 +83,18 @@ EXEC
 
 EXEC
 	ALU:
-		ALU0:	MAD  lp.lh, r2.l, #1, #0 (this)
-		ALU1:	MAD  lp.lh, r2.h, #1, #0 (other)
-		ALU2:	MAD  lp.lh, r3.l, #1, #0 (other)
-		ALU3:	MAD  lp.lh, r3.h, #1, #0
+		ALU0:	MAD  lp.lh, r0.l, u2.l, #0
+		ALU1:	MAD  lp.lh, r0.h, u2.h, #0
+		ALU2:	MAD  lp.lh, r1.l, u3.l, #0
+		ALU3:	MAD  lp.lh, r1.h, u3.h, r1.h
+
+	ALU:
+		ALU0:	MAD  lp.lh, alu0, #1, #0 (this)
+		ALU1:	MAD  lp.lh, alu1, #1, #0 (other)
+		ALU2:	MAD  lp.lh, alu2, #1, #0 (other)
+		ALU3:	MAD  lp.lh, alu3, #1, #0
 
-	// kill the pixel if src.bgra == 0
+	// kill the pixel if src.bgra * mask.bgra == 0 && src.a == 0
 	ALU:
 		ALU0:	CSEL kill, -alu0, #0, #1
 ;
@@ -90,22 +103,26 @@ EXEC
 	// fetch dst pixel to r2,r3
 	PSEQ:	0x0081000A
 
+	// tmp = -src.aaaa * mask.bgra + 1
 	ALU:
-		ALU0:	CSEL lp.lh, -u8.l, r3.h-1, -#0
+		ALU0:	MAD  lp.lh, -u2.l, r1.h, #1
+		ALU1:	MAD  lp.lh, -u2.h, r1.h, #1
+		ALU2:	MAD  lp.lh, -u3.l, r1.h, #1
+		ALU3:	MAD  lp.lh, -u3.h, r1.h, #1
 
-	// tmp = (dst.aaaa  - 1) * -mask.bgra
+	// tmp = tmp * dst.bgra
 	ALU:
-		ALU0:	MAD  lp.lh, -alu0, u2.l, #0
-		ALU1:	MAD  lp.lh, -alu0, u2.h, #0
-		ALU2:	MAD  lp.lh, -alu0, u3.l, #0
-		ALU3:	MAD  lp.lh, -alu0, u3.h, #0
+		ALU0:	MAD  lp.lh, alu0, r2.l, #0
+		ALU1:	MAD  lp.lh, alu1, r2.h, #0
+		ALU2:	MAD  lp.lh, alu2, r3.l, #0
+		ALU3:	MAD  lp.lh, alu3, r3.h, #0
 
-	// r2,r3 = dst.bgra + (1 - dst.aaaa) * src.bgra * mask.bgra
+	// r0,r1 = src.bgra * mask.bgra + tmp
 	ALU:
-		ALU0:	MAD  r0.l, alu0, r0.l, r2.l (sat)
-		ALU1:	MAD  r0.h, alu1, r0.h, r2.h (sat)
-		ALU2:	MAD  r1.l, alu2, r1.l, r3.l (sat)
-		ALU3:	MAD  r1.h, alu3, r1.h, r3.h (sat)
+		ALU0:	MAD  r0.l, u2.l, r0.l, alu0 (sat)
+		ALU1:	MAD  r0.h, u2.h, r0.h, alu1 (sat)
+		ALU2:	MAD  r1.l, u3.l, r1.l, alu2 (sat)
+		ALU3:	MAD  r1.h, u3.h, r1.h, alu3 (sat)
 ;
 
 EXEC
@@ -20,7 +20,11 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#ifdef NO_MASK_CLAMP
+pseq_to_dw_exec_nb = 5	// the number of 'EXEC' block where DW happens
+#else
 pseq_to_dw_exec_nb = 6	// the number of 'EXEC' block where DW happens
+#endif
 alu_buffer_size = 1	// number of .rgba regs carried through pipeline
 
 .uniforms
@@ -59,6 +63,13 @@ EXEC
 	// mask.b = mask_has_per_component_alpha ? mask.b : tmp
 	// mask.a = tmp
 	ALU:
+#ifdef NO_MASK_CLAMP
+		ALU0:	CSEL r0.l, -u6.l, alu1, alu0
+		ALU1:	CSEL r0.h, -u6.l, r2.h, alu0
+		ALU2:	CSEL r1.l, -u6.l, alu2, alu0
+		ALU3:	CSEL r1.h, -u8.l, alu0, #0
+;
+#else
 		ALU0:	CSEL r2.l, -u6.l, alu1, alu0
 		ALU1:	CSEL r2.h, -u6.l, r2.h, alu0
 		ALU2:	CSEL r3.l, -u6.l, alu2, alu0
@@ -83,6 +94,7 @@ EXEC
 		ALU2:	MAD  r1.l, r3.l, #1, -alu0 (sat)
 		ALU3:	MAD  r1.h, r3.h, #1, -alu0 (sat)
 ;
+#endif
 
 EXEC
 	ALU:
@@ -6,19 +6,25 @@
 	[0] = "position";
 	[2] = "mask_texcoords";
 
+.uniforms
+	[3] = "dst_scale_bias";
+	[4] = "mask_scale";
+
 .constants
 	[0].z = 0.0;
 	[0].w = 1.0;
 
 .asm
+// position = dst pixel coords * 2 / dst size - 1
 EXEC(export[0]=vector)
-	MOVv r63.xy**, a[0].xyzw
+	MADv r63.xy**, a[0].xyzw, c[3].xyzw, c[3].zwzw
 ;
 
 EXEC(export[0]=vector)
 	MOVv r63.**zw, c[0].xyzw
 ;
 
+// mask texcoords = mask pixel coords / mask size
 EXEC_END(export[1]=vector)
-	MOVv r63.xy**, a[2].xyzw
+	MULv r63.xy**, a[2].xyzw, c[4].xyzw
 ;
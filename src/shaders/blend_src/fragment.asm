@@ -20,7 +20,19 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#ifdef NO_SRC_CLAMP
+#ifdef NO_MASK_CLAMP
+pseq_to_dw_exec_nb = 3	// the number of 'EXEC' block where DW happens
+#else
+pseq_to_dw_exec_nb = 4	// the number of 'EXEC' block where DW happens
+#endif
+#else
+#ifdef NO_MASK_CLAMP
+pseq_to_dw_exec_nb = 4	// the number of 'EXEC' block where DW happens
+#else
 pseq_to_dw_exec_nb = 5	// the number of 'EXEC' block where DW happens
+#endif
+#endif
 alu_buffer_size = 1	// number of .rgba regs carried through pipeline
 
 .uniforms
@@ -59,6 +71,13 @@ EXEC
 	// mask.b = mask_has_per_component_alpha ? mask.b : tmp
 	// mask.a = tmp
 	ALU:
+#ifdef NO_MASK_CLAMP
+		ALU0:	CSEL  r2.l, -u6.l, alu1, alu0
+		ALU1:	CSEL  r2.h, -u6.l, r0.h, alu0
+		ALU2:	CSEL  r3.l, -u6.l, alu2, alu0
+		ALU3:	MAD   r3.h,  alu0,   #1,   #0
+;
+#else
 		ALU0:	CSEL  r0.l, -u6.l, alu1, alu0
 		ALU1:	CSEL  r0.h, -u6.l, r0.h, alu0
 		ALU2:	CSEL  r1.l, -u6.l, alu2, alu0
@@ -83,6 +102,7 @@ EXEC
 		ALU2:	MAD  r3.l, r1.l, #1, -alu0 (sat)
 		ALU3:	MAD  r3.h, r1.h, #1, -alu0 (sat)
 ;
+#endif
 
 EXEC
 	MFU:	sfu:  rcp r4
@@ -105,6 +125,15 @@ EXEC
 EXEC
 	// dst = src.bgra * mask.bgra
 	ALU:
+#ifdef NO_SRC_CLAMP
+		ALU0:	MAD  r0.l, r0.l, r2.l, #0
+		ALU1:	MAD  r0.h, r0.h, r2.h, #0
+		ALU2:	MAD  r1.l, r1.l, r3.l, #0
+		ALU3:	MAD  r1.h, r1.h, r3.h, u8.l-1 (sat)
+
+	DW:	store rt1, r0, r1
+;
+#else
 		ALU0:	MAD  r2.l, r0.l, r2.l, #0
 		ALU1:	MAD  r2.h, r0.h, r2.h, #0
 		ALU2:	MAD  r3.l, r1.l, r3.l, #0
@@ -136,3 +165,4 @@ EXEC
 
 	DW:	store rt1, r0, r1
 ;
+#endif
@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) Dmitry Osipenko 2018
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+pseq_to_dw_exec_nb = 10	// the number of 'EXEC' block where DW happens
+alu_buffer_size = 2	// number of .rgba regs carried through pipeline
+
+.uniforms
+	[5].l = "src_fmt_alpha";
+	[5].h = "src_swap_bgr";
+
+	[8].l = "dst_fmt_alpha";
+
+	[9]  = "tap_step.x";
+	[10] = "tap_step.y";
+
+	[11] = "weight0";
+	[12] = "weight1";
+	[13] = "weight2";
+	[14] = "weight3";
+	[15] = "weight4";
+	[16] = "weight5";
+	[17] = "weight6";
+	[18] = "weight7";
+	[19] = "weight8";
+
+	[20] = "row_step.x";
+	[21] = "row_step.y";
+
+.asm
+
+/*
+ * Nine taps are fetched in three rows of three, texture coordinates of
+ * the next tap are advanced by tap_step within a row and by row_step to
+ * the start of the next row. Rows are made contiguous for a 1D kernel by
+ * using the same step for both. Weighted sum is accumulated in r4-r7.
+ */
+EXEC
+	MFU:	sfu:  rcp r4
+		mul0: bar, sfu, bar0
+		mul1: bar, sfu, bar1
+		ipl:  t0.fp20, t0.fp20, NOP, NOP
+
+	// sample tap 0
+	TEX:	tex r2, r3, tex0, r0, r1, r2
+
+	// acc.bgra = src.bgra * weight0
+	ALU:
+		ALU0:	MAD  r4.lh, r2.l, u11, #0
+		ALU1:	MAD  r5.lh, r2.h, u11, #0
+		ALU2:	MAD  r6.lh, r3.l, u11, #0
+		ALU3:	MAD  r7.lh, r3.h, u11, #0
+
+	// move to the next tap
+	ALU:
+		ALU0:	MAD  r0.lh, r0, #1, u9
+		ALU1:	MAD  r1.lh, r1, #1, u10
+;
+
+EXEC
+	// sample tap 1
+	TEX:	tex r2, r3, tex0, r0, r1, r2
+
+	// acc.bgra += src.bgra * weight1
+	ALU:
+		ALU0:	MAD  r4.lh, r2.l, u12, r4
+		ALU1:	MAD  r5.lh, r2.h, u12, r5
+		ALU2:	MAD  r6.lh, r3.l, u12, r6
+		ALU3:	MAD  r7.lh, r3.h, u12, r7
+
+	// move to the next tap
+	ALU:
+		ALU0:	MAD  r0.lh, r0, #1, u9
+		ALU1:	MAD  r1.lh, r1, #1, u10
+;
+
+EXEC
+	// sample tap 2
+	TEX:	tex r2, r3, tex0, r0, r1, r2
+
+	// acc.bgra += src.bgra * weight2
+	ALU:
+		ALU0:	MAD  r4.lh, r2.l, u13, r4
+		ALU1:	MAD  r5.lh, r2.h, u13, r5
+		ALU2:	MAD  r6.lh, r3.l, u13, r6
+		ALU3:	MAD  r7.lh, r3.h, u13, r7
+
+	// move to the next row
+	ALU:
+		ALU0:	MAD  r0.lh, r0, #1, u20
+		ALU1:	MAD  r1.lh, r1, #1, u21
+;
+
+EXEC
+	// sample tap 3
+	TEX:	tex r2, r3, tex0, r0, r1, r2
+
+	// acc.bgra += src.bgra * weight3
+	ALU:
+		ALU0:	MAD  r4.lh, r2.l, u14, r4
+		ALU1:	MAD  r5.lh, r2.h, u14, r5
+		ALU2:	MAD  r6.lh, r3.l, u14, r6
+		ALU3:	MAD  r7.lh, r3.h, u14, r7
+
+	// move to the next tap
+	ALU:
+		ALU0:	MAD  r0.lh, r0, #1, u9
+		ALU1:	MAD  r1.lh, r1, #1, u10
+;
+
+EXEC
+	// sample tap 4
+	TEX:	tex r2, r3, tex0, r0, r1, r2
+
+	// acc.bgra += src.bgra * weight4
+	ALU:
+		ALU0:	MAD  r4.lh, r2.l, u15, r4
+		ALU1:	MAD  r5.lh, r2.h, u15, r5
+		ALU2:	MAD  r6.lh, r3.l, u15, r6
+		ALU3:	MAD  r7.lh, r3.h, u15, r7
+
+	// move to the next tap
+	ALU:
+		ALU0:	MAD  r0.lh, r0, #1, u9
+		ALU1:	MAD  r1.lh, r1, #1, u10
+;
+
+EXEC
+	// sample tap 5
+	TEX:	tex r2, r3, tex0, r0, r1, r2
+
+	// acc.bgra += src.bgra * weight5
+	ALU:
+		ALU0:	MAD  r4.lh, r2.l, u16, r4
+		ALU1:	MAD  r5.lh, r2.h, u16, r5
+		ALU2:	MAD  r6.lh, r3.l, u16, r6
+		ALU3:	MAD  r7.lh, r3.h, u16, r7
+
+	// move to the next row
+	ALU:
+		ALU0:	MAD  r0.lh, r0, #1, u20
+		ALU1:	MAD  r1.lh, r1, #1, u21
+;
+
+EXEC
+	// sample tap 6
+	TEX:	tex r2, r3, tex0, r0, r1, r2
+
+	// acc.bgra += src.bgra * weight6
+	ALU:
+		ALU0:	MAD  r4.lh, r2.l, u17, r4
+		ALU1:	MAD  r5.lh, r2.h, u17, r5
+		ALU2:	MAD  r6.lh, r3.l, u17, r6
+		ALU3:	MAD  r7.lh, r3.h, u17, r7
+
+	// move to the next tap
+	ALU:
+		ALU0:	MAD  r0.lh, r0, #1, u9
+		ALU1:	MAD  r1.lh, r1, #1, u10
+;
+
+EXEC
+	// sample tap 7
+	TEX:	tex r2, r3, tex0, r0, r1, r2
+
+	// acc.bgra += src.bgra * weight7
+	ALU:
+		ALU0:	MAD  r4.lh, r2.l, u18, r4
+		ALU1:	MAD  r5.lh, r2.h, u18, r5
+		ALU2:	MAD  r6.lh, r3.l, u18, r6
+		ALU3:	MAD  r7.lh, r3.h, u18, r7
+
+	// move to the next tap
+	ALU:
+		ALU0:	MAD  r0.lh, r0, #1, u9
+		ALU1:	MAD  r1.lh, r1, #1, u10
+;
+
+EXEC
+	// sample tap 8
+	TEX:	tex r2, r3, tex0, r0, r1, r2
+
+	// acc.bgra += src.bgra * weight8
+	ALU:
+		ALU0:	MAD  r4.lh, r2.l, u19, r4
+		ALU1:	MAD  r5.lh, r2.h, u19, r5
+		ALU2:	MAD  r6.lh, r3.l, u19, r6
+		ALU3:	MAD  r7.lh, r3.h, u19, r7
+;
+
+EXEC
+	ALU:
+		// swap src ABGR to ARGB if needed
+		ALU0:	CSEL lp.lh, -u5.h, r6, r4
+		ALU1:	CSEL lp.lh, -u5.h, r4, r6
+
+		// src.a = src_fmt_alpha ? acc.a : 1.0
+		ALU2:	CSEL lp.lh, -u5.l, r7, #1
+
+		// tmp = dst_fmt_alpha ? 0.0 : -1.0
+		ALU3:	CSEL lp.lh, -u8.l, #0, -#1
+
+	ALU:
+		ALU0:	MAD  r0.l, alu0, #1, #0 (sat)
+		ALU1:	MAD  r0.h, r5,   #1, #0 (sat)
+		ALU2:	MAD  r1.l, alu1, #1, #0 (sat)
+		ALU3:	MAD  r1.h, alu2, #1, alu3 (sat)
+
+	DW:	store rt1, r0, r1
+;
@@ -0,0 +1,35 @@
+.exports
+	[0] = "position";
+	[1] = "src_texcoords";
+
+.attributes
+	[0] = "position";
+	[1] = "src_texcoords";
+
+.uniforms
+	[1] = "src_transform_row0";
+	[2] = "src_transform_row1";
+	[3] = "dst_scale_bias";
+
+.constants
+	[0].z = 0.0;
+	[0].w = 1.0;
+
+.asm
+// position = dst pixel coords * 2 / dst size - 1
+EXEC(export[0]=vector)
+	MADv r63.xy**, a[0].xyzw, c[3].xyzw, c[3].zwzw
+;
+
+EXEC(export[0]=vector)
+	MOVv r63.**zw, c[0].xyzw
+;
+
+// src texcoords = transform * src pixel coords, normalized
+EXEC(export[1]=vector)
+	DPHv r63.x***, a[1].xyzw, c[1].xyzw
+;
+
+EXEC_END(export[1]=vector)
+	DPHv r63.*y**, a[1].xyzw, c[2].xyzw
+;
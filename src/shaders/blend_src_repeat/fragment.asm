@@ -20,8 +20,8 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
-pseq_to_dw_exec_nb = 7	// the number of 'EXEC' block where DW happens
-alu_buffer_size = 2	// number of .rgba regs carried through pipeline
+pseq_to_dw_exec_nb = 5	// the number of 'EXEC' block where DW happens
+alu_buffer_size = 1	// number of .rgba regs carried through pipeline
 
 .uniforms
 	[5].l = "src_fmt_alpha";
@@ -37,27 +37,6 @@ alu_buffer_size = 2	// number of .rgba regs carried through pipeline
 
 .asm
 
-// First batch
-EXEC
-	MFU:	sfu:  rcp r4
-		mul0: bar, sfu, bar0
-		mul1: bar, sfu, bar1
-		ipl:  t0.fp20, t0.fp20, NOP, NOP
-
-	// sample tex0 (src)
-	TEX:	tex r2, r3, tex0, r0, r1, r2
-
-	// src.a = src_fmt_alpha ? src.a : 1.0
-	ALU:
-		ALU0:	CSEL  r3.h, -u5.l, r3.h, #1
-
-		ALU1:	MAD   r2.h, r2.h, #1, #0
-
-		// swap mask ABGR to ARGB if needed
-		ALU2:	CSEL  r2.l, -u5.h, r3.l, r2.l
-		ALU3:	CSEL  r3.l, -u5.h, r2.l, r3.l
-;
-
 EXEC
 	MFU:	sfu:  rcp r4
 		mul0: bar, sfu, bar0
@@ -69,99 +48,98 @@ EXEC
 
 	// tmp = mask_fmt_alpha ? mask.a : 1.0
 	ALU:
-		ALU0:	CSEL  lp.lh, -u6.h, r5.h, #1
+		ALU0:	CSEL  lp.lh, -u6.h, r1.h, #1
 
 		// swap mask ABGR to ARGB if needed
-		ALU1:	CSEL  lp.lh, -u7.l, r5.l, r4.l
-		ALU2:	CSEL  lp.lh, -u7.l, r4.l, r5.l
+		ALU1:	CSEL  lp.lh, -u7.l, r1.l, r0.l
+		ALU2:	CSEL  lp.lh, -u7.l, r0.l, r1.l
 
 	// mask.r = mask_has_per_component_alpha ? mask.r : tmp
 	// mask.g = mask_has_per_component_alpha ? mask.g : tmp
 	// mask.b = mask_has_per_component_alpha ? mask.b : tmp
 	// mask.a = tmp
 	ALU:
-		ALU0:	CSEL  r4.l, -u6.l, alu1, alu0
-		ALU1:	CSEL  r4.h, -u6.l, r4.h, alu0
-		ALU2:	CSEL  r5.l, -u6.l, alu2, alu0
-		ALU3:	MAD   r5.h,  alu0,   #1,   #0
-;
-
-// Second batch
-EXEC
-	// Emulate clamp-to-border for src
-	ALU:
-		ALU0:	MAD  lp.lh, r0, #1, -#1
-		ALU1:	MAD  lp.lh, r1, #1, -#1
-
-	ALU:
-		ALU0:	CSEL  lp.lh,   r0, u8.h, #0 (this)
-		ALU1:	CSEL  lp.lh, alu0, #0, u8.h (other)
-		ALU2:	CSEL  lp.lh,   r1, u8.h, #0 (other)
-		ALU3:	CSEL  lp.lh, alu1, #0, u8.h
-
-	ALU:
-		ALU0:	MAD  r0.l, r2.l, #1, -alu0 (sat)
-		ALU1:	MAD  r0.h, r2.h, #1, -alu0 (sat)
-		ALU2:	MAD  r1.l, r3.l, #1, -alu0 (sat)
-		ALU3:	MAD  r1.h, r3.h, #1, -alu0 (sat)
+		ALU0:	CSEL  r0.l, -u6.l, alu1, alu0
+		ALU1:	CSEL  r0.h, -u6.l, r0.h, alu0
+		ALU2:	CSEL  r1.l, -u6.l, alu2, alu0
+		ALU3:	MAD   r1.h,  alu0,   #1,   #0
 ;
 
 EXEC
 	// Emulate clamp-to-border for mask
 	ALU:
-		ALU0:	MAD  lp.lh, r6, #1, -#1
-		ALU1:	MAD  lp.lh, r7, #1, -#1
+		ALU0:	MAD  lp.lh, r2, #1, -#1
+		ALU1:	MAD  lp.lh, r3, #1, -#1
 
 	ALU:
-		ALU0:	CSEL  lp.lh,   r6, u7.h, #0 (this)
+		ALU0:	CSEL  lp.lh,   r2, u7.h, #0 (this)
 		ALU1:	CSEL  lp.lh, alu0, #0, u7.h (other)
-		ALU2:	CSEL  lp.lh,   r7, u7.h, #0 (other)
+		ALU2:	CSEL  lp.lh,   r3, u7.h, #0 (other)
 		ALU3:	CSEL  lp.lh, alu1, #0, u7.h
 
 	ALU:
-		ALU0:	MAD  r4.l, r4.l, #1, -alu0 (sat)
-		ALU1:	MAD  r4.h, r4.h, #1, -alu0 (sat)
-		ALU2:	MAD  r5.l, r5.l, #1, -alu0 (sat)
-		ALU3:	MAD  r5.h, r5.h, #1, -alu0 (sat)
+		ALU0:	MAD  r2.l, r0.l, #1, -alu0 (sat)
+		ALU1:	MAD  r2.h, r0.h, #1, -alu0 (sat)
+		ALU2:	MAD  r3.l, r1.l, #1, -alu0 (sat)
+		ALU3:	MAD  r3.h, r1.h, #1, -alu0 (sat)
 ;
 
-// Third batch
 EXEC
-	// fetch dst pixel to r2,r3
-	PSEQ:	0x0081000A
+	MFU:	sfu:  rcp r4
+		mul0: bar, sfu, bar0
+		mul1: bar, sfu, bar1
+		ipl:  t0.fp20, t0.fp20, NOP, NOP
+
+	// wrap src texcoords to emulate repeat of NPOT texture
+	MFU:	sfu:  frc r0
+		mul0: r0, sfu, #1
+
+	MFU:	sfu:  frc r1
+		mul0: r1, sfu, #1
+
+	// sample tex0 (src)
+	TEX:	tex r0, r1, tex0, r0, r1, r2
 
-	// dst = src.bgra * mask.bgra + dst.bgra
+	// src.a = src_fmt_alpha ? src.a : 1.0
 	ALU:
-		ALU0:	MAD  r0.l, r0.l, r4.l, r2.l (sat)
-		ALU1:	MAD  r0.h, r0.h, r4.h, r2.h (sat)
-		ALU2:	MAD  r1.l, r1.l, r5.l, r3.l (sat)
-		ALU3:	MAD  r1.h, r1.h, r5.h, r3.h (sat)
+		ALU0:	CSEL  r1.h, -u5.l, r1.h, #1
+
+		// swap mask ABGR to ARGB if needed
+		ALU1:	CSEL  r0.l, -u5.h, r1.l, r0.l
+		ALU2:	CSEL  r1.l, -u5.h, r0.l, r1.l
 ;
 
 EXEC
+	// dst = src.bgra * mask.bgra
+	ALU:
+		ALU0:	MAD  r2.l, r0.l, r2.l, #0
+		ALU1:	MAD  r2.h, r0.h, r2.h, #0
+		ALU2:	MAD  r3.l, r1.l, r3.l, #0
+		ALU3:	MAD  r3.h, r1.h, r3.h, u8.l-1 (sat)
 ;
 
-// Fourth batch
 EXEC
+	MFU:	sfu:  rcp r4
+		mul0: bar, sfu, bar0
+		mul1: bar, sfu, bar1
+		ipl:  t0.fp20, t0.fp20, NOP, NOP
+
+	// Emulate clamp-to-border for src
 	ALU:
-		ALU0:	MAD  lp.lh, r0.l, #1, -r2.l
-		ALU1:	MAD  lp.lh, r0.h, #1, -r2.h
-		ALU2:	MAD  lp.lh, r1.l, #1, -r3.l
-		ALU3:	MAD  lp.lh, r1.h, #1, -r3.h
+		ALU0:	MAD  lp.lh, r0, #1, -#1
+		ALU1:	MAD  lp.lh, r1, #1, -#1
 
 	ALU:
-		ALU0:	MAD  lp.lh, abs(alu0), #1, #0 (this)
-		ALU1:	MAD  lp.lh, abs(alu1), #1, #0 (other)
-		ALU2:	MAD  lp.lh, abs(alu2), #1, #0 (other)
-		ALU3:	MAD  lp.lh, abs(alu3), u8.l, #0
+		ALU0:	CSEL  lp.lh,   r0, u8.h, #0 (this)
+		ALU1:	CSEL  lp.lh, alu0, #0, u8.h (other)
+		ALU2:	CSEL  lp.lh,   r1, u8.h, #0 (other)
+		ALU3:	CSEL  lp.lh, alu1, #0, u8.h
 
-	// kill the pixel if dst is unchanged
 	ALU:
-		ALU0:	CSEL kill, -alu0, #0, #1
-		ALU1:	CSEL r1.h, -u8.l, r1.h, #0
+		ALU0:	MAD  r0.l, r2.l, #1, -alu0 (sat)
+		ALU1:	MAD  r0.h, r2.h, #1, -alu0 (sat)
+		ALU2:	MAD  r1.l, r3.l, #1, -alu0 (sat)
+		ALU3:	MAD  r1.h, r3.h, #1, -alu0 (sat)
 
 	DW:	store rt1, r0, r1
 ;
-
-EXEC
-;
@@ -20,7 +20,11 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#ifdef NO_SRC_CLAMP
+pseq_to_dw_exec_nb = 1	// the number of 'EXEC' block where DW happens
+#else
 pseq_to_dw_exec_nb = 3	// the number of 'EXEC' block where DW happens
+#endif
 alu_buffer_size = 1	// number of .rgba regs carried through pipeline
 
 .uniforms
@@ -43,6 +47,7 @@ EXEC
 		mul1: bar, sfu, bar1
 		ipl:  t0.fp20, t0.fp20, NOP, NOP
 
+#ifndef NO_SRC_CLAMP
 	ALU:
 		ALU0:	MAD r2.l, #0, #0, #0
 		ALU1:	MAD r2.h, #0, #0, #0
@@ -69,6 +74,7 @@ EXEC
 ;
 
 EXEC
+#endif
 	// sample tex0 (src)
 	TEX:	tex r0, r1, tex0, r0, r1, r2
 
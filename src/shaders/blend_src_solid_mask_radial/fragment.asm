@@ -20,7 +20,7 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
-pseq_to_dw_exec_nb = 4	// the number of 'EXEC' block where DW happens
+pseq_to_dw_exec_nb = 3	// the number of 'EXEC' block where DW happens
 alu_buffer_size = 1	// number of .rgba regs carried through pipeline
 
 .uniforms
@@ -43,72 +43,65 @@ EXEC
 		mul1: bar, sfu, bar1
 		ipl:  t0.fp20, t0.fp20, NOP, NOP
 
-	// Emulate clamp-to-border for src
+	// r0 = u * u + v * v, where u,v are centre-relative src coords
 	ALU:
-		ALU0:	MAD  lp.lh, r0, #1, -#1
-		ALU1:	MAD  lp.lh, r1, #1, -#1
+		ALU0:	MAD  r0.lh, r0, r0, #0 (this)
+		ALU1:	MAD  lp.lh, r1, r1, #0
 
+	// the gradient ramp is one texel high, sample its first row
 	ALU:
-		ALU0:	CSEL lp.lh,   r0, u8.h, #0 (this)
-		ALU1:	CSEL lp.lh, alu0, #0, u8.h (other)
-		ALU2:	CSEL lp.lh,   r1, u8.h, #0 (other)
-		ALU3:	CSEL lp.lh, alu1, #0, u8.h
+		ALU0:	MAD  r1.lh, #0, #0, #0
 
-	// kill the pixel if src is opaque
 	ALU:
-		ALU0:	CSEL kill, -alu0, #1, #0
+		ALU0:	MAD r2.l, #0, #0, #0
+		ALU1:	MAD r2.h, #0, #0, #0
+		ALU2:	MAD r3.l, #0, #0, #0
+		ALU3:	MAD r3.h, #0, #0, #0
+
+	DW:	store rt1, r2, r3
 ;
 
 EXEC
-	// sample tex0 (src)
-	TEX:	tex r0, r1, tex0, r0, r1, r2
+	// r0 = distance from the centre, i.e. the ramp position
+	MFU:	sfu:  sqrt r0
+		mul0: r0, sfu, #1
 
 	ALU:
-		// src = src_fmt_alpha ? src.a : 1.0
-		ALU0:	CSEL lp.lh, -u5.l, r1.h, #1
+		ALU0:	MAD  lp.lh, r0, #1, -#1
+		ALU1:	MAD  lp.lh, r1, #1, -#1
 
-	// kill the pixel if src.aaaa == 0
+	/*
+	 * Emulate clamp-to-border by writing black color and killing
+	 * the pixel if texels coords are outside of [0.0, 1.0].
+	 */
 	ALU:
-		ALU0:	CSEL kill, -alu0, #0, #1
-		ALU1:	MAD r1.h, alu0, #1, #0
+		ALU0:	CSEL  kill,   r0, u8.h, #0
+		ALU1:	CSEL  kill, alu0,   #0, u8.h
+		ALU2:	CSEL  kill,   r1, u8.h, #0
+		ALU3:	CSEL  kill, alu1,   #0, u8.h
 ;
 
 EXEC
-	// fetch dst pixel to r2,r3
-	PSEQ:	0x0081000A
-
-	// tmp = -src.aaaa * mask.bgra + 1
-	ALU:
-		ALU0:	MAD  lp.lh, -u2.l, r1.h, #1
-		ALU1:	MAD  lp.lh, -u2.h, r1.h, #1
-		ALU2:	MAD  lp.lh, -u3.l, r1.h, #1
-		ALU3:	MAD  lp.lh, -u3.h, r1.h, #1
+	// sample tex0 (gradient ramp)
+	TEX:	tex r0, r1, tex0, r0, r1, r2
 
-	// r2,r3 = tmp * dst.bgra
+	// tmp = src_fmt_alpha ? mask.a : 1.0
 	ALU:
-		ALU0:	MAD  r0.l, alu0, r2.l, #0
-		ALU1:	MAD  r0.h, alu1, r2.h, #0
-		ALU2:	MAD  r1.l, alu2, r3.l, #0
-		ALU3:	MAD  r1.h, alu3, r3.h, #0
-;
+		ALU0:	CSEL  lp.lh, -u5.l, r1.h, #1
 
-EXEC
-	ALU:
-		ALU0:	MAD  lp.lh, r0.l, #1, -r2.l
-		ALU1:	MAD  lp.lh, r0.h, #1, -r2.h
-		ALU2:	MAD  lp.lh, r1.l, #1, -r3.l
-		ALU3:	MAD  lp.lh, r1.h, #1, -r3.h
+		// swap mask ABGR to ARGB if needed
+		ALU1:	CSEL  lp.lh, -u5.h, r1.l, r0.l
+		ALU2:	CSEL  lp.lh, -u5.h, r0.l, r1.l
 
-	ALU:
-		ALU0:	MAD  lp.lh, abs(alu0), #1, #0 (this)
-		ALU1:	MAD  lp.lh, abs(alu1), #1, #0 (other)
-		ALU2:	MAD  lp.lh, abs(alu2), #1, #0 (other)
-		ALU3:	MAD  lp.lh, abs(alu3), u8.l, #0
+		// tmp = dst_fmt_alpha ? 0.0 : -1.0
+		ALU3:	CSEL  lp.lh, -u8.l, #0, -#1
 
-	// kill the pixel if dst is unchanged
+	// dst = src.bgra * mask.bgra
 	ALU:
-		ALU0:	CSEL kill, -alu0, #0, #1
-		ALU1:	CSEL r1.h, -u8.l, r1.h, #0
+		ALU0:	MAD  r0.l, alu1, u2.l, #0
+		ALU1:	MAD  r0.h, r0.h, u2.h, #0
+		ALU2:	MAD  r1.l, alu2, u3.l, #0
+		ALU3:	MAD  r1.h, alu0, u3.h, alu3
 
 	DW:	store rt1, r0, r1
 ;
@@ -20,7 +20,7 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
-pseq_to_dw_exec_nb = 4	// the number of 'EXEC' block where DW happens
+pseq_to_dw_exec_nb = 3	// the number of 'EXEC' block where DW happens
 alu_buffer_size = 1	// number of .rgba regs carried through pipeline
 
 .uniforms
@@ -43,16 +43,20 @@ EXEC
 		mul1: bar, sfu, bar1
 		ipl:  t0.fp20, t0.fp20, NOP, NOP
 
-	// sample tex0 (src)
-	TEX:	tex r2, r3, tex0, r0, r1, r2
+	// wrap src texcoords to emulate repeat of NPOT texture
+	MFU:	sfu:  frc r0
+		mul0: r0, sfu, #1
+
+	MFU:	sfu:  frc r1
+		mul0: r1, sfu, #1
 
 	ALU:
-		// src = src_fmt_alpha ? src.a : 1.0
-		ALU0:	CSEL  r3.h, -u5.l, r3.h, #1
+		ALU0:	MAD r2.l, #0, #0, #0
+		ALU1:	MAD r2.h, #0, #0, #0
+		ALU2:	MAD r3.l, #0, #0, #0
+		ALU3:	MAD r3.h, #0, #0, #0
 
-		// swap mask ABGR to ARGB if needed
-		ALU2:	CSEL  r2.l, -u5.h, r3.l, r2.l
-		ALU3:	CSEL  r3.l, -u5.h, r2.l, r3.l
+	DW:	store rt1, r2, r3
 ;
 
 EXEC
@@ -60,49 +64,38 @@ EXEC
 		ALU0:	MAD  lp.lh, r0, #1, -#1
 		ALU1:	MAD  lp.lh, r1, #1, -#1
 
+	/*
+	 * Emulate clamp-to-border by writing black color and killing
+	 * the pixel if texels coords are outside of [0.0, 1.0].
+	 */
 	ALU:
-		ALU0:	CSEL  lp.lh,   r0, u8.h, #0 (this)
-		ALU1:	CSEL  lp.lh, alu0, #0, u8.h (other)
-		ALU2:	CSEL  lp.lh,   r1, u8.h, #0 (other)
-		ALU3:	CSEL  lp.lh, alu1, #0, u8.h
-
-	// Emulate clamp-to-border for src
-	ALU:
-		ALU0:	MAD  r0.l, r2.l, #1, -alu0 (sat)
-		ALU1:	MAD  r0.h, r2.h, #1, -alu0 (sat)
-		ALU2:	MAD  r1.l, r3.l, #1, -alu0 (sat)
-		ALU3:	MAD  r1.h, r3.h, #1, -alu0 (sat)
+		ALU0:	CSEL  kill,   r0, u8.h, #0
+		ALU1:	CSEL  kill, alu0,   #0, u8.h
+		ALU2:	CSEL  kill,   r1, u8.h, #0
+		ALU3:	CSEL  kill, alu1,   #0, u8.h
 ;
 
 EXEC
-	// fetch dst pixel to r2,r3
-	PSEQ:	0x0081000A
+	// sample tex0 (src)
+	TEX:	tex r0, r1, tex0, r0, r1, r2
 
-	// dst = src.bgra * mask.bgra + dst.bgra
+	// tmp = src_fmt_alpha ? mask.a : 1.0
 	ALU:
-		ALU0:	MAD  r0.l, r0.l, u2.l, r2.l (sat)
-		ALU1:	MAD  r0.h, r0.h, u2.h, r2.h (sat)
-		ALU2:	MAD  r1.l, r1.l, u3.l, r3.l (sat)
-		ALU3:	MAD  r1.h, r1.h, u3.h, r3.h (sat)
-;
+		ALU0:	CSEL  lp.lh, -u5.l, r1.h, #1
 
-EXEC
-	ALU:
-		ALU0:	MAD  lp.lh, r0.l, #1, -r2.l
-		ALU1:	MAD  lp.lh, r0.h, #1, -r2.h
-		ALU2:	MAD  lp.lh, r1.l, #1, -r3.l
-		ALU3:	MAD  lp.lh, r1.h, #1, -r3.h
+		// swap mask ABGR to ARGB if needed
+		ALU1:	CSEL  lp.lh, -u5.h, r1.l, r0.l
+		ALU2:	CSEL  lp.lh, -u5.h, r0.l, r1.l
 
-	ALU:
-		ALU0:	MAD  lp.lh, abs(alu0), #1, #0 (this)
-		ALU1:	MAD  lp.lh, abs(alu1), #1, #0 (other)
-		ALU2:	MAD  lp.lh, abs(alu2), #1, #0 (other)
-		ALU3:	MAD  lp.lh, abs(alu3), u8.l, #0
+		// tmp = dst_fmt_alpha ? 0.0 : -1.0
+		ALU3:	CSEL  lp.lh, -u8.l, #0, -#1
 
-	// kill the pixel if dst is unchanged
+	// dst = src.bgra * mask.bgra
 	ALU:
-		ALU0:	CSEL kill, -alu0, #0, #1
-		ALU1:	CSEL r1.h, -u8.l, r1.h, #0
+		ALU0:	MAD  r0.l, alu1, u2.l, #0
+		ALU1:	MAD  r0.h, r0.h, u2.h, #0
+		ALU2:	MAD  r1.l, alu2, u3.l, #0
+		ALU3:	MAD  r1.h, alu0, u3.h, alu3
 
 	DW:	store rt1, r0, r1
 ;
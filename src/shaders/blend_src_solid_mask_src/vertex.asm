@@ -4,13 +4,17 @@
 .attributes
 	[0] = "position";
 
+.uniforms
+	[3] = "dst_scale_bias";
+
 .constants
 	[0].z = 0.0;
 	[0].w = 1.0;
 
 .asm
+// position = dst pixel coords * 2 / dst size - 1
 EXEC(export[0]=vector)
-	MOVv r63.xy**, a[0].xyzw
+	MADv r63.xy**, a[0].xyzw, c[3].xyzw, c[3].zwzw
 ;
 
 EXEC_END(export[0]=vector)
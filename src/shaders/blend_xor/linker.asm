@@ -1 +0,0 @@
-LINK fp20, fp20, fp20, fp20, tram0.xyzw, export1
@@ -1 +0,0 @@
-LINK fp20, fp20, NOP, NOP, tram0.xyzw, export1
@@ -24,6 +24,18 @@
 #ifndef __TEGRA_GR3D_SHADER_PROG_H
 #define __TEGRA_GR3D_SHADER_PROG_H
 
+/* state flags that fragment program variants are specialized on */
+#define SHADER_SRC_CLAMP    (1 << 0)
+#define SHADER_MASK_CLAMP   (1 << 1)
+
+struct shader_program;
+
+struct shader_variant {
+    unsigned flags_mask;
+    unsigned flags;
+    struct shader_program *prog;
+};
+
 struct shader_program {
     uint32_t *vs_prog_words;
     unsigned vs_prog_words_nb;
@@ -36,10 +48,25 @@ struct shader_program {
     unsigned fs_pseq_to_dw;
     unsigned fs_pseq_inst_nb;
 
+    /* static cost estimate, see fragment_asm_cost() */
+    unsigned fs_alu_inst_nb;
+    unsigned fs_mfu_inst_nb;
+    unsigned fs_tex_inst_nb;
+    unsigned fs_regs_nb;
+    unsigned fs_cycles;
+
     uint32_t *linker_words;
     unsigned linker_words_nb;
     unsigned linker_inst_nb;
     unsigned used_tram_rows_nb;
+
+    /* specialized programs, the cheapest matching one is used */
+    struct shader_variant *variants;
+    unsigned variants_nb;
+
+    /* complete GR3D initialization sequence, built on first use */
+    uint32_t *init_words;
+    unsigned init_words_nb;
 };
 
 #endif
@@ -25,6 +25,10 @@
  *    Arto Merilainen <amerilainen@nvidia.com>
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include "xorg-server.h"
 #include "xf86.h"
 
@@ -46,11 +50,57 @@
 
 int tegra_stream_create(struct tegra_stream *stream)
 {
+    memset(stream->ring, 0, sizeof(stream->ring));
+
     stream->status = TEGRADRM_STREAM_FREE;
+    stream->buffer = &stream->ring[0];
+    stream->ring_idx = 0;
+    stream->last_fence = NULL;
+    stream->seqno = 0;
+    stream->deferred_idx = 0;
+    stream->num_deferred = 0;
 
     return 0;
 }
 
+/*
+ * tegra_stream_retire_buffer(buffer)
+ *
+ * Wait for completion of the job that was submitted from the given command
+ * buffer and release the job.
+ */
+
+static void tegra_stream_retire_buffer(struct tegra_command_buffer *buffer)
+{
+    tegra_stream_wait_fence(buffer->fence);
+    tegra_stream_put_fence(buffer->fence);
+    drm_tegra_job_free(buffer->job);
+
+    buffer->fence = NULL;
+    buffer->job = NULL;
+    buffer->pushbuf = NULL;
+}
+
+/*
+ * tegra_stream_release_prefences(buffer, wait)
+ *
+ * Drop dependencies of the job, optionally waiting for them.
+ */
+
+static void tegra_stream_release_prefences(struct tegra_command_buffer *buffer,
+                                           bool wait)
+{
+    unsigned i;
+
+    for (i = 0; i < 2; i++) {
+        if (wait)
+            tegra_stream_wait_fence(buffer->prefences[i]);
+
+        tegra_stream_put_fence(buffer->prefences[i]);
+        buffer->prefences[i] = NULL;
+    }
+}
+
 /*
  * tegra_stream_destroy(stream)
  *
@@ -59,12 +109,19 @@ int tegra_stream_create(struct tegra_stream *stream)
 
 void tegra_stream_destroy(struct tegra_stream *stream)
 {
+    unsigned i;
+
     if (!stream)
         return;
 
+    tegra_stream_cleanup(stream);
+
     tegra_stream_wait_fence(stream->last_fence);
     tegra_stream_put_fence(stream->last_fence);
-    drm_tegra_job_free(stream->job);
+    stream->last_fence = NULL;
+
+    for (i = 0; i < TEGRA_STREAM_RING_SIZE; i++)
+        tegra_stream_retire_buffer(&stream->ring[i]);
 }
 
 int tegra_stream_cleanup(struct tegra_stream *stream)
@@ -72,9 +129,23 @@ int tegra_stream_cleanup(struct tegra_stream *stream)
     if (!stream)
         return -1;
 
-    drm_tegra_job_free(stream->job);
+    /* buffer could hold a submitted job, it is retired by begin() */
+    if (stream->status == TEGRADRM_STREAM_FREE)
+        return 0;
+
+    /* job under construction was never submitted, no need to wait */
+    drm_tegra_job_free(stream->buffer->job);
+    tegra_stream_release_prefences(stream->buffer, false);
+
+    /* fence handed out for the dropped job is considered as reached */
+    if (stream->buffer->fence) {
+        stream->buffer->fence->stream = NULL;
+        tegra_stream_put_fence(stream->buffer->fence);
+        stream->buffer->fence = NULL;
+    }
 
-    stream->job = NULL;
+    stream->buffer->job = NULL;
+    stream->buffer->pushbuf = NULL;
     stream->status = TEGRADRM_STREAM_FREE;
 
     return 0;
@@ -87,57 +158,143 @@ int tegra_stream_cleanup(struct tegra_stream *stream)
  * synchronized correctly (we cannot send partial streams). If
  * pointer to fence is given, the fence will contain the syncpoint value
  * that is reached when operations in the buffer are finished.
+ *
+ * Unlike tegra_stream_submit(), this function blocks until all jobs of
+ * the stream are completed.
  */
 
 int tegra_stream_flush(struct tegra_stream *stream)
 {
-    struct drm_tegra_fence *fence;
+    struct tegra_fence *f;
     int result = 0;
+    unsigned i;
 
     if (!stream)
         return -1;
 
-    tegra_stream_wait_fence(stream->last_fence);
-    tegra_stream_put_fence(stream->last_fence);
-    stream->last_fence = NULL;
-
     /* Reflushing is fine */
-    if (stream->status == TEGRADRM_STREAM_FREE)
-        return 0;
-
-    /* Return error if stream is constructed badly */
-    if (stream->status != TEGRADRM_STREAM_READY) {
-        result = -1;
-        goto cleanup;
+    if (stream->status != TEGRADRM_STREAM_FREE) {
+        /* Return error if stream is constructed badly */
+        if (stream->status != TEGRADRM_STREAM_READY) {
+            tegra_stream_cleanup(stream);
+            result = -1;
+        } else {
+            f = stream->last_fence;
+
+            if (tegra_stream_submit(stream, stream->class_id !=
+                                            HOST1X_CLASS_GR3D) == f)
+                result = -1;
+        }
     }
 
-    result = drm_tegra_job_submit(stream->job, &fence);
-    if (result != 0) {
-        ErrorMsg("drm_tegra_job_submit() failed %d\n", result);
-        result = -1;
-        goto cleanup;
-    }
+    /* stream could be used by multiple channels, wait for all jobs */
+    for (i = 0; i < TEGRA_STREAM_RING_SIZE; i++)
+        tegra_stream_wait_fence(stream->ring[i].fence);
 
-    result = drm_tegra_fence_wait_timeout(fence, 1000);
-    if (result != 0) {
-        ErrorMsg("drm_tegra_fence_wait_timeout() failed %d\n", result);
+    /* job could be handed to kernel by the waiting above */
+    if (stream->last_fence && stream->last_fence->error)
         result = -1;
-    }
 
-    drm_tegra_fence_free(fence);
+    return result;
+}
 
-cleanup:
-    tegra_stream_cleanup(stream);
+/*
+ * tegra_stream_prefences_reached(buffer)
+ *
+ * Check without blocking whether jobs the given job depends on are completed.
+ */
 
-    return result;
+static bool tegra_stream_prefences_reached(struct tegra_command_buffer *buffer)
+{
+    struct tegra_fence *f;
+    unsigned i;
+
+    for (i = 0; i < 2; i++) {
+        f = buffer->prefences[i];
+
+        if (!f)
+            continue;
+
+        /* job of the other channel isn't handed to kernel yet */
+        if (f->stream)
+            return false;
+
+        if (f->fence && drm_tegra_fence_wait_timeout(f->fence, 0) != 0)
+            return false;
+    }
+
+    return true;
 }
 
-struct tegra_fence * tegra_stream_submit(struct tegra_stream *stream, bool gr2d)
+/*
+ * tegra_stream_submit_deferred(stream, wait)
+ *
+ * Hand jobs held back by tegra_stream_submit() to kernel in the order of
+ * their submission. Without waiting, only jobs whose dependencies are
+ * completed already are handed over. Returns number of jobs left behind.
+ */
+
+unsigned tegra_stream_submit_deferred(struct tegra_stream *stream, bool wait)
 {
+    struct tegra_command_buffer *buffer;
     struct drm_tegra_fence *fence;
     struct tegra_fence *f;
     int result;
 
+    while (stream->num_deferred) {
+        buffer = &stream->ring[stream->deferred_idx];
+
+        if (!wait && !tegra_stream_prefences_reached(buffer))
+            break;
+
+        /*
+         * Waiting for a job of the other channel could submit its
+         * deferred jobs, which never depend on jobs of this channel
+         * that are queued after this job.
+         */
+        tegra_stream_release_prefences(buffer, true);
+
+        stream->deferred_idx = (stream->deferred_idx + 1) %
+                                    TEGRA_STREAM_RING_SIZE;
+        stream->num_deferred--;
+
+        f = buffer->fence;
+        f->stream = NULL;
+
+        result = drm_tegra_job_submit(buffer->job, &fence);
+        if (result != 0) {
+            /* fence is reached, the error is reported by flushing */
+            ErrorMsg("drm_tegra_job_submit() failed %d\n", result);
+            f->error = result;
+            continue;
+        }
+
+        f->fence = fence;
+    }
+
+    return stream->num_deferred;
+}
+
+/*
+ * tegra_stream_submit(stream, gr2d)
+ *
+ * Send the current contents of stream buffer without waiting for its
+ * completion and return fence of the job. The command buffer is recycled
+ * once ring wraps around to it, waiting for the job if it is still busy.
+ *
+ * Job that depends on a busy job of the other channel is held back till
+ * the dependency is completed, instead of blocking CPU. Channels can't
+ * wait for each other in hardware since syncpoints of the other channel
+ * aren't exposed by libdrm_tegra. Deferred jobs are handed to kernel by
+ * the following submissions, tegra_stream_submit_deferred() or once
+ * their fence is waited for.
+ */
+
+struct tegra_fence * tegra_stream_submit(struct tegra_stream *stream, bool gr2d)
+{
+    struct tegra_command_buffer *buffer;
+    struct tegra_fence *f;
+
     if (!stream)
         return NULL;
 
@@ -148,26 +305,42 @@ struct tegra_fence * tegra_stream_submit(struct tegra_stream *stream, bool gr2d)
         return f;
 
     /* Return error if stream is constructed badly */
-    if (stream->status != TEGRADRM_STREAM_READY) {
-        result = -1;
+    if (stream->status != TEGRADRM_STREAM_READY)
         goto cleanup;
-    }
 
-    result = drm_tegra_job_submit(stream->job, &fence);
-    if (result != 0) {
-        ErrorMsg("drm_tegra_job_submit() failed %d\n", result);
-        result = -1;
-    } else {
-        f = tegra_stream_create_fence(fence, gr2d);
-        tegra_stream_put_fence(stream->last_fence);
-        stream->last_fence = f;
+    buffer = stream->buffer;
+    f = buffer->fence;
+
+    if (!f) {
+        f = tegra_stream_create_fence(NULL, gr2d);
+        if (!f) {
+            f = stream->last_fence;
+            goto cleanup;
+        }
+
+        /* job stays alive till its fence is reached */
+        f->stream = stream;
+        buffer->fence = f;
     }
 
-cleanup:
-    drm_tegra_job_free(stream->job);
+    f->gr2d = gr2d;
+    f->seqno = ++stream->seqno;
 
-    stream->job = NULL;
+    tegra_stream_put_fence(stream->last_fence);
+    stream->last_fence = tegra_stream_ref_fence(f, f->opaque);
+    buffer->pushbuf = NULL;
+
+    stream->ring_idx = (stream->ring_idx + 1) % TEGRA_STREAM_RING_SIZE;
+    stream->buffer = &stream->ring[stream->ring_idx];
     stream->status = TEGRADRM_STREAM_FREE;
+    stream->num_deferred++;
+
+    tegra_stream_submit_deferred(stream, false);
+
+    return f;
+
+cleanup:
+    tegra_stream_cleanup(stream);
 
     return f;
 }
@@ -184,6 +357,12 @@ struct tegra_fence * tegra_stream_ref_fence(struct tegra_fence *f, void *opaque)
 
 struct tegra_fence * tegra_stream_get_last_fence(struct tegra_stream *stream)
 {
+    struct tegra_fence *f = stream->buffer->fence;
+
+    /* job under construction is the last one */
+    if (stream->status != TEGRADRM_STREAM_FREE && f)
+        return tegra_stream_ref_fence(f, f->opaque);
+
     if (stream->last_fence)
         return tegra_stream_ref_fence(stream->last_fence,
                                       stream->last_fence->opaque);
@@ -191,6 +370,39 @@ struct tegra_fence * tegra_stream_get_last_fence(struct tegra_stream *stream)
     return NULL;
 }
 
+/*
+ * tegra_stream_pending_fence(stream, gr2d)
+ *
+ * Return fence of the job under construction without submitting the job.
+ * The job is submitted once the fence is waited for, this allows to keep
+ * pushing commands to the job till CPU really needs the result. The fence
+ * is owned by the stream, caller should take a reference to keep it.
+ */
+
+struct tegra_fence * tegra_stream_pending_fence(struct tegra_stream *stream,
+                                                bool gr2d)
+{
+    struct tegra_fence *f;
+
+    if (!(stream && stream->status == TEGRADRM_STREAM_CONSTRUCT)) {
+        ErrorMsg("Stream status isn't CONSTRUCT\n");
+        return NULL;
+    }
+
+    f = stream->buffer->fence;
+
+    if (!f) {
+        f = tegra_stream_create_fence(NULL, gr2d);
+        if (!f)
+            return NULL;
+
+        f->stream = stream;
+        stream->buffer->fence = f;
+    }
+
+    return f;
+}
+
 struct tegra_fence * tegra_stream_create_fence(struct drm_tegra_fence *fence,
                                                bool gr2d)
 {
@@ -204,10 +416,39 @@ struct tegra_fence * tegra_stream_create_fence(struct drm_tegra_fence *fence,
     return f;
 }
 
+/*
+ * tegra_stream_submit_pending(f, wait)
+ *
+ * Submit the job under construction if the given fence belongs to it.
+ * Optionally hand the job to kernel, waiting for its dependencies.
+ */
+
+static void tegra_stream_submit_pending(struct tegra_fence *f, bool wait)
+{
+    struct tegra_stream *stream = f->stream;
+
+    if (!stream)
+        return;
+
+    if (stream->status != TEGRADRM_STREAM_FREE && stream->buffer->fence == f) {
+        if (stream->status == TEGRADRM_STREAM_CONSTRUCT)
+            tegra_stream_end(stream);
+
+        tegra_stream_submit(stream, f->gr2d);
+    }
+
+    if (wait)
+        tegra_stream_submit_deferred(stream, true);
+}
+
 bool tegra_stream_wait_fence(struct tegra_fence *f)
 {
     int result;
 
+    /* job under construction has to be submitted first */
+    if (f)
+        tegra_stream_submit_pending(f, true);
+
     if (f && f->fence) {
         result = drm_tegra_fence_wait_timeout(f->fence, 1000);
         if (result != 0) {
@@ -223,6 +464,48 @@ bool tegra_stream_wait_fence(struct tegra_fence *f)
     return false;
 }
 
+/*
+ * tegra_stream_add_prefence(stream, f)
+ *
+ * Make the job under construction depend on a job of another channel.
+ * The job isn't handed to kernel till the dependency is completed, so CPU
+ * keeps going while the other channel is busy. Jobs of a channel are
+ * completed in the order of submission, hence only the latest fence per
+ * channel is kept. Job of another stream that is under construction is
+ * submitted, so that it is ordered before this job.
+ */
+
+int tegra_stream_add_prefence(struct tegra_stream *stream,
+                              struct tegra_fence *f)
+{
+    struct tegra_fence **prefence;
+
+    if (!(stream && stream->status == TEGRADRM_STREAM_CONSTRUCT)) {
+        ErrorMsg("Stream status isn't CONSTRUCT\n");
+        return -1;
+    }
+
+    /* jobs of the stream itself are executed in order */
+    if (!f || f->stream == stream)
+        return 0;
+
+    tegra_stream_submit_pending(f, false);
+
+    /* fence is reached */
+    if (!f->fence && !f->stream)
+        return 0;
+
+    prefence = &stream->buffer->prefences[f->gr2d];
+
+    if (*prefence && (*prefence)->seqno >= f->seqno)
+        return 0;
+
+    tegra_stream_put_fence(*prefence);
+    *prefence = tegra_stream_ref_fence(f, f->opaque);
+
+    return 0;
+}
+
 void tegra_stream_put_fence(struct tegra_fence *f)
 {
     if (f && --f->refcnt < 0) {
@@ -253,6 +536,7 @@ void tegra_stream_put_fence(struct tegra_fence *f)
 int tegra_stream_begin(struct tegra_stream *stream,
                        struct drm_tegra_channel *channel)
 {
+    struct tegra_command_buffer *buffer;
     int ret;
 
     /* check stream and its state */
@@ -261,23 +545,33 @@ int tegra_stream_begin(struct tegra_stream *stream,
         return -1;
     }
 
-    ret = drm_tegra_job_new(&stream->job, channel);
+    /* back-pressure: wait for the oldest job if ring is full */
+    buffer = stream->buffer;
+    tegra_stream_retire_buffer(buffer);
+
+    ret = drm_tegra_job_new(&buffer->job, channel);
     if (ret != 0) {
         ErrorMsg("drm_tegra_job_new() failed %d\n", ret);
+        buffer->job = NULL;
         return -1;
     }
 
-    ret = drm_tegra_pushbuf_new(&stream->buffer.pushbuf, stream->job);
+    ret = drm_tegra_pushbuf_new(&buffer->pushbuf, buffer->job);
     if (ret != 0) {
         ErrorMsg("drm_tegra_pushbuf_new() failed %d\n", ret);
-        drm_tegra_job_free(stream->job);
+        drm_tegra_job_free(buffer->job);
+        buffer->job = NULL;
+        buffer->pushbuf = NULL;
         return -1;
     }
 
     stream->class_id = 0;
+    stream->num_words = 0;
     stream->status = TEGRADRM_STREAM_CONSTRUCT;
     stream->op_done_synced = false;
 
+    tegra_stream_checkpoint(stream);
+
     return 0;
 }
 
@@ -298,14 +592,17 @@ int tegra_stream_push_reloc(struct tegra_stream *stream,
         return -1;
     }
 
-    ret = drm_tegra_pushbuf_relocate(stream->buffer.pushbuf,
+    ret = drm_tegra_pushbuf_relocate(stream->buffer->pushbuf,
                                      bo, offset, 0);
     if (ret != 0) {
         stream->status = TEGRADRM_STREAM_CONSTRUCTION_FAILED;
+        stream->op_broken = true;
         ErrorMsg("drm_tegra_pushbuf_relocate() failed %d\n", ret);
         return -1;
     }
 
+    stream->op_fixed = true;
+
     return 0;
 }
 
@@ -322,7 +619,7 @@ int tegra_stream_push(struct tegra_stream *stream, uint32_t word)
         return -1;
     }
 
-    *stream->buffer.pushbuf->ptr++ = word;
+    *stream->buffer->pushbuf->ptr++ = word;
     stream->op_done_synced = false;
 
     return 0;
@@ -369,7 +666,7 @@ int tegra_stream_end(struct tegra_stream *stream)
     if (stream->op_done_synced)
         goto ready;
 
-    ret = drm_tegra_pushbuf_sync(stream->buffer.pushbuf,
+    ret = drm_tegra_pushbuf_sync(stream->buffer->pushbuf,
                                  DRM_TEGRA_SYNCPT_COND_OP_DONE);
     if (ret != 0) {
         stream->status = TEGRADRM_STREAM_CONSTRUCTION_FAILED;
@@ -377,6 +674,8 @@ int tegra_stream_end(struct tegra_stream *stream)
         return -1;
     }
 
+    stream->num_words += 2;
+
 ready:
     stream->status = TEGRADRM_STREAM_READY;
     stream->op_done_synced = false;
@@ -398,6 +697,27 @@ struct tegra_reloc tegra_reloc(const void *var_ptr, struct drm_tegra_bo *bo,
     return reloc;
 }
 
+/*
+ * tegra_stream_prepare(stream, words)
+ *
+ * Make room for the given number of words. Once pushbuf moves on to a new
+ * buffer, the words pushed before are queued for submission.
+ */
+
+static int tegra_stream_prepare(struct tegra_stream *stream, unsigned words)
+{
+    struct drm_tegra_pushbuf *pushbuf = stream->buffer->pushbuf;
+    uint32_t *ptr = pushbuf->ptr;
+    int ret;
+
+    ret = drm_tegra_pushbuf_prepare(pushbuf, words);
+
+    if (ret != 0 || pushbuf->ptr != ptr)
+        stream->op_fixed = true;
+
+    return ret;
+}
+
 /*
  * tegra_stream_push_words(stream, addr, words, ...)
  *
@@ -419,7 +739,7 @@ int tegra_stream_push_words(struct tegra_stream *stream, const void *addr,
         return -1;
     }
 
-    ret = drm_tegra_pushbuf_prepare(stream->buffer.pushbuf, words);
+    ret = tegra_stream_prepare(stream, words);
     if (ret != 0) {
         stream->status = TEGRADRM_STREAM_CONSTRUCTION_FAILED;
         ErrorMsg("drm_tegra_pushbuf_prepare() failed %d\n", ret);
@@ -434,7 +754,7 @@ int tegra_stream_push_words(struct tegra_stream *stream, const void *addr,
     }
 
     /* Copy the contents */
-    pushbuf_ptr = stream->buffer.pushbuf->ptr;
+    pushbuf_ptr = stream->buffer->pushbuf->ptr;
     memcpy(pushbuf_ptr, addr, words * sizeof(uint32_t));
 
     /* Copy relocs */
@@ -442,20 +762,23 @@ int tegra_stream_push_words(struct tegra_stream *stream, const void *addr,
     for (; num_relocs; num_relocs--) {
         reloc_arg = va_arg(ap, struct tegra_reloc);
 
-        stream->buffer.pushbuf->ptr  = pushbuf_ptr;
-        stream->buffer.pushbuf->ptr += reloc_arg.var_offset / sizeof(uint32_t);
+        stream->buffer->pushbuf->ptr  = pushbuf_ptr;
+        stream->buffer->pushbuf->ptr += reloc_arg.var_offset / sizeof(uint32_t);
 
-        ret = drm_tegra_pushbuf_relocate(stream->buffer.pushbuf, reloc_arg.bo,
+        ret = drm_tegra_pushbuf_relocate(stream->buffer->pushbuf, reloc_arg.bo,
                                          reloc_arg.offset, 0);
         if (ret != 0) {
             stream->status = TEGRADRM_STREAM_CONSTRUCTION_FAILED;
             ErrorMsg("drm_tegra_pushbuf_relocate() failed %d\n", ret);
             break;
         }
+
+        stream->op_fixed = true;
     }
     va_end(ap);
 
-    stream->buffer.pushbuf->ptr = pushbuf_ptr + words;
+    stream->buffer->pushbuf->ptr = pushbuf_ptr + words;
+    stream->num_words += words;
 
     return ret ? -1 : 0;
 }
@@ -469,13 +792,15 @@ int tegra_stream_prep(struct tegra_stream *stream, uint32_t words)
         return -1;
     }
 
-    ret = drm_tegra_pushbuf_prepare(stream->buffer.pushbuf, words);
+    ret = tegra_stream_prepare(stream, words);
     if (ret != 0) {
         stream->status = TEGRADRM_STREAM_CONSTRUCTION_FAILED;
         ErrorMsg("drm_tegra_pushbuf_prepare() failed %d\n", ret);
         return -1;
     }
 
+    stream->num_words += words;
+
     return 0;
 }
 
@@ -489,7 +814,7 @@ int tegra_stream_sync(struct tegra_stream *stream,
         return -1;
     }
 
-    ret = drm_tegra_pushbuf_sync(stream->buffer.pushbuf, cond);
+    ret = drm_tegra_pushbuf_sync(stream->buffer->pushbuf, cond);
     if (ret != 0) {
         stream->status = TEGRADRM_STREAM_CONSTRUCTION_FAILED;
         ErrorMsg("drm_tegra_pushbuf_sync() failed %d\n", ret);
@@ -499,6 +824,10 @@ int tegra_stream_sync(struct tegra_stream *stream,
     if (cond == DRM_TEGRA_SYNCPT_COND_OP_DONE)
         stream->op_done_synced = true;
 
+    /* pushbuf could move on to a new buffer */
+    stream->op_fixed = true;
+    stream->num_words += 2;
+
     return 0;
 }
 
@@ -513,3 +842,135 @@ int tegra_stream_pushf(struct tegra_stream *stream, float f)
 
     return tegra_stream_push(stream, value.u);
 }
+
+/*
+ * tegra_stream_reserve(stream, words)
+ *
+ * Reserve space for the given number of words, reloc slots included, and
+ * return write cursor. Words are stored through the cursor directly, relocs
+ * are emitted with tegra_stream_write_reloc(). Nothing is pushed to the
+ * stream till tegra_stream_commit() is invoked with the advanced cursor,
+ * which is the only place where result is validated.
+ */
+
+uint32_t * tegra_stream_reserve(struct tegra_stream *stream, unsigned words)
+{
+    if (tegra_stream_prep(stream, words) < 0)
+        return NULL;
+
+    stream->reserved_start = stream->buffer->pushbuf->ptr;
+    stream->reserved_end = stream->reserved_start + words;
+
+    return stream->reserved_start;
+}
+
+uint32_t * tegra_stream_write_reloc(struct tegra_stream *stream,
+                                    uint32_t *cursor,
+                                    struct drm_tegra_bo *bo, unsigned offset)
+{
+    struct drm_tegra_pushbuf *pushbuf = stream->buffer->pushbuf;
+    int ret;
+
+    /* relocation is recorded at the pushbuf's position */
+    pushbuf->ptr = cursor;
+
+    ret = drm_tegra_pushbuf_relocate(pushbuf, bo, offset, 0);
+    if (ret != 0) {
+        stream->status = TEGRADRM_STREAM_CONSTRUCTION_FAILED;
+        stream->op_broken = true;
+        ErrorMsg("drm_tegra_pushbuf_relocate() failed %d\n", ret);
+        return cursor + 1;
+    }
+
+    stream->op_fixed = true;
+
+    return pushbuf->ptr;
+}
+
+int tegra_stream_commit(struct tegra_stream *stream, uint32_t *cursor)
+{
+    if (!(stream && stream->status == TEGRADRM_STREAM_CONSTRUCT)) {
+        ErrorMsg("Stream status isn't CONSTRUCT\n");
+        return -1;
+    }
+
+    if (cursor < stream->reserved_start || cursor > stream->reserved_end) {
+        stream->status = TEGRADRM_STREAM_CONSTRUCTION_FAILED;
+        stream->op_broken = true;
+        ErrorMsg("Cursor is out of reserved space\n");
+        return -1;
+    }
+
+    stream->buffer->pushbuf->ptr = cursor;
+    stream->reserved_start = stream->reserved_end = NULL;
+    stream->op_done_synced = false;
+
+    return 0;
+}
+
+/*
+ * tegra_stream_checkpoint(stream)
+ *
+ * Remember state of the job under construction, so that words of an
+ * operation that fails half-way could be taken back later on.
+ */
+
+void tegra_stream_checkpoint(struct tegra_stream *stream)
+{
+    if (stream->status != TEGRADRM_STREAM_CONSTRUCT)
+        return;
+
+    stream->op_start = stream->buffer->pushbuf->ptr;
+    stream->op_num_words = stream->num_words;
+    stream->op_class_id = stream->class_id;
+    stream->op_synced = stream->op_done_synced;
+    stream->op_fixed = false;
+    stream->op_broken = false;
+}
+
+/*
+ * tegra_stream_rollback(stream)
+ *
+ * Drop words pushed since the checkpoint, keeping the rest of the job.
+ * Not possible once a relocation was recorded for the dropped words or
+ * pushbuf moved on to a new buffer.
+ */
+
+int tegra_stream_rollback(struct tegra_stream *stream)
+{
+    if (stream->status != TEGRADRM_STREAM_CONSTRUCT &&
+        stream->status != TEGRADRM_STREAM_CONSTRUCTION_FAILED)
+        return -1;
+
+    if (stream->op_fixed || stream->op_broken)
+        return -1;
+
+    stream->buffer->pushbuf->ptr = stream->op_start;
+    stream->num_words = stream->op_num_words;
+    stream->class_id = stream->op_class_id;
+    stream->op_done_synced = stream->op_synced;
+    stream->reserved_start = stream->reserved_end = NULL;
+    stream->status = TEGRADRM_STREAM_CONSTRUCT;
+
+    return 0;
+}
+
+/*
+ * tegra_stream_recover(stream)
+ *
+ * Make the job submittable after its construction failed. Words pushed
+ * since the checkpoint stay in the job, which is only valid if none of
+ * opcodes was cut short. Failed prep skips whole blocks of words, unlike
+ * a failed relocation.
+ */
+
+int tegra_stream_recover(struct tegra_stream *stream)
+{
+    if (stream->status == TEGRADRM_STREAM_CONSTRUCTION_FAILED &&
+        !stream->op_broken) {
+        stream->reserved_start = stream->reserved_end = NULL;
+        stream->status = TEGRADRM_STREAM_CONSTRUCT;
+    }
+
+    return stream->status == TEGRADRM_STREAM_CONSTRUCT ? 0 : -1;
+}
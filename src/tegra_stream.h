@@ -30,7 +30,12 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+
+#ifdef HAVE_SW_HOST1X
+#include "host1x_sw.h"
+#else
 #include <libdrm/tegra.h>
+#endif
 
 enum tegra_stream_status {
     TEGRADRM_STREAM_FREE,
@@ -39,27 +44,62 @@ enum tegra_stream_status {
     TEGRADRM_STREAM_READY,
 };
 
-struct tegra_command_buffer {
-    struct drm_tegra_pushbuf *pushbuf;
-};
+#define TEGRA_STREAM_RING_SIZE  4
+
+struct tegra_stream;
 
 struct tegra_fence {
     struct drm_tegra_fence *fence;
+    struct tegra_stream *stream; /* set while job isn't submitted yet */
+    uint64_t seqno;
     void *opaque;
     int refcnt;
+    int error; /* deferred submission of the job failed */
     bool gr2d;
 };
 
+struct tegra_command_buffer {
+    struct drm_tegra_job *job;
+    struct drm_tegra_pushbuf *pushbuf;
+    struct tegra_fence *fence;
+
+    /* latest fences of other channels, indexed by tegra_fence.gr2d */
+    struct tegra_fence *prefences[2];
+};
+
 struct tegra_stream {
     enum tegra_stream_status status;
 
-    struct drm_tegra_job *job;
+    /*
+     * Submitted jobs are kept in the ring till they are completed, so that
+     * CPU could construct the next job while the previous are executing.
+     */
+    struct tegra_command_buffer ring[TEGRA_STREAM_RING_SIZE];
+    struct tegra_command_buffer *buffer;
+    unsigned ring_idx;
+
+    /* submitted jobs that wait for jobs of the other channel */
+    unsigned deferred_idx;
+    unsigned num_deferred;
 
     struct tegra_fence *last_fence;
-    struct tegra_command_buffer buffer;
+    uint64_t seqno;
     uint32_t class_id;
+    unsigned num_words; /* size of the job under construction */
+
+    /* space given out by tegra_stream_reserve() */
+    uint32_t *reserved_start;
+    uint32_t *reserved_end;
 
     bool op_done_synced;
+
+    /* state of the job at tegra_stream_checkpoint() */
+    uint32_t *op_start;
+    unsigned op_num_words;
+    uint32_t op_class_id;
+    bool op_synced;
+    bool op_fixed;      /* words since the checkpoint can't be taken back */
+    bool op_broken;     /* opcode was cut short by a failed relocation */
 };
 
 struct tegra_reloc {
@@ -78,11 +118,16 @@ int tegra_stream_end(struct tegra_stream *stream);
 int tegra_stream_cleanup(struct tegra_stream *stream);
 int tegra_stream_flush(struct tegra_stream *stream);
 struct tegra_fence * tegra_stream_submit(struct tegra_stream *stream, bool gr2d);
+unsigned tegra_stream_submit_deferred(struct tegra_stream *stream, bool wait);
 struct tegra_fence * tegra_stream_ref_fence(struct tegra_fence *f, void *opaque);
 struct tegra_fence * tegra_stream_get_last_fence(struct tegra_stream *stream);
+struct tegra_fence * tegra_stream_pending_fence(struct tegra_stream *stream,
+                                                bool gr2d);
 struct tegra_fence * tegra_stream_create_fence(struct drm_tegra_fence *fence,
                                                bool gr2d);
 bool tegra_stream_wait_fence(struct tegra_fence *f);
+int tegra_stream_add_prefence(struct tegra_stream *stream,
+                              struct tegra_fence *f);
 void tegra_stream_put_fence(struct tegra_fence *f);
 int tegra_stream_push(struct tegra_stream *stream, uint32_t word);
 int tegra_stream_push_setclass(struct tegra_stream *stream, unsigned class_id);
@@ -96,5 +141,13 @@ int tegra_stream_prep(struct tegra_stream *stream, uint32_t words);
 int tegra_stream_sync(struct tegra_stream *stream,
                       enum drm_tegra_syncpt_cond cond);
 int tegra_stream_pushf(struct tegra_stream *stream, float f);
+uint32_t * tegra_stream_reserve(struct tegra_stream *stream, unsigned words);
+uint32_t * tegra_stream_write_reloc(struct tegra_stream *stream,
+                                    uint32_t *cursor,
+                                    struct drm_tegra_bo *bo, unsigned offset);
+int tegra_stream_commit(struct tegra_stream *stream, uint32_t *cursor);
+void tegra_stream_checkpoint(struct tegra_stream *stream);
+int tegra_stream_rollback(struct tegra_stream *stream);
+int tegra_stream_recover(struct tegra_stream *stream);
 
 #endif
@@ -1326,8 +1326,7 @@ static Bool TegraVideoOverlayUpdateRotatedFb(TegraVideoPtr priv,
                                     rotation))
         goto err_destroy_fb;
 
-    tegra_stream_flush(&priv->cmds);
-
+    /* rotation jobs are waited for right before committing to display */
 done:
     TegraVideoDestroyFramebuffer(scrn, &overlay->old_fb_rotated);
 
@@ -1490,6 +1489,10 @@ static Bool TegraVideoOverlayPutImageOnOverlays(TegraVideoPtr priv,
     if (priv->passthrough != 1)
         flags |= DRM_MODE_ATOMIC_NONBLOCK;
 
+    /* rotated framebuffers must be ready before they are displayed */
+    if (priv->gr2d)
+        tegra_stream_flush(&priv->cmds);
+
     err = TegraDrmModeAtomicCommit(tegra->fd, req, flags, NULL);
     drmModeAtomicFree(req);
 
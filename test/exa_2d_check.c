@@ -0,0 +1,382 @@
+/*
+ * Copyright (c) Dmitry Osipenko
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * Checks and benchmarks 2D acceleration of the driver from X client side.
+ *
+ * Random fills (all GC functions) and copies (overlapping and between
+ * pixmaps) are rendered by the X server, the result is read back and
+ * compared pixel-for-pixel against the same operations executed locally.
+ * Pointed at a server running the driver built with --enable-sw-host1x,
+ * this exercises TegraEXAPrepareSolid() / TegraEXACopy() and the GR2D
+ * command streams on a machine without Tegra GPU.
+ *
+ * Usage: exa_2d_check [-d display] [-s seed] [-n iterations] [-b]
+ *
+ * With -b the fills and copies are timed instead of checked.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+#define WIDTH       512
+#define HEIGHT      512
+#define BATCH       64
+
+struct surface {
+    Pixmap pixmap;
+    uint32_t *pixels;
+    unsigned depth;
+    uint32_t mask;
+};
+
+static Display *dpy;
+static GC gc;
+
+static uint32_t rop(int function, uint32_t src, uint32_t dst)
+{
+    switch (function) {
+    case GXclear:        return 0;
+    case GXand:          return src & dst;
+    case GXandReverse:   return src & ~dst;
+    case GXcopy:         return src;
+    case GXandInverted:  return ~src & dst;
+    case GXnoop:         return dst;
+    case GXxor:          return src ^ dst;
+    case GXor:           return src | dst;
+    case GXnor:          return ~(src | dst);
+    case GXequiv:        return ~src ^ dst;
+    case GXinvert:       return ~dst;
+    case GXorReverse:    return src | ~dst;
+    case GXcopyInverted: return ~src;
+    case GXorInverted:   return ~src | dst;
+    case GXnand:         return ~(src & dst);
+    case GXset:          return ~0u;
+    }
+
+    return dst;
+}
+
+static bool surface_init(struct surface *s, unsigned depth)
+{
+    XImage *img;
+    unsigned x, y;
+
+    s->depth = depth;
+    s->mask = depth < 32 ? (1u << depth) - 1 : ~0u;
+    s->pixels = malloc(WIDTH * HEIGHT * sizeof(uint32_t));
+    if (!s->pixels)
+        return false;
+
+    s->pixmap = XCreatePixmap(dpy, DefaultRootWindow(dpy), WIDTH, HEIGHT,
+                              depth);
+
+    img = XGetImage(dpy, s->pixmap, 0, 0, WIDTH, HEIGHT, AllPlanes, ZPixmap);
+    if (!img)
+        return false;
+
+    for (y = 0; y < HEIGHT; y++) {
+        for (x = 0; x < WIDTH; x++) {
+            s->pixels[y * WIDTH + x] = (uint32_t) random() & s->mask;
+            XPutPixel(img, x, y, s->pixels[y * WIDTH + x]);
+        }
+    }
+
+    XPutImage(dpy, s->pixmap, DefaultGC(dpy, DefaultScreen(dpy)), img,
+              0, 0, 0, 0, WIDTH, HEIGHT);
+    XDestroyImage(img);
+
+    return true;
+}
+
+static void surface_fini(struct surface *s)
+{
+    XFreePixmap(dpy, s->pixmap);
+    free(s->pixels);
+}
+
+static bool surface_compare(struct surface *s, const char *what)
+{
+    XImage *img;
+    uint32_t pixel;
+    unsigned x, y;
+    bool ok = true;
+
+    img = XGetImage(dpy, s->pixmap, 0, 0, WIDTH, HEIGHT, AllPlanes, ZPixmap);
+    if (!img) {
+        fprintf(stderr, "XGetImage failed\n");
+        return false;
+    }
+
+    for (y = 0; y < HEIGHT && ok; y++) {
+        for (x = 0; x < WIDTH; x++) {
+            pixel = XGetPixel(img, x, y) & s->mask;
+
+            if (pixel != s->pixels[y * WIDTH + x]) {
+                fprintf(stderr,
+                        "depth %u: %s mismatch at %u,%u: 0x%08x expected 0x%08x\n",
+                        s->depth, what, x, y, pixel,
+                        s->pixels[y * WIDTH + x]);
+                ok = false;
+                break;
+            }
+        }
+    }
+
+    XDestroyImage(img);
+
+    return ok;
+}
+
+static void random_rect(int *x, int *y, unsigned *w, unsigned *h)
+{
+    *w = 1 + random() % WIDTH;
+    *h = 1 + random() % HEIGHT;
+    *x = random() % (WIDTH - *w + 1);
+    *y = random() % (HEIGHT - *h + 1);
+}
+
+static void fill(struct surface *dst, int function, uint32_t color,
+                 int x, int y, unsigned w, unsigned h, bool local)
+{
+    uint32_t *p;
+    unsigned i, k;
+
+    XSetFunction(dpy, gc, function);
+    XSetForeground(dpy, gc, color);
+    XFillRectangle(dpy, dst->pixmap, gc, x, y, w, h);
+
+    if (!local)
+        return;
+
+    for (i = 0; i < h; i++) {
+        p = &dst->pixels[(y + i) * WIDTH + x];
+
+        for (k = 0; k < w; k++)
+            p[k] = rop(function, color, p[k]) & dst->mask;
+    }
+}
+
+static void copy(struct surface *src, struct surface *dst, int function,
+                 int sx, int sy, int dx, int dy, unsigned w, unsigned h,
+                 bool local)
+{
+    uint32_t *tmp;
+    unsigned i, k;
+
+    XSetFunction(dpy, gc, function);
+    XCopyArea(dpy, src->pixmap, dst->pixmap, gc, sx, sy, w, h, dx, dy);
+
+    if (!local)
+        return;
+
+    /* source and destination may overlap */
+    tmp = malloc(w * h * sizeof(uint32_t));
+    if (!tmp)
+        abort();
+
+    for (i = 0; i < h; i++)
+        memcpy(&tmp[i * w], &src->pixels[(sy + i) * WIDTH + sx],
+               w * sizeof(uint32_t));
+
+    for (i = 0; i < h; i++) {
+        for (k = 0; k < w; k++) {
+            uint32_t *p = &dst->pixels[(dy + i) * WIDTH + dx + k];
+
+            *p = rop(function, tmp[i * w + k], *p) & dst->mask;
+        }
+    }
+
+    free(tmp);
+}
+
+static bool check_depth(unsigned depth, unsigned iterations)
+{
+    struct surface a, b;
+    unsigned i, k, w, h;
+    int x, y, sx, sy;
+    bool ok = true;
+
+    if (!surface_init(&a, depth) || !surface_init(&b, depth))
+        return false;
+
+    XSetPlaneMask(dpy, gc, AllPlanes);
+
+    for (i = 0; i < iterations && ok; i++) {
+        for (k = 0; k < BATCH; k++) {
+            random_rect(&x, &y, &w, &h);
+
+            switch (random() % 3) {
+            case 0:
+                fill(&a, random() % 16, random() & a.mask, x, y, w, h, true);
+                break;
+            case 1:
+                sx = random() % (WIDTH - w + 1);
+                sy = random() % (HEIGHT - h + 1);
+                copy(&a, &a, random() % 16, sx, sy, x, y, w, h, true);
+                break;
+            case 2:
+                sx = random() % (WIDTH - w + 1);
+                sy = random() % (HEIGHT - h + 1);
+                copy(&b, &a, random() % 16, sx, sy, x, y, w, h, true);
+                break;
+            }
+        }
+
+        ok = surface_compare(&a, "fill/copy");
+    }
+
+    surface_fini(&b);
+    surface_fini(&a);
+
+    printf("depth %2u: %s\n", depth, ok ? "passed" : "FAILED");
+
+    return ok;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench_depth(unsigned depth, unsigned iterations)
+{
+    static const unsigned sizes[] = { 10, 100, 500 };
+    struct surface a, b;
+    unsigned i, k, s;
+    double t;
+
+    if (!surface_init(&a, depth) || !surface_init(&b, depth))
+        return;
+
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        for (k = 0; k < 3; k++) {
+            XSync(dpy, False);
+            t = now();
+
+            for (i = 0; i < iterations * BATCH; i++) {
+                int x = i % (WIDTH - sizes[s]);
+                int y = (i * 7) % (HEIGHT - sizes[s]);
+
+                if (k == 0)
+                    fill(&a, GXcopy, i, x, y, sizes[s], sizes[s], false);
+                else if (k == 1)
+                    copy(&a, &a, GXcopy, y, x, x, y, sizes[s], sizes[s],
+                         false);
+                else
+                    copy(&b, &a, GXcopy, y, x, x, y, sizes[s], sizes[s],
+                         false);
+            }
+
+            XSync(dpy, False);
+            t = now() - t;
+
+            printf("depth %2u: %-9s %3ux%-3u %10.0f ops/s\n", depth,
+                   k == 0 ? "fill" : k == 1 ? "copy" : "copy-pix",
+                   sizes[s], sizes[s], iterations * BATCH / t);
+        }
+    }
+
+    surface_fini(&b);
+    surface_fini(&a);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *display = NULL;
+    unsigned iterations = 100;
+    unsigned seed = 1;
+    bool bench = false;
+    bool ok = true;
+    Pixmap tmp;
+    int *depths;
+    int i, n, c;
+
+    while ((c = getopt(argc, argv, "d:s:n:b")) != -1) {
+        switch (c) {
+        case 'd':
+            display = optarg;
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            iterations = strtoul(optarg, NULL, 0);
+            break;
+        case 'b':
+            bench = true;
+            break;
+        default:
+            fprintf(stderr,
+                    "usage: %s [-d display] [-s seed] [-n iterations] [-b]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+
+    dpy = XOpenDisplay(display);
+    if (!dpy) {
+        fprintf(stderr, "can't open display %s\n", XDisplayName(display));
+        return 1;
+    }
+
+    srandom(seed);
+
+    depths = XListDepths(dpy, DefaultScreen(dpy), &n);
+
+    for (i = 0; i < n; i++) {
+        /* GR2D handles 8, 16 and 32 bpp */
+        if (depths[i] != 8 && depths[i] != 16 &&
+            depths[i] != 24 && depths[i] != 32)
+            continue;
+
+        /* GC must match depth of the drawables */
+        tmp = XCreatePixmap(dpy, DefaultRootWindow(dpy), 1, 1, depths[i]);
+        gc = XCreateGC(dpy, tmp, 0, NULL);
+        XFreePixmap(dpy, tmp);
+
+        if (bench)
+            bench_depth(depths[i], iterations);
+        else if (!check_depth(depths[i], iterations))
+            ok = false;
+
+        XFreeGC(dpy, gc);
+    }
+
+    XFree(depths);
+    XCloseDisplay(dpy);
+
+    return ok ? 0 : 1;
+}
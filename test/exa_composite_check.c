@@ -0,0 +1,492 @@
+/*
+ * Copyright (c) Dmitry Osipenko
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * Checks Render composite acceleration of the driver against pixman.
+ *
+ * Every Porter-Duff operation is run for combinations of source (texture,
+ * solid, a8, linear and radial gradients with and without pad), mask (none,
+ * a8, component-alpha, solid) and destination formats. The result is read back and compared against pixman with the
+ * given per-channel tolerance, GR3D blends at reduced precision. Pointed at
+ * a server running the driver built with --enable-sw-host1x, this runs the
+ * blend programs through the GR3D interpreter on a machine without Tegra
+ * GPU; per-draw cycle estimates of the interpreter go to the server log at
+ * verbosity 4.
+ *
+ * Usage: exa_composite_check [-d display] [-s seed] [-t tolerance] [-b]
+ *
+ * With -b every combination is timed instead of checked.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <pixman.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/Xrender.h>
+
+#define WIDTH       128
+#define HEIGHT      128
+#define BENCH_REPS  200
+
+enum image_kind {
+    IMAGE_NONE,
+    IMAGE_ARGB,
+    IMAGE_XRGB,
+    IMAGE_A8,
+    IMAGE_SOLID,
+    IMAGE_ARGB_CA,
+    IMAGE_LINEAR,
+    IMAGE_LINEAR_PAD,
+    IMAGE_RADIAL,
+    IMAGE_RADIAL_PAD,
+};
+
+struct image {
+    enum image_kind kind;
+    pixman_image_t *ref;
+    uint32_t *bits;
+    Pixmap pixmap;
+    Picture picture;
+    unsigned width;
+    unsigned height;
+    unsigned depth;
+};
+
+static const char * const op_names[] = {
+    "Clear", "Src", "Dst", "Over", "OverReverse", "In", "InReverse",
+    "Out", "OutReverse", "Atop", "AtopReverse", "Xor", "Add", "Saturate",
+};
+
+static const char * const kind_names[] = {
+    "none", "argb", "xrgb", "a8", "solid", "argb-ca",
+    "linear", "linear-pad", "radial", "radial-pad",
+};
+
+static Display *dpy;
+static unsigned tolerance = 2;
+
+#define GRADIENT_STOPS  3
+
+/*
+ * Gradients span a part of the image only, so that the areas before and
+ * after the stops are composited too. Pixel centers are kept away from the
+ * ends of the gradient, where GR3D and pixman could round differently.
+ */
+static bool gradient_init(struct image *img, enum image_kind kind)
+{
+    pixman_gradient_stop_t stops[GRADIENT_STOPS];
+    XFixed offsets[GRADIENT_STOPS];
+    XRenderColor colors[GRADIENT_STOPS];
+    XRenderPictureAttributes pa;
+    XLinearGradient linear;
+    XRadialGradient radial;
+    unsigned i;
+
+    for (i = 0; i < GRADIENT_STOPS; i++) {
+        offsets[i] = XDoubleToFixed((double) i / (GRADIENT_STOPS - 1));
+        colors[i].red = random();
+        colors[i].green = random();
+        colors[i].blue = random();
+        colors[i].alpha = random();
+
+        stops[i].x = offsets[i];
+        stops[i].color.red = colors[i].red;
+        stops[i].color.green = colors[i].green;
+        stops[i].color.blue = colors[i].blue;
+        stops[i].color.alpha = colors[i].alpha;
+    }
+
+    if (kind == IMAGE_LINEAR || kind == IMAGE_LINEAR_PAD) {
+        linear.p1.x = XDoubleToFixed(24.0);
+        linear.p1.y = XDoubleToFixed(8.0);
+        linear.p2.x = XDoubleToFixed(104.0);
+        linear.p2.y = XDoubleToFixed(40.0);
+
+        img->picture = XRenderCreateLinearGradient(dpy, &linear, offsets,
+                                                   colors, GRADIENT_STOPS);
+        img->ref = pixman_image_create_linear_gradient(
+                        (pixman_point_fixed_t *) &linear.p1,
+                        (pixman_point_fixed_t *) &linear.p2,
+                        stops, GRADIENT_STOPS);
+    } else {
+        /*
+         * Squared distances of pixel centers to the center are integers,
+         * none of them is between 1604 and 1609.
+         */
+        radial.inner.x = XDoubleToFixed(64.5);
+        radial.inner.y = XDoubleToFixed(64.5);
+        radial.inner.radius = 0;
+        radial.outer.x = radial.inner.x;
+        radial.outer.y = radial.inner.y;
+        radial.outer.radius = XDoubleToFixed(40.08);
+
+        img->picture = XRenderCreateRadialGradient(dpy, &radial, offsets,
+                                                   colors, GRADIENT_STOPS);
+        img->ref = pixman_image_create_radial_gradient(
+                        (pixman_point_fixed_t *) &radial.inner,
+                        (pixman_point_fixed_t *) &radial.outer,
+                        radial.inner.radius, radial.outer.radius,
+                        stops, GRADIENT_STOPS);
+    }
+
+    if (!img->picture || !img->ref)
+        return false;
+
+    if (kind == IMAGE_LINEAR_PAD || kind == IMAGE_RADIAL_PAD) {
+        pa.repeat = RepeatPad;
+        XRenderChangePicture(dpy, img->picture, CPRepeat, &pa);
+        pixman_image_set_repeat(img->ref, PIXMAN_REPEAT_PAD);
+    }
+
+    return true;
+}
+
+static bool image_init(struct image *img, enum image_kind kind)
+{
+    XRenderPictureAttributes pa;
+    XRenderPictFormat *format;
+    pixman_format_code_t code;
+    unsigned long mask = 0;
+    unsigned x, y, stride;
+    XImage *ximg;
+    GC gc;
+
+    memset(img, 0, sizeof(*img));
+    img->kind = kind;
+
+    if (kind == IMAGE_NONE)
+        return true;
+
+    if (kind >= IMAGE_LINEAR)
+        return gradient_init(img, kind);
+
+    img->width = kind == IMAGE_SOLID ? 1 : WIDTH;
+    img->height = kind == IMAGE_SOLID ? 1 : HEIGHT;
+
+    switch (kind) {
+    case IMAGE_XRGB:
+        format = XRenderFindStandardFormat(dpy, PictStandardRGB24);
+        code = PIXMAN_x8r8g8b8;
+        img->depth = 24;
+        break;
+    case IMAGE_A8:
+        format = XRenderFindStandardFormat(dpy, PictStandardA8);
+        code = PIXMAN_a8;
+        img->depth = 8;
+        break;
+    default:
+        format = XRenderFindStandardFormat(dpy, PictStandardARGB32);
+        code = PIXMAN_a8r8g8b8;
+        img->depth = 32;
+        break;
+    }
+
+    if (!format)
+        return false;
+
+    stride = (img->width * PIXMAN_FORMAT_BPP(code) / 8 + 3) & ~3;
+    img->bits = calloc(img->height, stride);
+    if (!img->bits)
+        return false;
+
+    img->ref = pixman_image_create_bits(code, img->width, img->height,
+                                        img->bits, stride);
+    if (!img->ref)
+        return false;
+
+    img->pixmap = XCreatePixmap(dpy, DefaultRootWindow(dpy), img->width,
+                                img->height, img->depth);
+
+    ximg = XGetImage(dpy, img->pixmap, 0, 0, img->width, img->height,
+                     AllPlanes, ZPixmap);
+    if (!ximg)
+        return false;
+
+    for (y = 0; y < img->height; y++) {
+        for (x = 0; x < img->width; x++) {
+            uint32_t pixel = (uint32_t) random() << 16 ^ random();
+
+            if (img->depth == 8) {
+                ((uint8_t *) img->bits)[y * stride + x] = pixel;
+                pixel &= 0xff;
+            } else {
+                /* keep the colors premultiplied */
+                uint32_t a = pixel >> 24;
+
+                if (img->depth == 24)
+                    a = 0xff;
+
+                pixel = (a << 24) |
+                        (((pixel >> 16) & 0xff) * a / 255) << 16 |
+                        (((pixel >> 8) & 0xff) * a / 255) << 8 |
+                        ((pixel & 0xff) * a / 255);
+
+                img->bits[y * stride / 4 + x] = pixel;
+
+                if (img->depth == 24)
+                    pixel &= 0xffffff;
+            }
+
+            XPutPixel(ximg, x, y, pixel);
+        }
+    }
+
+    gc = XCreateGC(dpy, img->pixmap, 0, NULL);
+    XPutImage(dpy, img->pixmap, gc, ximg, 0, 0, 0, 0, img->width,
+              img->height);
+    XFreeGC(dpy, gc);
+    XDestroyImage(ximg);
+
+    if (kind == IMAGE_SOLID) {
+        pa.repeat = RepeatNormal;
+        mask |= CPRepeat;
+        pixman_image_set_repeat(img->ref, PIXMAN_REPEAT_NORMAL);
+    }
+
+    if (kind == IMAGE_ARGB_CA) {
+        pa.component_alpha = True;
+        mask |= CPComponentAlpha;
+        pixman_image_set_component_alpha(img->ref, 1);
+    }
+
+    img->picture = XRenderCreatePicture(dpy, img->pixmap, format, mask, &pa);
+
+    return true;
+}
+
+static void image_fini(struct image *img)
+{
+    if (img->kind == IMAGE_NONE)
+        return;
+
+    if (img->picture)
+        XRenderFreePicture(dpy, img->picture);
+
+    if (img->pixmap)
+        XFreePixmap(dpy, img->pixmap);
+
+    if (img->ref)
+        pixman_image_unref(img->ref);
+
+    free(img->bits);
+}
+
+static unsigned image_compare(struct image *dst)
+{
+    unsigned x, y, c, stride, diff, max_diff = 0;
+    uint32_t pixel, ref;
+    XImage *ximg;
+
+    ximg = XGetImage(dpy, dst->pixmap, 0, 0, dst->width, dst->height,
+                     AllPlanes, ZPixmap);
+    if (!ximg)
+        return ~0u;
+
+    stride = pixman_image_get_stride(dst->ref);
+
+    for (y = 0; y < dst->height; y++) {
+        for (x = 0; x < dst->width; x++) {
+            pixel = XGetPixel(ximg, x, y);
+
+            if (dst->depth == 8)
+                ref = ((uint8_t *) dst->bits)[y * stride + x];
+            else
+                ref = dst->bits[y * stride / 4 + x];
+
+            if (dst->depth == 24) {
+                pixel &= 0xffffff;
+                ref &= 0xffffff;
+            }
+
+            for (c = 0; c < 32; c += 8) {
+                diff = abs((int)((pixel >> c) & 0xff) -
+                           (int)((ref >> c) & 0xff));
+                if (diff > max_diff)
+                    max_diff = diff;
+            }
+        }
+    }
+
+    XDestroyImage(ximg);
+
+    return max_diff;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool check(int op, enum image_kind src_kind, enum image_kind mask_kind,
+                  enum image_kind dst_kind, bool bench)
+{
+    struct image src = { IMAGE_NONE };
+    struct image mask = { IMAGE_NONE };
+    struct image dst = { IMAGE_NONE };
+    unsigned w, h, x, y, sx, sy, mx, my, i, diff;
+    bool ok = true;
+    double t;
+
+    if (!image_init(&src, src_kind) || !image_init(&mask, mask_kind) ||
+        !image_init(&dst, dst_kind)) {
+        fprintf(stderr, "failed to create images\n");
+        ok = false;
+        goto cleanup;
+    }
+
+    w = 1 + random() % WIDTH;
+    h = 1 + random() % HEIGHT;
+    x = random() % (WIDTH - w + 1);
+    y = random() % (HEIGHT - h + 1);
+    sx = random() % (WIDTH - w + 1);
+    sy = random() % (HEIGHT - h + 1);
+    mx = random() % (WIDTH - w + 1);
+    my = random() % (HEIGHT - h + 1);
+
+    if (bench) {
+        XSync(dpy, False);
+        t = now();
+
+        for (i = 0; i < BENCH_REPS; i++)
+            XRenderComposite(dpy, op, src.picture, mask.picture, dst.picture,
+                             0, 0, 0, 0, 0, 0, WIDTH, HEIGHT);
+
+        XSync(dpy, False);
+        t = now() - t;
+
+        printf("%-11s src %-7s mask %-7s dst %-4s %10.0f Mpix/s\n",
+               op_names[op], kind_names[src_kind], kind_names[mask_kind],
+               kind_names[dst_kind],
+               (double) BENCH_REPS * WIDTH * HEIGHT / t / 1e6);
+        goto cleanup;
+    }
+
+    XRenderComposite(dpy, op, src.picture, mask.picture, dst.picture,
+                     sx, sy, mx, my, x, y, w, h);
+
+    pixman_image_composite32(op, src.ref, mask.ref, dst.ref,
+                             sx, sy, mx, my, x, y, w, h);
+
+    diff = image_compare(&dst);
+    ok = diff <= tolerance;
+
+    if (!ok)
+        printf("%-11s src %-7s mask %-7s dst %-4s FAILED, max error %u\n",
+               op_names[op], kind_names[src_kind], kind_names[mask_kind],
+               kind_names[dst_kind], diff);
+
+cleanup:
+    image_fini(&dst);
+    image_fini(&mask);
+    image_fini(&src);
+
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    static const enum image_kind src_kinds[] = {
+        IMAGE_ARGB, IMAGE_XRGB, IMAGE_A8, IMAGE_SOLID,
+        IMAGE_LINEAR, IMAGE_LINEAR_PAD, IMAGE_RADIAL, IMAGE_RADIAL_PAD,
+    };
+    static const enum image_kind mask_kinds[] = {
+        IMAGE_NONE, IMAGE_A8, IMAGE_ARGB_CA, IMAGE_SOLID,
+    };
+    static const enum image_kind dst_kinds[] = {
+        IMAGE_ARGB, IMAGE_XRGB, IMAGE_A8,
+    };
+    const char *display = NULL;
+    unsigned failed = 0, total = 0;
+    unsigned seed = 1;
+    bool bench = false;
+    int major, minor;
+    unsigned s, m, d;
+    int op, c;
+
+    while ((c = getopt(argc, argv, "d:s:t:b")) != -1) {
+        switch (c) {
+        case 'd':
+            display = optarg;
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            tolerance = strtoul(optarg, NULL, 0);
+            break;
+        case 'b':
+            bench = true;
+            break;
+        default:
+            fprintf(stderr,
+                    "usage: %s [-d display] [-s seed] [-t tolerance] [-b]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+
+    dpy = XOpenDisplay(display);
+    if (!dpy) {
+        fprintf(stderr, "can't open display %s\n", XDisplayName(display));
+        return 1;
+    }
+
+    if (!XRenderQueryVersion(dpy, &major, &minor)) {
+        fprintf(stderr, "Render extension isn't available\n");
+        return 1;
+    }
+
+    srandom(seed);
+
+    for (op = PictOpClear; op <= PictOpSaturate; op++) {
+        for (s = 0; s < sizeof(src_kinds) / sizeof(src_kinds[0]); s++) {
+            for (m = 0; m < sizeof(mask_kinds) / sizeof(mask_kinds[0]); m++) {
+                for (d = 0; d < sizeof(dst_kinds) / sizeof(dst_kinds[0]); d++) {
+                    if (!check(op, src_kinds[s], mask_kinds[m], dst_kinds[d],
+                               bench))
+                        failed++;
+                    total++;
+                }
+            }
+        }
+    }
+
+    XCloseDisplay(dpy);
+
+    if (!bench)
+        printf("%u of %u composites passed\n", total - failed, total);
+
+    return failed ? 1 : 0;
+}